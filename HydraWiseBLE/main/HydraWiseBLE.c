@@ -11,19 +11,123 @@
 #include "host/ble_hs.h"
 #include "services/gap/ble_svc_gap.h"
 #include "services/gatt/ble_svc_gatt.h"
+#include "store/config/ble_store_config.h"
 #include "esp_random.h"
 #include "sdkconfig.h"
+#include "scheduler.h"
+#include "batch.h"
+#include "adc_acq.h"
+#include "sample_ring.h"
+#include "notify_pool.h"
+#include "stream.h"
+#include "conn_params.h"
+#include "ctrl_proto.h"
+#include "hr_monitor.h"
+#include "hrm.h"
+#include "sample_store.h"
+#include "l2cap_bulk.h"
+#include "bench.h"
+#include "dlog.h"
+#include "diag.h"
+#include "power.h"
+#include "adv_payload.h"
+#include "adv_policy.h"
+#include "adv_bcast.h"
 
 // Define device
 char *TAG = "HydraWise-BLE-Server";
 #define CONFIG_IDF_TARGET_ESP32 1
 uint8_t ble_addr_type;
-static uint16_t conn_handle_global = 0; // Global connection handle to track the current connection
 static uint16_t hrm_handle = 0; // Handle for Heart Rate Measurement characteristic
 static uint16_t conductivity_handle = 0; // Handle for Conductivity characteristic
-uint8_t button_state = 0; // 0 = STOPPED, 1 = STARTED
+uint8_t button_state = 0; // 0 = STOPPED, 1 = STARTED (any channel enabled)
 static uint16_t button_char_handle = 0; // Handle for button characteristic
+static uint16_t battery_handle = 0; // Handle for Battery Level characteristic
+static uint16_t log_handle = 0; // Handle for the sample log (backfill) characteristic
+static uint8_t battery_level = 100; // Percent; no fuel gauge is wired up yet
+#define MANUFACTURER_NAME "HydraWise"
+#define MODEL_NUMBER "HydraWise-BLE"
+#define DEVICE_NAME "HydraWise-BLE-Server"
 void ble_app_advertise(void);
+static void adv_wake(adv_wake_t reason);
+static void adv_on_connect(uint16_t conn_handle);
+static adv_policy_t adv_policy; // host task only
+// Peer of the last disconnect, as seen on air; directed advertising and the accept list
+// bring it back first if it is bonded. Host task only.
+static ble_addr_t last_peer;
+static bool last_peer_bonded;
+// Broadcast mode (CTRL_OP_BROADCAST): live values in the advertising data for observers
+// that do not connect, refreshed by the scheduler task once per conductivity sample
+#define BROADCAST_PERIOD_MS (1000 / ADC_ACQ_OUTPUT_HZ)
+static volatile bool broadcast_on = false; // written by the host task
+static bcast_t bcast;                      // under bcast_lock
+static uint16_t bcast_cond[ADC_ACQ_BLOCK_LEN]; // last conductivity block, paced out by the refresh
+static uint16_t bcast_cond_n;                  // 0 until a block since START; reads get its last sample
+static uint32_t bcast_cond_ms;             // when it arrived
+static portMUX_TYPE bcast_lock = portMUX_INITIALIZER_UNLOCKED;
+static void broadcast_refresh(void *param);
+
+// Periods of the scheduler channels
+#define HR_NOTIFY_PERIOD_MS 1000
+#define BACKFILL_PERIOD_MS 50 // a reopened flow window also resumes backfill, this only bounds an idle link
+#define BENCH_PERIOD_MS 10    // likewise for a benchmark run
+#define CONDUCTIVITY_DRAIN_PERIOD_MS (ADC_ACQ_BLOCK_LEN * 1000 / ADC_ACQ_OUTPUT_HZ)
+// Longest from acquiring a sample to sending it. A block arrives with its first sample
+// already a drain period old, so a frame is due once holding it for the next drain would
+// pass the cap.
+#define BATCH_LATENCY_CAP_MS 1000
+_Static_assert(BATCH_LATENCY_CAP_MS > CONDUCTIVITY_DRAIN_PERIOD_MS, "an ADC block must arrive within the latency cap");
+// Channel ids: control protocol and batch frame header (heart rate uses 0x2A37 frames)
+#define BATCH_CHANNEL_HR 0
+#define BATCH_CHANNEL_CONDUCTIVITY 1
+#define BATCH_CHANNEL_RR 2 // RR intervals (ms), logged and backfilled only
+// Notify flow window per peer, see flow_ctl.h
+#define FLOW_WINDOW_MIN 1
+#define FLOW_WINDOW_INIT 2
+// Heart Rate Measurement frames: the last one is cached for reads, RR intervals wait for the next
+#define HRM_RR_PENDING 32
+static uint8_t hrm_frame[NOTIFY_POOL_MAX_PAYLOAD];
+static uint16_t hrm_frame_len = 0;
+static portMUX_TYPE hrm_lock = portMUX_INITIALIZER_UNLOCKED; // hrm_frame, read by the host task
+static uint16_t hrm_rr[HRM_RR_PENDING]; // owned by the scheduler task
+static uint8_t hrm_rr_count = 0;
+static uint8_t hrm_rr_max = 0;          // SET_BATCH cap on RR intervals per frame, 0 = fill the MTU
+static bool hrm_retry = false;          // last frame was held back by the flow window
+// Conductivity samples between the ADC task (producer) and the scheduler task (consumer)
+static stream_t conductivity_stream;
+// Samples read back from the flash log after a reconnect, every channel in one ring
+static stream_t log_stream;
+static bool backfilling = false;  // scheduler task only
+static uint32_t log_fed, log_acked; // samples moved into log_stream / acknowledged to the store
+static uint32_t log_held;           // samples in the SDU the bulk channel's stack still holds
+static bool log_bulk;               // this backfill went over the bulk channel
+static volatile bool backfill_requested = false; // BACKFILL command or a log subscription
+static volatile uint32_t backfill_since_ms = 0;
+static sched_t sched; // periodic notify channels, owned by scheduler_task
+static int hr_sched_id, conductivity_sched_id, backfill_sched_id, bench_sched_id, broadcast_sched_id;
+#define CHANNEL_BIT(ch) (1u << (ch))
+#define CHANNEL_ALL (CHANNEL_BIT(BATCH_CHANNEL_HR) | CHANNEL_BIT(BATCH_CHANNEL_CONDUCTIVITY))
+#define HR_NOTIFY_PERIOD_MIN_MS 250
+// Channels started by the client. Written by the host task, read by the scheduler task.
+static volatile uint8_t channel_mask = 0;
+// Rate and batch changes from the control protocol, applied by the scheduler task
+typedef struct {
+    bool dirty;
+    uint16_t hr_period_ms;       // 0 = unchanged
+    bool batch_set[2];
+    uint8_t batch_samples[2];    // per BATCH_CHANNEL_*
+    bool codec_set;
+    uint8_t codec_channel;       // BATCH_CHANNEL_CONDUCTIVITY or CTRL_ALL_CHANNELS
+    uint8_t codec;
+    bool bench;
+    uint8_t bench_transport;
+    uint16_t bench_seconds;
+} ctrl_pending_t;
+static ctrl_pending_t ctrl_pending;
+static portMUX_TYPE ctrl_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t sched_task_handle = NULL;
+static void sched_kick(void);
+static void button_update(void);
 
 /*
 -------------------------------------------
@@ -37,98 +141,267 @@ ESP 32 FUNCTIONALITIES
    - Conductivity Service
    - Battery Level Service
    - Device Information Service
+   - Sample Log Service, Diagnostics Service (custom UUIDs)
 3. Characteristics:
-    - Heart Rate Measurement (Notify)
+    - Heart Rate Measurement (Notify), standard 0x2A37 frames with RR intervals
     - Conductivity Measurement (Notify)
     - Battery Level (Notify)
     - Device Name (Read/Write)
     - Device Information (Read/Write)
-    - Custom Commands (e.g., "LIGHT ON", "LIGHT OFF")
+    - Custom Commands (binary TLV control protocol, see ctrl_proto.h)
+    - Diagnostics (Read), latency histograms and notify failure counters, see diag.h
 4. Access Control:
     - Heart Rate Measurement: Read and Notify
-    - Conductivity Measurement: Read and Notify
+    - Conductivity Measurement: Read and Notify; a read gets the last decimated sample,
+      uint16 mean raw counts little endian, or an empty value while the channel is stopped
     - Battery Level: Read and Notify
     - Device Name: Read and Write
     - Device Information: Read and Write
     - Custom Commands: Write only (to control external devices)
 5. Connection Handling:
     - Handle connection and disconnection events
-    - Retry advertising on disconnection
-    - Store connection handle for further communication
+    - Up to CONFIG_BT_NIMBLE_MAX_CONNECTIONS peers; keep advertising while a slot is free
+    - A bonded peer that drops gets directed advertising, then advertising only bonded peers
+      can connect to, before the slot is open to anyone (adv_policy.h); reconnect gaps are
+      kept in the diagnostics
+    - Every connection asks for encryption: a new phone pairs (Just Works) and bonds once, a
+      bonded one encrypts with its stored keys and gets its subscriptions back from NVS
+      (CONFIG_BT_NIMBLE_NVS_PERSIST), so notifications resume without rediscovery
+    - Broadcast mode puts live heart rate, conductivity and battery values in the advertising
+      data (see adv_bcast.h), so observers read many units without connecting; advertising
+      then goes on, non-connectable, with every slot taken
+    - Track each peer's notification subscriptions and fan notifications out to subscribers
+    - Samples nobody is subscribed to (e.g. while disconnected) are logged to flash and backfilled
+      on the sample log characteristic after a reconnect, or over the L2CAP bulk channel
+      (PSM 0x0081, see l2cap_bulk.h) when the client opens one
 6. Button State:
-    - Button state is used to control the device's operation (START/STOP)
-    - The button state is used to control the data collection process
+    - START/STOP enable channels individually; the button state reports whether any channel runs
+    - A peer that subscribes, or whose subscription the bond store restores, gets the state at once
+    - The command characteristic also sets the heart rate period, the samples per frame
+      and whether batched frames are delta coded (sample_codec.h)
 7. FreeRTOS:
     - Use FreeRTOS for task management
-    - Create tasks for heart rate and conductivity notifications
+    - One scheduler task samples heart rate and conductivity and sends batched notifications
+    - Heart rate comes from the PPG input (GPIO35), filtered and beat-detected on core 1
 ---------------------------------------------
 */
-// Write data to ESP32 defined as server
-static int device_write(uint16_t conn_handle, uint16_t attr_handle,
-    struct ble_gatt_access_ctxt *ctxt, void *arg) {
-    printf("Received WRITE (handle: %d, conn: %d)\n", attr_handle, conn_handle);
-
-    // Print data as a raw string (if safe)
-    char buf[ctxt->om->om_len + 1]; // +1 for null-termination
-    memcpy(buf, ctxt->om->om_data, ctxt->om->om_len);
-    buf[ctxt->om->om_len] = '\0'; // ensure it's null-terminated
-
-    printf("Data from the client: %s\n", buf);
-
-    // You can add parsing logic here
-    if (strcmp(buf, "START") == 0) {
-        button_state = 1;
-        printf("Starting...\n");
-        ESP_LOGI(TAG, "START command received. Notifying button state");
-    } else if (strcmp(buf, "STOP") == 0) {
-        button_state = 0;
-        printf("Stopping...\n");
-        ESP_LOGI(TAG, "STOP command received. Notifying button state.");
-    }
-    
-    // notify client about button state change
-    if (conn_handle_global != 0 && button_char_handle != 0) {
-        struct os_mbuf *om = ble_hs_mbuf_from_flat(&button_state, sizeof(button_state));
-        int rc = ble_gattc_notify_custom(conn_handle_global, button_char_handle, om);
-        if (rc != 0) {
-            ESP_LOGE(TAG, "Failed to send button state notification: %d", rc);
-        } else {
-            ESP_LOGI(TAG, "Button state notification sent: %d", button_state);
-        }
+// Apply one control record. Runs in the host task: channel starts and stops take
+// effect directly, everything owned by the scheduler task is handed over.
+static void control_command(const ctrl_cmd_t *cmd, void *arg) {
+    switch (cmd->op) {
+        case CTRL_OP_START:
+            channel_mask |= cmd->channels & CHANNEL_ALL;
+            DLOG(DLOG_START, channel_mask);
+            break;
+        case CTRL_OP_STOP:
+            channel_mask &= ~cmd->channels;
+            DLOG(DLOG_STOP, channel_mask);
+            break;
+        case CTRL_OP_SET_RATE:
+            if (cmd->channel != BATCH_CHANNEL_HR) {
+                // conductivity is paced by the ADC decimator, see adc_acq.h
+                DLOG(DLOG_RATE_FIXED, cmd->channel);
+                break;
+            }
+            taskENTER_CRITICAL(&ctrl_lock);
+            ctrl_pending.hr_period_ms = cmd->period_ms < HR_NOTIFY_PERIOD_MIN_MS ? HR_NOTIFY_PERIOD_MIN_MS : cmd->period_ms;
+            ctrl_pending.dirty = true;
+            taskEXIT_CRITICAL(&ctrl_lock);
+            break;
+        case CTRL_OP_SET_BATCH:
+            if (cmd->channel > BATCH_CHANNEL_CONDUCTIVITY) {
+                DLOG(DLOG_NO_CHANNEL, cmd->channel);
+                break;
+            }
+            taskENTER_CRITICAL(&ctrl_lock);
+            ctrl_pending.batch_set[cmd->channel] = true;
+            ctrl_pending.batch_samples[cmd->channel] = cmd->batch_samples;
+            ctrl_pending.dirty = true;
+            taskEXIT_CRITICAL(&ctrl_lock);
+            break;
+        case CTRL_OP_BACKFILL:
+            DLOG(DLOG_BACKFILL_REQUEST, cmd->since_ms);
+            backfill_since_ms = cmd->since_ms;
+            backfill_requested = true;
+            break;
+        case CTRL_OP_SET_CODEC:
+            if ((cmd->channel != BATCH_CHANNEL_CONDUCTIVITY && cmd->channel != CTRL_ALL_CHANNELS) ||
+                cmd->codec > BATCH_CODEC_DELTA) {
+                // heart rate goes out as standard 0x2A37 frames
+                DLOG(DLOG_NO_CODEC, cmd->codec, cmd->channel);
+                break;
+            }
+            taskENTER_CRITICAL(&ctrl_lock);
+            ctrl_pending.codec_set = true;
+            ctrl_pending.codec_channel = cmd->channel;
+            ctrl_pending.codec = cmd->codec;
+            ctrl_pending.dirty = true;
+            taskEXIT_CRITICAL(&ctrl_lock);
+            break;
+        case CTRL_OP_BENCH:
+            taskENTER_CRITICAL(&ctrl_lock);
+            ctrl_pending.bench = true;
+            ctrl_pending.bench_transport = cmd->transport;
+            ctrl_pending.bench_seconds = cmd->seconds;
+            ctrl_pending.dirty = true;
+            taskEXIT_CRITICAL(&ctrl_lock);
+            break;
+        case CTRL_OP_BROADCAST:
+            DLOG(DLOG_BROADCAST, cmd->broadcast);
+            if (broadcast_on != cmd->broadcast) {
+                broadcast_on = cmd->broadcast;
+                ble_app_advertise(); // payload, interval and connectability all change
+            }
+            break;
     }
-    return 0;
 }
 
-// extravagant read data from ESP32 defined as a server
-static int device_read(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg) {
-    if (attr_handle == hrm_handle) {
-        ESP_LOGI(TAG, "💓 Client is reading Heart Rate characteristic");
-        float dummy_hr = 75.0f;
-        os_mbuf_append(ctxt->om, &dummy_hr, sizeof(dummy_hr));
-    }
-    else if (attr_handle == conductivity_handle) {
-        ESP_LOGI(TAG, "💧 Client is reading Conductivity characteristic");
-        float dummy_conductivity = 1.23f;
-        os_mbuf_append(ctxt->om, &dummy_conductivity, sizeof(dummy_conductivity));
+// Segment walk over the written os_mbuf chain for ctrl_parse
+typedef struct {
+    const struct os_mbuf *head;
+    const struct os_mbuf *cur;
+} mbuf_src_t;
+
+static bool mbuf_next_seg(void *ctx, const uint8_t **data, uint16_t *len) {
+    mbuf_src_t *m = ctx;
+    if (m->cur == NULL) {
+        return false;
     }
-    else if (attr_handle == button_char_handle) {
-        ESP_LOGI(TAG, "📥 Client is reading Button state characteristic");
-        os_mbuf_append(ctxt->om, &button_state, sizeof(button_state));
+    *data = m->cur->om_data;
+    *len = m->cur->om_len;
+    m->cur = SLIST_NEXT(m->cur, om_next);
+    return true;
+}
+
+static void mbuf_rewind(void *ctx) {
+    mbuf_src_t *m = ctx;
+    m->cur = m->head;
+}
+
+// Parse and apply control records from an os_mbuf chain, in place
+static ctrl_status_t control_parse_mbuf(const struct os_mbuf *om, ctrl_result_t *result) {
+    mbuf_src_t chain = { .head = om };
+    ctrl_src_t src = { .next = mbuf_next_seg, .rewind = mbuf_rewind, .ctx = &chain };
+    return ctrl_parse(&src, control_command, NULL, result);
+}
+
+// Write data to ESP32 defined as server (command characteristic), see ctrl_proto.h
+static int device_write(uint16_t conn_handle, struct ble_gatt_access_ctxt *ctxt) {
+    ctrl_result_t result;
+
+    ctrl_status_t status = control_parse_mbuf(ctxt->om, &result);
+    if (status != CTRL_OK) {
+        DLOG(DLOG_CMD_REJECTED, conn_handle, status);
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
     }
-    else {
-        ESP_LOGW(TAG, "⚠️ Unknown characteristic read (handle: %d)", attr_handle);
-        os_mbuf_append(ctxt->om, "Unknown", 7);
+    DLOG(DLOG_CMD_APPLIED, conn_handle, result.commands, result.unknown);
+    sched_kick();
+    button_update();
+    return 0;
+}
+
+// Notify subscribed clients when START/STOP changed whether any channel runs
+static void button_update(void) {
+    uint8_t state = channel_mask != 0;
+    if (state != button_state) {
+        button_state = state;
+        // notify subscribed clients about button state change
+        if (button_char_handle != 0) {
+            stream_notify_value(CHR_BUTTON, button_char_handle, &button_state, sizeof(button_state));
+            DLOG(DLOG_BUTTON_SENT, button_state);
+        }
     }
+}
 
-    return 0;
+// Read handlers, one per characteristic, reached through gatt_chr_t
+static int append_value(struct os_mbuf *om, const void *data, uint16_t len) {
+    return os_mbuf_append(om, data, len) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+static int hr_read(struct os_mbuf *om) {
+    DLOG(DLOG_HR_READ);
+    uint8_t frame[sizeof(hrm_frame)];
+    taskENTER_CRITICAL(&hrm_lock);
+    uint16_t len = hrm_frame_len;
+    memcpy(frame, hrm_frame, len); // the last encoded measurement, never re-encoded
+    taskEXIT_CRITICAL(&hrm_lock);
+    return append_value(om, frame, len);
+}
+
+static int conductivity_read(struct os_mbuf *om) {
+    DLOG(DLOG_CONDUCTIVITY_READ);
+    uint8_t value[2];
+    taskENTER_CRITICAL(&bcast_lock);
+    uint16_t n = bcast_cond_n;
+    uint16_t last = n > 0 ? bcast_cond[n - 1] : 0;
+    taskEXIT_CRITICAL(&bcast_lock);
+    value[0] = last & 0xff;
+    value[1] = last >> 8;
+    return append_value(om, value, n > 0 ? sizeof(value) : 0); // nothing measured since START
+}
+
+static int battery_read(struct os_mbuf *om) {
+    DLOG(DLOG_BATTERY_READ);
+    return append_value(om, &battery_level, sizeof(battery_level));
+}
+
+static int button_read(struct os_mbuf *om) {
+    DLOG(DLOG_BUTTON_READ);
+    return append_value(om, &button_state, sizeof(button_state));
+}
+
+static int manufacturer_read(struct os_mbuf *om) {
+    return append_value(om, MANUFACTURER_NAME, sizeof(MANUFACTURER_NAME) - 1);
+}
+
+static int model_read(struct os_mbuf *om) {
+    return append_value(om, MODEL_NUMBER, sizeof(MODEL_NUMBER) - 1);
+}
+
+static int diag_read(struct os_mbuf *om) {
+    static uint8_t value[DIAG_VALUE_LEN]; // host task only
+    return append_value(om, value, diag_serialize(value));
+}
+
+// Per-characteristic access context, registered as the chr_def arg so every access
+// goes straight to its own handler instead of comparing attribute handles
+typedef struct {
+    int (*read)(struct os_mbuf *om);
+    int (*write)(uint16_t conn_handle, struct ble_gatt_access_ctxt *ctxt);
+} gatt_chr_t;
+
+static const gatt_chr_t hr_chr_ctx = { .read = hr_read };
+static const gatt_chr_t conductivity_chr_ctx = { .read = conductivity_read };
+static const gatt_chr_t battery_chr_ctx = { .read = battery_read };
+static const gatt_chr_t button_chr_ctx = { .read = button_read };
+static const gatt_chr_t manufacturer_chr_ctx = { .read = manufacturer_read };
+static const gatt_chr_t model_chr_ctx = { .read = model_read };
+static const gatt_chr_t command_chr_ctx = { .write = device_write };
+static const gatt_chr_t log_chr_ctx = { 0 }; // notify only
+static const gatt_chr_t diag_chr_ctx = { .read = diag_read };
+
+// Single access callback for every characteristic
+static int gatt_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    const gatt_chr_t *chr = arg;
+    switch (ctxt->op) {
+        case BLE_GATT_ACCESS_OP_READ_CHR:
+            return chr->read ? chr->read(ctxt->om) : BLE_ATT_ERR_READ_NOT_PERMITTED;
+        case BLE_GATT_ACCESS_OP_WRITE_CHR:
+            return chr->write ? chr->write(conn_handle, ctxt) : BLE_ATT_ERR_WRITE_NOT_PERMITTED;
+        default:
+            DLOG(DLOG_ACCESS_OP, ctxt->op, attr_handle);
+            return BLE_ATT_ERR_UNLIKELY;
+    }
 }
 
 // heart rate characteristic
 static const struct ble_gatt_chr_def heart_rate_chr[] = {
     {
         .uuid = BLE_UUID16_DECLARE(0x2A37), // HEART RATE MEASUREMENT
-        .access_cb = device_read,
+        .access_cb = gatt_access,
+        .arg = (void *)&hr_chr_ctx,
         .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+        .val_handle = &hrm_handle, // filled in at registration
     },
     {
         0, // NULL TERMINATOR
@@ -142,11 +415,13 @@ static const ble_uuid128_t conductivity_uuid =
                      0x90, 0xc7, 0x54, 0xc0,
                      0xc8, 0xc6, 0xae, 0x84);
 
-static struct ble_gatt_chr_def conductivity_chr[] = {
+static const struct ble_gatt_chr_def conductivity_chr[] = {
     {
         .uuid = (const ble_uuid_t *)&conductivity_uuid,  // Cast to correct type
-        .access_cb = device_read,
+        .access_cb = gatt_access,
+        .arg = (void *)&conductivity_chr_ctx,
         .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+        .val_handle = &conductivity_handle,
     },
     {
         0
@@ -157,8 +432,10 @@ static struct ble_gatt_chr_def conductivity_chr[] = {
 static const struct ble_gatt_chr_def battery_level_chr[] = {
     {
         .uuid = BLE_UUID16_DECLARE(0x2A19), // BATTERY LEVEL
-        .access_cb = device_read,
+        .access_cb = gatt_access,
+        .arg = (void *)&battery_chr_ctx,
         .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+        .val_handle = &battery_handle,
     },
     {
         0, // NULL TERMINATOR
@@ -176,59 +453,466 @@ static const ble_uuid128_t button_char_uuid =
 static const struct ble_gatt_chr_def button_chr[] = {
     {
         .uuid = (const ble_uuid_t *)&button_char_uuid,  // Cast to correct type
-        .access_cb = device_read,
+        .access_cb = gatt_access,
+        .arg = (void *)&button_chr_ctx,
         .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+        .val_handle = &button_char_handle,
     },
     {
         0, // NULL TERMINATOR
     }
 };
 
-// heart rate notification task with FreeRTOS
-void notify_heart_rate_task(void *param) {
-    while(1) {
-        if (conn_handle_global != 0 && button_state) // Check if connected and running
-        {
-            uint8_t hr_data[2] = { 0x00, 75 }; // Heart rate measurement (75 bpm)   
-
-            struct os_mbuf *om = ble_hs_mbuf_from_flat(hr_data, sizeof(hr_data)); // Allocate a packet header
-            int rc = ble_gattc_notify_custom(conn_handle_global, // Connection handle
-                hrm_handle, // Heart Rate Measurement UUID
-                om); // The data to send
-            if (rc != 0) {
-                printf("failed to send heart rate notification: %d\n", rc);
-                ESP_LOGE(TAG, "Failed to send heart rate notification: %d", rc);
-            } else {
-                printf("heart rate notification sent: %d bpm\n", hr_data[1]);
-                ESP_LOGI(TAG, "Heart rate notification sent: %d bpm", hr_data[1]);
-            }
-            // vTaskDelay(pdMS_TO_TICKS(3000)); // Notify every 3 seconds
+// sample log characteristic: batch frames of logged samples, one channel per frame
+static const ble_uuid128_t log_svc_uuid =
+    BLE_UUID128_INIT(0xaa, 0x5b, 0x97, 0x50,
+                     0xc9, 0x82, 0x4c, 0xe6,
+                     0x90, 0xc7, 0x54, 0xc0,
+                     0x00, 0x10, 0xae, 0x84);
+static const ble_uuid128_t log_chr_uuid =
+    BLE_UUID128_INIT(0xaa, 0x5b, 0x97, 0x50,
+                     0xc9, 0x82, 0x4c, 0xe6,
+                     0x90, 0xc7, 0x54, 0xc0,
+                     0x01, 0x10, 0xae, 0x84);
+
+static const struct ble_gatt_chr_def log_chr[] = {
+    {
+        .uuid = (const ble_uuid_t *)&log_chr_uuid,
+        .access_cb = gatt_access,
+        .arg = (void *)&log_chr_ctx,
+        .flags = BLE_GATT_CHR_F_NOTIFY,
+        .val_handle = &log_handle,
+    },
+    {
+        0, // NULL TERMINATOR
+    }
+};
+
+// diagnostics characteristic: latency histograms and failure counters, layout in diag.h
+static const ble_uuid128_t diag_svc_uuid =
+    BLE_UUID128_INIT(0xaa, 0x5b, 0x97, 0x50,
+                     0xc9, 0x82, 0x4c, 0xe6,
+                     0x90, 0xc7, 0x54, 0xc0,
+                     0x00, 0x20, 0xae, 0x84);
+static const ble_uuid128_t diag_chr_uuid =
+    BLE_UUID128_INIT(0xaa, 0x5b, 0x97, 0x50,
+                     0xc9, 0x82, 0x4c, 0xe6,
+                     0x90, 0xc7, 0x54, 0xc0,
+                     0x01, 0x20, 0xae, 0x84);
+
+static const struct ble_gatt_chr_def diag_chr[] = {
+    {
+        .uuid = (const ble_uuid_t *)&diag_chr_uuid,
+        .access_cb = gatt_access,
+        .arg = (void *)&diag_chr_ctx,
+        .flags = BLE_GATT_CHR_F_READ, // longer than an ATT MTU: clients use a long read
+    },
+    {
+        0, // NULL TERMINATOR
+    }
+};
+
+static uint32_t now_ms(void) {
+    return pdTICKS_TO_MS(xTaskGetTickCount());
+}
+
+// A channel samples from START to STOP; while nobody subscribed to it its samples go to the flash log
+static uint8_t active_channels(void) {
+    return channel_mask;
+}
+
+static bool channel_active(uint8_t channel) {
+    return active_channels() & CHANNEL_BIT(channel);
+}
+
+// Encode the current measurement with as many pending RR intervals as fit in payload
+// and cache it for reads
+static uint16_t hrm_update(uint16_t payload, uint8_t *rr_used) {
+    uint16_t bpm = hr_monitor_bpm();
+    hrm_meas_t m = {
+        .bpm = bpm,
+        .contact_supported = true,
+        .contact = bpm != 0, // the PPG pipeline only reports a rate while it sees beats
+        .rr_ms = hrm_rr,
+        .rr_count = hrm_rr_max != 0 && hrm_rr_count > hrm_rr_max ? hrm_rr_max : hrm_rr_count,
+    };
+    uint8_t frame[sizeof(hrm_frame)];
+    uint16_t len = hrm_encode(&m, frame, payload, rr_used);
+    taskENTER_CRITICAL(&hrm_lock);
+    memcpy(hrm_frame, frame, len);
+    hrm_frame_len = len;
+    taskEXIT_CRITICAL(&hrm_lock);
+    return len;
+}
+
+// Drop the first n pending RR intervals
+static void hrm_rr_consume(uint8_t n) {
+    memmove(hrm_rr, hrm_rr + n, (hrm_rr_count - n) * sizeof(hrm_rr[0]));
+    hrm_rr_count -= n;
+}
+
+// heart rate channel, run by the scheduler task: one 0x2A37 notification per period
+static void notify_heart_rate(void *param) {
+    if (!channel_active(BATCH_CHANNEL_HR)) // STOP may have arrived since the deadline was armed
+    {
+        return;
+    }
+    // collect new RR intervals; if the link cannot keep up, the oldest go first
+    uint16_t rr[HR_MONITOR_RR_MAX];
+    uint8_t n = hr_monitor_take_rr(rr, HR_MONITOR_RR_MAX);
+    if (hrm_rr_count + n > HRM_RR_PENDING) {
+        hrm_rr_consume(hrm_rr_count + n - HRM_RR_PENDING);
+    }
+    memcpy(hrm_rr + hrm_rr_count, rr, n * sizeof(rr[0]));
+    hrm_rr_count += n;
+
+    uint16_t payload = peers_payload(CHR_HR);
+    uint8_t used;
+    if (payload == 0) {
+        // nobody connected or subscribed: keep the cache fresh for reads and log
+        // the rate and every RR interval for backfill
+        hrm_update(NOTIFY_POOL_MAX_PAYLOAD, NULL);
+        uint32_t ts = now_ms();
+        uint16_t bpm = hr_monitor_bpm();
+        if (bpm != 0) {
+            store_append(&(sample_t){ .ts_ms = ts, .value = bpm, .channel = BATCH_CHANNEL_HR });
+        }
+        for (uint8_t i = 0; i < hrm_rr_count; i++) {
+            store_append(&(sample_t){ .ts_ms = ts, .value = hrm_rr[i], .channel = BATCH_CHANNEL_RR });
+        }
+        hrm_rr_consume(hrm_rr_count);
+        return;
+    }
+    uint16_t len = hrm_update(payload, &used);
+    hrm_retry = !stream_notify_frame(CHR_HR, hrm_handle, hrm_frame, len);
+    if (!hrm_retry) {
+        hrm_rr_consume(used); // the rest go out with the next frame
+    }
+}
+
+// Called from the ADC acquisition task for every decimated block
+static void adc_block_ready(const adc_acq_block_t *block, void *arg) {
+    if (block->source == ADC_ACQ_SRC_PPG) {
+        hr_monitor_feed(block);
+        return;
+    }
+    if (!channel_active(BATCH_CHANNEL_CONDUCTIVITY)) {
+        return; // the ADC also runs for heart rate alone
+    }
+    for (int i = 0; i < block->n; i++) {
+        sample_t sample = {
+            .ts_ms = block->ts_ms + i * 1000 / ADC_ACQ_OUTPUT_HZ,
+            .acq_us = block->end_us - (block->n - 1 - i) * ADC_ACQ_OUTPUT_US,
+            .value = block->samples[i], // Mean raw ADC counts
+            .channel = BATCH_CHANNEL_CONDUCTIVITY,
+        };
+        ring_push(&conductivity_stream.ring, &sample); // a full ring is counted in ring.overflow
+    }
+    // kept for reads as well as for broadcast mode
+    taskENTER_CRITICAL(&bcast_lock);
+    memcpy(bcast_cond, block->samples, block->n * sizeof(bcast_cond[0]));
+    bcast_cond_n = block->n;
+    bcast_cond_ms = now_ms();
+    taskEXIT_CRITICAL(&bcast_lock);
+    sched_kick(); // a due frame goes out now, not at the drain's phase
+}
+
+// Move everything a stream holds into the flash log
+static void stream_to_store(stream_t *st) {
+    sample_t sample;
+    while (ring_pop(&st->ring, &sample)) {
+        store_append(&sample);
+    }
+}
+
+// conductivity drain channel, run by the scheduler task once per ADC block
+static void drain_conductivity(void *param) {
+    if (!channel_active(BATCH_CHANNEL_CONDUCTIVITY)) // STOP may have arrived since the deadline was armed
+    {
+        return;
+    }
+    if (peers_payload(CHR_CONDUCTIVITY) == 0) {
+        stream_to_store(&conductivity_stream); // nobody to send to, keep it for backfill
+        return;
+    }
+    stream_drain(&conductivity_stream, false);
+}
+
+// Ends a backfill; an aborted one resends its unacknowledged samples next time
+static void backfill_end(bool aborted) {
+    stream_discard(&log_stream);
+    if (aborted) {
+        store_backfill_abort();
+    }
+    backfilling = false;
+    log_bulk = false;
+    log_held = 0;
+    ESP_LOGI(TAG, "Backfill %s after %lu samples", aborted ? "interrupted" : "complete", (unsigned long)log_acked);
+    stream_log_stats(&log_stream);
+    store_log_stats();
+    sched_kick(); // drop the backfill connection profile
+}
+
+// A backfill goes over the L2CAP bulk channel when one is open, else as notifications
+static bool log_listener(void) {
+    return l2cap_bulk_connected() || peers_payload(CHR_LOG) > 0;
+}
+
+// Send the log stream as batch frames over the L2CAP bulk channel, as long as the
+// peer has credits. Frames are sized to its SDU (l2cap_bulk_mtu()) rather than the ATT MTU.
+static void log_drain_bulk(void) {
+    static uint8_t frame[BATCH_MAX_FRAME];
+    batch_set_max_payload(&log_stream.batch, l2cap_bulk_mtu());
+    while (ring_count(&log_stream.ring) > 0) {
+        if (!l2cap_bulk_ready()) {
+            log_stream.backpressure++;
+            return; // TX_UNSTALLED resumes it
+        }
+        uint8_t count = batch_frame_samples(&log_stream.batch, &log_stream.ring);
+        uint16_t len = batch_encode(&log_stream.batch, &log_stream.ring, &count, frame);
+        if (l2cap_bulk_send(frame, len) != 0) {
+            log_stream.backpressure++;
+            return; // no mbuf, retry on the next tick
+        }
+        stream_frame_sent(&log_stream, count, len);
+        if (l2cap_bulk_stalled()) {
+            log_held = count; // out of credits: not sent until TX_UNSTALLED
         }
-        vTaskDelay(pdMS_TO_TICKS(3000));
     }
 }
 
-// conductivity notification task with FreeRTOS
-void notify_conductivity_task(void *param) {
+// backfill channel, run by the scheduler task while the log is being sent back.
+// Over GATT it shares each peer's flow window with the live channels, so both
+// interleave; over L2CAP the peer's credits pace it. Either way the store is
+// only read as fast as the ring empties, and a record is only acknowledged to
+// the store once its last sample left the host.
+static void backfill_run(void *param) {
+    if (!backfilling) {
+        return;
+    }
+    if (!log_listener()) {
+        backfill_end(true); // nobody listens any more, keep the rest on flash
+        return;
+    }
+    if (log_bulk && !l2cap_bulk_connected()) {
+        // the held SDU went down with the channel: resend from the last
+        // acknowledged record, over GATT if the peer still subscribes
+        backfill_end(true);
+        backfill_requested = true;
+        return;
+    }
+    log_fed += store_backfill_fill(&log_stream.ring);
+    if (l2cap_bulk_connected()) {
+        log_bulk = true;
+        if (!l2cap_bulk_stalled()) {
+            log_held = 0; // TX_UNSTALLED: the held SDU went out
+        }
+        log_drain_bulk();
+    } else {
+        stream_drain(&log_stream, true);
+    }
+    uint32_t delivered = log_fed - ring_count(&log_stream.ring) - log_held;
+    store_backfill_ack(delivered - log_acked);
+    log_acked = delivered;
+    if (ring_count(&log_stream.ring) == 0 && log_held == 0 && store_backfill_done()) {
+        backfill_end(false);
+    }
+}
+
+// Take over rate and batch changes posted by the control protocol
+static void apply_ctrl_pending(void) {
+    ctrl_pending_t p;
+    taskENTER_CRITICAL(&ctrl_lock);
+    p = ctrl_pending;
+    memset(&ctrl_pending, 0, sizeof(ctrl_pending));
+    taskEXIT_CRITICAL(&ctrl_lock);
+    if (!p.dirty) {
+        return;
+    }
+    if (p.hr_period_ms != 0) {
+        sched_set_period(&sched, hr_sched_id, pdMS_TO_TICKS(p.hr_period_ms));
+        ESP_LOGI(TAG, "Heart rate period %u ms", p.hr_period_ms);
+    }
+    if (p.batch_set[BATCH_CHANNEL_HR]) {
+        hrm_rr_max = p.batch_samples[BATCH_CHANNEL_HR];
+        ESP_LOGI(TAG, "heart rate: at most %u RR intervals per frame (0 = fill the MTU)", hrm_rr_max);
+    }
+    if (p.batch_set[BATCH_CHANNEL_CONDUCTIVITY]) {
+        batch_set_max_samples(&conductivity_stream.batch, p.batch_samples[BATCH_CHANNEL_CONDUCTIVITY]);
+        ESP_LOGI(TAG, "%s: at most %u samples per frame", conductivity_stream.name, batch_capacity(&conductivity_stream.batch));
+    }
+    if (p.codec_set) {
+        batch_set_codec(&conductivity_stream.batch, p.codec);
+        if (p.codec_channel == CTRL_ALL_CHANNELS) {
+            batch_set_codec(&log_stream.batch, p.codec);
+        }
+        ESP_LOGI(TAG, "%s frames for channel 0x%02x", p.codec == BATCH_CODEC_DELTA ? "Delta coded" : "Raw", p.codec_channel);
+    }
+    if (p.bench) {
+        if (backfilling || !bench_start(p.bench_transport, p.bench_seconds, CHR_LOG, log_handle)) {
+            ESP_LOGW(TAG, "⚠️ Benchmark not started");
+        }
+    }
+}
+
+// STOP sends what is buffered; what a full flow window held back, or everything
+// while nobody listens, goes to the log for backfill
+static void stream_stop(stream_t *st) {
+    if (peers_payload(st->chr) > 0) {
+        stream_drain(st, true);
+    }
+    stream_to_store(st);
+    stream_log_stats(st);
+}
+
+// Start a requested backfill, or drop one nobody can receive
+static void backfill_update(void) {
+    if (backfill_requested && !backfilling && !bench_running() && log_listener()) {
+        backfill_requested = false;
+        store_flush(); // include what is still in RAM
+        store_backfill_start(backfill_since_ms);
+        log_fed = log_acked = 0;
+        backfilling = true;
+        ESP_LOGI(TAG, "Backfill started");
+    }
+    if (backfill_requested && peers_count() == 0) {
+        backfill_requested = false;
+    }
+    if (backfilling && !log_listener()) {
+        backfill_end(true);
+    }
+}
+
+// Re-evaluate which channels should be armed. Called from the scheduler task only,
+// so the channel table never needs a lock.
+static void sched_update_armed(void) {
+    static uint8_t was_active = 0;
+    static conn_profile_t profile = CONN_PROFILE_IDLE;
+    apply_ctrl_pending();
+    backfill_update();
+    uint8_t active = active_channels();
+    uint8_t stopped = was_active & ~active;
+    if (stopped & CHANNEL_BIT(BATCH_CHANNEL_HR)) {
+        hrm_rr_consume(hrm_rr_count);
+        hrm_retry = false;
+    }
+    if (stopped & CHANNEL_BIT(BATCH_CHANNEL_CONDUCTIVITY)) {
+        stream_stop(&conductivity_stream);
+        taskENTER_CRITICAL(&bcast_lock);
+        bcast_cond_n = 0; // no stale block after the next START
+        taskEXIT_CRITICAL(&bcast_lock);
+    }
+    if (was_active && !active) {
+        adc_acq_stop();
+        hr_monitor_reset();
+    }
+    if (stopped && !active) {
+        store_log_stats();
+        dlog_log_stats();
+        diag_log_stats();
+        power_log_period("session");
+        notify_pool_stats_t pool;
+        notify_pool_stats(&pool);
+        ESP_LOGI(TAG, "Notify pool: %u/%u free, min free %u, alloc failures %lu",
+            pool.free, pool.blocks, pool.min_free, (unsigned long)pool.alloc_fail);
+    }
+    if (active && !was_active) {
+        power_log_period("idle"); // since the last STOP, or boot
+        adc_acq_start(); // the ADC (PPG and conductivity) only runs between START and STOP
+    }
+    conn_profile_t want = backfilling || bench_running() ? CONN_PROFILE_BACKFILL :
+        active && peers_count() > 0 ? CONN_PROFILE_STREAMING : CONN_PROFILE_IDLE;
+    if (want != profile) {
+        conn_params_set_profile(want);
+        profile = want;
+    }
+    was_active = active;
+    TickType_t now = xTaskGetTickCount();
+    const struct { int id; uint8_t channel; } channels[] = {
+        { hr_sched_id, BATCH_CHANNEL_HR },
+        { conductivity_sched_id, BATCH_CHANNEL_CONDUCTIVITY },
+    };
+    for (int i = 0; i < 2; i++) {
+        if (active & CHANNEL_BIT(channels[i].channel)) {
+            sched_arm(&sched, channels[i].id, now);
+        } else {
+            sched_disarm(&sched, channels[i].id);
+        }
+    }
+    if (backfilling) {
+        sched_arm(&sched, backfill_sched_id, now);
+    } else {
+        sched_disarm(&sched, backfill_sched_id);
+    }
+    if (bench_running()) {
+        sched_arm(&sched, bench_sched_id, now);
+    } else {
+        sched_disarm(&sched, bench_sched_id);
+    }
+    if (broadcast_on && active) {
+        sched_arm(&sched, broadcast_sched_id, now);
+    } else {
+        sched_disarm(&sched, broadcast_sched_id);
+    }
+    if (broadcast_on) {
+        broadcast_refresh(NULL); // channels just started or stopped change the flags
+    }
+}
+
+// Send whatever became due while the flow window was closed
+static void streams_resume(void) {
+    if (channel_active(BATCH_CHANNEL_HR) && hrm_retry) {
+        notify_heart_rate(NULL);
+    }
+    if (channel_active(BATCH_CHANNEL_CONDUCTIVITY) && peers_payload(CHR_CONDUCTIVITY) > 0) {
+        stream_drain(&conductivity_stream, false);
+    }
+    backfill_run(NULL); // after the live channels, which go first
+    bench_run();
+}
+
+// bench channel, run by the scheduler task during a throughput benchmark
+static void bench_tick(void *param) {
+    bench_run();
+    if (!bench_running()) {
+        sched_kick(); // disarm and drop the fast connection profile
+    }
+}
+
+// Wake the scheduler task after the connection, button or flow state changed
+static void sched_kick(void) {
+    if (sched_task_handle != NULL) {
+        xTaskNotifyGive(sched_task_handle);
+    }
+}
+
+// A notification left the host for the controller: wake the sender if its peer's
+// window had held it back. Runs in whichever task freed the mbuf.
+static void notify_released(uint16_t conn_handle, void *arg) {
+    if (peers_on_released(conn_handle)) {
+        sched_kick();
+    }
+}
+
+// single task owning every periodic channel
+// Sleeps until the next armed deadline, or forever while nothing is started or backfilling.
+void scheduler_task(void *param) {
     while(1) {
-        if (conn_handle_global != 0 && button_state) // Check if connected and running
-        {
-            uint8_t conductivity_data[2] = { 0x00, 50 }; // Conductivity measurement (50 mS/cm)   
-
-            struct os_mbuf *om = ble_hs_mbuf_from_flat(conductivity_data, sizeof(conductivity_data)); // Allocate a packet header
-            int rc = ble_gattc_notify_custom(conn_handle_global, // Connection handle
-                conductivity_handle, // Conductivity UUID
-                om); // The data to send
-            if (rc != 0) {
-                printf("failed to send conductivity notification: %d\n", rc);
-                ESP_LOGE(TAG, "Failed to send conductivity notification: %d", rc);
-            } else {
-                printf("conductivity notification sent: %d mS/cm\n", conductivity_data[1]);
-                ESP_LOGI(TAG, "Conductivity notification sent: %d mS/cm", conductivity_data[1]);
-            }
-            // vTaskDelay(pdMS_TO_TICKS(3000)); // Notify every 3 seconds
+        sched_update_armed();
+        uint32_t due;
+        TickType_t wait = portMAX_DELAY;
+        if (sched_next_deadline(&sched, &due)) {
+            wait = sched_wait_ticks(&sched, xTaskGetTickCount());
         }
-        vTaskDelay(pdMS_TO_TICKS(5000)); // Yield every 5 seconds
+        if (wait > 0 && ulTaskNotifyTake(pdTRUE, wait) > 0) {
+            power_lock(POWER_LOCK_RADIO);
+            streams_resume();
+            power_unlock(POWER_LOCK_RADIO);
+            continue; // state changed, re-arm and recompute the next deadline
+        }
+        power_lock(POWER_LOCK_RADIO); // the sends run at full speed, then the CPU drops back
+        sched_run_due(&sched, xTaskGetTickCount());
+        power_unlock(POWER_LOCK_RADIO);
     }
 }
 
@@ -271,18 +955,34 @@ static const struct ble_gatt_svc_def gatt_svcs[] = {
         {
             {
                 .uuid = BLE_UUID16_DECLARE(0x2A29), // Characteristic: Manufacturer Name
-                .access_cb = device_read,
+                .access_cb = gatt_access,
+                .arg = (void *)&manufacturer_chr_ctx,
                 .flags = BLE_GATT_CHR_F_READ,
             },
             {
                 .uuid = BLE_UUID16_DECLARE(0x2A24), // Characteristic: Model Number
-                .access_cb = device_read,
+                .access_cb = gatt_access,
+                .arg = (void *)&model_chr_ctx,
                 .flags = BLE_GATT_CHR_F_READ,
             },
             { 0 } // Terminator
         }
     },
 
+    // Sample Log Service (custom UUID): backfill of samples taken while disconnected
+    {
+        .type = BLE_GATT_SVC_TYPE_PRIMARY,
+        .uuid = (const ble_uuid_t *)&log_svc_uuid,
+        .characteristics = log_chr,
+    },
+
+    // Diagnostics Service (custom UUID): sample-to-air latency and notify failures
+    {
+        .type = BLE_GATT_SVC_TYPE_PRIMARY,
+        .uuid = (const ble_uuid_t *)&diag_svc_uuid,
+        .characteristics = diag_chr,
+    },
+
     // Custom Command Control Service (0x180C)
     {
         .type = BLE_GATT_SVC_TYPE_PRIMARY,
@@ -291,7 +991,8 @@ static const struct ble_gatt_svc_def gatt_svcs[] = {
         {
             {
                 .uuid = BLE_UUID16_DECLARE(0x2A00), // Characteristic: Device Name Write
-                .access_cb = device_write,
+                .access_cb = gatt_access,
+                .arg = (void *)&command_chr_ctx,
                 .flags = BLE_GATT_CHR_F_WRITE,
             },
             { 0 } // Terminator
@@ -301,15 +1002,57 @@ static const struct ble_gatt_svc_def gatt_svcs[] = {
 };
 
 
+// Map a characteristic value handle to its subscription bit, -1 if it does not notify
+static int chr_index(uint16_t attr_handle) {
+    if (attr_handle == 0) {
+        return -1;
+    }
+    if (attr_handle == hrm_handle) {
+        return CHR_HR;
+    }
+    if (attr_handle == conductivity_handle) {
+        return CHR_CONDUCTIVITY;
+    }
+    if (attr_handle == button_char_handle) {
+        return CHR_BUTTON;
+    }
+    if (attr_handle == log_handle) {
+        return CHR_LOG;
+    }
+    return -1;
+}
+
 // BLE event handling
 static int ble_gap_event(struct ble_gap_event *event, void *arg) {
+    int rc;
     switch (event -> type)
     {
         // Advertise if connected
         case BLE_GAP_EVENT_CONNECT:
             if (event -> connect.status == 0) {
-                ESP_LOGI("GAP", "Device connected");
-                conn_handle_global = event -> connect.conn_handle; // Store the connection handle globally
+                ESP_LOGI("GAP", "Device connected (handle %d)", event -> connect.conn_handle);
+                if (!peers_add(event -> connect.conn_handle)) {
+                    ESP_LOGE("GAP", "Peer table full, dropping connection");
+                    ble_gap_terminate(event -> connect.conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+                    break;
+                }
+                diag_conn_opened(event -> connect.conn_handle);
+                // a bonded peer encrypts with its stored keys and the store restores its
+                // subscriptions; a new one pairs and bonds for next time
+                rc = ble_gap_security_initiate(event -> connect.conn_handle);
+                if (rc != 0) {
+                    ESP_LOGW("GAP", "Security request failed: %d", rc);
+                }
+                // ask for the longest LL packets so a full frame needs one packet (1M PHY: 2120 us)
+                rc = ble_gap_set_data_len(event -> connect.conn_handle, CONN_LL_OCTETS_MAX, 2120);
+                if (rc != 0) {
+                    ESP_LOGW("GAP", "Data length extension request failed: %d", rc);
+                }
+                conn_params_on_connect(event -> connect.conn_handle,
+                    button_state ? CONN_PROFILE_STREAMING : CONN_PROFILE_IDLE);
+                adv_on_connect(event -> connect.conn_handle);
+                sched_kick();
+                ble_app_advertise(); // Keep a slot open for another central, or keep broadcasting
             }
             else {
                 ble_app_advertise(); // Retry advertising if connection failed
@@ -317,13 +1060,96 @@ static int ble_gap_event(struct ble_gap_event *event, void *arg) {
             break;
         // advertise again after completion of event
         case BLE_GAP_EVENT_DISCONNECT:
-            ESP_LOGI("GAP", "BLE GAP EVENT DISCONNECT");
-            conn_handle_global = 0;  // Reset connection handle
-            ble_app_advertise();     // Restart advertising
+            ESP_LOGI("GAP", "BLE GAP EVENT DISCONNECT (handle %d, reason %d)",
+                event -> disconnect.conn.conn_handle, event -> disconnect.reason);
+            peers_remove(event -> disconnect.conn.conn_handle);
+            conn_params_on_disconnect(event -> disconnect.conn.conn_handle);
+            sched_kick();
+            last_peer = event -> disconnect.conn.peer_ota_addr;
+            last_peer_bonded = event -> disconnect.conn.sec_state.bonded;
+            adv_wake(ADV_WAKE_DISCONNECT); // the client is probably still in range, be quick to find
+            break;
+        // connection parameters changed, or our request was rejected
+        case BLE_GAP_EVENT_CONN_UPDATE:
+            conn_params_on_update(event -> conn_update.conn_handle, event -> conn_update.status);
+            break;
+        // encryption on, with stored keys or after pairing
+        case BLE_GAP_EVENT_ENC_CHANGE: {
+            struct ble_gap_conn_desc desc;
+            if (event -> enc_change.status != 0 || ble_gap_conn_find(event -> enc_change.conn_handle, &desc) != 0) {
+                ESP_LOGW("GAP", "Peer %d encryption failed: %d", event -> enc_change.conn_handle, event -> enc_change.status);
+                break;
+            }
+            ESP_LOGI("GAP", "Peer %d encrypted %lu ms after connecting%s", event -> enc_change.conn_handle,
+                (unsigned long)diag_conn_age_ms(event -> enc_change.conn_handle), desc.sec_state.bonded ? ", bonded" : "");
+            break;
+        }
+        // a bonded peer pairs again, e.g. after it dropped its keys: replace the old bond
+        case BLE_GAP_EVENT_REPEAT_PAIRING: {
+            struct ble_gap_conn_desc desc;
+            if (ble_gap_conn_find(event -> repeat_pairing.conn_handle, &desc) == 0) {
+                ble_store_util_delete_peer(&desc.peer_id_addr);
+            }
+            return BLE_GAP_REPEAT_PAIRING_RETRY;
+        }
+        // a peer enabled or disabled notifications on a characteristic, or the bond
+        // store restored them for a returning peer
+        case BLE_GAP_EVENT_SUBSCRIBE: {
+            int chr = chr_index(event -> subscribe.attr_handle);
+            if (chr >= 0) {
+                bool restored = event -> subscribe.reason == BLE_GAP_SUBSCRIBE_REASON_RESTORE;
+                ESP_LOGI("GAP", "Peer %d %s notifications on characteristic %d%s",
+                    event -> subscribe.conn_handle, event -> subscribe.cur_notify ? "enabled" : "disabled", chr,
+                    restored ? " (restored)" : "");
+                if (restored) {
+                    diag_conn_restored(event -> subscribe.conn_handle);
+                }
+                peers_subscribe(event -> subscribe.conn_handle, chr, event -> subscribe.cur_notify);
+                if (chr == CHR_BUTTON && event -> subscribe.cur_notify) {
+                    // the state now: a restored client does not read it, and while idle
+                    // nothing else notifies until the next START or STOP
+                    stream_notify_peer(event -> subscribe.conn_handle, button_char_handle, &button_state,
+                        sizeof(button_state));
+                }
+                if (chr == CHR_LOG && event -> subscribe.cur_notify) {
+                    backfill_since_ms = 0; // a reconnecting client gets everything it missed
+                    backfill_requested = true;
+                }
+                sched_kick();
+            }
+            break;
+        }
+        // ATT MTU exchange finished
+        case BLE_GAP_EVENT_MTU:
+            ESP_LOGI("GAP", "Peer %d MTU %d", event -> mtu.conn_handle, event -> mtu.value);
+            peers_set_mtu(event -> mtu.conn_handle, event -> mtu.value);
+            break;
+#ifdef BLE_GAP_EVENT_DATA_LEN_CHG
+        // LL data length changed, frames are sized to fill whole LL packets
+        case BLE_GAP_EVENT_DATA_LEN_CHG:
+            ESP_LOGI("GAP", "Peer %d LL data length tx %d octets / %d us, rx %d octets",
+                event -> data_len_chg.conn_handle, event -> data_len_chg.max_tx_octets,
+                event -> data_len_chg.max_tx_time, event -> data_len_chg.max_rx_octets);
+            peers_set_data_len(event -> data_len_chg.conn_handle, event -> data_len_chg.max_tx_octets);
+            break;
+#endif
+        // a notification left the host, successfully or not
+        case BLE_GAP_EVENT_NOTIFY_TX:
+            if (!event -> notify_tx.indication) {
+                peers_on_notify_tx(event -> notify_tx.conn_handle, event -> notify_tx.status);
+            }
             break;
         case BLE_GAP_EVENT_ADV_COMPLETE:
-            ESP_LOGI("GAP", "BLE GAP EVENT ADV COMPLETE");
-            ble_app_advertise();
+            if (event -> adv_complete.reason == BLE_HS_ETIMEOUT) {
+                // the tier ran out without a connection, back off to the next one
+                adv_tier_t tier = adv_policy_on_timeout(&adv_policy, now_ms());
+                ESP_LOGI("GAP", "No connection after %lu ms, advertising slows to the %s tier",
+                    (unsigned long)(now_ms() - adv_policy.wake_ms), adv_tier_name(tier));
+                ble_app_advertise();
+            } else if (event -> adv_complete.reason != 0) {
+                ESP_LOGI("GAP", "Advertising ended (reason %d), restarting", event -> adv_complete.reason);
+                ble_app_advertise();
+            }
             break;
         default:
             break;
@@ -331,104 +1157,257 @@ static int ble_gap_event(struct ble_gap_event *event, void *arg) {
     return 0;          
 }
 
-// for apple
+// Services a scanner filters on go into the advertising data itself, so a
+// passive scan (and iOS in the background) sees them; the complete list follows
+// in the scan response.
+static const uint16_t adv_primary_uuids[] = {
+    0x180D, // Heart Rate Service
+    0x181C, // Conductivity Service
+};
+static const uint16_t adv_all_uuids[] = {
+    0x180D, // Heart Rate Service
+    0x181C, // Conductivity Service
+    0x180F, // Battery Service
+    0x180A, // Device Information Service
+    0x180C, // Custom Command Control Service
+    0x180E, // Button Service
+};
+// DEVICE_NAME fits the advertising data in full (31 bytes); a longer one moves to the
+// scan response, and only if that is full too is it shortened, to no less than this
+#define ADV_NAME_MIN 8
+_Static_assert(ADV_AD_SIZE(1) + ADV_AD_SIZE(sizeof(adv_primary_uuids)) + ADV_AD_SIZE(ADV_NAME_MIN) <= ADV_MAX_LEN,
+    "flags, primary services and a shortened name must fit the advertising data");
+_Static_assert(ADV_AD_SIZE(sizeof(adv_all_uuids)) <= ADV_MAX_LEN, "the service list must fit the scan response");
+_Static_assert(ADV_AD_SIZE(1) + ADV_AD_SIZE(BCAST_LEN) + ADV_AD_SIZE(sizeof(adv_primary_uuids)) + ADV_AD_SIZE(ADV_NAME_MIN) <= ADV_MAX_LEN,
+    "broadcast mode: flags, live values, primary services and a shortened name must fit the advertising data");
+
+// Advertising data and scan response, in that order of importance. False if they do not fit.
+static bool adv_build(adv_payload_t *p) {
+    adv_payload_init(p);
+    const uint8_t flags = ADV_FLAG_LE_GENERAL | ADV_FLAG_BREDR_UNSUPPORTED;
+    bool ok = adv_payload_add(p, ADV_TYPE_FLAGS, &flags, sizeof(flags), true) == ADV_PLACED_ADV;
+    if (ok && broadcast_on) {
+        uint8_t values[BCAST_LEN];
+        taskENTER_CRITICAL(&bcast_lock);
+        bcast_encode(&bcast, values);
+        taskEXIT_CRITICAL(&bcast_lock);
+        ok = adv_payload_add(p, ADV_TYPE_MANUFACTURER, values, sizeof(values), true) == ADV_PLACED_ADV;
+    }
+    ok = ok &&
+        adv_payload_add_uuid16(p, adv_primary_uuids, sizeof(adv_primary_uuids) / 2, false, true) == ADV_PLACED_ADV &&
+        adv_payload_add_name(p, ble_svc_gap_device_name(), ADV_NAME_MIN) != ADV_PLACED_NONE;
+    // while broadcasting, the complete list gives way to the name pushed into the scan
+    // response; a client that connects discovers the services anyway
+    if (ok && adv_payload_add_uuid16(p, adv_all_uuids, sizeof(adv_all_uuids) / 2, true, false) == ADV_PLACED_NONE) {
+        ok = broadcast_on;
+    }
+    if (!ok) {
+        ESP_LOGE("GAP", "Advertising payload does not fit (adv %u, scan response %u bytes)", p->adv.len, p->rsp.len);
+    }
+    return ok;
+}
+
+// Advertising data and scan response. Returns 0 or a BLE_HS error.
+static int adv_set_payload(void) {
+    adv_payload_t p;
+    if (!adv_build(&p)) {
+        return BLE_HS_EMSGSIZE;
+    }
+    int rc = ble_gap_adv_set_data(p.adv.data, p.adv.len);
+    if (rc != 0) {
+        ESP_LOGE("GAP", "Setting the advertising data failed: %d", rc);
+        return rc;
+    }
+    rc = ble_gap_adv_rsp_set_data(p.rsp.data, p.rsp.len);
+    if (rc != 0) {
+        ESP_LOGE("GAP", "Setting the scan response failed: %d", rc);
+    }
+    return rc;
+}
+
+// Accept list for the reconnect tier: the last peer as it was seen on air (a phone keeps a
+// resolvable private address for minutes, and the controller does not resolve them here),
+// then every bonded identity. False if the controller refused it.
+static bool adv_accept_list_set(void) {
+    ble_addr_t addrs[CONFIG_BT_NIMBLE_WHITELIST_SIZE];
+    int n = 0;
+    addrs[n++] = last_peer;
+    int bonded = 0;
+    if (ble_store_util_bonded_peers(&addrs[n], &bonded, CONFIG_BT_NIMBLE_WHITELIST_SIZE - n) == 0) {
+        n += bonded;
+    }
+    int rc = ble_gap_wl_set(addrs, n);
+    if (rc != 0) {
+        ESP_LOGW("GAP", "Setting the accept list failed: %d, advertising open", rc);
+        return false;
+    }
+    return true;
+}
+
+// (Re)starts advertising with the interval and duration of the current tier
 void ble_app_advertise(void)
 {
-    struct ble_hs_adv_fields fields;
-    memset(&fields, 0, sizeof(fields));
-
-    // Include flags for general discoverability and BLE-only support
-    fields.flags = BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP;
-
-    // Include complete device name
-    const char *device_name = ble_svc_gap_device_name();
-    fields.name = (uint8_t *)device_name;
-    fields.name_len = strlen(device_name);
-    fields.name_is_complete = 1;
-
-    // Include the Heart Rate Service UUID and battery in the advertisement
-    // const uint16_t svc_uuid = 0x180D;
-    static const ble_uuid16_t svc_uuids[] = {
-        BLE_UUID16_INIT(0x180D), // Heart Rate Service
-        BLE_UUID16_INIT(0x180F), // Battery Service
-        BLE_UUID16_INIT(0x181C), // Conductivity Service
-        BLE_UUID16_INIT(0x180A), // Device Information Service
-        BLE_UUID16_INIT(0x180C), // Custom Command Control Service
-        BLE_UUID16_INIT(0x180E), // Button Service
-    };
-    fields.uuids16 = (ble_uuid16_t *)svc_uuids;
-    fields.num_uuids16 = sizeof(svc_uuids) / sizeof(svc_uuids[0]);
-    fields.uuids16_is_complete = 1;
-
-    ble_gap_adv_set_fields(&fields);
+    if (ble_gap_adv_active()) {
+        ble_gap_adv_stop(); // e.g. a slot kept open at the slow tier, restart with the new one
+    }
+    bool slot_free = peers_count() < CONN_TABLE_MAX;
+    if (!slot_free && !broadcast_on) {
+        return; // nobody could connect, and there is nothing to broadcast
+    }
+    if (adv_set_payload() != 0) {
+        return; // advertising without the payload would only make the device harder to find
+    }
 
-    // Start advertising
+    adv_tier_params_t tier = adv_policy_params(&adv_policy);
+    if (broadcast_on) {
+        // one advertising event per sample; 100 ms is also the floor for
+        // non-connectable legacy advertising before Bluetooth 5.0
+        tier.itvl_min = tier.itvl_max = ADV_ITVL_MS(BROADCAST_PERIOD_MS);
+        tier.duration_ms = 0;
+    }
     struct ble_gap_adv_params adv_params;
     memset(&adv_params, 0, sizeof(adv_params));
-    adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
+    adv_params.conn_mode = slot_free ? BLE_GAP_CONN_MODE_UND : BLE_GAP_CONN_MODE_NON;
     adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
+    adv_params.itvl_min = tier.itvl_min;
+    adv_params.itvl_max = tier.itvl_max;
+    const ble_addr_t *direct = NULL;
+    bool reconnect_tier = !broadcast_on && adv_policy.running && adv_policy.tier < ADV_TIER_FAST;
+    if (reconnect_tier && adv_policy.tier == ADV_TIER_DIRECTED) {
+        adv_params.conn_mode = BLE_GAP_CONN_MODE_DIR;
+        adv_params.high_duty_cycle = 1;
+        direct = &last_peer;
+    } else if (reconnect_tier && adv_accept_list_set()) {
+        adv_params.filter_policy = BLE_HCI_ADV_FILT_CONN; // anyone may still scan
+    }
 
-    ble_gap_adv_start(ble_addr_type, NULL, BLE_HS_FOREVER, &adv_params, ble_gap_event, NULL);
+    int32_t duration = tier.duration_ms != 0 ? (int32_t)tier.duration_ms : BLE_HS_FOREVER;
+    int rc = ble_gap_adv_start(ble_addr_type, direct, duration, &adv_params, ble_gap_event, NULL);
+    if (rc != 0 && reconnect_tier) {
+        // e.g. a controller without high duty cycle directed advertising: carry on with the next tier
+        ESP_LOGW("GAP", "Advertising in the %s tier failed to start: %d", adv_tier_name(adv_policy.tier), rc);
+        adv_policy_on_timeout(&adv_policy, now_ms());
+        ble_app_advertise();
+    } else if (rc != 0) {
+        ESP_LOGE("GAP", "Advertising failed to start: %d", rc);
+    }
 }
 
-
-// The application
-void ble_app_on_sync(void) {
-    ble_hs_id_infer_auto(0, &ble_addr_type);
+// Boot or disconnect: advertise fast again, to a bonded peer that just left first
+static void adv_wake(adv_wake_t reason) {
+    bool reconnect = reason == ADV_WAKE_DISCONNECT && last_peer_bonded && !broadcast_on;
+    adv_policy_wake(&adv_policy, reason, now_ms(), reconnect);
+    if (broadcast_on) {
+        ble_app_advertise(); // the broadcast interval stays, the run still times the next connect
+        return;
+    }
+    if (reconnect) {
+        ESP_LOGI("GAP", "Advertising directed to the bonded peer, then for bonded peers only for %lu s",
+            (unsigned long)(ADV_ACCEPT_LIST_WINDOW_MS / 1000));
+        ble_app_advertise();
+        return;
+    }
+    adv_tier_params_t tier = adv_policy_params(&adv_policy);
+    ESP_LOGI("GAP", "Advertising fast after %s: %u-%u ms for %lu s", adv_wake_name(reason),
+        tier.itvl_min * 5 / 8, tier.itvl_max * 5 / 8, (unsigned long)(tier.duration_ms / 1000));
     ble_app_advertise();
-    ESP_LOGI(TAG, "Attempting to locate Heart Rate Characteristic UUID: 0x2A37 in Service UUID: 0x180D");
-
-    uint16_t def_handle;
-    uint16_t val_handle;
+}
 
-    int rc = ble_gatts_find_chr(
-        BLE_UUID16_DECLARE(0x180D),
-        BLE_UUID16_DECLARE(0x2A37),
-        &def_handle,
-        &val_handle
-    );
+// Time to connect, this connection and per wake reason so far
+static void adv_on_connect(uint16_t conn_handle) {
+    adv_tier_t tier = adv_policy.tier;
+    adv_wake_t reason = adv_policy.reason;
+    uint32_t ttc;
+    if (!adv_policy_on_connect(&adv_policy, now_ms(), &ttc)) {
+        return; // a second central found the slot kept open
+    }
+    struct ble_gap_conn_desc desc;
+    if (reason == ADV_WAKE_DISCONNECT && ble_gap_conn_find(conn_handle, &desc) == 0 &&
+        memcmp(&desc.peer_ota_addr, &last_peer, sizeof(last_peer)) == 0) {
+        // the peer that dropped is back: its data gap ends here
+        diag_reconnect(tier == ADV_TIER_DIRECTED ? DIAG_RECONNECT_DIRECTED :
+            tier == ADV_TIER_ACCEPT_LIST ? DIAG_RECONNECT_ACCEPT_LIST : DIAG_RECONNECT_OPEN, ttc);
+    }
+    const adv_ttc_t *t = &adv_policy.by_reason[reason];
+    ESP_LOGI("GAP", "Connected %lu ms after %s, in the %s tier; after %s: %lu connects, mean %lu ms, max %lu ms",
+        (unsigned long)ttc, adv_wake_name(reason), adv_tier_name(tier), adv_wake_name(reason),
+        (unsigned long)t->connects, (unsigned long)(t->ttc_sum_ms / t->connects), (unsigned long)t->ttc_max_ms);
+    for (int i = 0; i < ADV_TIER_COUNT; i++) {
+        if (adv_policy.connects_in_tier[i] != 0 || adv_policy.tier_ms[i] != 0) {
+            ESP_LOGI("GAP", "  %s tier: %lu connects, advertised %lu s", adv_tier_name(i),
+                (unsigned long)adv_policy.connects_in_tier[i], (unsigned long)(adv_policy.tier_ms[i] / 1000));
+        }
+    }
+}
 
+// broadcast channel, run by the scheduler task once per conductivity sample period.
+// Only changed values reach the controller; the scan response stays as it is.
+static void broadcast_refresh(void *param) {
+    if (!broadcast_on) {
+        return;
+    }
+    bcast_values_t v = { .battery = battery_level };
+    if (channel_active(BATCH_CHANNEL_HR)) {
+        v.flags |= BCAST_FLAG_HR;
+        v.bpm = hr_monitor_bpm();
+    }
+    uint32_t now = now_ms();
+    taskENTER_CRITICAL(&bcast_lock);
+    if (channel_active(BATCH_CHANNEL_CONDUCTIVITY) && bcast_cond_n > 0) {
+        // a block arrives every ADC_ACQ_BLOCK_LEN samples (500 ms at 10 Hz): pace its
+        // samples out at the sample rate, one block late
+        uint32_t i = (now - bcast_cond_ms) / BROADCAST_PERIOD_MS;
+        v.flags |= BCAST_FLAG_CONDUCTIVITY;
+        v.conductivity = bcast_cond[i < bcast_cond_n ? i : bcast_cond_n - 1u];
+    }
+    bool changed = bcast_update(&bcast, &v);
+    taskEXIT_CRITICAL(&bcast_lock);
+    if (!changed) {
+        return;
+    }
+    adv_payload_t p;
+    if (!adv_build(&p)) {
+        return;
+    }
+    int rc = ble_gap_adv_set_data(p.adv.data, p.adv.len);
     if (rc != 0) {
-        ESP_LOGE(TAG, "Failed to find Heart Rate Measurement characteristic: %d", rc);
-    } else {
-        hrm_handle = val_handle;
-        ESP_LOGI(TAG, "Heart Rate Measurement characteristic handle: %d", hrm_handle);
+        ESP_LOGW("GAP", "Refreshing the broadcast values failed: %d", rc);
     }
+}
 
-    // conductivity handle
-    ESP_LOGI(TAG, "Attempting to locate Conductivity Characteristic UUID: 0xAA5B9750C9824CE690C754C0C8C6AE84 in Service UUID: 0x181C");
-
-    rc = ble_gatts_find_chr(
-        BLE_UUID16_DECLARE(0x181C),
-        (const ble_uuid_t *)&conductivity_uuid,
-        &def_handle,
-        &val_handle
-    );
 
-    if (rc != 0) {
-        ESP_LOGE(TAG, "Failed to find Conductivity characteristic: %d", rc);
-    } else {
-        conductivity_handle = val_handle;
-        ESP_LOGI(TAG, "Conductivity characteristic handle: %d", conductivity_handle);
-    }
+// The application
+void ble_app_on_sync(void) {
+    ble_hs_id_infer_auto(0, &ble_addr_type);
+    adv_wake(ADV_WAKE_BOOT);
+    // value handles were written through the val_handle pointers when the services were registered
+    ESP_LOGI(TAG, "Characteristic handles: heart rate %d, conductivity %d, battery %d, button %d, log %d",
+        hrm_handle, conductivity_handle, battery_handle, button_char_handle, log_handle);
+}
 
-    // button handle
-    ESP_LOGI(TAG, "Locating Button Characteristic UUID: 0x2A3F in Service UUID: 0x180E");
-    rc = ble_gatts_find_chr(
-        BLE_UUID16_DECLARE(0x180E),
-        BLE_UUID16_DECLARE(0x2A3F),
-        &def_handle,
-        &val_handle
-    );
+// L2CAP bulk channel: control records in SDUs, backfill and benchmarks out
+static void bulk_connected(uint16_t conn_handle) {
+    backfill_since_ms = 0; // as for a log subscription
+    backfill_requested = true;
+    sched_kick();
+}
 
-    if (rc != 0) {
-        ESP_LOGE(TAG, "Failed to find Button characteristic: %d", rc);
-    } else {
-        button_char_handle = val_handle;
-        ESP_LOGI(TAG, "Button characteristic handle: %d", button_char_handle);
+static void bulk_received(const struct os_mbuf *sdu) {
+    ctrl_result_t result;
+    if (control_parse_mbuf(sdu, &result) != CTRL_OK) {
+        DLOG(DLOG_SDU_REJECTED);
+        return;
     }
+    sched_kick();
+    button_update();
 }
 
+static const l2cap_bulk_cbs_t bulk_cbs = {
+    .connected = bulk_connected,
+    .received = bulk_received,
+    .writable = sched_kick,
+};
+
 // the inifinite task
 void host_task(void *param) {
     nimble_port_run();
@@ -436,20 +1415,62 @@ void host_task(void *param) {
 
 void app_main() {
     nvs_flash_init();
+    dlog_init(); // first, the host task logs through it
+    if (power_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Power management unavailable, running at a fixed frequency");
+    }
     // esp_nimble_hci_and_controller_init();
     nimble_port_init();
-    ble_svc_gap_device_name_set("HydraWise-BLE-Server");
+    ble_svc_gap_device_name_set(DEVICE_NAME);
     ble_svc_gap_init();
     ble_svc_gatt_init();
     ble_gatts_count_cfg(gatt_svcs);
     ble_gatts_add_svcs(gatt_svcs);
+    l2cap_bulk_init(&bulk_cbs);
+    adv_policy_init(&adv_policy, ADV_FAST_WINDOW_MS);
     ble_hs_cfg.sync_cb = ble_app_on_sync;
+    // Just Works bonding (no display or keyboard), LE Secure Connections, and keys for
+    // reconnecting on both sides: LTK, and IRK so the peer's private address resolves
+    ble_hs_cfg.sm_io_cap = BLE_SM_IO_CAP_NO_IO;
+    ble_hs_cfg.sm_bonding = 1;
+    ble_hs_cfg.sm_mitm = 0;
+    ble_hs_cfg.sm_sc = 1;
+    ble_hs_cfg.sm_our_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+    ble_hs_cfg.sm_their_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+    ble_hs_cfg.store_status_cb = ble_store_util_status_rr; // a full store drops the oldest bond
+    ble_store_config_init();
+    sched_init(&sched);
+    notify_pool_init(notify_released, NULL);
+    conn_params_init();
+    peers_init(FLOW_WINDOW_MIN, NOTIFY_POOL_COUNT, FLOW_WINDOW_INIT);
+    hrm_update(NOTIFY_POOL_MAX_PAYLOAD, NULL); // reads before the first measurement get "no contact"
+    stream_init(&conductivity_stream, "conductivity", CHR_CONDUCTIVITY, &conductivity_handle,
+        BATCH_CHANNEL_CONDUCTIVITY, BATCH_LATENCY_CAP_MS - CONDUCTIVITY_DRAIN_PERIOD_MS);
+    stream_init(&log_stream, "sample log", CHR_LOG, &log_handle, BATCH_CHANNEL_MIXED, 0);
+    batch_set_codec(&log_stream.batch, BATCH_CODEC_DELTA); // backfill is bulk, live channels stay raw until SET_CODEC
+    if (store_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Sample log unavailable, samples taken offline are lost");
+    }
+    hr_sched_id = sched_add(&sched, "hr_notify", pdMS_TO_TICKS(HR_NOTIFY_PERIOD_MS), notify_heart_rate, NULL);
+    conductivity_sched_id = sched_add(&sched, "conductivity_drain", pdMS_TO_TICKS(CONDUCTIVITY_DRAIN_PERIOD_MS), drain_conductivity, NULL);
+    backfill_sched_id = sched_add(&sched, "backfill", pdMS_TO_TICKS(BACKFILL_PERIOD_MS), backfill_run, NULL);
+    bench_sched_id = sched_add(&sched, "bench", pdMS_TO_TICKS(BENCH_PERIOD_MS), bench_tick, NULL);
+    bcast_init(&bcast);
+    broadcast_sched_id = sched_add(&sched, "broadcast", pdMS_TO_TICKS(BROADCAST_PERIOD_MS), broadcast_refresh, NULL);
+    if (hr_monitor_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Heart rate pipeline unavailable");
+    }
+    if (adc_acq_init(adc_block_ready, NULL) != ESP_OK) {
+        ESP_LOGE(TAG, "PPG and conductivity acquisition unavailable");
+    }
+    xTaskCreate(scheduler_task, "sched_task", 3072, NULL, 5, &sched_task_handle); // One task for every periodic notification
+    // The host task last: its GAP and GATT events use everything above, and a
+    // bonded peer can reconnect as soon as it syncs
     nimble_port_freertos_init(host_task);
-    xTaskCreate(notify_heart_rate_task, "hr_notify_task", 2048, NULL, 5, NULL); // Create FreeRTOS task for heart rate notifications
-    xTaskCreate(notify_conductivity_task, "conductivity_notify_task", 2048, NULL, 5, NULL); // Create FreeRTOS task for conductivity notifications
-    // Note: The above task will send heart rate notifications every 3 seconds
-    // This will allow the ESP32 to send heart rate notifications to connected clients.
-    // The application will now start advertising and waiting for connections.
-    // The notify_heart_rate_task will run in parallel and send notifications to the connected client.
-    // Make sure to handle the connection and disconnection events properly to manage the connection state.
+    // The scheduler task blocks without a timeout until a client sends START.
+    // While streaming it sleeps until the earliest sample deadline; samples are batched into
+    // MTU-sized notifications that go out when full or after BATCH_LATENCY_CAP_MS.
+    // While no peer is connected the samples go to the flash log instead and are sent back
+    // on the sample log characteristic once a client subscribes to it.
+    // Connection and button state changes wake it through sched_kick().
 }
\ No newline at end of file
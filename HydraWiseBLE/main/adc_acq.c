@@ -0,0 +1,187 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_adc/adc_continuous.h"
+#include "adc_acq.h"
+#include "decimator.h"
+#include "power.h"
+
+static const char *TAG = "adc_acq";
+
+static adc_continuous_handle_t adc_handle = NULL;
+static TaskHandle_t acq_task_handle = NULL;
+// Per-input decimation state
+typedef struct {
+    adc_acq_src_t source;
+    decim_t decim;
+    uint32_t out_hz;
+    uint32_t block_ts_ms; // timestamp of the first output in the block being built
+    adc_acq_block_t block; // completed in the frame being fed, stamped after it
+    bool block_done;
+} acq_input_t;
+
+static acq_input_t inputs[] = {
+    { .source = ADC_ACQ_SRC_CONDUCTIVITY, .out_hz = ADC_ACQ_OUTPUT_HZ },
+    { .source = ADC_ACQ_SRC_PPG, .out_hz = ADC_ACQ_PPG_HZ },
+};
+static adc_acq_block_fn block_fn;
+static void *block_arg;
+static volatile bool running = false; // read by the acquisition task
+
+// DMA frame done: wake the acquisition task, never touch the data here
+static bool IRAM_ATTR adc_conv_done_cb(adc_continuous_handle_t handle,
+    const adc_continuous_evt_data_t *edata, void *user_data) {
+    BaseType_t must_yield = pdFALSE;
+    vTaskNotifyGiveFromISR(acq_task_handle, &must_yield);
+    return must_yield == pdTRUE;
+}
+
+// A frame completes at most one block per input, so where in it the block
+// ended is known once the frame is fed
+_Static_assert(ADC_ACQ_FRAME_BYTES / SOC_ADC_DIGI_RESULT_BYTES <
+    (ADC_ACQ_INPUT_HZ / ADC_ACQ_PPG_HZ) * ADC_ACQ_PPG_BLOCK_LEN, "a DMA frame must not span two PPG blocks");
+
+// Keep each decimated block until its frame is fed
+static void decim_block_cb(const uint16_t *samples, uint16_t n, void *arg) {
+    acq_input_t *in = arg;
+    in->block.source = in->source;
+    in->block.ts_ms = in->block_ts_ms;
+    in->block.n = n;
+    memcpy(in->block.samples, samples, n * sizeof(samples[0]));
+    in->block_ts_ms += n * 1000 / in->out_hz;
+    in->block_done = true;
+}
+
+// Feed one frame's readings of an input read at read_us; a block it completed
+// is stamped back from there by the readings left over after it, and passed on
+static void input_feed(acq_input_t *in, const uint16_t *raw, size_t n, uint32_t read_us) {
+    decim_feed(&in->decim, raw, n);
+    if (!in->block_done) {
+        return;
+    }
+    in->block_done = false;
+    uint32_t after = in->decim.block_fill * in->decim.factor + in->decim.acc_n;
+    in->block.end_us = read_us - (uint32_t)((uint64_t)after * 1000000 / ADC_ACQ_INPUT_HZ);
+    if (block_fn) {
+        block_fn(&in->block, block_arg);
+    }
+}
+
+static void adc_acq_task(void *param) {
+    static uint8_t frame[ADC_ACQ_FRAME_BYTES];
+    static uint16_t raw[2][ADC_ACQ_FRAME_BYTES / SOC_ADC_DIGI_RESULT_BYTES];
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        power_lock(POWER_LOCK_SAMPLING);
+        uint32_t got = 0;
+        // drain everything the DMA ring holds, one frame at a time
+        while (running && adc_continuous_read(adc_handle, frame, sizeof(frame), &got, 0) == ESP_OK) {
+            uint32_t read_us = (uint32_t)esp_timer_get_time();
+            size_t n[2] = { 0, 0 };
+            for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= got; i += SOC_ADC_DIGI_RESULT_BYTES) {
+                const adc_digi_output_data_t *p = (const adc_digi_output_data_t *)&frame[i];
+                if (p->type1.channel == ADC_ACQ_CHANNEL) {
+                    raw[ADC_ACQ_SRC_CONDUCTIVITY][n[ADC_ACQ_SRC_CONDUCTIVITY]++] = p->type1.data;
+                } else if (p->type1.channel == ADC_ACQ_PPG_CHANNEL) {
+                    raw[ADC_ACQ_SRC_PPG][n[ADC_ACQ_SRC_PPG]++] = p->type1.data;
+                }
+            }
+            input_feed(&inputs[ADC_ACQ_SRC_CONDUCTIVITY], raw[ADC_ACQ_SRC_CONDUCTIVITY], n[ADC_ACQ_SRC_CONDUCTIVITY], read_us);
+            input_feed(&inputs[ADC_ACQ_SRC_PPG], raw[ADC_ACQ_SRC_PPG], n[ADC_ACQ_SRC_PPG], read_us);
+        }
+        power_unlock(POWER_LOCK_SAMPLING);
+    }
+}
+
+esp_err_t adc_acq_init(adc_acq_block_fn fn, void *arg) {
+    block_fn = fn;
+    block_arg = arg;
+    decim_init(&inputs[ADC_ACQ_SRC_CONDUCTIVITY].decim, ADC_ACQ_INPUT_HZ / ADC_ACQ_OUTPUT_HZ,
+        ADC_ACQ_BLOCK_LEN, decim_block_cb, &inputs[ADC_ACQ_SRC_CONDUCTIVITY]);
+    decim_init(&inputs[ADC_ACQ_SRC_PPG].decim, ADC_ACQ_INPUT_HZ / ADC_ACQ_PPG_HZ,
+        ADC_ACQ_PPG_BLOCK_LEN, decim_block_cb, &inputs[ADC_ACQ_SRC_PPG]);
+
+    adc_continuous_handle_cfg_t handle_cfg = {
+        .max_store_buf_size = 4 * ADC_ACQ_FRAME_BYTES,
+        .conv_frame_size = ADC_ACQ_FRAME_BYTES,
+    };
+    esp_err_t err = adc_continuous_new_handle(&handle_cfg, &adc_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create ADC handle: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    adc_digi_pattern_config_t pattern[] = {
+        {
+            .atten = ADC_ATTEN_DB_12,
+            .channel = ADC_ACQ_CHANNEL,
+            .unit = ADC_UNIT_1,
+            .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+        },
+        {
+            .atten = ADC_ATTEN_DB_12,
+            .channel = ADC_ACQ_PPG_CHANNEL,
+            .unit = ADC_UNIT_1,
+            .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+        },
+    };
+    adc_continuous_config_t dig_cfg = {
+        .pattern_num = sizeof(pattern) / sizeof(pattern[0]),
+        .adc_pattern = pattern,
+        .sample_freq_hz = ADC_ACQ_SAMPLE_HZ,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+    };
+    err = adc_continuous_config(adc_handle, &dig_cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure ADC: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    adc_continuous_evt_cbs_t cbs = {
+        .on_conv_done = adc_conv_done_cb,
+    };
+    err = adc_continuous_register_event_callbacks(adc_handle, &cbs, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register ADC callbacks: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    xTaskCreate(adc_acq_task, "adc_acq_task", 3072, NULL, 6, &acq_task_handle);
+    return ESP_OK;
+}
+
+esp_err_t adc_acq_start(void) {
+    if (adc_handle == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (running) {
+        return ESP_OK;
+    }
+    uint32_t now = pdTICKS_TO_MS(xTaskGetTickCount());
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        decim_reset(&inputs[i].decim);
+        inputs[i].block_ts_ms = now;
+        inputs[i].block_done = false;
+    }
+    running = true;
+    esp_err_t err = adc_continuous_start(adc_handle);
+    if (err != ESP_OK) {
+        running = false;
+        ESP_LOGE(TAG, "Failed to start ADC: %s", esp_err_to_name(err));
+        return err;
+    }
+    power_lock(POWER_LOCK_ADC);
+    return ESP_OK;
+}
+
+esp_err_t adc_acq_stop(void) {
+    if (!running) {
+        return ESP_OK;
+    }
+    running = false;
+    power_unlock(POWER_LOCK_ADC);
+    return adc_continuous_stop(adc_handle);
+}
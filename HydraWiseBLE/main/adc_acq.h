@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+Continuous (DMA) ADC acquisition for the conductivity and PPG channels.
+
+The driver alternates between the two ADC1 inputs at ADC_ACQ_SAMPLE_HZ in
+total. A conversion-done interrupt wakes the acquisition task once per DMA
+frame, which drains the ring, splits the readings by input, decimates each to
+its output rate and hands blocks to the block callback. Values are mean raw
+12-bit counts.
+
+Blocks carry two times. ts_ms is the nominal timestamp of the first sample,
+counted from START at the output rate, which frames and the log use. end_us
+is when the last sample's readings were taken, by esp_timer: the time the
+task read their DMA frame, less the readings that frame holds after them.
+A frame that waited in the driver's pool behind another is stamped late by
+that wait.
+*/
+
+#define ADC_ACQ_CHANNEL ADC_CHANNEL_6     // GPIO34, conductivity electrode
+#define ADC_ACQ_PPG_CHANNEL ADC_CHANNEL_7 // GPIO35, PPG photodiode amplifier
+#define ADC_ACQ_SAMPLE_HZ 20000           // ESP32 lower limit for the digital controller
+#define ADC_ACQ_INPUT_HZ (ADC_ACQ_SAMPLE_HZ / 2) // per input, the pattern alternates
+#define ADC_ACQ_OUTPUT_HZ 10
+#define ADC_ACQ_BLOCK_LEN 5               // one block per 500 ms at 10 Hz, half the batch latency cap
+#define ADC_ACQ_PPG_HZ 200
+#define ADC_ACQ_PPG_BLOCK_LEN 20          // one block per 100 ms at 200 Hz
+#define ADC_ACQ_BLOCK_MAX ADC_ACQ_PPG_BLOCK_LEN
+#define ADC_ACQ_FRAME_BYTES 1024          // DMA frame, one task wakeup per frame
+#define ADC_ACQ_OUTPUT_US (1000000 / ADC_ACQ_OUTPUT_HZ)
+
+typedef enum {
+    ADC_ACQ_SRC_CONDUCTIVITY,
+    ADC_ACQ_SRC_PPG,
+} adc_acq_src_t;
+
+typedef struct {
+    adc_acq_src_t source;
+    uint32_t ts_ms;  // timestamp of the first sample in the block
+    uint32_t end_us; // esp_timer, low 32 bits, when the last sample was complete
+    uint16_t n;
+    uint16_t samples[ADC_ACQ_BLOCK_MAX];
+} adc_acq_block_t;
+
+// Called from the acquisition task for every completed block
+typedef void (*adc_acq_block_fn)(const adc_acq_block_t *block, void *arg);
+
+esp_err_t adc_acq_init(adc_acq_block_fn fn, void *arg);
+esp_err_t adc_acq_start(void);
+esp_err_t adc_acq_stop(void);
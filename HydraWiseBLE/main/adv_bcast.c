@@ -0,0 +1,40 @@
+#include <string.h>
+#include "adv_bcast.h"
+
+void bcast_init(bcast_t *b) {
+    memset(b, 0, sizeof(*b));
+}
+
+bool bcast_update(bcast_t *b, const bcast_values_t *v) {
+    bcast_values_t n = *v;
+    if (!(n.flags & BCAST_FLAG_HR)) {
+        n.bpm = 0;
+    }
+    if (!(n.flags & BCAST_FLAG_CONDUCTIVITY)) {
+        n.conductivity = 0;
+    }
+    if (n.bpm > UINT8_MAX) {
+        n.bpm = UINT8_MAX;
+    }
+    const bcast_values_t *l = &b->last;
+    if (b->updates != 0 && n.flags == l->flags && n.bpm == l->bpm &&
+        n.conductivity == l->conductivity && n.battery == l->battery) {
+        return false;
+    }
+    b->last = n;
+    b->updates++;
+    b->seq = (uint8_t)b->updates;
+    return true;
+}
+
+void bcast_encode(const bcast_t *b, uint8_t *dst) {
+    dst[0] = BCAST_COMPANY_ID & 0xff;
+    dst[1] = BCAST_COMPANY_ID >> 8;
+    dst[2] = BCAST_VERSION;
+    dst[3] = b->seq;
+    dst[4] = b->last.flags;
+    dst[5] = (uint8_t)b->last.bpm;
+    dst[6] = b->last.conductivity & 0xff;
+    dst[7] = b->last.conductivity >> 8;
+    dst[8] = b->last.battery;
+}
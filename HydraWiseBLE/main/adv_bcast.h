@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Live metrics in manufacturer-specific advertising data, for broadcast mode.
+
+An observer (a gateway listening to a whole team) reads each unit's latest
+values from its advertisements without connecting. The manufacturer data,
+little endian:
+
+    uint16 company id    BCAST_COMPANY_ID
+    uint8  version       BCAST_VERSION
+    uint8  sequence      bumped on every change of the values, wraps
+    uint8  flags         BCAST_FLAG_*, a value without its flag is 0
+    uint8  heart rate    bpm, 0 = no beats seen, saturates at 255
+    uint16 conductivity  latest sample, mean raw ADC counts
+    uint8  battery       percent
+
+The same data goes out on every advertising event until it changes, so an
+observer keeps the first packet per sequence number and counts the gaps as
+updates it missed. No NimBLE dependency.
+*/
+
+#define BCAST_COMPANY_ID 0xffff // reserved by the Bluetooth SIG for testing, until one is assigned
+#define BCAST_VERSION 1
+#define BCAST_LEN 9
+
+#define BCAST_FLAG_HR 0x01           // heart rate channel running
+#define BCAST_FLAG_CONDUCTIVITY 0x02 // conductivity channel running
+
+typedef struct {
+    uint8_t flags;
+    uint16_t bpm;
+    uint16_t conductivity;
+    uint8_t battery;
+} bcast_values_t;
+
+typedef struct {
+    bcast_values_t last;
+    uint8_t seq;
+    uint32_t updates; // changes taken, seq is its low byte
+} bcast_t;
+
+void bcast_init(bcast_t *b);
+
+// Takes the current values; true, with the sequence bumped, if they differ
+// from the last ones.
+bool bcast_update(bcast_t *b, const bcast_values_t *v);
+
+// Writes the manufacturer data for the last values, BCAST_LEN bytes.
+void bcast_encode(const bcast_t *b, uint8_t *dst);
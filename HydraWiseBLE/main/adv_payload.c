@@ -0,0 +1,54 @@
+#include <string.h>
+#include "adv_payload.h"
+
+static bool buf_put(adv_buf_t *b, uint8_t type, const void *data, uint8_t len) {
+    if (b->len + ADV_AD_SIZE(len) > ADV_MAX_LEN) {
+        return false;
+    }
+    b->data[b->len++] = len + 1; // the length byte counts the type
+    b->data[b->len++] = type;
+    memcpy(&b->data[b->len], data, len);
+    b->len += len;
+    return true;
+}
+
+void adv_payload_init(adv_payload_t *p) {
+    memset(p, 0, sizeof(*p));
+}
+
+adv_placed_t adv_payload_add(adv_payload_t *p, uint8_t type, const void *data, uint8_t len, bool adv_only) {
+    if (buf_put(&p->adv, type, data, len)) {
+        return ADV_PLACED_ADV;
+    }
+    if (!adv_only && buf_put(&p->rsp, type, data, len)) {
+        return ADV_PLACED_RSP;
+    }
+    return ADV_PLACED_NONE;
+}
+
+adv_placed_t adv_payload_add_uuid16(adv_payload_t *p, const uint16_t *uuids, uint8_t count, bool complete, bool adv_only) {
+    uint8_t data[ADV_MAX_LEN];
+    if (count * 2 > ADV_MAX_LEN - ADV_AD_SIZE(0)) {
+        return ADV_PLACED_NONE;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        data[2 * i] = uuids[i] & 0xff;
+        data[2 * i + 1] = uuids[i] >> 8;
+    }
+    return adv_payload_add(p, complete ? ADV_TYPE_UUID16_COMPLETE : ADV_TYPE_UUID16_INCOMPLETE, data, count * 2, adv_only);
+}
+
+adv_placed_t adv_payload_add_name(adv_payload_t *p, const char *name, uint8_t min_len) {
+    size_t len = strlen(name);
+    if (len <= ADV_MAX_LEN - ADV_AD_SIZE(0)) {
+        adv_placed_t placed = adv_payload_add(p, ADV_TYPE_NAME_COMPLETE, name, (uint8_t)len, false);
+        if (placed != ADV_PLACED_NONE) {
+            return placed;
+        }
+    }
+    uint8_t room = adv_buf_room(&p->adv);
+    if (room < min_len || room == 0) {
+        return ADV_PLACED_NONE;
+    }
+    return adv_payload_add(p, ADV_TYPE_NAME_SHORT, name, room < len ? room : (uint8_t)len, true);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Legacy advertising payload builder.
+
+Advertising data and scan response are each at most ADV_MAX_LEN bytes of AD
+structures { uint8 length, uint8 type, data }. Fields are added in order of
+importance: each goes into the advertising data if it still fits there, else
+into the scan response, which a scanner only sees after a scan request. A
+field that fits neither is refused, never truncated, except the device name,
+which falls back to a shortened name in whatever room the advertising data
+has left. Sizes of a fixed layout are known at compile time, so callers
+check them with ADV_AD_SIZE() in a _Static_assert. No NimBLE dependency.
+*/
+
+#define ADV_MAX_LEN 31 // legacy ADV_IND / SCAN_RSP payload
+#define ADV_AD_SIZE(data_len) (2 + (data_len))
+
+// AD types, Core Specification Supplement part A
+#define ADV_TYPE_FLAGS 0x01
+#define ADV_TYPE_UUID16_INCOMPLETE 0x02
+#define ADV_TYPE_UUID16_COMPLETE 0x03
+#define ADV_TYPE_NAME_SHORT 0x08
+#define ADV_TYPE_NAME_COMPLETE 0x09
+#define ADV_TYPE_TX_POWER 0x0a
+#define ADV_TYPE_APPEARANCE 0x19
+#define ADV_TYPE_MANUFACTURER 0xff
+
+#define ADV_FLAG_LE_GENERAL 0x02
+#define ADV_FLAG_BREDR_UNSUPPORTED 0x04
+
+typedef struct {
+    uint8_t data[ADV_MAX_LEN];
+    uint8_t len;
+} adv_buf_t;
+
+typedef struct {
+    adv_buf_t adv;
+    adv_buf_t rsp;
+} adv_payload_t;
+
+typedef enum {
+    ADV_PLACED_NONE = -1, // fits neither
+    ADV_PLACED_ADV,
+    ADV_PLACED_RSP,
+} adv_placed_t;
+
+void adv_payload_init(adv_payload_t *p);
+
+// Adds one AD structure to the advertising data, or to the scan response if
+// the advertising data is full and adv_only is false.
+adv_placed_t adv_payload_add(adv_payload_t *p, uint8_t type, const void *data, uint8_t len, bool adv_only);
+
+// List of 16-bit service UUIDs, little endian on air
+adv_placed_t adv_payload_add_uuid16(adv_payload_t *p, const uint16_t *uuids, uint8_t count, bool complete, bool adv_only);
+
+// Complete name in the advertising data or the scan response; failing both, a
+// shortened name of at least min_len characters in what the advertising data has left.
+adv_placed_t adv_payload_add_name(adv_payload_t *p, const char *name, uint8_t min_len);
+
+// Room left for data in a buffer, after a new structure's 2-byte header
+static inline uint8_t adv_buf_room(const adv_buf_t *b) {
+    return b->len + ADV_AD_SIZE(0) <= ADV_MAX_LEN ? ADV_MAX_LEN - b->len - ADV_AD_SIZE(0) : 0;
+}
@@ -0,0 +1,94 @@
+#include <string.h>
+#include "adv_policy.h"
+
+// Apple's accessory guidelines: 20 ms for the first 30 s, then one of their
+// listed longer intervals (152.5, 211.25, ... 1022.5, 1285 ms)
+static const adv_tier_params_t tiers[ADV_TIER_COUNT] = {
+    // the controller paces high duty cycle directed advertising itself
+    [ADV_TIER_DIRECTED] = { .itvl_min = 0, .itvl_max = 0, .duration_ms = ADV_DIRECTED_MS },
+    [ADV_TIER_ACCEPT_LIST] = { .itvl_min = ADV_ITVL_MS(20), .itvl_max = ADV_ITVL_MS(30), .duration_ms = ADV_ACCEPT_LIST_WINDOW_MS },
+    [ADV_TIER_FAST] = { .itvl_min = ADV_ITVL_MS(20), .itvl_max = ADV_ITVL_MS(30), .duration_ms = ADV_FAST_WINDOW_MS },
+    [ADV_TIER_MEDIUM] = { .itvl_min = ADV_ITVL_MS(152.5), .itvl_max = ADV_ITVL_MS(211.25), .duration_ms = ADV_MEDIUM_WINDOW_MS },
+    [ADV_TIER_SLOW] = { .itvl_min = ADV_ITVL_MS(1022.5), .itvl_max = ADV_ITVL_MS(1285), .duration_ms = 0 },
+};
+
+static const char *tier_names[ADV_TIER_COUNT] = {
+    [ADV_TIER_DIRECTED] = "directed",
+    [ADV_TIER_ACCEPT_LIST] = "accept list",
+    [ADV_TIER_FAST] = "fast",
+    [ADV_TIER_MEDIUM] = "medium",
+    [ADV_TIER_SLOW] = "slow",
+};
+
+static const char *wake_names[ADV_WAKE_COUNT] = {
+    [ADV_WAKE_BOOT] = "boot",
+    [ADV_WAKE_DISCONNECT] = "disconnect",
+};
+
+const char *adv_tier_name(adv_tier_t tier) {
+    return tier_names[tier];
+}
+
+const char *adv_wake_name(adv_wake_t reason) {
+    return wake_names[reason];
+}
+
+void adv_policy_init(adv_policy_t *p, uint32_t fast_window_ms) {
+    memset(p, 0, sizeof(*p));
+    p->tier = ADV_TIER_SLOW; // until the first wake
+    p->fast_window_ms = fast_window_ms != 0 ? fast_window_ms : ADV_FAST_WINDOW_MS;
+}
+
+// Charges the time in the current tier
+static void close_tier(adv_policy_t *p, uint32_t now_ms) {
+    if (p->running) {
+        p->tier_ms[p->tier] += now_ms - p->tier_since_ms;
+    }
+}
+
+void adv_policy_wake(adv_policy_t *p, adv_wake_t reason, uint32_t now_ms, bool reconnect) {
+    close_tier(p, now_ms);
+    p->running = true;
+    p->tier = reconnect ? ADV_TIER_DIRECTED : ADV_TIER_FAST;
+    p->reason = reason;
+    p->wake_ms = now_ms;
+    p->tier_since_ms = now_ms;
+}
+
+adv_tier_params_t adv_policy_params(const adv_policy_t *p) {
+    if (!p->running) {
+        return tiers[ADV_TIER_SLOW];
+    }
+    adv_tier_params_t params = tiers[p->tier];
+    if (p->tier == ADV_TIER_FAST) {
+        params.duration_ms = p->fast_window_ms;
+    }
+    return params;
+}
+
+adv_tier_t adv_policy_on_timeout(adv_policy_t *p, uint32_t now_ms) {
+    close_tier(p, now_ms);
+    if (p->tier + 1 < ADV_TIER_COUNT) {
+        p->tier++;
+    }
+    p->tier_since_ms = now_ms;
+    return p->tier;
+}
+
+bool adv_policy_on_connect(adv_policy_t *p, uint32_t now_ms, uint32_t *ttc_ms) {
+    if (!p->running) {
+        return false;
+    }
+    close_tier(p, now_ms);
+    p->running = false;
+    uint32_t ttc = now_ms - p->wake_ms;
+    adv_ttc_t *t = &p->by_reason[p->reason];
+    t->connects++;
+    t->ttc_sum_ms += ttc;
+    if (ttc > t->ttc_max_ms) {
+        t->ttc_max_ms = ttc;
+    }
+    p->connects_in_tier[p->tier]++;
+    *ttc_ms = ttc;
+    return true;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Advertising interval policy: fast, then backing off.
+
+A wake event (boot or a disconnect) starts advertising in the fast tier,
+where a scanning phone finds the device within a scan window or two. Each
+tier lasts its duration and then steps down to the next, slower one; the
+last tier has no end. A connection ends the run and records the time to
+connect against the wake reason and the tier it happened in, so the windows
+can be tuned against idle current. No GAP dependency: events are fed in,
+interval and duration come out.
+
+A wake for a bonded peer that just left starts two tiers earlier: high duty
+cycle directed advertising to that peer, which the controller ends after
+1.28 s, then advertising that only takes connections from the accept list.
+Another phone cannot take the slot while the peer is on its way back; after
+those the run goes on as usual, open to anyone.
+*/
+
+// Advertising interval units (0.625 ms)
+#define ADV_ITVL_MS(ms) ((uint16_t)((ms) * 8 / 5))
+
+#define ADV_FAST_WINDOW_MS 30000   // default fast tier length
+#define ADV_MEDIUM_WINDOW_MS 120000
+#define ADV_DIRECTED_MS 1280        // high duty cycle directed advertising, fixed by the spec
+#define ADV_ACCEPT_LIST_WINDOW_MS 10000
+
+typedef enum {
+    ADV_TIER_DIRECTED,    // high duty cycle directed to the last peer, 3.75 ms or less
+    ADV_TIER_ACCEPT_LIST, // 20-30 ms, connections from bonded peers only
+    ADV_TIER_FAST,   // 20-30 ms
+    ADV_TIER_MEDIUM, // 152.5-211.25 ms
+    ADV_TIER_SLOW,   // 1022.5-1285 ms, until a connection
+    ADV_TIER_COUNT,
+} adv_tier_t;
+
+typedef enum {
+    ADV_WAKE_BOOT,
+    ADV_WAKE_DISCONNECT,
+    ADV_WAKE_COUNT,
+} adv_wake_t;
+
+typedef struct {
+    uint16_t itvl_min;    // 0.625 ms units
+    uint16_t itvl_max;
+    uint32_t duration_ms; // 0 = until stopped
+} adv_tier_params_t;
+
+typedef struct {
+    uint32_t connects;
+    uint32_t ttc_sum_ms; // time to connect, wake to connection
+    uint32_t ttc_max_ms;
+} adv_ttc_t;
+
+typedef struct {
+    bool running;          // a run is in progress, from a wake until a connection
+    adv_tier_t tier;
+    adv_wake_t reason;     // wake that started the run
+    uint32_t wake_ms;
+    uint32_t tier_since_ms;
+    uint32_t fast_window_ms;
+    adv_ttc_t by_reason[ADV_WAKE_COUNT];
+    uint32_t connects_in_tier[ADV_TIER_COUNT];
+    uint32_t tier_ms[ADV_TIER_COUNT]; // time spent advertising per tier, closed tiers only
+} adv_policy_t;
+
+const char *adv_tier_name(adv_tier_t tier);
+const char *adv_wake_name(adv_wake_t reason);
+
+// fast_window_ms of 0 selects ADV_FAST_WINDOW_MS.
+void adv_policy_init(adv_policy_t *p, uint32_t fast_window_ms);
+
+// Starts a new run in the fast tier, or in the directed tier if reconnect is
+// set (a bonded peer left). A wake during a run restarts it.
+void adv_policy_wake(adv_policy_t *p, adv_wake_t reason, uint32_t now_ms, bool reconnect);
+
+// Interval and duration for the current tier. Outside a run, e.g. to keep a
+// slot open while connected, the slow tier without end.
+adv_tier_params_t adv_policy_params(const adv_policy_t *p);
+
+// The current tier's duration elapsed without a connection: steps down one tier
+// and returns it.
+adv_tier_t adv_policy_on_timeout(adv_policy_t *p, uint32_t now_ms);
+
+// A central connected: records the time to connect into *ttc_ms and ends the
+// run. False if no run was in progress, e.g. a second central took the slot
+// kept open while connected.
+bool adv_policy_on_connect(adv_policy_t *p, uint32_t now_ms, uint32_t *ttc_ms);
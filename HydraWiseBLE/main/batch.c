@@ -0,0 +1,128 @@
+#include <string.h>
+#include "batch.h"
+#include "sample_codec.h"
+
+static inline void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static inline void put_le32(uint8_t *p, uint32_t v) {
+    put_le16(p, v & 0xffff);
+    put_le16(p + 2, v >> 16);
+}
+
+void batch_init(batch_t *b, uint8_t channel, uint16_t max_payload, uint32_t latency_cap_ms) {
+    memset(b, 0, sizeof(*b));
+    b->channel = channel;
+    b->latency_cap_ms = latency_cap_ms;
+    batch_set_max_payload(b, max_payload);
+}
+
+void batch_set_max_payload(batch_t *b, uint16_t max_payload) {
+    if (max_payload > BATCH_MAX_FRAME) {
+        max_payload = BATCH_MAX_FRAME;
+    }
+    if (max_payload < batch_frame_len(1)) {
+        max_payload = batch_frame_len(1);
+    }
+    b->max_payload = max_payload;
+}
+
+void batch_set_max_samples(batch_t *b, uint8_t max_samples) {
+    b->max_samples = max_samples;
+}
+
+void batch_set_codec(batch_t *b, batch_codec_t codec) {
+    b->codec = codec;
+}
+
+uint8_t batch_capacity(const batch_t *b) {
+    uint16_t sample_len = b->codec == BATCH_CODEC_DELTA ? CODEC_MIN_SAMPLE_LEN : BATCH_SAMPLE_LEN;
+    uint16_t n = (b->max_payload - BATCH_HDR_LEN) / sample_len;
+    if (b->max_samples != 0 && b->max_samples < n) {
+        n = b->max_samples;
+    }
+    return n > UINT8_MAX ? UINT8_MAX : n;
+}
+
+uint8_t batch_frame_samples(const batch_t *b, const sample_ring_t *ring) {
+    uint32_t queued = ring_count(ring);
+    uint8_t cap = batch_capacity(b);
+    uint8_t n = queued < cap ? queued : cap;
+    if (n == 0) {
+        return 0;
+    }
+    const sample_t *first = ring_peek(ring, 0);
+    for (uint8_t i = 1; i < n; i++) {
+        const sample_t *s = ring_peek(ring, i);
+        if (s->ts_ms - first->ts_ms > UINT16_MAX) {
+            return i;
+        }
+        if (b->channel == BATCH_CHANNEL_MIXED && s->channel != first->channel) {
+            return i;
+        }
+    }
+    return n;
+}
+
+bool batch_due(const batch_t *b, const sample_ring_t *ring, uint32_t now_ms) {
+    uint32_t queued = ring_count(ring);
+    if (queued == 0) {
+        return false;
+    }
+    if (queued >= batch_capacity(b)) {
+        return true;
+    }
+    return now_ms - ring_peek(ring, 0)->ts_ms >= b->latency_cap_ms;
+}
+
+uint16_t batch_frame_bound(const batch_t *b, uint8_t count) {
+    if (b->codec != BATCH_CODEC_DELTA) {
+        return batch_frame_len(count);
+    }
+    uint32_t bound = BATCH_HDR_LEN + (uint32_t)count * CODEC_MAX_SAMPLE_LEN;
+    return bound < b->max_payload ? bound : b->max_payload;
+}
+
+uint16_t batch_encode(const batch_t *b, const sample_ring_t *ring, uint8_t *count, uint8_t *dst) {
+    uint8_t n = *count;
+    uint32_t base = n ? ring_peek(ring, 0)->ts_ms : 0;
+    uint8_t channel = b->channel == BATCH_CHANNEL_MIXED && n ? ring_peek(ring, 0)->channel : b->channel;
+    put_le16(dst, b->seq);
+    put_le32(dst + 4, base);
+    uint8_t *p = dst + BATCH_HDR_LEN;
+    if (b->codec == BATCH_CODEC_DELTA) {
+        // as many as fit in the payload
+        codec_t c;
+        codec_init(&c, base);
+        uint16_t avail = batch_frame_bound(b, n) - BATCH_HDR_LEN;
+        uint8_t i;
+        for (i = 0; i < n; i++) {
+            uint16_t len = codec_put(&c, ring_peek(ring, i), false, p, avail);
+            if (len == 0) {
+                break;
+            }
+            p += len;
+            avail -= len;
+        }
+        n = i;
+        channel |= BATCH_FLAG_DELTA;
+    } else {
+        for (uint8_t i = 0; i < n; i++) {
+            const sample_t *s = ring_peek(ring, i);
+            put_le16(p, s->ts_ms - base);
+            put_le16(p + 2, s->value);
+            p += BATCH_SAMPLE_LEN;
+        }
+    }
+    dst[2] = n;
+    dst[3] = channel;
+    *count = n;
+    return p - dst;
+}
+
+void batch_commit(batch_t *b, sample_ring_t *ring, uint8_t count) {
+    ring_consume(ring, count);
+    b->seq++;
+}
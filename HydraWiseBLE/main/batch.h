@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sample_ring.h"
+
+/*
+Multi-sample notification frames.
+
+Frame layout (little endian):
+    0  uint16  sequence number, increments per frame and wraps
+    2  uint8   sample count
+    3  uint8   channel id
+    4  uint32  base timestamp in ms (timestamp of the first sample)
+    8  count x { uint16 offset_ms from base, uint16 value }
+
+With BATCH_CODEC_DELTA the channel id has BATCH_FLAG_DELTA set and the samples
+are delta coded (sample_codec.h, single-channel run starting at the base
+timestamp) instead, so the frame length no longer follows from the count.
+
+Samples wait in the channel's sample ring until a frame is sent. A frame is
+due when the ring holds enough samples to fill the negotiated ATT payload,
+or when the oldest sample has waited latency_cap_ms. The encoder peeks at the
+ring and writes straight into the caller's buffer; samples are only consumed
+by batch_commit() once the stack accepted the frame.
+*/
+
+#define BATCH_HDR_LEN 8
+#define BATCH_SAMPLE_LEN 4
+#define BATCH_MAX_FRAME 512 // largest ATT attribute value
+// Ring holds several channels: each frame carries one, taken from its first sample
+#define BATCH_CHANNEL_MIXED 0xff
+#define BATCH_FLAG_DELTA 0x80
+
+typedef enum {
+    BATCH_CODEC_RAW = 0,
+    BATCH_CODEC_DELTA = 1,
+} batch_codec_t;
+
+typedef struct {
+    uint16_t seq;           // sequence number of the next frame
+    uint8_t channel;
+    uint16_t max_payload;   // ATT payload limit, MTU - 3
+    uint8_t max_samples;    // client cap on samples per frame, 0 = fill the payload
+    uint8_t codec;          // batch_codec_t
+    uint32_t latency_cap_ms;
+} batch_t;
+
+void batch_init(batch_t *b, uint8_t channel, uint16_t max_payload, uint32_t latency_cap_ms);
+
+// Clamp the frame size to the current ATT payload (MTU - 3).
+void batch_set_max_payload(batch_t *b, uint16_t max_payload);
+
+// Cap the samples per frame below what the payload allows; 0 removes the cap.
+void batch_set_max_samples(batch_t *b, uint8_t max_samples);
+
+void batch_set_codec(batch_t *b, batch_codec_t codec);
+
+// Samples that fit in one frame at the current payload size and sample cap.
+// For delta frames this assumes the best case, the encoder may fit fewer.
+uint8_t batch_capacity(const batch_t *b);
+
+// Length of a raw frame
+static inline uint16_t batch_frame_len(uint8_t count) {
+    return BATCH_HDR_LEN + count * BATCH_SAMPLE_LEN;
+}
+
+// Buffer batch_encode() needs for up to count samples
+uint16_t batch_frame_bound(const batch_t *b, uint8_t count);
+
+// Samples the next frame would carry: bounded by capacity, by the 16-bit
+// offset range from the first sample and, for a mixed ring, by a channel change.
+uint8_t batch_frame_samples(const batch_t *b, const sample_ring_t *ring);
+
+// True if a frame must be sent: a full frame is queued, or the oldest queued
+// sample is older than the latency cap.
+bool batch_due(const batch_t *b, const sample_ring_t *ring, uint32_t now_ms);
+
+// Encodes up to *count queued samples into dst, which must hold
+// batch_frame_bound(*count) bytes, and sets *count to the samples encoded.
+// Returns the frame length. Does not consume from the ring.
+uint16_t batch_encode(const batch_t *b, const sample_ring_t *ring, uint8_t *count, uint8_t *dst);
+
+// Consumes `count` samples after their frame was accepted by the stack.
+void batch_commit(batch_t *b, sample_ring_t *ring, uint8_t count);
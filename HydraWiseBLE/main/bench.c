@@ -0,0 +1,101 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "bench.h"
+#include "stream.h"
+#include "l2cap_bulk.h"
+#include "batch.h"
+
+static const char *TAG = "bench";
+
+static bool running = false;
+static uint8_t transport;
+static uint8_t bench_chr;
+static uint16_t bench_handle;
+static int64_t start_us, end_us;
+static uint32_t frames, bytes, pushed_back;
+static uint8_t frame[BATCH_MAX_FRAME];
+
+static inline void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+}
+
+// Largest frame the transport takes right now, 0 without a listener
+static uint16_t frame_len(void) {
+    uint16_t len = transport == BENCH_L2CAP ? l2cap_bulk_mtu() : peers_payload(bench_chr);
+    return len > sizeof(frame) ? sizeof(frame) : len;
+}
+
+bool bench_start(uint8_t t, uint16_t seconds, uint8_t chr, uint16_t attr_handle) {
+    if (running || t > BENCH_L2CAP) {
+        return false;
+    }
+    transport = t;
+    bench_chr = chr;
+    bench_handle = attr_handle;
+    uint16_t len = frame_len();
+    if (len < sizeof(uint32_t)) {
+        ESP_LOGW(TAG, "No %s listener, benchmark not started", t == BENCH_L2CAP ? "L2CAP" : "GATT");
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(frame); i++) {
+        frame[i] = i;
+    }
+    frames = bytes = pushed_back = 0;
+    start_us = esp_timer_get_time();
+    end_us = start_us + (int64_t)seconds * 1000000;
+    running = true;
+    ESP_LOGI(TAG, "%s benchmark for %u s, %u byte frames", t == BENCH_L2CAP ? "L2CAP" : "GATT", seconds, len);
+    return true;
+}
+
+bool bench_running(void) {
+    return running;
+}
+
+static void bench_end(const char *why) {
+    running = false;
+    int64_t us = esp_timer_get_time() - start_us;
+    uint32_t kbps = us > 0 ? (uint32_t)((uint64_t)bytes * 8000 / us) : 0;
+    ESP_LOGI(TAG, "%s benchmark %s: %lu bytes in %lu frames over %lld ms, %lu kbit/s, pushed back %lu times",
+        transport == BENCH_L2CAP ? "L2CAP" : "GATT", why, (unsigned long)bytes, (unsigned long)frames,
+        (long long)(us / 1000), (unsigned long)kbps, (unsigned long)pushed_back);
+}
+
+// Frames the stack took but has not passed on yet: notifications still in the
+// host, or an SDU held for want of credits
+static bool transport_holds(void) {
+    return transport == BENCH_L2CAP ? l2cap_bulk_connected() && l2cap_bulk_stalled() : peers_in_flight(bench_chr);
+}
+
+void bench_run(void) {
+    if (!running) {
+        return;
+    }
+    while (esp_timer_get_time() < end_us) {
+        uint16_t len = frame_len();
+        if (len < sizeof(uint32_t)) {
+            bench_end("aborted"); // the listener went away
+            return;
+        }
+        put_le32(frame, frames);
+        bool sent = transport == BENCH_L2CAP ?
+            l2cap_bulk_ready() && l2cap_bulk_send(frame, len) == 0 :
+            stream_notify_frame(bench_chr, bench_handle, frame, len);
+        if (!sent) {
+            pushed_back++;
+            return; // a reopened flow window or TX_UNSTALLED resumes the run
+        }
+        frames++;
+        bytes += len;
+    }
+    // time's up: the run ends when the last frame has left the host, not when
+    // it was handed over
+    if (transport_holds() && frame_len() >= sizeof(uint32_t)) {
+        return;
+    }
+    bench_end("complete");
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Throughput benchmark, GATT notifications against the L2CAP bulk channel.
+
+Started with the BENCH control command (ctrl_proto.h). For the given number of
+seconds the scheduler task sends filler frames as fast as the transport takes
+them: MTU-sized notifications on the sample log characteristic, gated by the
+peer's flow window, or SDUs of the peer's CoC MTU, gated by its credits. Each
+frame starts with a uint32 sequence number (little endian) and is otherwise
+filler, so the client only counts them. The result (bytes, frames, kbit/s) is
+logged when the run ends: once the time is up and the last frame left the host
+(released to the controller, or the held SDU went out on new credits), so
+frames still queued in the stack do not inflate it. Payload bytes are counted
+once per frame, not per subscriber. Over the air the client's own count is the
+reference; the simulation checks the rate at the receiver (sim_bench_* tests).
+
+No backfill runs alongside a benchmark, both use the same characteristic.
+*/
+
+typedef enum {
+    BENCH_GATT = 0,
+    BENCH_L2CAP = 1,
+} bench_transport_t;
+
+// Starts a run; false if one is running or the transport has no listener
+bool bench_start(uint8_t transport, uint16_t seconds, uint8_t chr, uint16_t attr_handle);
+
+bool bench_running(void);
+
+// Sends until the transport pushes back, ends the run when its time is up.
+// Scheduler task only.
+void bench_run(void);
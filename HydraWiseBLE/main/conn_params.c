@@ -0,0 +1,166 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "host/ble_hs.h"
+#include "conn_params.h"
+#include "conn_table.h"
+
+static const char *TAG = "conn_params";
+
+typedef struct {
+    bool in_use;
+    uint16_t conn_handle;
+    conn_policy_t policy;
+} conn_params_entry_t;
+
+static conn_params_entry_t entries[CONN_TABLE_MAX];
+static portMUX_TYPE entries_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t retry_timer;
+
+static uint32_t now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static conn_params_entry_t *find(uint16_t conn_handle) {
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        if (entries[i].in_use && entries[i].conn_handle == conn_handle) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Issue every request the policies want now, then arm the timer for the earliest retry
+static void evaluate(void) {
+    uint16_t handles[CONN_TABLE_MAX];
+    conn_params_t reqs[CONN_TABLE_MAX];
+    int n = 0;
+    uint32_t now = now_ms();
+
+    taskENTER_CRITICAL(&entries_lock);
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        if (entries[i].in_use && conn_policy_next(&entries[i].policy, now, &reqs[n])) {
+            handles[n++] = entries[i].conn_handle;
+        }
+    }
+    taskEXIT_CRITICAL(&entries_lock);
+
+    for (int i = 0; i < n; i++) {
+        struct ble_gap_upd_params params = {
+            .itvl_min = reqs[i].itvl_min,
+            .itvl_max = reqs[i].itvl_max,
+            .latency = reqs[i].latency,
+            .supervision_timeout = reqs[i].supervision_timeout,
+        };
+        int rc = ble_gap_update_params(handles[i], &params);
+        ESP_LOGI(TAG, "Conn %u: requesting itvl %u-%u, latency %u, timeout %u (rc %d)",
+            handles[i], params.itvl_min, params.itvl_max, params.latency, params.supervision_timeout, rc);
+        if (rc != 0) {
+            taskENTER_CRITICAL(&entries_lock);
+            conn_params_entry_t *e = find(handles[i]);
+            if (e != NULL) {
+                conn_policy_on_start_failed(&e->policy, now);
+            }
+            taskEXIT_CRITICAL(&entries_lock);
+        }
+    }
+
+    bool any = false;
+    uint32_t earliest = 0;
+    taskENTER_CRITICAL(&entries_lock);
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        uint32_t at;
+        if (entries[i].in_use && conn_policy_retry_time(&entries[i].policy, &at)) {
+            if (!any || (int32_t)(at - earliest) < 0) {
+                earliest = at;
+            }
+            any = true;
+        }
+    }
+    taskEXIT_CRITICAL(&entries_lock);
+
+    esp_timer_stop(retry_timer);
+    if (any) {
+        int32_t wait = (int32_t)(earliest - now_ms());
+        esp_timer_start_once(retry_timer, (wait > 0 ? wait : 1) * 1000ULL);
+    }
+}
+
+static void retry_timer_cb(void *arg) {
+    evaluate();
+}
+
+void conn_params_init(void) {
+    const esp_timer_create_args_t args = {
+        .callback = retry_timer_cb,
+        .name = "conn_params",
+    };
+    esp_timer_create(&args, &retry_timer);
+}
+
+void conn_params_on_connect(uint16_t conn_handle, conn_profile_t profile) {
+    struct ble_gap_conn_desc desc;
+    if (ble_gap_conn_find(conn_handle, &desc) != 0) {
+        return;
+    }
+    ESP_LOGI(TAG, "Conn %u: central picked itvl %u (x1.25 ms), latency %u, timeout %u (x10 ms)",
+        conn_handle, desc.conn_itvl, desc.conn_latency, desc.supervision_timeout);
+    taskENTER_CRITICAL(&entries_lock);
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        if (!entries[i].in_use) {
+            entries[i].in_use = true;
+            entries[i].conn_handle = conn_handle;
+            conn_policy_init(&entries[i].policy, desc.conn_itvl, desc.conn_latency, desc.supervision_timeout);
+            conn_policy_want(&entries[i].policy, profile);
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&entries_lock);
+    evaluate();
+}
+
+void conn_params_on_disconnect(uint16_t conn_handle) {
+    taskENTER_CRITICAL(&entries_lock);
+    conn_params_entry_t *e = find(conn_handle);
+    conn_policy_t policy;
+    if (e != NULL) {
+        policy = e->policy;
+        e->in_use = false;
+    }
+    taskEXIT_CRITICAL(&entries_lock);
+    if (e != NULL) {
+        ESP_LOGI(TAG, "Conn %u: %lu requests, %lu granted, %lu rejected", conn_handle,
+            (unsigned long)policy.requests, (unsigned long)policy.granted, (unsigned long)policy.rejected);
+    }
+}
+
+void conn_params_on_update(uint16_t conn_handle, int status) {
+    struct ble_gap_conn_desc desc = { 0 };
+    if (status == 0 && ble_gap_conn_find(conn_handle, &desc) == 0) {
+        ESP_LOGI(TAG, "Conn %u: granted itvl %u (x1.25 ms), latency %u, timeout %u (x10 ms)",
+            conn_handle, desc.conn_itvl, desc.conn_latency, desc.supervision_timeout);
+    } else {
+        ESP_LOGW(TAG, "Conn %u: parameter update rejected (status %d)", conn_handle, status);
+        status = status ? status : BLE_HS_ENOTCONN;
+    }
+    taskENTER_CRITICAL(&entries_lock);
+    conn_params_entry_t *e = find(conn_handle);
+    if (e != NULL) {
+        conn_policy_on_update(&e->policy, status, now_ms(), desc.conn_itvl, desc.conn_latency, desc.supervision_timeout);
+    }
+    taskEXIT_CRITICAL(&entries_lock);
+    evaluate();
+}
+
+void conn_params_set_profile(conn_profile_t profile) {
+    taskENTER_CRITICAL(&entries_lock);
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        if (entries[i].in_use) {
+            conn_policy_want(&entries[i].policy, profile);
+        }
+    }
+    taskEXIT_CRITICAL(&entries_lock);
+    ESP_LOGI(TAG, "Connection profile: %s", conn_profile_name(profile));
+    evaluate();
+}
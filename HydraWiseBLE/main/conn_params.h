@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+#include "conn_policy.h"
+
+/*
+Drives conn_policy for every connection against the NimBLE GAP: issues
+ble_gap_update_params, feeds BLE_GAP_EVENT_CONN_UPDATE results back, logs
+the parameters actually granted and retries after backoff from an esp_timer.
+*/
+
+void conn_params_init(void);
+void conn_params_on_connect(uint16_t conn_handle, conn_profile_t profile);
+void conn_params_on_disconnect(uint16_t conn_handle);
+void conn_params_on_update(uint16_t conn_handle, int status);
+
+// Wanted profile for every connection, e.g. on START/STOP
+void conn_params_set_profile(conn_profile_t profile);
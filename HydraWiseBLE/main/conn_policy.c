@@ -0,0 +1,137 @@
+#include <string.h>
+#include "conn_policy.h"
+
+// Ranges chosen to satisfy common phone constraints: min >= 15 ms except for
+// backfill, max * (latency + 1) <= 2 s, timeout > 3 * max * (latency + 1)
+static const conn_params_t profiles[CONN_PROFILE_COUNT] = {
+    [CONN_PROFILE_IDLE] = { .itvl_min = 80, .itvl_max = 160, .latency = 4, .supervision_timeout = 600 },     // 100-200 ms
+    [CONN_PROFILE_STREAMING] = { .itvl_min = 12, .itvl_max = 24, .latency = 0, .supervision_timeout = 400 }, // 15-30 ms
+    [CONN_PROFILE_BACKFILL] = { .itvl_min = 6, .itvl_max = 12, .latency = 0, .supervision_timeout = 400 },   // 7.5-15 ms
+};
+
+static const char *profile_names[CONN_PROFILE_COUNT] = {
+    [CONN_PROFILE_IDLE] = "idle",
+    [CONN_PROFILE_STREAMING] = "streaming",
+    [CONN_PROFILE_BACKFILL] = "backfill",
+};
+
+#define ITVL_MAX_ALLOWED 3200 // 4 s, spec limit
+
+const conn_params_t *conn_profile_params(conn_profile_t profile) {
+    return &profiles[profile];
+}
+
+const char *conn_profile_name(conn_profile_t profile) {
+    return profile_names[profile];
+}
+
+void conn_policy_init(conn_policy_t *p, uint16_t itvl, uint16_t latency, uint16_t timeout) {
+    memset(p, 0, sizeof(*p));
+    p->want = CONN_PROFILE_IDLE;
+    p->current.itvl_min = itvl;
+    p->current.itvl_max = itvl;
+    p->current.latency = latency;
+    p->current.supervision_timeout = timeout;
+}
+
+void conn_policy_want(conn_policy_t *p, conn_profile_t profile) {
+    if (profile == p->want) {
+        return;
+    }
+    p->want = profile;
+    p->rejects = 0;
+    p->retry_at_ms = 0;
+}
+
+// Wanted range, widened by one profile width per rejection so far
+static conn_params_t widened(const conn_policy_t *p) {
+    conn_params_t req = profiles[p->want];
+    uint8_t steps = p->rejects < CONN_POLICY_MAX_WIDEN ? p->rejects : CONN_POLICY_MAX_WIDEN;
+    uint32_t max = req.itvl_max + (uint32_t)steps * req.itvl_max;
+    req.itvl_max = max > ITVL_MAX_ALLOWED ? ITVL_MAX_ALLOWED : max;
+    // keep the supervision timeout comfortably above the widest connection event gap
+    uint32_t min_timeout = (uint32_t)req.itvl_max * (req.latency + 1) * 125 * 3 / 1000 + 1; // 1.25 ms -> 10 ms units
+    if (req.supervision_timeout < min_timeout) {
+        req.supervision_timeout = min_timeout > 3200 ? 3200 : min_timeout;
+    }
+    return req;
+}
+
+// While data flows a faster interval than asked for only costs power the central
+// chose to spend, so only the slow side counts, plus how long a lost link may go
+// unnoticed. Idle is there to save that power: a link left fast by streaming or
+// backfill is slowed down.
+bool conn_policy_satisfied(const conn_policy_t *p) {
+    const conn_params_t *want = &profiles[p->want];
+    conn_params_t range = widened(p);
+    if (p->want == CONN_PROFILE_IDLE && p->current.itvl_min < want->itvl_min) {
+        return false;
+    }
+    return p->current.itvl_min <= range.itvl_max &&
+           p->current.latency <= want->latency &&
+           p->current.supervision_timeout <= range.supervision_timeout;
+}
+
+bool conn_policy_next(conn_policy_t *p, uint32_t now_ms, conn_params_t *req) {
+    if (p->pending || conn_policy_satisfied(p)) {
+        return false;
+    }
+    if (p->retry_at_ms != 0 && (int32_t)(now_ms - p->retry_at_ms) < 0) {
+        return false;
+    }
+    *req = widened(p);
+    p->pending = true;
+    p->requests++;
+    return true;
+}
+
+static void backoff(conn_policy_t *p, uint32_t now_ms) {
+    uint8_t shift = p->rejects < 5 ? p->rejects : 5;
+    uint32_t delay = CONN_POLICY_BACKOFF_MS << shift;
+    if (delay > CONN_POLICY_BACKOFF_MAX_MS) {
+        delay = CONN_POLICY_BACKOFF_MAX_MS;
+    }
+    p->retry_at_ms = (now_ms + delay) | 1; // 0 means "no backoff"
+}
+
+void conn_policy_on_start_failed(conn_policy_t *p, uint32_t now_ms) {
+    p->pending = false;
+    backoff(p, now_ms);
+}
+
+void conn_policy_on_update(conn_policy_t *p, int status, uint32_t now_ms,
+    uint16_t itvl, uint16_t latency, uint16_t timeout) {
+    bool was_pending = p->pending;
+    p->pending = false;
+    if (status == 0) {
+        p->current.itvl_min = itvl;
+        p->current.itvl_max = itvl;
+        p->current.latency = latency;
+        p->current.supervision_timeout = timeout;
+        if (conn_policy_satisfied(p)) {
+            p->granted += was_pending;
+            p->rejects = 0;
+            p->retry_at_ms = 0;
+            return;
+        }
+        if (!was_pending) {
+            // the central moved on its own; do not fight it immediately
+            backoff(p, now_ms);
+            return;
+        }
+    }
+    // rejected, or granted something outside the range
+    p->rejected++;
+    if (p->rejects < UINT8_MAX) {
+        p->rejects++;
+    }
+    backoff(p, now_ms);
+}
+
+bool conn_policy_retry_time(const conn_policy_t *p, uint32_t *at_ms) {
+    if (p->pending || conn_policy_satisfied(p)) {
+        return false;
+    }
+    *at_ms = p->retry_at_ms;
+    return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Connection-parameter policy for one peer.
+
+The application says which profile it wants (idle, streaming, backfill); the
+policy decides when to ask the central for it and with what range. A request
+is only issued when the parameters in effect fall outside the profile, never
+while one is pending, and after a rejection only once a backoff has elapsed.
+Each rejection widens the requested interval range so a strict central
+(phones often insist on their own limits) has something it can accept.
+No GAP dependency: results are fed in, requests come out.
+*/
+
+typedef enum {
+    CONN_PROFILE_IDLE,
+    CONN_PROFILE_STREAMING,
+    CONN_PROFILE_BACKFILL,
+    CONN_PROFILE_COUNT,
+} conn_profile_t;
+
+// Units as on air: interval 1.25 ms, supervision timeout 10 ms
+typedef struct {
+    uint16_t itvl_min;
+    uint16_t itvl_max;
+    uint16_t latency;
+    uint16_t supervision_timeout;
+} conn_params_t;
+
+#define CONN_POLICY_MAX_WIDEN 3         // rejections after which the range stops widening
+#define CONN_POLICY_BACKOFF_MS 1000     // first retry delay, doubles per rejection
+#define CONN_POLICY_BACKOFF_MAX_MS 30000
+
+typedef struct {
+    conn_profile_t want;
+    bool pending;          // an update procedure is in flight
+    uint8_t rejects;       // consecutive failures while chasing `want`
+    uint32_t retry_at_ms;  // earliest time for the next request
+    conn_params_t current; // parameters in effect (itvl_min == itvl_max == interval)
+    uint32_t requests;
+    uint32_t granted;
+    uint32_t rejected;
+} conn_policy_t;
+
+const conn_params_t *conn_profile_params(conn_profile_t profile);
+const char *conn_profile_name(conn_profile_t profile);
+
+// New connection with the parameters the central picked
+void conn_policy_init(conn_policy_t *p, uint16_t itvl, uint16_t latency, uint16_t timeout);
+
+// Changing the wanted profile clears the rejection history.
+void conn_policy_want(conn_policy_t *p, conn_profile_t profile);
+
+// True if the current parameters satisfy the wanted profile: interval no slower
+// than the (widened) range, and for idle no faster than it either; peripheral
+// latency and supervision timeout no larger
+bool conn_policy_satisfied(const conn_policy_t *p);
+
+// Returns true and fills *req if a request should be sent now; marks it pending.
+bool conn_policy_next(conn_policy_t *p, uint32_t now_ms, conn_params_t *req);
+
+// A request could not even be started (e.g. BLE_HS_EBUSY): retry after backoff.
+void conn_policy_on_start_failed(conn_policy_t *p, uint32_t now_ms);
+
+// BLE_GAP_EVENT_CONN_UPDATE. On success pass the parameters now in effect.
+// Also called for updates the central made on its own.
+void conn_policy_on_update(conn_policy_t *p, int status, uint32_t now_ms,
+    uint16_t itvl, uint16_t latency, uint16_t timeout);
+
+// When conn_policy_next() may next return true; false if nothing is waiting.
+bool conn_policy_retry_time(const conn_policy_t *p, uint32_t *at_ms);
@@ -0,0 +1,102 @@
+#include <string.h>
+#include "conn_table.h"
+
+void conn_table_init(conn_table_t *t, uint8_t window_min, uint8_t window_max, uint8_t window_init) {
+    memset(t, 0, sizeof(*t));
+    flow_init(&t->flow_template, window_min, window_max, window_init);
+}
+
+peer_t *conn_add(conn_table_t *t, uint16_t conn_handle) {
+    peer_t *p = conn_find(t, conn_handle);
+    if (p != NULL) {
+        return p;
+    }
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        p = &t->peers[i];
+        if (!p->in_use) {
+            memset(p, 0, sizeof(*p));
+            p->in_use = true;
+            p->conn_handle = conn_handle;
+            p->flow = t->flow_template;
+            p->mtu = CONN_ATT_MTU_DFLT;
+            p->ll_tx_octets = CONN_LL_OCTETS_DFLT;
+            t->count++;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+void conn_remove(conn_table_t *t, uint16_t conn_handle) {
+    peer_t *p = conn_find(t, conn_handle);
+    if (p != NULL) {
+        p->in_use = false;
+        t->count--;
+    }
+}
+
+peer_t *conn_find(conn_table_t *t, uint16_t conn_handle) {
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        if (t->peers[i].in_use && t->peers[i].conn_handle == conn_handle) {
+            return &t->peers[i];
+        }
+    }
+    return NULL;
+}
+
+void conn_set_subscribed(peer_t *p, uint8_t chr, bool on) {
+    if (on) {
+        p->subscribed |= 1u << chr;
+    } else {
+        p->subscribed &= ~(1u << chr);
+    }
+}
+
+uint8_t conn_subscribers(conn_table_t *t, uint8_t chr, uint16_t *handles, bool *blocked) {
+    uint8_t n = 0;
+    if (blocked != NULL) {
+        *blocked = false;
+    }
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        peer_t *p = &t->peers[i];
+        if (!p->in_use || !(p->subscribed & (1u << chr))) {
+            continue;
+        }
+        if (blocked != NULL && !flow_can_send(&p->flow)) {
+            *blocked = true;
+        }
+        handles[n++] = p->conn_handle;
+    }
+    return n;
+}
+
+uint16_t conn_frame_payload(uint16_t mtu, uint16_t ll_tx_octets) {
+    const uint16_t hdr = CONN_L2CAP_HDR_LEN + CONN_ATT_NOTIFY_HDR_LEN;
+    if (mtu < CONN_ATT_MTU_DFLT) {
+        mtu = CONN_ATT_MTU_DFLT;
+    }
+    uint16_t max_value = mtu - CONN_ATT_NOTIFY_HDR_LEN;
+    if (ll_tx_octets <= hdr) {
+        return max_value;
+    }
+    uint16_t packets = (max_value + hdr) / ll_tx_octets;
+    if (packets == 0) {
+        return max_value; // MTU smaller than one LL packet
+    }
+    return packets * ll_tx_octets - hdr;
+}
+
+uint16_t conn_subscribers_payload(conn_table_t *t, uint8_t chr, uint16_t limit) {
+    uint16_t payload = limit;
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        peer_t *p = &t->peers[i];
+        if (!p->in_use || !(p->subscribed & (1u << chr))) {
+            continue;
+        }
+        uint16_t fit = conn_frame_payload(p->mtu, p->ll_tx_octets);
+        if (fit < payload) {
+            payload = fit;
+        }
+    }
+    return payload;
+}
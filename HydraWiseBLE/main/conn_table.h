@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "flow_ctl.h"
+
+/*
+Table of connected peers.
+
+Each peer has its connection handle, a bitmask of the characteristics it has
+enabled notifications on (from BLE_GAP_EVENT_SUBSCRIBE), its own notify flow
+window, and the negotiated ATT MTU and LL TX data length that size its
+frames. Not thread safe; the caller serializes.
+*/
+
+#ifdef CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#define CONN_TABLE_MAX CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#else
+#define CONN_TABLE_MAX 3
+#endif
+
+#define CONN_ATT_MTU_DFLT 23     // until BLE_GAP_EVENT_MTU
+#define CONN_LL_OCTETS_DFLT 27   // until the data length changes
+#define CONN_LL_OCTETS_MAX 251
+#define CONN_L2CAP_HDR_LEN 4
+#define CONN_ATT_NOTIFY_HDR_LEN 3
+
+typedef struct {
+    bool in_use;
+    uint16_t conn_handle;
+    uint32_t subscribed; // bit n set = notifications enabled on characteristic n
+    flow_ctl_t flow;
+    uint16_t mtu;          // ATT MTU
+    uint16_t ll_tx_octets; // LL payload per packet towards the peer
+} peer_t;
+
+typedef struct {
+    peer_t peers[CONN_TABLE_MAX];
+    uint8_t count;
+    flow_ctl_t flow_template; // window settings copied into every new peer
+} conn_table_t;
+
+void conn_table_init(conn_table_t *t, uint8_t window_min, uint8_t window_max, uint8_t window_init);
+
+// Adds a peer with no subscriptions and an empty window. NULL if the table is full.
+peer_t *conn_add(conn_table_t *t, uint16_t conn_handle);
+void conn_remove(conn_table_t *t, uint16_t conn_handle);
+peer_t *conn_find(conn_table_t *t, uint16_t conn_handle);
+
+void conn_set_subscribed(peer_t *p, uint8_t chr, bool on);
+
+// Largest notification value for this peer that fits the ATT MTU and fills
+// whole LL packets: L2CAP + ATT headers + value is a multiple of the LL TX
+// length, so a frame never spills a few bytes into an extra packet.
+uint16_t conn_frame_payload(uint16_t mtu, uint16_t ll_tx_octets);
+
+// Smallest conn_frame_payload() among the peers subscribed to `chr`, capped
+// at `limit`. Frames are encoded once for all of them.
+uint16_t conn_subscribers_payload(conn_table_t *t, uint8_t chr, uint16_t limit);
+
+// Writes the handles of peers subscribed to `chr` into `handles` (room for
+// CONN_TABLE_MAX) and returns how many there are. If `blocked` is not NULL
+// it is set when any of them has a full flow window, in which case nothing
+// should be sent.
+uint8_t conn_subscribers(conn_table_t *t, uint8_t chr, uint16_t *handles, bool *blocked);
@@ -0,0 +1,216 @@
+#include <string.h>
+#include "ctrl_proto.h"
+
+typedef struct {
+    const ctrl_src_t *src;
+    const uint8_t *p;
+    const uint8_t *end;
+} cursor_t;
+
+static void cursor_start(cursor_t *c, const ctrl_src_t *src) {
+    c->src = src;
+    c->p = c->end = NULL;
+    src->rewind(src->ctx);
+}
+
+static bool cursor_byte(cursor_t *c, uint8_t *out) {
+    while (c->p == c->end) {
+        uint16_t len;
+        if (!c->src->next(c->src->ctx, &c->p, &len)) {
+            return false;
+        }
+        c->end = c->p + len;
+    }
+    *out = *c->p++;
+    return true;
+}
+
+// Little-endian value of `len` bytes (at most 4)
+static bool cursor_le(cursor_t *c, uint8_t len, uint32_t *out) {
+    uint32_t v = 0;
+    for (uint8_t i = 0; i < len; i++) {
+        uint8_t b;
+        if (!cursor_byte(c, &b)) {
+            return false;
+        }
+        v |= (uint32_t)b << (8 * i);
+    }
+    *out = v;
+    return true;
+}
+
+static bool cursor_skip(cursor_t *c, uint8_t len) {
+    uint8_t b;
+    while (len--) {
+        if (!cursor_byte(c, &b)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Checks the value length of known opcodes; unknown ones are always accepted
+static bool value_len_ok(uint8_t op, uint8_t len, bool *known) {
+    *known = true;
+    switch (op) {
+        case CTRL_OP_START:
+        case CTRL_OP_STOP:
+            return len == 0 || len == 1;
+        case CTRL_OP_SET_RATE:
+            return len == 3;
+        case CTRL_OP_SET_BATCH:
+            return len == 2;
+        case CTRL_OP_BACKFILL:
+            return len == 0 || len == 4;
+        case CTRL_OP_BENCH:
+            return len == 3;
+        case CTRL_OP_SET_CODEC:
+            return len == 2;
+        case CTRL_OP_BROADCAST:
+            return len == 1;
+        default:
+            *known = false;
+            return true;
+    }
+}
+
+// Legacy ASCII write, compared in place against both keywords at once. Stops at
+// the first byte that fits neither, the first one for any binary write.
+// Returns the opcode, 0 if the write is not a keyword.
+static uint8_t legacy_keyword(const ctrl_src_t *src) {
+    static const struct { const char *word; uint8_t op; } words[] = {
+        { "START", CTRL_OP_START },
+        { "STOP", CTRL_OP_STOP },
+    };
+    bool alive[2] = { true, true };
+    cursor_t c;
+    cursor_start(&c, src);
+    uint8_t b;
+    size_t i = 0;
+    while (cursor_byte(&c, &b)) {
+        bool any = false;
+        for (int w = 0; w < 2; w++) {
+            alive[w] = alive[w] && words[w].word[i] != '\0' && words[w].word[i] == (char)b;
+            any |= alive[w];
+        }
+        if (!any) {
+            return 0;
+        }
+        i++;
+    }
+    for (int w = 0; w < 2; w++) {
+        if (alive[w] && words[w].word[i] == '\0') {
+            return words[w].op;
+        }
+    }
+    return 0;
+}
+
+// Pass 1 checked every operand length, so the reads below cannot run short
+static void decode(cursor_t *c, uint8_t op, uint8_t len, ctrl_cmd_t *cmd) {
+    uint32_t v = 0;
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->op = op;
+    switch (op) {
+        case CTRL_OP_START:
+        case CTRL_OP_STOP:
+            cmd->channels = CTRL_ALL_CHANNELS;
+            if (len == 1 && cursor_le(c, 1, &v)) {
+                cmd->channels = v;
+            }
+            break;
+        case CTRL_OP_SET_RATE:
+            cursor_le(c, 1, &v);
+            cmd->channel = v;
+            cursor_le(c, 2, &v);
+            cmd->period_ms = v;
+            break;
+        case CTRL_OP_SET_BATCH:
+            cursor_le(c, 1, &v);
+            cmd->channel = v;
+            cursor_le(c, 1, &v);
+            cmd->batch_samples = v;
+            break;
+        case CTRL_OP_BACKFILL:
+            if (len == 4 && cursor_le(c, 4, &v)) {
+                cmd->since_ms = v;
+            }
+            break;
+        case CTRL_OP_BENCH:
+            cursor_le(c, 1, &v);
+            cmd->transport = v;
+            cursor_le(c, 2, &v);
+            cmd->seconds = v;
+            break;
+        case CTRL_OP_SET_CODEC:
+            cursor_le(c, 1, &v);
+            cmd->channel = v;
+            cursor_le(c, 1, &v);
+            cmd->codec = v;
+            break;
+        case CTRL_OP_BROADCAST:
+            cursor_le(c, 1, &v);
+            cmd->broadcast = v != 0;
+            break;
+    }
+}
+
+ctrl_status_t ctrl_parse(const ctrl_src_t *src, ctrl_cmd_fn fn, void *arg, ctrl_result_t *result) {
+    ctrl_result_t res = { 0 };
+    ctrl_cmd_t cmd;
+
+    uint8_t legacy = legacy_keyword(src);
+    if (legacy != 0) {
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.op = legacy;
+        cmd.channels = CTRL_ALL_CHANNELS;
+        fn(&cmd, arg);
+        res.commands = 1;
+        if (result) {
+            *result = res;
+        }
+        return CTRL_OK;
+    }
+
+    // pass 1: structure only
+    cursor_t c;
+    cursor_start(&c, src);
+    uint8_t op, len;
+    bool any = false;
+    while (cursor_byte(&c, &op)) {
+        bool known;
+        if (!cursor_byte(&c, &len)) {
+            return CTRL_ERR_TRUNCATED;
+        }
+        if (!value_len_ok(op, len, &known)) {
+            return CTRL_ERR_BAD_VALUE;
+        }
+        if (!cursor_skip(&c, len)) {
+            return CTRL_ERR_TRUNCATED;
+        }
+        any = true;
+    }
+    if (!any) {
+        return CTRL_ERR_EMPTY;
+    }
+
+    // pass 2: apply
+    cursor_start(&c, src);
+    while (cursor_byte(&c, &op)) {
+        bool known;
+        cursor_byte(&c, &len);
+        value_len_ok(op, len, &known);
+        if (!known) {
+            cursor_skip(&c, len);
+            res.unknown++;
+            continue;
+        }
+        decode(&c, op, len, &cmd);
+        fn(&cmd, arg);
+        res.commands++;
+    }
+    if (result) {
+        *result = res;
+    }
+    return CTRL_OK;
+}
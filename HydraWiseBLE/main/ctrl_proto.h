@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Binary control protocol for the command characteristic.
+
+A write carries one or more TLV records:
+    uint8 opcode, uint8 length, length bytes of value (little endian)
+
+    0x01 START      [uint8 channel mask]       mask omitted = every channel
+    0x02 STOP       [uint8 channel mask]
+    0x03 SET_RATE   uint8 channel, uint16 notification period in ms
+    0x04 SET_BATCH  uint8 channel, uint8 max samples (RR intervals for heart rate)
+                    per frame, 0 = fill the MTU
+    0x05 BACKFILL   [uint32 timestamp ms]      send logged samples newer than it
+    0x06 BENCH      uint8 transport (0 GATT notifications, 1 L2CAP channel),
+                    uint16 seconds         throughput run, result in the log
+    0x07 SET_CODEC  uint8 channel (0xff = every batched stream, backfill included),
+                    uint8 codec            0 raw frames, 1 delta coded, see batch.h
+    0x08 BROADCAST  uint8 on               live values in the advertising data, see adv_bcast.h
+
+Unknown opcodes are skipped by their length. A truncated record or a known
+opcode with the wrong length rejects the whole write before anything is
+applied. The legacy ASCII writes "START" and "STOP" are still accepted.
+
+The parser walks the written data segment by segment through ctrl_src_t
+(an os_mbuf chain on the device, a plain buffer on the host), reading each
+byte in place: there is no copy of the write. The legacy keyword check reads
+until the first byte that fits neither keyword, just the first byte of a
+binary write; after it every byte is visited twice (validate, then apply).
+*/
+
+enum {
+    CTRL_OP_START = 0x01,
+    CTRL_OP_STOP = 0x02,
+    CTRL_OP_SET_RATE = 0x03,
+    CTRL_OP_SET_BATCH = 0x04,
+    CTRL_OP_BACKFILL = 0x05,
+    CTRL_OP_BENCH = 0x06,
+    CTRL_OP_SET_CODEC = 0x07,
+    CTRL_OP_BROADCAST = 0x08,
+};
+
+#define CTRL_ALL_CHANNELS 0xff
+
+typedef enum {
+    CTRL_OK = 0,
+    CTRL_ERR_EMPTY,
+    CTRL_ERR_TRUNCATED, // record runs past the end of the write
+    CTRL_ERR_BAD_VALUE, // known opcode with a value of the wrong length
+} ctrl_status_t;
+
+typedef struct {
+    uint8_t op;
+    uint8_t channels;      // START/STOP: channel mask
+    uint8_t channel;       // SET_RATE/SET_BATCH/SET_CODEC
+    uint16_t period_ms;    // SET_RATE
+    uint8_t batch_samples; // SET_BATCH
+    uint32_t since_ms;     // BACKFILL
+    uint8_t transport;     // BENCH
+    uint16_t seconds;      // BENCH
+    uint8_t codec;         // SET_CODEC
+    bool broadcast;        // BROADCAST
+} ctrl_cmd_t;
+
+// Yields the next segment of the write; false at the end
+typedef bool (*ctrl_seg_fn)(void *ctx, const uint8_t **data, uint16_t *len);
+
+typedef struct {
+    ctrl_seg_fn next;
+    void (*rewind)(void *ctx); // back to the first segment
+    void *ctx;
+} ctrl_src_t;
+
+typedef void (*ctrl_cmd_fn)(const ctrl_cmd_t *cmd, void *arg);
+
+typedef struct {
+    uint16_t commands; // records applied
+    uint16_t unknown;  // records skipped
+} ctrl_result_t;
+
+// Validates the whole write, then calls fn once per known record in order.
+ctrl_status_t ctrl_parse(const ctrl_src_t *src, ctrl_cmd_fn fn, void *arg, ctrl_result_t *result);
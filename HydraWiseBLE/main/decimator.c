@@ -0,0 +1,43 @@
+#include <string.h>
+#include "decimator.h"
+
+void decim_init(decim_t *d, uint32_t factor, uint16_t block_len, decim_block_fn fn, void *arg) {
+    memset(d, 0, sizeof(*d));
+    d->factor = factor ? factor : 1;
+    if (block_len == 0 || block_len > DECIM_BLOCK_MAX) {
+        block_len = DECIM_BLOCK_MAX;
+    }
+    d->block_len = block_len;
+    d->fn = fn;
+    d->arg = arg;
+}
+
+void decim_reset(decim_t *d) {
+    d->acc = 0;
+    d->acc_n = 0;
+    d->block_fill = 0;
+}
+
+void decim_feed(decim_t *d, const uint16_t *raw, size_t n) {
+    uint32_t acc = d->acc;
+    uint32_t acc_n = d->acc_n;
+    for (size_t i = 0; i < n; i++) {
+        acc += raw[i];
+        if (++acc_n < d->factor) {
+            continue;
+        }
+        d->block[d->block_fill++] = (uint16_t)((acc + d->factor / 2) / d->factor);
+        d->outputs++;
+        acc = 0;
+        acc_n = 0;
+        if (d->block_fill == d->block_len) {
+            d->blocks++;
+            if (d->fn) {
+                d->fn(d->block, d->block_fill, d->arg);
+            }
+            d->block_fill = 0;
+        }
+    }
+    d->acc = acc;
+    d->acc_n = acc_n;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Box-car decimator with block hand-off.
+
+Raw ADC readings are summed in groups of `factor` and each group produces one
+output sample (the mean). Outputs are collected into blocks of `block_len`
+and handed to the callback once per block, so the consumer wakes per block
+rather than per sample. No ESP-IDF dependency: the same code runs against a
+synthetic feed on the host.
+*/
+
+#define DECIM_BLOCK_MAX 32
+
+typedef void (*decim_block_fn)(const uint16_t *samples, uint16_t n, void *arg);
+
+typedef struct {
+    uint32_t factor;     // raw samples per output sample
+    uint32_t acc;        // running sum of the current group
+    uint32_t acc_n;      // raw samples in the current group
+    uint16_t block[DECIM_BLOCK_MAX];
+    uint16_t block_len;  // outputs per hand-off
+    uint16_t block_fill;
+    decim_block_fn fn;
+    void *arg;
+    uint32_t outputs;    // total output samples produced
+    uint32_t blocks;     // total blocks handed off
+} decim_t;
+
+void decim_init(decim_t *d, uint32_t factor, uint16_t block_len, decim_block_fn fn, void *arg);
+
+// Drops the partial group and partial block, e.g. when acquisition restarts.
+void decim_reset(decim_t *d);
+
+// Feeds raw readings. Calls the block callback for every completed block.
+void decim_feed(decim_t *d, const uint16_t *raw, size_t n);
@@ -0,0 +1,296 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "diag.h"
+#include "conn_table.h"
+
+static const char *TAG = "diag";
+
+static const char *const stage_names[DIAG_STAGE_COUNT] = { "queue", "encode", "call", "tx", "air" };
+static const char *const reconnect_names[DIAG_RECONNECT_COUNT] = { "directed", "accept list", "open" };
+static const char *const first_notify_names[DIAG_FIRST_NOTIFY_COUNT] = { "subscribed", "restored" };
+
+// A notification from diag_tx_start() until its call returned and its mbuf came back
+typedef struct {
+    uint32_t call_us;
+    uint32_t acquire_us;
+    uint32_t released_us;
+    uint32_t released_ms;
+    bool called;
+    bool refused;
+} diag_tx_t;
+
+// Notifications in flight on one connection, oldest first
+typedef struct {
+    uint16_t conn_handle;
+    bool used;
+    uint8_t head;
+    uint8_t count;
+    bool first_pending; // no notification delivered since diag_conn_opened()
+    bool restored;
+    uint32_t opened_ms;
+    uint8_t released;   // oldest entries whose mbuf is back, waiting for their call to return
+    diag_tx_t fifo[DIAG_INFLIGHT];
+} diag_conn_t;
+
+static latency_hist_t stages[DIAG_STAGE_COUNT];
+static uint32_t fails[DIAG_FAIL_COUNT];
+// Gaps too long for a latency_hist_t
+typedef struct {
+    uint32_t count;
+    uint32_t sum_ms;
+    uint32_t max_ms;
+} diag_gap_t;
+
+static diag_gap_t reconnects[DIAG_RECONNECT_COUNT];
+static diag_gap_t first_notify[DIAG_FIRST_NOTIFY_COUNT];
+static diag_conn_t conns[CONN_TABLE_MAX];
+static portMUX_TYPE diag_lock = portMUX_INITIALIZER_UNLOCKED; // scheduler and host task
+
+static uint32_t now_us(void) {
+    return (uint32_t)esp_timer_get_time();
+}
+
+static uint32_t now_ms(void) {
+    return pdTICKS_TO_MS(xTaskGetTickCount());
+}
+
+uint32_t diag_cycles(void) {
+    return esp_cpu_get_cycle_count();
+}
+
+void diag_stage_us(diag_stage_t stage, uint32_t us) {
+    taskENTER_CRITICAL(&diag_lock);
+    hist_add(&stages[stage], us);
+    taskEXIT_CRITICAL(&diag_lock);
+}
+
+void diag_stage_cycles(diag_stage_t stage, uint32_t start) {
+    // DFS changes the CCOUNT rate; the sends run under the radio PM lock, so this
+    // is the maximum frequency in practice
+    diag_stage_us(stage, (diag_cycles() - start) / esp_rom_get_cpu_ticks_per_us());
+}
+
+void diag_fail(diag_fail_t what) {
+    taskENTER_CRITICAL(&diag_lock);
+    fails[what]++;
+    taskEXIT_CRITICAL(&diag_lock);
+}
+
+// Caller holds diag_lock
+static void gap_add(diag_gap_t *g, uint32_t ms) {
+    g->count++;
+    g->sum_ms += ms;
+    if (ms > g->max_ms) {
+        g->max_ms = ms;
+    }
+}
+
+void diag_reconnect(diag_reconnect_t how, uint32_t gap_ms) {
+    taskENTER_CRITICAL(&diag_lock);
+    gap_add(&reconnects[how], gap_ms);
+    taskEXIT_CRITICAL(&diag_lock);
+}
+
+// Caller holds diag_lock
+static diag_conn_t *conn_slot(uint16_t conn_handle, bool create) {
+    diag_conn_t *free_slot = NULL;
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        if (conns[i].used && conns[i].conn_handle == conn_handle) {
+            return &conns[i];
+        }
+        if (!conns[i].used && free_slot == NULL) {
+            free_slot = &conns[i];
+        }
+    }
+    if (!create || free_slot == NULL) {
+        return NULL;
+    }
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->used = true;
+    free_slot->conn_handle = conn_handle;
+    return free_slot;
+}
+
+void diag_tx_start(uint16_t conn_handle, uint32_t acquire_us) {
+    uint32_t us = now_us();
+    taskENTER_CRITICAL(&diag_lock);
+    diag_conn_t *c = conn_slot(conn_handle, true);
+    if (c != NULL && c->count < DIAG_INFLIGHT) {
+        uint8_t i = (c->head + c->count++) % DIAG_INFLIGHT;
+        c->fifo[i] = (diag_tx_t){ .call_us = us, .acquire_us = acquire_us };
+    }
+    taskEXIT_CRITICAL(&diag_lock);
+}
+
+// Retires the oldest notifications that were both called and released.
+// Caller holds diag_lock.
+static void tx_complete(diag_conn_t *c) {
+    while (c->released > 0 && c->fifo[c->head].called) {
+        const diag_tx_t *e = &c->fifo[c->head];
+        if (!e->refused) {
+            if (c->first_pending) {
+                c->first_pending = false;
+                gap_add(&first_notify[c->restored ? DIAG_FIRST_NOTIFY_RESTORED : DIAG_FIRST_NOTIFY_SUBSCRIBED],
+                    e->released_ms - c->opened_ms);
+            }
+            hist_add(&stages[DIAG_STAGE_TX], e->released_us - e->call_us);
+            if (e->acquire_us != DIAG_NO_ACQUIRE) {
+                hist_add(&stages[DIAG_STAGE_AIR], e->released_us - e->acquire_us);
+            }
+        }
+        c->head = (c->head + 1) % DIAG_INFLIGHT;
+        c->count--;
+        c->released--;
+    }
+}
+
+void diag_tx_called(uint16_t conn_handle, int rc) {
+    taskENTER_CRITICAL(&diag_lock);
+    diag_conn_t *c = conn_slot(conn_handle, false);
+    if (c != NULL && c->count > 0) {
+        uint8_t i = (c->head + c->count - 1) % DIAG_INFLIGHT;
+        c->fifo[i].called = true;
+        c->fifo[i].refused = rc != 0;
+        tx_complete(c);
+    }
+    taskEXIT_CRITICAL(&diag_lock);
+}
+
+void diag_tx_released(uint16_t conn_handle) {
+    uint32_t us = now_us();
+    uint32_t ms = now_ms();
+    taskENTER_CRITICAL(&diag_lock);
+    diag_conn_t *c = conn_slot(conn_handle, false);
+    if (c != NULL && c->released < c->count) {
+        uint8_t i = (c->head + c->released++) % DIAG_INFLIGHT;
+        c->fifo[i].released_us = us;
+        c->fifo[i].released_ms = ms;
+        tx_complete(c);
+    }
+    taskEXIT_CRITICAL(&diag_lock);
+}
+
+void diag_conn_opened(uint16_t conn_handle) {
+    uint32_t ms = now_ms();
+    taskENTER_CRITICAL(&diag_lock);
+    diag_conn_t *c = conn_slot(conn_handle, true);
+    if (c != NULL) {
+        c->first_pending = true;
+        c->restored = false;
+        c->opened_ms = ms;
+    }
+    taskEXIT_CRITICAL(&diag_lock);
+}
+
+void diag_conn_restored(uint16_t conn_handle) {
+    taskENTER_CRITICAL(&diag_lock);
+    diag_conn_t *c = conn_slot(conn_handle, false);
+    if (c != NULL) {
+        c->restored = true;
+    }
+    taskEXIT_CRITICAL(&diag_lock);
+}
+
+uint32_t diag_conn_age_ms(uint16_t conn_handle) {
+    uint32_t ms = now_ms();
+    uint32_t age = 0;
+    taskENTER_CRITICAL(&diag_lock);
+    diag_conn_t *c = conn_slot(conn_handle, false);
+    if (c != NULL) {
+        age = ms - c->opened_ms;
+    }
+    taskEXIT_CRITICAL(&diag_lock);
+    return age;
+}
+
+void diag_conn_closed(uint16_t conn_handle) {
+    taskENTER_CRITICAL(&diag_lock);
+    diag_conn_t *c = conn_slot(conn_handle, false);
+    if (c != NULL) {
+        c->used = false;
+    }
+    taskEXIT_CRITICAL(&diag_lock);
+}
+
+static inline uint8_t *put_le32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+    return p + 4;
+}
+
+uint16_t diag_serialize(uint8_t *dst) {
+    static latency_hist_t snap[DIAG_STAGE_COUNT]; // host task only, too big for its stack
+    uint32_t fail_snap[DIAG_FAIL_COUNT];
+    diag_gap_t gap_snap[DIAG_RECONNECT_COUNT + DIAG_FIRST_NOTIFY_COUNT];
+    taskENTER_CRITICAL(&diag_lock);
+    memcpy(snap, stages, sizeof(snap));
+    memcpy(fail_snap, fails, sizeof(fail_snap));
+    memcpy(gap_snap, reconnects, sizeof(reconnects));
+    memcpy(&gap_snap[DIAG_RECONNECT_COUNT], first_notify, sizeof(first_notify));
+    taskEXIT_CRITICAL(&diag_lock);
+
+    uint8_t *p = dst;
+    *p++ = DIAG_VERSION;
+    *p++ = DIAG_STAGE_COUNT;
+    *p++ = HIST_BUCKETS;
+    *p++ = HIST_MIN_SHIFT;
+    p = put_le32(p, (uint32_t)(esp_timer_get_time() / 1000000));
+    for (int i = 0; i < DIAG_FAIL_COUNT; i++) {
+        p = put_le32(p, fail_snap[i]);
+    }
+    for (int s = 0; s < DIAG_STAGE_COUNT; s++) {
+        p = put_le32(p, snap[s].count);
+        p = put_le32(p, snap[s].max_us);
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            p = put_le32(p, snap[s].buckets[b]);
+        }
+    }
+    for (int i = 0; i < DIAG_RECONNECT_COUNT + DIAG_FIRST_NOTIFY_COUNT; i++) {
+        p = put_le32(p, gap_snap[i].count);
+        p = put_le32(p, gap_snap[i].sum_ms);
+        p = put_le32(p, gap_snap[i].max_ms);
+    }
+    return p - dst;
+}
+
+void diag_log_stats(void) {
+    for (int s = 0; s < DIAG_STAGE_COUNT; s++) {
+        taskENTER_CRITICAL(&diag_lock);
+        latency_hist_t h = stages[s];
+        taskEXIT_CRITICAL(&diag_lock);
+        if (h.count > 0) {
+            ESP_LOGI(TAG, "%s: %lu samples, p50 < %lu us, p99 < %lu us, max %lu us", stage_names[s],
+                (unsigned long)h.count, (unsigned long)hist_percentile(&h, 50),
+                (unsigned long)hist_percentile(&h, 99), (unsigned long)h.max_us);
+        }
+    }
+    ESP_LOGI(TAG, "Failures: notify enomem %lu, notify error %lu, tx %lu, window full %lu, pool empty %lu",
+        (unsigned long)fails[DIAG_FAIL_NOTIFY_ENOMEM], (unsigned long)fails[DIAG_FAIL_NOTIFY_ERROR],
+        (unsigned long)fails[DIAG_FAIL_TX], (unsigned long)fails[DIAG_FAIL_WINDOW_FULL],
+        (unsigned long)fails[DIAG_FAIL_POOL_EMPTY]);
+    for (int i = 0; i < DIAG_RECONNECT_COUNT; i++) {
+        taskENTER_CRITICAL(&diag_lock);
+        diag_gap_t g = reconnects[i];
+        taskEXIT_CRITICAL(&diag_lock);
+        if (g.count > 0) {
+            ESP_LOGI(TAG, "Reconnects (%s): %lu, mean gap %lu ms, max %lu ms", reconnect_names[i],
+                (unsigned long)g.count, (unsigned long)(g.sum_ms / g.count), (unsigned long)g.max_ms);
+        }
+    }
+    for (int i = 0; i < DIAG_FIRST_NOTIFY_COUNT; i++) {
+        taskENTER_CRITICAL(&diag_lock);
+        diag_gap_t g = first_notify[i];
+        taskEXIT_CRITICAL(&diag_lock);
+        if (g.count > 0) {
+            ESP_LOGI(TAG, "Connect to first notification (%s): %lu, mean %lu ms, max %lu ms", first_notify_names[i],
+                (unsigned long)g.count, (unsigned long)(g.sum_ms / g.count), (unsigned long)g.max_ms);
+        }
+    }
+}
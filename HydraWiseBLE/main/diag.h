@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdint.h>
+#include "latency_hist.h"
+
+/*
+Sample-to-air latency, notify failure and (re)connect statistics.
+
+Stages of a batched sample, each with its own latency_hist_t:
+    QUEUE   acquire -> encode: time in the sample ring, mostly batching
+    ENCODE  encode start -> frame enqueued in its mbufs (CCOUNT)
+    CALL    inside ble_gattc_notify_custom (CCOUNT)
+    TX      notify call -> its mbuf released to the notify pool, per peer
+    AIR     acquire -> release of the frame's first sample, per peer
+
+NimBLE reports BLE_GAP_EVENT_NOTIFY_TX before the notify call returns, so TX
+and AIR end when the host gives the mbuf back (notify_pool.h), i.e. when the
+controller took the packet; a refused notification is not counted.
+
+ENCODE and CALL are measured with the cycle counter of the running core,
+both ends inside one call, and converted at the CPU frequency in force.
+CCOUNT is per core and the scheduler task is not pinned, so intervals that
+cross tasks use esp_timer instead: TX from the notify call, QUEUE and AIR
+from the acquisition time each sample carries (sample_t.acq_us, adc_acq.h).
+Samples read back from the log have none and count in neither.
+
+A peer that drops and comes back loses what it would have received in
+between, so the gap from its disconnect to its next connection is kept per
+advertising mode that brought it back. Gaps run to seconds, past the
+histogram range: they are counted, summed and maxed in ms instead. So is the
+time from a connection to its first delivered notification, split by whether
+the peer's subscriptions were restored from the bond store or written again
+after discovery: the cost of a reconnect without and with a bond. The button
+state goes out as soon as its subscription is back, so the first notification
+does not wait for periodic data.
+
+diag_serialize() packs everything into the diagnostics characteristic value,
+little endian:
+    0   uint8   layout version (DIAG_VERSION)
+    1   uint8   stage count
+    2   uint8   HIST_BUCKETS
+    3   uint8   HIST_MIN_SHIFT
+    4   uint32  uptime in s
+    8   uint32  x DIAG_FAIL_COUNT failure counters, in diag_fail_t order
+    then per stage: uint32 count, uint32 max us, uint32 x HIST_BUCKETS
+    then per diag_reconnect_t: uint32 count, uint32 sum ms, uint32 max ms
+    then per diag_first_notify_t: uint32 count, uint32 sum ms, uint32 max ms
+Counters never reset; a client diffs two reads.
+*/
+
+#define DIAG_VERSION 4
+#define DIAG_INFLIGHT 16     // notifications tracked per peer until their release
+#define DIAG_NO_ACQUIRE UINT32_MAX // frame without an acquisition time, no AIR stage
+
+typedef enum {
+    DIAG_STAGE_QUEUE,
+    DIAG_STAGE_ENCODE,
+    DIAG_STAGE_CALL,
+    DIAG_STAGE_TX,
+    DIAG_STAGE_AIR,
+    DIAG_STAGE_COUNT,
+} diag_stage_t;
+
+typedef enum {
+    DIAG_FAIL_NOTIFY_ENOMEM, // notify call refused for lack of host buffers
+    DIAG_FAIL_NOTIFY_ERROR,  // notify call failed otherwise
+    DIAG_FAIL_TX,            // NOTIFY_TX reported a failure
+    DIAG_FAIL_WINDOW_FULL,   // frame held back by a full flow window
+    DIAG_FAIL_POOL_EMPTY,    // frame held back for lack of notify mbufs
+    DIAG_FAIL_COUNT,
+} diag_fail_t;
+
+typedef enum {
+    DIAG_RECONNECT_DIRECTED,    // during directed advertising to the peer that left
+    DIAG_RECONNECT_ACCEPT_LIST, // during advertising for bonded peers only
+    DIAG_RECONNECT_OPEN,        // once advertising was open to anyone
+    DIAG_RECONNECT_COUNT,
+} diag_reconnect_t;
+
+typedef enum {
+    DIAG_FIRST_NOTIFY_SUBSCRIBED, // the client wrote its CCCDs on this connection
+    DIAG_FIRST_NOTIFY_RESTORED,   // bonded peer, CCCDs restored from the store
+    DIAG_FIRST_NOTIFY_COUNT,
+} diag_first_notify_t;
+
+#define DIAG_VALUE_LEN (8 + DIAG_FAIL_COUNT * 4 + DIAG_STAGE_COUNT * (8 + HIST_BUCKETS * 4) + \
+    (DIAG_RECONNECT_COUNT + DIAG_FIRST_NOTIFY_COUNT) * 12)
+_Static_assert(DIAG_VALUE_LEN <= 512, "the diagnostics value must fit one ATT attribute");
+
+uint32_t diag_cycles(void);
+
+// Adds the time since start (diag_cycles()) to a CCOUNT stage
+void diag_stage_cycles(diag_stage_t stage, uint32_t start);
+void diag_stage_us(diag_stage_t stage, uint32_t us);
+void diag_fail(diag_fail_t what);
+
+// A connection came gap_ms after a disconnect
+void diag_reconnect(diag_reconnect_t how, uint32_t gap_ms);
+
+// A notification is about to be handed to the stack for conn_handle;
+// acquire_us is when its first sample was taken (esp_timer) or DIAG_NO_ACQUIRE
+void diag_tx_start(uint16_t conn_handle, uint32_t acquire_us);
+
+// The notify call for the last diag_tx_start() on conn_handle returned rc
+void diag_tx_called(uint16_t conn_handle, int rc);
+
+// The notify pool got an mbuf of conn_handle back: completes its oldest
+// notification. May run inside the notify call.
+void diag_tx_released(uint16_t conn_handle);
+
+// A connection opened; its first delivered notification is timed from here
+void diag_conn_opened(uint16_t conn_handle);
+
+// The bond store restored a subscription on conn_handle
+void diag_conn_restored(uint16_t conn_handle);
+
+// Time since diag_conn_opened(), 0 for an unknown connection
+uint32_t diag_conn_age_ms(uint16_t conn_handle);
+
+void diag_conn_closed(uint16_t conn_handle);
+
+// Fills dst (DIAG_VALUE_LEN bytes); returns the length
+uint16_t diag_serialize(uint8_t *dst);
+
+void diag_log_stats(void);
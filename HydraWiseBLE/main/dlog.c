@@ -0,0 +1,132 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "dlog.h"
+#include "dlog_table.h" // generated from dlog_fmt.h by tools/dlog_table.py
+
+static const char *TAG = "dlog";
+
+typedef struct {
+    esp_log_level_t level;
+    const char *fmt;
+} dlog_fmt_t;
+
+#define DLOG_LEVEL_E ESP_LOG_ERROR
+#define DLOG_LEVEL_W ESP_LOG_WARN
+#define DLOG_LEVEL_I ESP_LOG_INFO
+
+static const dlog_fmt_t formats[DLOG_FMT_COUNT] = {
+#define DLOG_FMT(id, level, fmt) [id] = { DLOG_LEVEL_##level, fmt },
+#include "dlog_fmt.h"
+#undef DLOG_FMT
+};
+_Static_assert(DLOG_TABLE_COUNT == DLOG_FMT_COUNT, "tools/dlog_table.py read dlog_fmt.h differently");
+
+static dlog_slot_t slots[DLOG_RING_LEN];
+static dlog_ring_t ring;
+static bool ready = false;
+static SemaphoreHandle_t drain_lock; // the ring has one consumer: the drain task or dlog_flush()
+static uint32_t written, dropped_reported;
+
+static void emit(const dlog_rec_t *rec) {
+    const uint32_t *a = rec->args;
+    if (rec->id >= DLOG_FMT_COUNT) {
+        return;
+    }
+#if DLOG_TEXT || DLOG_DIRECT
+    char line[128];
+    snprintf(line, sizeof(line), formats[rec->id].fmt, a[0], a[1], a[2], a[3]);
+    ESP_LOG_LEVEL(formats[rec->id].level, TAG, "(%lu us, core %u) %s",
+        (unsigned long)rec->ts_us, rec->core, line);
+#else
+    // ts, id, nargs, core, args, little endian
+    printf("DLOG %08lx%02x%02x%02x%02x", (unsigned long)__builtin_bswap32(rec->ts_us),
+        rec->id & 0xff, rec->id >> 8, rec->nargs, rec->core);
+    for (int i = 0; i < rec->nargs; i++) {
+        printf("%08lx", (unsigned long)__builtin_bswap32(a[i]));
+    }
+    printf("\n");
+#endif
+}
+
+// Names the format table ahead of binary records, so tools/dlog_expand.py can
+// tell whether its table is the one this firmware was built with
+static void emit_table_id(void) {
+#if !(DLOG_TEXT || DLOG_DIRECT)
+    printf("DLOG_TABLE %08lx %d\n", (unsigned long)DLOG_TABLE_HASH, DLOG_FMT_COUNT);
+#endif
+}
+
+void dlog_put(uint16_t id, int nargs, ...) {
+    dlog_rec_t rec = {
+        .ts_us = (uint32_t)esp_timer_get_time(),
+        .id = id,
+        .nargs = nargs,
+        .core = xPortGetCoreID(),
+    };
+    va_list ap;
+    va_start(ap, nargs);
+    for (int i = 0; i < nargs && i < DLOG_MAX_ARGS; i++) {
+        rec.args[i] = va_arg(ap, uint32_t);
+    }
+    va_end(ap);
+#if DLOG_DIRECT
+    emit(&rec);
+#else
+    if (ready) {
+        dlog_ring_put(&ring, &rec); // a full ring counts the record as dropped
+    }
+#endif
+}
+
+void dlog_flush(void) {
+    if (!ready) {
+        return;
+    }
+    xSemaphoreTake(drain_lock, portMAX_DELAY);
+    dlog_rec_t rec;
+    while (dlog_ring_take(&ring, &rec)) {
+        emit(&rec);
+        written++;
+    }
+    xSemaphoreGive(drain_lock);
+    uint32_t dropped = atomic_load_explicit(&ring.dropped, memory_order_relaxed);
+    if (dropped != dropped_reported) {
+        ESP_LOGW(TAG, "%lu records dropped, ring full", (unsigned long)(dropped - dropped_reported));
+        dropped_reported = dropped;
+    }
+}
+
+// Lowest priority above idle: UART time only ever comes out of idle time
+static void dlog_task(void *param) {
+    while (1) {
+        dlog_flush();
+        vTaskDelay(pdMS_TO_TICKS(DLOG_DRAIN_MS));
+    }
+}
+
+esp_err_t dlog_init(void) {
+    dlog_ring_init(&ring, slots, DLOG_RING_LEN);
+    drain_lock = xSemaphoreCreateMutex();
+    if (drain_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ready = true;
+    emit_table_id();
+    if (xTaskCreate(dlog_task, "dlog_task", 3072, NULL, 1, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM; // records still come out through dlog_flush()
+    }
+    ESP_LOGI(TAG, "Deferred log: %d formats (table %08lx), %d record ring", DLOG_FMT_COUNT,
+        (unsigned long)DLOG_TABLE_HASH, DLOG_RING_LEN);
+    return ESP_OK;
+}
+
+void dlog_log_stats(void) {
+    emit_table_id(); // again, for a capture that started after boot
+    ESP_LOGI(TAG, "Deferred log: %lu written, %lu dropped", (unsigned long)written,
+        (unsigned long)atomic_load_explicit(&ring.dropped, memory_order_relaxed));
+}
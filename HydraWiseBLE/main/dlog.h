@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "dlog_ring.h"
+
+/*
+Deferred logging for the notify, read and write paths.
+
+DLOG(id, args...) stores a format id, a timestamp and up to DLOG_MAX_ARGS
+integer arguments in a lock-free RAM ring (dlog_ring.h): a few hundred
+nanoseconds instead of the milliseconds a formatted line takes at 115200
+baud, and it never blocks the NimBLE host task. A low-priority task drains the
+ring every DLOG_DRAIN_MS and writes the lines out, either formatted on the
+device (DLOG_TEXT 1) or as "DLOG <hex>" records that tools/dlog_expand.py
+expands with the same format table, which keeps UART time down further. The
+build generates that table from dlog_fmt.h (tools/dlog_table.py, dlog_table.json
+next to the firmware) and binary output names it with a "DLOG_TABLE <hash>"
+line at boot and with the stats, so a capture is never expanded against the
+wrong table. dlog_flush() drains on demand, e.g. before printing stats, so the
+deferred lines land before them.
+
+Build with DLOG_DIRECT 1 to format and write synchronously from the caller
+as before; the stream stats report the send path time either way, which gives
+the before/after comparison.
+*/
+
+#ifndef DLOG_DIRECT
+#define DLOG_DIRECT 0
+#endif
+#ifndef DLOG_TEXT
+#define DLOG_TEXT 1
+#endif
+#define DLOG_RING_LEN 128   // records, power of two
+#define DLOG_DRAIN_MS 50
+
+enum {
+#define DLOG_FMT(id, level, fmt) id,
+#include "dlog_fmt.h"
+#undef DLOG_FMT
+    DLOG_FMT_COUNT,
+};
+
+#define DLOG_NARGS(...) DLOG_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, n, ...) n
+#define DLOG(id, ...) dlog_put((id), DLOG_NARGS(__VA_ARGS__), ##__VA_ARGS__)
+
+esp_err_t dlog_init(void);
+
+// Records an event; arguments are taken as uint32_t. Any task, never blocks.
+void dlog_put(uint16_t id, int nargs, ...);
+
+// Writes out everything recorded so far from the calling task.
+void dlog_flush(void);
+
+void dlog_log_stats(void);
@@ -0,0 +1,29 @@
+/*
+Format table of the deferred log (dlog.h), one entry per record id:
+    DLOG_FMT(id, level, format)    level: E, W or I
+
+Ids are assigned in table order, so append new entries at the end and never
+reorder: the build turns this file into the table tools/dlog_expand.py
+expands binary records with (tools/dlog_table.py). Formats take at most DLOG_MAX_ARGS integer conversions (%u %d %x), no
+strings. Included once per use, hence no include guard.
+*/
+
+DLOG_FMT(DLOG_START, I, "START channels 0x%02x")
+DLOG_FMT(DLOG_STOP, I, "STOP, channels left 0x%02x")
+DLOG_FMT(DLOG_RATE_FIXED, W, "⚠️ Rate of channel %u is fixed")
+DLOG_FMT(DLOG_NO_CHANNEL, W, "⚠️ No channel %u")
+DLOG_FMT(DLOG_BACKFILL_REQUEST, I, "Backfill since %u ms requested")
+DLOG_FMT(DLOG_NO_CODEC, W, "⚠️ No codec %u for channel %u")
+DLOG_FMT(DLOG_CMD_REJECTED, W, "⚠️ Rejected command write (conn: %u, status %u)")
+DLOG_FMT(DLOG_CMD_APPLIED, I, "Command write (conn: %u): %u applied, %u unknown skipped")
+DLOG_FMT(DLOG_SDU_REJECTED, W, "⚠️ Rejected command SDU")
+DLOG_FMT(DLOG_BUTTON_SENT, I, "Button state notification sent: %u")
+DLOG_FMT(DLOG_HR_READ, I, "💓 Client is reading Heart Rate characteristic")
+DLOG_FMT(DLOG_CONDUCTIVITY_READ, I, "💧 Client is reading Conductivity characteristic")
+DLOG_FMT(DLOG_BATTERY_READ, I, "🔋 Client is reading Battery Level characteristic")
+DLOG_FMT(DLOG_BUTTON_READ, I, "📥 Client is reading Button state characteristic")
+DLOG_FMT(DLOG_ACCESS_OP, W, "⚠️ Unexpected access op %u (handle: %u)")
+DLOG_FMT(DLOG_FRAME_SENT, I, "Characteristic %u notification sent: seq %u, %u samples, %u peers")
+DLOG_FMT(DLOG_FRAME_FAILED, E, "Failed to send characteristic %u notification to %u: %d")
+DLOG_FMT(DLOG_VALUE_FAILED, E, "Failed to send notification to %u: %d")
+DLOG_FMT(DLOG_BROADCAST, I, "Broadcast mode %u")
@@ -0,0 +1,52 @@
+#include <string.h>
+#include "dlog_ring.h"
+
+void dlog_ring_init(dlog_ring_t *r, dlog_slot_t *slots, uint32_t capacity) {
+    memset(r, 0, sizeof(*r));
+    r->slots = slots;
+    r->mask = capacity - 1;
+    for (uint32_t i = 0; i < capacity; i++) {
+        atomic_init(&slots[i].seq, i);
+    }
+    atomic_init(&r->head, 0);
+    atomic_init(&r->dropped, 0);
+}
+
+bool dlog_ring_put(dlog_ring_t *r, const dlog_rec_t *rec) {
+    uint32_t pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+    dlog_slot_t *slot;
+    while (1) {
+        slot = &r->slots[pos & r->mask];
+        uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            // free slot: claim it, or retry from the head another producer moved
+            if (atomic_compare_exchange_weak_explicit(&r->head, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // the consumer has not freed this slot yet
+            atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+            return false;
+        } else {
+            pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+        }
+    }
+    slot->rec = *rec;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+bool dlog_ring_take(dlog_ring_t *r, dlog_rec_t *rec) {
+    dlog_slot_t *slot = &r->slots[r->tail & r->mask];
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if ((int32_t)(seq - (r->tail + 1)) < 0) {
+        return false; // not published yet
+    }
+    *rec = slot->rec;
+    // free for the producer one lap ahead
+    atomic_store_explicit(&slot->seq, r->tail + r->mask + 1, memory_order_release);
+    r->tail++;
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Lock-free multi-producer / single-consumer ring of deferred log records.
+
+Any task on either core may put; one task takes. Each slot carries a
+sequence number (bounded queue after D. Vyukov): a producer claims a slot by
+advancing head with a compare-and-swap, fills it and publishes it by storing
+the slot's sequence, so producers never wait for each other or for the
+consumer. A full ring refuses the record and counts it. A producer preempted
+between claim and publish only delays the consumer at that slot, nothing is
+reordered. Capacity must be a power of two.
+*/
+
+#define DLOG_MAX_ARGS 4
+
+typedef struct {
+    uint32_t ts_us;                 // time of the event, wraps after ~71 minutes
+    uint16_t id;                    // index into dlog_fmt.h
+    uint8_t nargs;
+    uint8_t core;
+    uint32_t args[DLOG_MAX_ARGS];   // integers only, formats never see a pointer
+} dlog_rec_t;
+
+typedef struct {
+    _Atomic uint32_t seq;
+    dlog_rec_t rec;
+} dlog_slot_t;
+
+typedef struct {
+    dlog_slot_t *slots;
+    uint32_t mask;
+    _Atomic uint32_t head;          // next slot to claim, shared by producers
+    uint32_t tail;                  // consumer only
+    _Atomic uint32_t dropped;       // records refused because the ring was full
+} dlog_ring_t;
+
+void dlog_ring_init(dlog_ring_t *r, dlog_slot_t *slots, uint32_t capacity);
+
+// Copies rec into the ring; false (and counted) if it is full. Never blocks.
+bool dlog_ring_put(dlog_ring_t *r, const dlog_rec_t *rec);
+
+// Oldest published record; false if none. Consumer only.
+bool dlog_ring_take(dlog_ring_t *r, dlog_rec_t *rec);
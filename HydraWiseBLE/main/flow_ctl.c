@@ -0,0 +1,62 @@
+#include <string.h>
+#include "flow_ctl.h"
+
+void flow_init(flow_ctl_t *f, uint8_t window_min, uint8_t window_max, uint8_t window_init) {
+    memset(f, 0, sizeof(*f));
+    f->window_min = window_min ? window_min : 1;
+    f->window_max = window_max < f->window_min ? f->window_min : window_max;
+    f->window_init = window_init;
+    flow_reset(f);
+}
+
+void flow_reset(flow_ctl_t *f) {
+    uint8_t w = f->window_init;
+    if (w < f->window_min) {
+        w = f->window_min;
+    }
+    if (w > f->window_max) {
+        w = f->window_max;
+    }
+    f->window = w;
+    f->in_flight = 0;
+    f->ok_streak = 0;
+    f->stalled = false;
+}
+
+bool flow_can_send(flow_ctl_t *f) {
+    if (f->in_flight < f->window) {
+        return true;
+    }
+    f->stalled = true;
+    f->window_full++;
+    return false;
+}
+
+void flow_on_sent(flow_ctl_t *f) {
+    f->in_flight++;
+    f->sent++;
+}
+
+bool flow_on_released(flow_ctl_t *f) {
+    if (f->in_flight > 0) {
+        f->in_flight--;
+    }
+    f->completed++;
+    if (++f->ok_streak >= f->window) {
+        if (f->window < f->window_max) {
+            f->window++;
+        }
+        f->ok_streak = 0;
+    }
+    if (f->stalled && f->in_flight < f->window) {
+        f->stalled = false;
+        return true;
+    }
+    return false;
+}
+
+void flow_on_congestion(flow_ctl_t *f) {
+    f->failed++;
+    f->window = f->window / 2 < f->window_min ? f->window_min : f->window / 2;
+    f->ok_streak = 0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Notification window for one connection.
+
+Every notification handed to the stack counts as in flight until its mbuf
+goes back to the notify pool, i.e. until the host has passed it to the
+controller, which only takes more as connection events free its buffers.
+NOTIFY_TX cannot be the completion: the host raises it from inside the
+notify call. Sends are refused while the window is full, so samples coalesce
+into fuller frames instead of piling up in the host's queue. The window
+grows by one after a full window of releases and halves on congestion (a
+failed notify, typically BLE_HS_ENOMEM, or an empty notify pool), so the
+send rate follows what the link actually drains. Not thread safe; the
+caller serializes.
+*/
+
+typedef struct {
+    uint8_t window;       // current cap on notifications in flight
+    uint8_t window_min;
+    uint8_t window_max;
+    uint8_t window_init;
+    uint8_t in_flight;
+    uint8_t ok_streak;    // releases since the window last changed
+    bool stalled;         // a send was refused since the last release
+    uint32_t sent;
+    uint32_t completed;   // released to the controller
+    uint32_t failed;      // congestion signals
+    uint32_t window_full; // sends refused because the window was full
+} flow_ctl_t;
+
+void flow_init(flow_ctl_t *f, uint8_t window_min, uint8_t window_max, uint8_t window_init);
+
+// New connection: empty window at the initial size. Counters are kept.
+void flow_reset(flow_ctl_t *f);
+
+// True if another notification may be sent. A refusal marks the flow stalled.
+bool flow_can_send(flow_ctl_t *f);
+
+// Call just before handing a notification to the stack.
+void flow_on_sent(flow_ctl_t *f);
+
+// Call when a notification's mbuf went back to the pool. Returns true if the
+// flow was stalled and now has room again, i.e. the sender should be woken.
+bool flow_on_released(flow_ctl_t *f);
+
+// Call on congestion: a notify failed or the pool ran dry. Halves the window.
+void flow_on_congestion(flow_ctl_t *f);
@@ -0,0 +1,119 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "hr_monitor.h"
+#include "power.h"
+
+static const char *TAG = "hr_monitor";
+
+static QueueHandle_t block_queue = NULL;
+static ppg_t ppg; // owned by hr_monitor_task
+static uint32_t blocks_dropped = 0;
+
+// Published results
+static portMUX_TYPE hr_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t hr_epoch = 0; // bumped by every reset, so a block in progress cannot publish
+static uint16_t hr_bpm = 0;
+static uint16_t hr_rr[HR_MONITOR_RR_MAX];
+static uint8_t hr_rr_count = 0;
+
+// Results of a block started in `epoch`; dropped if a reset came in meanwhile
+static void publish(uint32_t epoch) {
+    uint16_t rr[PPG_RR_QUEUE];
+    uint8_t n = ppg_take_rr(&ppg, rr, PPG_RR_QUEUE);
+    taskENTER_CRITICAL(&hr_lock);
+    if (epoch != hr_epoch) {
+        taskEXIT_CRITICAL(&hr_lock);
+        return;
+    }
+    hr_bpm = ppg_bpm(&ppg);
+    for (uint8_t i = 0; i < n; i++) {
+        if (hr_rr_count == HR_MONITOR_RR_MAX) {
+            // nobody took them: keep the newest
+            memmove(hr_rr, hr_rr + 1, (HR_MONITOR_RR_MAX - 1) * sizeof(hr_rr[0]));
+            hr_rr_count--;
+        }
+        hr_rr[hr_rr_count++] = rr[i];
+    }
+    taskEXIT_CRITICAL(&hr_lock);
+}
+
+static void hr_monitor_task(void *param) {
+    adc_acq_block_t block;
+    uint16_t published_bpm = 0;
+    uint32_t ppg_epoch = 0;
+    while (1) {
+        xQueueReceive(block_queue, &block, portMAX_DELAY);
+        power_lock(POWER_LOCK_DSP);
+        taskENTER_CRITICAL(&hr_lock);
+        uint32_t epoch = hr_epoch;
+        taskEXIT_CRITICAL(&hr_lock);
+        if (epoch != ppg_epoch) {
+            ppg_epoch = epoch;
+            ppg_reset(&ppg);
+            published_bpm = 0;
+        }
+        bool beat = false;
+        for (uint16_t i = 0; i < block.n; i++) {
+            beat |= ppg_feed(&ppg, block.samples[i]);
+        }
+        // a beat adds an RR interval; losing the rhythm clears the BPM without one
+        if (beat || ppg_bpm(&ppg) != published_bpm) {
+            publish(epoch);
+            published_bpm = ppg_bpm(&ppg);
+        }
+        power_unlock(POWER_LOCK_DSP);
+    }
+}
+
+esp_err_t hr_monitor_init(void) {
+    ppg_init(&ppg, ADC_ACQ_PPG_HZ, true);
+    block_queue = xQueueCreate(HR_MONITOR_QUEUE_LEN, sizeof(adc_acq_block_t));
+    if (block_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create the PPG block queue");
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreatePinnedToCore(hr_monitor_task, "hr_monitor", 3072, NULL, 4, NULL, HR_MONITOR_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the heart rate task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void hr_monitor_feed(const adc_acq_block_t *block) {
+    if (block_queue != NULL && xQueueSend(block_queue, block, 0) != pdTRUE) {
+        blocks_dropped++; // a gap looks like lost contact to the pipeline, which re-anchors
+    }
+}
+
+void hr_monitor_reset(void) {
+    if (block_queue != NULL) {
+        xQueueReset(block_queue);
+    }
+    taskENTER_CRITICAL(&hr_lock);
+    hr_epoch++;
+    hr_bpm = 0;
+    hr_rr_count = 0;
+    taskEXIT_CRITICAL(&hr_lock);
+    ESP_LOGI(TAG, "PPG: %lu beats, %lu rejected, %lu blocks dropped",
+        (unsigned long)ppg.beats, (unsigned long)ppg.rejected, (unsigned long)blocks_dropped);
+}
+
+uint16_t hr_monitor_bpm(void) {
+    taskENTER_CRITICAL(&hr_lock);
+    uint16_t bpm = hr_bpm;
+    taskEXIT_CRITICAL(&hr_lock);
+    return bpm;
+}
+
+uint8_t hr_monitor_take_rr(uint16_t *rr_ms, uint8_t max) {
+    taskENTER_CRITICAL(&hr_lock);
+    uint8_t n = hr_rr_count < max ? hr_rr_count : max;
+    memcpy(rr_ms, hr_rr, n * sizeof(hr_rr[0]));
+    memmove(hr_rr, hr_rr + n, (hr_rr_count - n) * sizeof(hr_rr[0]));
+    hr_rr_count -= n;
+    taskEXIT_CRITICAL(&hr_lock);
+    return n;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "adc_acq.h"
+#include "ppg.h"
+
+/*
+Heart rate from the PPG input.
+
+PPG blocks from the ADC acquisition task are queued to a task pinned to core 1,
+away from the BLE host and controller on core 0, which runs them through the
+ppg pipeline. The latest BPM and the RR intervals of accepted beats are
+published under a lock for the heart rate channel.
+*/
+
+#define HR_MONITOR_CORE 1
+#define HR_MONITOR_QUEUE_LEN 4 // PPG blocks, 400 ms of slack
+#define HR_MONITOR_RR_MAX PPG_RR_QUEUE // RR intervals kept until taken
+
+esp_err_t hr_monitor_init(void);
+
+// Queues a PPG block; called from the acquisition task, never blocks.
+void hr_monitor_feed(const adc_acq_block_t *block);
+
+// Drops queued blocks and beat history, e.g. when acquisition restarts.
+void hr_monitor_reset(void);
+
+// Latest mean heart rate, 0 while no rhythm is established.
+uint16_t hr_monitor_bpm(void);
+
+// Moves up to max RR intervals (ms, oldest first) into rr_ms.
+uint8_t hr_monitor_take_rr(uint16_t *rr_ms, uint8_t max);
@@ -0,0 +1,48 @@
+#include "hrm.h"
+
+static inline uint8_t *put_le16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+// ms to the 1/1024 s unit of the RR field, saturating
+static uint16_t rr_units(uint16_t rr_ms) {
+    uint32_t u = ((uint32_t)rr_ms * 1024 + 500) / 1000;
+    return u > UINT16_MAX ? UINT16_MAX : u;
+}
+
+uint16_t hrm_encode(const hrm_meas_t *m, uint8_t *dst, uint16_t max_len, uint8_t *rr_used) {
+    uint8_t flags = 0;
+    uint8_t *p = dst + 1;
+    const uint8_t *end = dst + max_len;
+
+    if (m->contact_supported) {
+        flags |= HRM_FLAG_CONTACT_SUPPORTED;
+        if (m->contact) {
+            flags |= HRM_FLAG_CONTACT_DETECTED;
+        }
+    }
+    if (m->bpm > UINT8_MAX) {
+        flags |= HRM_FLAG_HR_UINT16;
+        p = put_le16(p, m->bpm);
+    } else {
+        *p++ = m->bpm;
+    }
+    if (m->has_energy && end - p >= 2) {
+        flags |= HRM_FLAG_ENERGY;
+        p = put_le16(p, m->energy_kj);
+    }
+    uint8_t n = 0;
+    while (n < m->rr_count && end - p >= 2) {
+        p = put_le16(p, rr_units(m->rr_ms[n++]));
+    }
+    if (n > 0) {
+        flags |= HRM_FLAG_RR;
+    }
+    dst[0] = flags;
+    if (rr_used) {
+        *rr_used = n;
+    }
+    return p - dst;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Heart Rate Measurement (0x2A37) encoder, shared by reads and notifications.
+
+    uint8   flags
+    uint8   heart rate, or uint16 when flags bit 0 is set (rate above 255)
+    uint16  energy expended in kJ, when flags bit 3 is set
+    uint16  RR intervals in 1/1024 s, when flags bit 4 is set, as many as fit
+
+All multi-byte fields are little endian. Energy goes before the RR
+intervals, so a frame too short for both keeps it.
+*/
+
+#define HRM_FLAG_HR_UINT16 0x01
+#define HRM_FLAG_CONTACT_DETECTED 0x02
+#define HRM_FLAG_CONTACT_SUPPORTED 0x04
+#define HRM_FLAG_ENERGY 0x08
+#define HRM_FLAG_RR 0x10
+
+#define HRM_MIN_LEN 2 // flags + uint8 heart rate
+
+typedef struct {
+    uint16_t bpm;
+    bool contact_supported;
+    bool contact;
+    bool has_energy;
+    uint16_t energy_kj;    // since the last reset, held at 0xffff once it gets there
+    const uint16_t *rr_ms; // oldest first
+    uint8_t rr_count;
+} hrm_meas_t;
+
+// Encodes m into dst, at most max_len bytes (the ATT payload). RR intervals are
+// added oldest first while they fit; *rr_used reports how many went in.
+// Returns the frame length.
+uint16_t hrm_encode(const hrm_meas_t *m, uint8_t *dst, uint16_t max_len, uint8_t *rr_used);
@@ -0,0 +1,203 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "host/ble_hs.h"
+#include "host/ble_l2cap.h"
+#include "sdkconfig.h"
+#include "l2cap_bulk.h"
+
+static const char *TAG = "l2cap_bulk";
+
+static l2cap_bulk_cbs_t cbs;
+static portMUX_TYPE bulk_lock = portMUX_INITIALIZER_UNLOCKED;
+static struct ble_l2cap_chan *chan = NULL; // behind bulk_lock, set by the host task
+static uint16_t chan_conn_handle;
+static uint16_t peer_sdu = 0; // SDU size we send
+#define SDU_LEN_LEN 2         // SDU length field in the first K-frame
+static bool stalled = false;
+
+static uint32_t sdus_sent, bytes_sent, stalls, send_errors, sdus_received;
+
+#if CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM > 0
+
+// Largest SDU within the peer's CoC MTU that fills whole K-frames: with the
+// length field it is a multiple of the peer's MPS, so no SDU ends in a K-frame
+// (and an LL packet) carrying a few bytes. The CoC MTU itself if it is below one MPS.
+static uint16_t sdu_size(uint16_t coc_mtu, uint16_t mps) {
+    if (mps == 0 || coc_mtu + SDU_LEN_LEN < mps) {
+        return coc_mtu;
+    }
+    return (coc_mtu + SDU_LEN_LEN) / mps * mps - SDU_LEN_LEN;
+}
+
+// Give the peer credits for the next SDU
+static int give_rx_buffer(struct ble_l2cap_chan *c) {
+    struct os_mbuf *sdu = os_msys_get_pkthdr(L2CAP_BULK_MTU, 0);
+    if (sdu == NULL) {
+        ESP_LOGE(TAG, "No buffer for the next SDU, the peer runs out of credits");
+        return BLE_HS_ENOMEM;
+    }
+    return ble_l2cap_recv_ready(c, sdu);
+}
+
+static int bulk_event(struct ble_l2cap_event *event, void *arg) {
+    switch (event->type) {
+        case BLE_L2CAP_EVENT_COC_ACCEPT:
+            // one channel at a time
+            if (l2cap_bulk_connected()) {
+                return BLE_HS_ENOMEM;
+            }
+            return give_rx_buffer(event->accept.chan);
+
+        case BLE_L2CAP_EVENT_COC_CONNECTED: {
+            if (event->connect.status != 0) {
+                ESP_LOGW(TAG, "Channel setup failed: %d", event->connect.status);
+                break;
+            }
+            struct ble_l2cap_chan_info info;
+            uint16_t mtu = 0, mps = 0;
+            if (ble_l2cap_get_chan_info(event->connect.chan, &info) == 0) {
+                mtu = info.peer_coc_mtu;
+                mps = info.peer_l2cap_mtu;
+            }
+            taskENTER_CRITICAL(&bulk_lock);
+            chan = event->connect.chan;
+            chan_conn_handle = event->connect.conn_handle;
+            peer_sdu = sdu_size(mtu, mps);
+            stalled = false;
+            taskEXIT_CRITICAL(&bulk_lock);
+            ESP_LOGI(TAG, "Channel open (conn %u), peer SDU size %u, MPS %u: sending %u byte SDUs",
+                event->connect.conn_handle, mtu, mps, sdu_size(mtu, mps));
+            if (cbs.connected) {
+                cbs.connected(event->connect.conn_handle);
+            }
+            break;
+        }
+
+        case BLE_L2CAP_EVENT_COC_DISCONNECTED:
+            taskENTER_CRITICAL(&bulk_lock);
+            if (chan == event->disconnect.chan) {
+                chan = NULL;
+                peer_sdu = 0;
+            }
+            taskEXIT_CRITICAL(&bulk_lock);
+            ESP_LOGI(TAG, "Channel closed (conn %u)", event->disconnect.conn_handle);
+            l2cap_bulk_log_stats();
+            if (cbs.writable) {
+                cbs.writable(); // let senders notice the channel is gone
+            }
+            break;
+
+        case BLE_L2CAP_EVENT_COC_DATA_RECEIVED:
+            sdus_received++;
+            if (event->receive.sdu_rx != NULL) {
+                if (cbs.received) {
+                    cbs.received(event->receive.sdu_rx);
+                }
+                os_mbuf_free_chain(event->receive.sdu_rx);
+            }
+            give_rx_buffer(event->receive.chan);
+            break;
+
+        case BLE_L2CAP_EVENT_COC_TX_UNSTALLED:
+            taskENTER_CRITICAL(&bulk_lock);
+            stalled = false;
+            taskEXIT_CRITICAL(&bulk_lock);
+            if (cbs.writable) {
+                cbs.writable();
+            }
+            break;
+
+        default:
+            break;
+    }
+    return 0;
+}
+
+esp_err_t l2cap_bulk_init(const l2cap_bulk_cbs_t *callbacks) {
+    cbs = *callbacks;
+    int rc = ble_l2cap_create_server(L2CAP_BULK_PSM, L2CAP_BULK_MTU, bulk_event, NULL);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Failed to create the L2CAP server on PSM 0x%04x: %d", L2CAP_BULK_PSM, rc);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Bulk endpoint on PSM 0x%04x", L2CAP_BULK_PSM);
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t l2cap_bulk_init(const l2cap_bulk_cbs_t *callbacks) {
+    ESP_LOGW(TAG, "CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM is 0, no bulk endpoint");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
+
+bool l2cap_bulk_connected(void) {
+    taskENTER_CRITICAL(&bulk_lock);
+    bool open = chan != NULL;
+    taskEXIT_CRITICAL(&bulk_lock);
+    return open;
+}
+
+bool l2cap_bulk_ready(void) {
+    taskENTER_CRITICAL(&bulk_lock);
+    bool ready = chan != NULL && !stalled;
+    taskEXIT_CRITICAL(&bulk_lock);
+    return ready;
+}
+
+bool l2cap_bulk_stalled(void) {
+    taskENTER_CRITICAL(&bulk_lock);
+    bool held = stalled;
+    taskEXIT_CRITICAL(&bulk_lock);
+    return held;
+}
+
+uint16_t l2cap_bulk_mtu(void) {
+    taskENTER_CRITICAL(&bulk_lock);
+    uint16_t mtu = chan != NULL ? peer_sdu : 0;
+    taskEXIT_CRITICAL(&bulk_lock);
+    return mtu;
+}
+
+int l2cap_bulk_send(const void *data, uint16_t len) {
+    taskENTER_CRITICAL(&bulk_lock);
+    struct ble_l2cap_chan *c = stalled ? NULL : chan;
+    taskEXIT_CRITICAL(&bulk_lock);
+    if (c == NULL) {
+        return BLE_HS_EBUSY;
+    }
+    struct os_mbuf *sdu = os_msys_get_pkthdr(len, 0);
+    if (sdu == NULL) {
+        return BLE_HS_ENOMEM;
+    }
+    if (os_mbuf_append(sdu, data, len) != 0) {
+        os_mbuf_free_chain(sdu);
+        return BLE_HS_ENOMEM;
+    }
+    int rc = ble_l2cap_send(c, sdu);
+    if (rc == BLE_HS_ESTALLED) {
+        // out of credits: the stack keeps this SDU and reports TX_UNSTALLED
+        taskENTER_CRITICAL(&bulk_lock);
+        stalled = true;
+        taskEXIT_CRITICAL(&bulk_lock);
+        stalls++;
+        rc = 0;
+    } else if (rc != 0) {
+        // not taken, the SDU is still ours
+        os_mbuf_free_chain(sdu);
+        send_errors++;
+        return rc;
+    }
+    sdus_sent++;
+    bytes_sent += len;
+    return 0;
+}
+
+void l2cap_bulk_log_stats(void) {
+    ESP_LOGI(TAG, "Bulk channel: %lu SDUs / %lu bytes sent, %lu stalls, %lu send errors, %lu SDUs received",
+        (unsigned long)sdus_sent, (unsigned long)bytes_sent, (unsigned long)stalls,
+        (unsigned long)send_errors, (unsigned long)sdus_received);
+}
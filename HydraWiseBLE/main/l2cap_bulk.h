@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+LE credit-based L2CAP connection-oriented channel for bulk transfers.
+
+A central opens a channel on L2CAP_BULK_PSM. SDUs carry up to the peer's CoC
+MTU, cut to fill whole K-frames, with no ATT header per packet, and the peer
+paces them with credits: once they run out, the stack holds the last SDU, and
+l2cap_bulk_ready() stays false until BLE_L2CAP_EVENT_COC_TX_UNSTALLED.
+Senders pull data (e.g. from the sample log) only while the channel is ready,
+so the peer's credits throttle flash reads as well as the radio.
+
+SDUs received on the channel are handed to the received callback, from the
+NimBLE host task. One channel at a time
+(CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM).
+*/
+
+#define L2CAP_BULK_PSM 0x0081 // dynamic LE PSM range is 0x0080-0x00ff
+#define L2CAP_BULK_MTU 512    // largest SDU we receive
+
+struct os_mbuf;
+
+typedef struct {
+    void (*connected)(uint16_t conn_handle);
+    void (*received)(const struct os_mbuf *sdu); // freed after the call
+    void (*writable)(void);                      // credits came back
+} l2cap_bulk_cbs_t;
+
+esp_err_t l2cap_bulk_init(const l2cap_bulk_cbs_t *cbs);
+
+// A channel is open and its peer has credits for another SDU
+bool l2cap_bulk_ready(void);
+bool l2cap_bulk_connected(void);
+
+// The stack holds the last SDU sent until the peer returns credits. Stays true
+// if the channel closes meanwhile: that SDU never went out.
+bool l2cap_bulk_stalled(void);
+
+// SDU size to send: the largest the peer accepts that fills whole K-frames of
+// its MPS. 0 without a channel.
+uint16_t l2cap_bulk_mtu(void);
+
+// Copies data into an SDU and sends it. Returns 0 if the stack took it (sent,
+// or held until credits arrive, see l2cap_bulk_stalled()), non-zero if the
+// caller should retry later.
+int l2cap_bulk_send(const void *data, uint16_t len);
+
+void l2cap_bulk_log_stats(void);
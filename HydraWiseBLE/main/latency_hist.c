@@ -0,0 +1,38 @@
+#include "latency_hist.h"
+
+static inline void inc_sat(uint32_t *c) {
+    if (*c != UINT32_MAX) {
+        (*c)++;
+    }
+}
+
+uint8_t hist_bucket(uint32_t us) {
+    if (us < (1u << HIST_MIN_SHIFT)) {
+        return 0;
+    }
+    uint8_t b = 31 - __builtin_clz(us) - HIST_MIN_SHIFT + 1;
+    return b < HIST_BUCKETS ? b : HIST_BUCKETS - 1;
+}
+
+void hist_add(latency_hist_t *h, uint32_t us) {
+    inc_sat(&h->count);
+    inc_sat(&h->buckets[hist_bucket(us)]);
+    if (us > h->max_us) {
+        h->max_us = us;
+    }
+}
+
+uint32_t hist_percentile(const latency_hist_t *h, uint8_t pct) {
+    if (h->count == 0) {
+        return 0;
+    }
+    uint64_t want = ((uint64_t)h->count * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (uint8_t i = 0; i < HIST_BUCKETS - 1; i++) {
+        seen += h->buckets[i];
+        if (seen >= want) {
+            return 1u << (i + HIST_MIN_SHIFT);
+        }
+    }
+    return h->max_us;
+}
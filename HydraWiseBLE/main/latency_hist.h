@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+Fixed-bucket log-scale latency histogram.
+
+Bucket 0 counts values below 2^HIST_MIN_SHIFT us, bucket i (i > 0) counts
+[2^(i + HIST_MIN_SHIFT - 1), 2^(i + HIST_MIN_SHIFT)) us and the last bucket
+everything above. With 18 buckets from 64 us that spans 64 us to 4.2 s at a
+factor of two per bucket, so the 1 s batch latency cap and what goes past it
+land in buckets of their own: coarse, but enough to read p50/p99 off, and adding
+a value is a count-leading-zeros and an increment. Counters saturate rather
+than wrap. Not thread safe; the caller serializes.
+*/
+
+#define HIST_BUCKETS 18
+#define HIST_MIN_SHIFT 6
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint32_t buckets[HIST_BUCKETS];
+} latency_hist_t;
+
+void hist_add(latency_hist_t *h, uint32_t us);
+
+// Bucket a value lands in
+uint8_t hist_bucket(uint32_t us);
+
+// Upper bound (us) of the bucket holding the given percentile (0-100), 0 if empty
+uint32_t hist_percentile(const latency_hist_t *h, uint8_t pct);
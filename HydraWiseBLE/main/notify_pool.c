@@ -0,0 +1,77 @@
+#include "notify_pool.h"
+
+#define NOTIFY_POOL_BUF_SIZE (sizeof(struct os_mbuf) + sizeof(struct os_mbuf_pkthdr) + \
+                              NOTIFY_POOL_LEADING_SPACE + NOTIFY_POOL_MAX_PAYLOAD)
+
+static os_membuf_t notify_mem[OS_MEMPOOL_SIZE(NOTIFY_POOL_COUNT, NOTIFY_POOL_BUF_SIZE)];
+static struct os_mempool_ext notify_mempool;
+static struct os_mbuf_pool notify_mbuf_pool;
+static uint32_t alloc_fail = 0;
+static uint16_t block_owner[NOTIFY_POOL_COUNT]; // connection each block was sent on, until it comes back
+static notify_pool_release_fn *release_fn;
+static void *release_arg;
+
+static int block_index(const void *block) {
+    return ((uintptr_t)block - (uintptr_t)notify_mem) / notify_mempool.mpe_mp.mp_block_size;
+}
+
+// Every free of a pool mbuf ends here, from the host task or the sender
+static int notify_pool_put(struct os_mempool_ext *mpe, void *data, void *arg) {
+    int i = block_index(data);
+    uint16_t owner = block_owner[i];
+    block_owner[i] = BLE_HS_CONN_HANDLE_NONE;
+    int rc = os_memblock_put_from_cb(&mpe->mpe_mp, data);
+    if (owner != BLE_HS_CONN_HANDLE_NONE && release_fn != NULL) {
+        release_fn(owner, release_arg);
+    }
+    return rc;
+}
+
+int notify_pool_init(notify_pool_release_fn *on_release, void *arg) {
+    int rc = os_mempool_ext_init(&notify_mempool, NOTIFY_POOL_COUNT, NOTIFY_POOL_BUF_SIZE,
+        notify_mem, "notify_pool");
+    if (rc != 0) {
+        return rc;
+    }
+    for (int i = 0; i < NOTIFY_POOL_COUNT; i++) {
+        block_owner[i] = BLE_HS_CONN_HANDLE_NONE;
+    }
+    release_fn = on_release;
+    release_arg = arg;
+    notify_mempool.mpe_put_cb = notify_pool_put;
+    return os_mbuf_pool_init(&notify_mbuf_pool, &notify_mempool.mpe_mp, NOTIFY_POOL_BUF_SIZE,
+        NOTIFY_POOL_COUNT);
+}
+
+struct os_mbuf *notify_pool_get(void) {
+    struct os_mbuf *om = os_mbuf_get_pkthdr(&notify_mbuf_pool, 0);
+    if (om == NULL) {
+        alloc_fail++;
+        return NULL;
+    }
+    om->om_data += NOTIFY_POOL_LEADING_SPACE;
+    return om;
+}
+
+struct os_mbuf *notify_pool_from_flat(const void *buf, uint16_t len) {
+    struct os_mbuf *om = notify_pool_get();
+    if (om == NULL) {
+        return NULL;
+    }
+    if (os_mbuf_append(om, buf, len) != 0) {
+        os_mbuf_free_chain(om);
+        return NULL;
+    }
+    return om;
+}
+
+void notify_pool_set_owner(struct os_mbuf *om, uint16_t conn_handle) {
+    block_owner[block_index(om)] = conn_handle; // a packet header mbuf starts its block
+}
+
+void notify_pool_stats(notify_pool_stats_t *stats) {
+    stats->blocks = notify_mempool.mpe_mp.mp_num_blocks;
+    stats->free = notify_mempool.mpe_mp.mp_num_free;
+    stats->min_free = notify_mempool.mpe_mp.mp_min_free;
+    stats->alloc_fail = alloc_fail;
+}
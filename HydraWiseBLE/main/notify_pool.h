@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include "host/ble_hs.h"
+
+/*
+Dedicated mbuf pool for outgoing notifications.
+
+Notifications are built directly in mbufs from this pool instead of the shared
+msys pools, so streaming cannot starve the host of buffers for ATT responses
+and a full pool is visible to the sender as backpressure rather than a lost
+sample. The host returns each mbuf to this pool once the controller has taken
+it; an mbuf tagged with its connection reports that release to the callback,
+which is what the per-peer flow window counts as completion.
+*/
+
+#define NOTIFY_POOL_COUNT 8
+#define NOTIFY_POOL_MAX_PAYLOAD 253 // ATT payload at the preferred MTU of 256
+// HCI ACL (4) + L2CAP (4) + ATT notify (3) headers are prepended in place
+#define NOTIFY_POOL_LEADING_SPACE 12
+
+typedef struct {
+    uint16_t blocks;     // mbufs in the pool
+    uint16_t free;       // mbufs free right now
+    uint16_t min_free;   // lowest free count seen
+    uint32_t alloc_fail; // gets that found the pool empty
+} notify_pool_stats_t;
+
+// Called with the connection an mbuf was tagged for, from whichever task freed it
+typedef void notify_pool_release_fn(uint16_t conn_handle, void *arg);
+
+int notify_pool_init(notify_pool_release_fn *on_release, void *arg);
+
+// Empty packet-header mbuf with room for NOTIFY_POOL_MAX_PAYLOAD bytes, or
+// NULL if every mbuf is in flight.
+struct os_mbuf *notify_pool_get(void);
+
+// Copies a flat buffer into a pool mbuf, like ble_hs_mbuf_from_flat().
+struct os_mbuf *notify_pool_from_flat(const void *buf, uint16_t len);
+
+// Tags a pool mbuf about to be sent on conn_handle, so its release is reported
+void notify_pool_set_owner(struct os_mbuf *om, uint16_t conn_handle);
+
+void notify_pool_stats(notify_pool_stats_t *stats);
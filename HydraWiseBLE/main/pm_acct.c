@@ -0,0 +1,98 @@
+#include <string.h>
+#include "pm_acct.h"
+
+// Level in force: the highest any held lock asks for
+static uint8_t current_level(const pm_acct_t *a) {
+    for (int l = PM_ACCT_LEVELS - 1; l > PM_ACCT_MIN; l--) {
+        if (a->held[l] > 0) {
+            return (uint8_t)l;
+        }
+    }
+    return PM_ACCT_MIN;
+}
+
+// Charges the time since the last level change and moves to the new level
+static void level_update(pm_acct_t *a, uint64_t now_us) {
+    uint8_t level = current_level(a);
+    if (level != a->level) {
+        a->level_us[a->level] += now_us - a->level_since_us;
+        a->level = level;
+        a->level_since_us = now_us;
+    }
+}
+
+void pm_acct_init(pm_acct_t *a, uint64_t now_us) {
+    memset(a, 0, sizeof(*a));
+    a->level = PM_ACCT_MIN;
+    a->level_since_us = now_us;
+    a->start_us = now_us;
+}
+
+int pm_acct_add(pm_acct_t *a, const char *name, pm_acct_level_t level) {
+    if (a->count >= PM_ACCT_MAX_LOCKS || level >= PM_ACCT_LEVELS) {
+        return -1;
+    }
+    a->locks[a->count] = (pm_acct_lock_t){ .name = name, .level = level };
+    return a->count++;
+}
+
+void pm_acct_acquire(pm_acct_t *a, int id, uint64_t now_us) {
+    pm_acct_lock_t *l = &a->locks[id];
+    if (l->depth++ > 0) {
+        return;
+    }
+    l->acquires++;
+    l->since_us = now_us;
+    a->held[l->level]++;
+    level_update(a, now_us);
+}
+
+void pm_acct_release(pm_acct_t *a, int id, uint64_t now_us) {
+    pm_acct_lock_t *l = &a->locks[id];
+    if (l->depth == 0) {
+        a->unbalanced++;
+        return;
+    }
+    if (--l->depth > 0) {
+        return;
+    }
+    l->held_us += now_us - l->since_us;
+    a->held[l->level]--;
+    level_update(a, now_us);
+}
+
+void pm_acct_slept(pm_acct_t *a, uint64_t us, uint32_t sleeps) {
+    a->slept_us += us;
+    a->sleeps += sleeps;
+}
+
+void pm_acct_restart(pm_acct_t *a, uint64_t now_us) {
+    for (int i = 0; i < a->count; i++) {
+        pm_acct_lock_t *l = &a->locks[i];
+        l->held_us = 0;
+        l->acquires = l->depth > 0;
+        l->since_us = now_us;
+    }
+    memset(a->level_us, 0, sizeof(a->level_us));
+    a->level_since_us = now_us;
+    a->start_us = now_us;
+    a->slept_us = 0;
+    a->sleeps = 0;
+    a->unbalanced = 0;
+}
+
+void pm_acct_report(const pm_acct_t *a, uint64_t now_us, pm_acct_report_t *r) {
+    memcpy(r->level_us, a->level_us, sizeof(r->level_us));
+    r->level_us[a->level] += now_us - a->level_since_us;
+    r->total_us = now_us - a->start_us;
+    // sleep only happens with no lock held; a report racing a wakeup may see
+    // the sleep before the MIN time that covers it
+    r->slept_us = a->slept_us < r->level_us[PM_ACCT_MIN] ? a->slept_us : r->level_us[PM_ACCT_MIN];
+    r->level_us[PM_ACCT_MIN] -= r->slept_us;
+    r->sleeps = a->sleeps;
+}
+
+uint64_t pm_acct_held_us(const pm_acct_t *a, int id, uint64_t now_us) {
+    const pm_acct_lock_t *l = &a->locks[id];
+    return l->held_us + (l->depth > 0 ? now_us - l->since_us : 0);
+}
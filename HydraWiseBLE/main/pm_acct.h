@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Power-management lock and duty-cycle accounting.
+
+Mirrors the esp_pm lock model: every lock asks for a minimum level while it
+is held, and the chip runs at the highest level any held lock asks for:
+    MAX     CPU at the maximum frequency (ESP_PM_CPU_FREQ_MAX)
+    APB     APB at 80 MHz (ESP_PM_APB_FREQ_MAX), e.g. the ADC DMA driver
+    MIN     no lock: minimum frequency, and light sleep whenever FreeRTOS
+            idles long enough
+Locks count recursively like esp_pm locks. Time is charged to the level in
+force, per lock to its holders, and light sleep reported by the sleep
+callbacks is taken out of the MIN time. Timestamps are passed in, so the
+same code runs under a virtual clock on the host. Not thread safe; the
+caller serializes.
+*/
+
+#define PM_ACCT_MAX_LOCKS 6
+
+typedef enum {
+    PM_ACCT_MIN,
+    PM_ACCT_APB,
+    PM_ACCT_MAX,
+    PM_ACCT_LEVELS,
+} pm_acct_level_t;
+
+typedef struct {
+    const char *name;
+    uint8_t level;      // pm_acct_level_t asked for while held
+    uint8_t depth;      // recursive holds
+    uint32_t acquires;  // 0 -> 1 transitions
+    uint64_t since_us;  // start of the current hold
+    uint64_t held_us;
+} pm_acct_lock_t;
+
+typedef struct {
+    pm_acct_lock_t locks[PM_ACCT_MAX_LOCKS];
+    uint8_t count;
+    uint8_t held[PM_ACCT_LEVELS]; // locks held per level
+    uint8_t level;                // level in force
+    uint64_t level_since_us;
+    uint64_t level_us[PM_ACCT_LEVELS];
+    uint64_t start_us;
+    uint64_t slept_us;
+    uint32_t sleeps;
+    uint32_t unbalanced;          // releases of a lock that was not held
+} pm_acct_t;
+
+// Accounting as seen over [start_us, now]
+typedef struct {
+    uint64_t total_us;
+    uint64_t level_us[PM_ACCT_LEVELS]; // MIN excludes the time asleep
+    uint64_t slept_us;
+    uint32_t sleeps;
+} pm_acct_report_t;
+
+void pm_acct_init(pm_acct_t *a, uint64_t now_us);
+
+// Registers a lock. Returns its id, or -1 if the table is full.
+int pm_acct_add(pm_acct_t *a, const char *name, pm_acct_level_t level);
+
+void pm_acct_acquire(pm_acct_t *a, int id, uint64_t now_us);
+void pm_acct_release(pm_acct_t *a, int id, uint64_t now_us);
+
+// Adds `sleeps` light sleeps totalling `us`, as reported on wakeup
+void pm_acct_slept(pm_acct_t *a, uint64_t us, uint32_t sleeps);
+
+// Starts a new accounting period at now, e.g. per session. Locks still held
+// are charged from now on; acquire counts restart.
+void pm_acct_restart(pm_acct_t *a, uint64_t now_us);
+
+// Totals up to now, including the holds still open
+void pm_acct_report(const pm_acct_t *a, uint64_t now_us, pm_acct_report_t *r);
+
+// Time lock id was held up to now, including an open hold
+uint64_t pm_acct_held_us(const pm_acct_t *a, int id, uint64_t now_us);
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+#include "sdkconfig.h"
+#include "power.h"
+#include "pm_acct.h"
+
+static const char *TAG = "power";
+
+static const struct {
+    const char *name;
+    esp_pm_lock_type_t type;
+    pm_acct_level_t level;
+    bool accounted_only;
+} lock_defs[POWER_LOCK_COUNT] = {
+    [POWER_LOCK_ADC] = { "adc", ESP_PM_APB_FREQ_MAX, PM_ACCT_APB, true },
+    [POWER_LOCK_SAMPLING] = { "sampling", ESP_PM_CPU_FREQ_MAX, PM_ACCT_MAX, false },
+    [POWER_LOCK_DSP] = { "dsp", ESP_PM_CPU_FREQ_MAX, PM_ACCT_MAX, false },
+    [POWER_LOCK_RADIO] = { "radio", ESP_PM_CPU_FREQ_MAX, PM_ACCT_MAX, false },
+};
+
+static esp_pm_lock_handle_t locks[POWER_LOCK_COUNT];
+static int acct_ids[POWER_LOCK_COUNT];
+static pm_acct_t acct;
+static portMUX_TYPE acct_lock = portMUX_INITIALIZER_UNLOCKED; // tasks on both cores
+
+// Filled by the light sleep exit callback, folded into acct by power_log_period()
+static portMUX_TYPE sleep_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t slept_us;
+static uint32_t sleeps;
+
+static uint64_t now_us(void) {
+    return (uint64_t)esp_timer_get_time(); // esp_timer is corrected for light sleep
+}
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+// Runs in the idle task with interrupts off: count and leave
+static esp_err_t IRAM_ATTR on_sleep_exit(int64_t sleep_time_us, void *arg) {
+    portENTER_CRITICAL_SAFE(&sleep_lock);
+    slept_us += sleep_time_us;
+    sleeps++;
+    portEXIT_CRITICAL_SAFE(&sleep_lock);
+    return ESP_OK;
+}
+#endif
+
+esp_err_t power_init(void) {
+    pm_acct_init(&acct, now_us());
+    for (int i = 0; i < POWER_LOCK_COUNT; i++) {
+        acct_ids[i] = pm_acct_add(&acct, lock_defs[i].name, lock_defs[i].level);
+    }
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = POWER_MIN_FREQ_MHZ,
+        .light_sleep_enable = true,
+    };
+    esp_err_t err = esp_pm_configure(&pm);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_pm_configure failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    for (int i = 0; i < POWER_LOCK_COUNT; i++) {
+        if (lock_defs[i].accounted_only) {
+            continue;
+        }
+        err = esp_pm_lock_create(lock_defs[i].type, 0, lock_defs[i].name, &locks[i]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create the %s PM lock: %s", lock_defs[i].name, esp_err_to_name(err));
+            return err;
+        }
+    }
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t cbs = { .exit_cb = on_sleep_exit };
+    err = esp_pm_light_sleep_register_cbs(&cbs);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Light sleep time is not accounted: %s", esp_err_to_name(err));
+    }
+#endif
+    ESP_LOGI(TAG, "DFS %u-%u MHz, automatic light sleep", POWER_MIN_FREQ_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+#else
+    ESP_LOGW(TAG, "CONFIG_PM_ENABLE is off, running at a fixed %u MHz", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+#endif
+    return ESP_OK;
+}
+
+void power_lock(power_lock_t lock) {
+    if (locks[lock] != NULL) {
+        esp_pm_lock_acquire(locks[lock]); // before the work, so it runs at full speed
+    }
+    taskENTER_CRITICAL(&acct_lock);
+    pm_acct_acquire(&acct, acct_ids[lock], now_us());
+    taskEXIT_CRITICAL(&acct_lock);
+}
+
+void power_unlock(power_lock_t lock) {
+    taskENTER_CRITICAL(&acct_lock);
+    pm_acct_release(&acct, acct_ids[lock], now_us());
+    taskEXIT_CRITICAL(&acct_lock);
+    if (locks[lock] != NULL) {
+        esp_pm_lock_release(locks[lock]);
+    }
+}
+
+// Share of total in tenths of a percent
+static unsigned permille(uint64_t part, uint64_t total) {
+    return total > 0 ? (unsigned)(part * 1000 / total) : 0;
+}
+
+void power_log_period(const char *period) {
+    taskENTER_CRITICAL(&sleep_lock);
+    uint64_t us = slept_us;
+    uint32_t n = sleeps;
+    slept_us = 0;
+    sleeps = 0;
+    taskEXIT_CRITICAL(&sleep_lock);
+
+    pm_acct_report_t r;
+    uint64_t held[POWER_LOCK_COUNT];
+    uint32_t acquires[POWER_LOCK_COUNT];
+    uint64_t now = now_us();
+    taskENTER_CRITICAL(&acct_lock);
+    pm_acct_slept(&acct, us, n);
+    pm_acct_report(&acct, now, &r);
+    for (int i = 0; i < POWER_LOCK_COUNT; i++) {
+        held[i] = pm_acct_held_us(&acct, acct_ids[i], now);
+        acquires[i] = acct.locks[acct_ids[i]].acquires;
+    }
+    pm_acct_restart(&acct, now);
+    taskEXIT_CRITICAL(&acct_lock);
+
+    unsigned p_max = permille(r.level_us[PM_ACCT_MAX], r.total_us);
+    unsigned p_apb = permille(r.level_us[PM_ACCT_APB], r.total_us);
+    unsigned p_min = permille(r.level_us[PM_ACCT_MIN], r.total_us);
+    unsigned p_sleep = permille(r.slept_us, r.total_us);
+    ESP_LOGI(TAG, "Power, %s of %lu ms: %u MHz %u.%u%%, %u MHz %u.%u%%, %u MHz %u.%u%%, light sleep %u.%u%% (%lu sleeps)",
+        period, (unsigned long)(r.total_us / 1000),
+        CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, p_max / 10, p_max % 10,
+        POWER_APB_FREQ_MHZ, p_apb / 10, p_apb % 10,
+        POWER_MIN_FREQ_MHZ, p_min / 10, p_min % 10,
+        p_sleep / 10, p_sleep % 10, (unsigned long)r.sleeps);
+    for (int i = 0; i < POWER_LOCK_COUNT; i++) {
+        if (acquires[i] > 0) {
+            ESP_LOGI(TAG, "  %s lock: %lu holds, %lu ms", lock_defs[i].name,
+                (unsigned long)acquires[i], (unsigned long)(held[i] / 1000));
+        }
+    }
+#if POWER_DUMP_LOCKS && CONFIG_PM_PROFILING
+    esp_pm_dump_locks(stdout); // the driver's view, every lock in the system
+#endif
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+Dynamic frequency scaling, automatic light sleep and the PM locks that hold
+the CPU up around work.
+
+The CPU idles at the XTAL frequency and light-sleeps between connection and
+advertising events whenever FreeRTOS has nothing to run (tickless idle). Work
+bursts hold a lock for their duration only: an ADC frame being split and
+decimated, a PPG block through the heart rate pipeline, a scheduler pass of
+notification sends. While acquisition runs the ADC DMA driver keeps APB at
+80 MHz and the chip awake; between sessions nothing does.
+
+Every lock is also counted in a pm_acct_t, so each session and each idle gap
+between sessions gets a duty-cycle report: time per frequency, time in light
+sleep and time each lock was held.
+
+Build with POWER_DUMP_LOCKS 1 (and CONFIG_PM_PROFILING) to follow each report
+with the driver's esp_pm_dump_locks() table of every lock in the system. Off
+by default: profiling adds to each lock operation and the dump holds the
+caller for the console.
+*/
+
+#ifndef POWER_DUMP_LOCKS
+#define POWER_DUMP_LOCKS 0
+#endif
+
+#define POWER_MIN_FREQ_MHZ CONFIG_XTAL_FREQ
+#define POWER_APB_FREQ_MHZ 80
+
+typedef enum {
+    POWER_LOCK_ADC,      // accounting only, the ADC driver holds its own APB lock while started
+    POWER_LOCK_SAMPLING, // acquisition task, per DMA frame
+    POWER_LOCK_DSP,      // heart rate task, per PPG block
+    POWER_LOCK_RADIO,    // scheduler task, per pass of notification sends
+    POWER_LOCK_COUNT,
+} power_lock_t;
+
+// Configures DFS and light sleep and creates the locks. Without CONFIG_PM_ENABLE
+// the locks are accounted but do nothing.
+esp_err_t power_init(void);
+
+void power_lock(power_lock_t lock);
+void power_unlock(power_lock_t lock);
+
+// Logs the duty cycle since the previous call (or boot) as `period`, e.g.
+// "session" or "idle", and starts the next period.
+void power_log_period(const char *period);
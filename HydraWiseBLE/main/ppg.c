@@ -0,0 +1,153 @@
+#include <string.h>
+#include "ppg.h"
+
+// Largest k with (1 << k) <= n
+static uint8_t log2_floor(uint32_t n) {
+    uint8_t k = 0;
+    while (k < 31 && (2u << k) <= n) {
+        k++;
+    }
+    return k;
+}
+
+void ppg_init(ppg_t *p, uint16_t fs_hz, bool invert) {
+    if (fs_hz < PPG_FS_MIN) {
+        fs_hz = PPG_FS_MIN;
+    }
+    if (fs_hz > PPG_FS_MAX) {
+        fs_hz = PPG_FS_MAX;
+    }
+    memset(p, 0, sizeof(*p));
+    p->fs_hz = fs_hz;
+    p->invert = invert;
+    p->dc_shift = log2_floor(fs_hz * 32 / 100);       // time constant ~0.32 s, corner ~0.5 Hz
+    p->ma_shift = log2_floor(fs_hz / 8);              // first null at >= 8 Hz
+    p->env_shift = log2_floor(fs_hz * 4);             // envelope decays over ~4 s
+    p->settle = fs_hz;                                // one second for the filters to settle
+    p->refractory = (uint32_t)fs_hz * PPG_REFRACTORY_MS / 1000;
+}
+
+void ppg_reset(ppg_t *p) {
+    ppg_init(p, p->fs_hz, p->invert);
+}
+
+static void rr_queue_push(ppg_t *p, uint16_t rr_ms) {
+    if (p->rr_count == PPG_RR_QUEUE) {
+        p->rr_head = (p->rr_head + 1) % PPG_RR_QUEUE; // drop the oldest
+        p->rr_count--;
+        p->rr_dropped++;
+    }
+    p->rr_queue[(p->rr_head + p->rr_count) % PPG_RR_QUEUE] = rr_ms;
+    p->rr_count++;
+}
+
+static void rr_hist_clear(ppg_t *p) {
+    p->rr_hist_n = 0;
+    p->rr_hist_pos = 0;
+    p->rr_sum = 0;
+    p->bpm = 0;
+}
+
+static void accept_beat(ppg_t *p, uint16_t rr_ms) {
+    if (p->rr_hist_n == PPG_AVG_BEATS) {
+        p->rr_sum -= p->rr_hist[p->rr_hist_pos];
+    } else {
+        p->rr_hist_n++;
+    }
+    p->rr_hist[p->rr_hist_pos] = rr_ms;
+    p->rr_hist_pos = (p->rr_hist_pos + 1) % PPG_AVG_BEATS;
+    p->rr_sum += rr_ms;
+    if (p->rr_hist_n >= PPG_AVG_MIN) {
+        p->bpm = (60000u * p->rr_hist_n + p->rr_sum / 2) / p->rr_sum;
+    }
+    rr_queue_push(p, rr_ms);
+    p->beats++;
+}
+
+// A peak at sample index `at` passed the amplitude test
+static bool on_peak(ppg_t *p, uint32_t at) {
+    if (!p->anchored) {
+        p->anchored = true;
+        p->last_beat = at;
+        return false;
+    }
+    uint32_t gap = at - p->last_beat;
+    if (gap < p->refractory) {
+        return false; // dicrotic notch or noise on the same pulse
+    }
+    uint32_t rr_ms = gap * 1000 / p->fs_hz;
+    if (rr_ms > PPG_RR_MAX_MS) {
+        // lost contact or missed beats: start over from this one
+        p->last_beat = at;
+        rr_hist_clear(p);
+        return false;
+    }
+    if (rr_ms < PPG_RR_MIN_MS) {
+        p->rejected++;
+        return false;
+    }
+    if (p->rr_hist_n >= PPG_AVG_MIN) {
+        uint32_t mean = p->rr_sum / p->rr_hist_n;
+        uint32_t tol = mean * PPG_RR_TOL_PCT / 100;
+        if (rr_ms + tol < mean) {
+            // early: an extra peak inside this pulse, keep the anchor
+            p->rejected++;
+            return false;
+        }
+        if (rr_ms > mean + tol) {
+            // late: a missed beat or a rhythm change
+            p->rejected++;
+            p->last_beat = at;
+            if (++p->rejected_run >= PPG_AVG_MIN) {
+                rr_hist_clear(p);
+                p->rejected_run = 0;
+            }
+            return false;
+        }
+    }
+    p->rejected_run = 0;
+    p->last_beat = at;
+    accept_beat(p, rr_ms);
+    return true;
+}
+
+bool ppg_feed(ppg_t *p, uint16_t raw) {
+    int32_t x = (int32_t)raw << 8;
+    if (!p->primed) {
+        p->dc = x;
+        p->primed = true;
+    }
+
+    // band-pass
+    p->dc += (x - p->dc) >> p->dc_shift;
+    int32_t hp = p->invert ? p->dc - x : x - p->dc;
+    p->ma_sum += hp - p->ma_buf[p->ma_pos];
+    p->ma_buf[p->ma_pos] = hp;
+    p->ma_pos = (p->ma_pos + 1) & ((1u << p->ma_shift) - 1);
+    int32_t y = p->ma_sum >> p->ma_shift;
+
+    // peak at the previous sample?
+    bool beat = false;
+    p->env -= p->env >> p->env_shift;
+    if (p->y1 > p->y2 && p->y1 >= y && p->n >= p->settle) {
+        int32_t peak = p->y1;
+        if (peak > (PPG_MIN_AMPLITUDE << 8) && peak > p->env - (p->env >> 2)) {
+            p->env += (peak - p->env) / 2;
+            beat = on_peak(p, p->n - 1);
+        }
+    }
+    p->y2 = p->y1;
+    p->y1 = y;
+    p->n++;
+    return beat;
+}
+
+uint8_t ppg_take_rr(ppg_t *p, uint16_t *rr_ms, uint8_t max) {
+    uint8_t n = 0;
+    while (n < max && p->rr_count > 0) {
+        rr_ms[n++] = p->rr_queue[p->rr_head];
+        p->rr_head = (p->rr_head + 1) % PPG_RR_QUEUE;
+        p->rr_count--;
+    }
+    return n;
+}
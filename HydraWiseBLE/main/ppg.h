@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Photoplethysmogram (PPG) heart rate pipeline, integer only.
+
+Per raw sample:
+    band-pass   DC tracker (first-order high-pass, ~0.5 Hz) followed by a
+                power-of-two moving average (low-pass, first null >= 8 Hz)
+    peaks       local maxima above 3/4 of a decaying peak envelope, with a
+                250 ms refractory period (240 bpm ceiling)
+    validation  RR between PPG_RR_MIN_MS and PPG_RR_MAX_MS and, once a few
+                beats are known, within PPG_RR_TOL_PCT of the running mean
+
+Accepted beats update the BPM (mean of the last PPG_AVG_BEATS intervals) and
+queue their RR interval for the HRM encoder. Everything per sample is adds
+and shifts; divisions only happen once per beat. Input rates from PPG_FS_MIN
+to PPG_FS_MAX are supported. No ESP-IDF dependency, so the same code runs
+against recorded waveforms on the host.
+*/
+
+#define PPG_FS_MIN 100
+#define PPG_FS_MAX 400
+#define PPG_MA_MAX 32        // moving average taps at PPG_FS_MAX
+#define PPG_AVG_BEATS 8      // RR intervals averaged into the BPM
+#define PPG_AVG_MIN 3        // beats before a BPM is reported
+#define PPG_RR_QUEUE 16      // RR intervals waiting for the encoder
+#define PPG_RR_MIN_MS 300    // 200 bpm
+#define PPG_RR_MAX_MS 2000   // 30 bpm
+#define PPG_RR_TOL_PCT 30
+#define PPG_REFRACTORY_MS 250
+#define PPG_MIN_AMPLITUDE 4  // raw counts; smaller peaks are noise
+
+typedef struct {
+    uint16_t fs_hz;
+    bool invert;            // photodiode output falls on each pulse
+
+    // band-pass, values in raw counts << 8
+    bool primed;
+    int32_t dc;
+    uint8_t dc_shift;
+    int32_t ma_buf[PPG_MA_MAX];
+    int32_t ma_sum;
+    uint8_t ma_shift;       // taps = 1 << ma_shift
+    uint8_t ma_pos;
+
+    // peak detection
+    int32_t y1, y2;         // previous two filtered values
+    int32_t env;            // peak envelope
+    uint8_t env_shift;
+    uint32_t n;             // samples seen
+    uint32_t settle;        // samples before peaks count
+    uint32_t refractory;    // samples
+    bool anchored;
+    uint32_t last_beat;     // sample index of the last accepted beat
+
+    // validation and output
+    uint16_t rr_hist[PPG_AVG_BEATS];
+    uint8_t rr_hist_n;
+    uint8_t rr_hist_pos;
+    uint32_t rr_sum;
+    uint8_t rejected_run;   // consecutive rejected beats
+    uint16_t bpm;
+    uint16_t rr_queue[PPG_RR_QUEUE];
+    uint8_t rr_head;
+    uint8_t rr_count;
+
+    uint32_t beats;         // accepted
+    uint32_t rejected;
+    uint32_t rr_dropped;    // queue overflow, encoder fell behind
+} ppg_t;
+
+// fs_hz is clamped to [PPG_FS_MIN, PPG_FS_MAX].
+void ppg_init(ppg_t *p, uint16_t fs_hz, bool invert);
+
+// Forgets filter state and beat history, e.g. when acquisition restarts.
+void ppg_reset(ppg_t *p);
+
+// Feeds one raw sample. Returns true if it completed an accepted beat.
+bool ppg_feed(ppg_t *p, uint16_t raw);
+
+// Mean heart rate over the recent beats, 0 until PPG_AVG_MIN beats were accepted.
+static inline uint16_t ppg_bpm(const ppg_t *p) {
+    return p->bpm;
+}
+
+// Moves up to max queued RR intervals (ms, oldest first) into rr_ms.
+uint8_t ppg_take_rr(ppg_t *p, uint16_t *rr_ms, uint8_t max);
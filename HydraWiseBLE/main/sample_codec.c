@@ -0,0 +1,119 @@
+#include <string.h>
+#include "sample_codec.h"
+
+#define TOKEN_FLAGS 0x4
+#define TOKEN_CHANNEL_MASK 0x3
+#define TOKEN_SHIFT 3
+
+static inline uint32_t zigzag32(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag32(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static inline uint16_t zigzag16(int16_t v) {
+    return ((uint16_t)v << 1) ^ (uint16_t)(v >> 15);
+}
+
+static inline int16_t unzigzag16(uint16_t v) {
+    return (int16_t)((v >> 1) ^ -(v & 1));
+}
+
+static uint8_t varint_len(uint64_t v) {
+    uint8_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static uint8_t *varint_put(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+// Reads at most max_bytes; NULL if the varint runs past avail or is too long
+static const uint8_t *varint_get(const uint8_t *p, const uint8_t *end, uint8_t max_bytes, uint64_t *v) {
+    uint64_t r = 0;
+    for (uint8_t i = 0; i < max_bytes && p < end; i++) {
+        uint8_t b = *p++;
+        r |= (uint64_t)(b & 0x7f) << (7 * i);
+        if (!(b & 0x80)) {
+            *v = r;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+void codec_init(codec_t *c, uint32_t base_ts) {
+    memset(c, 0, sizeof(*c));
+    c->ts = base_ts;
+}
+
+uint16_t codec_put(codec_t *c, const sample_t *s, bool mixed, uint8_t *dst, uint16_t avail) {
+    uint8_t ch = mixed ? s->channel : 0;
+    if (ch >= CODEC_CHANNELS) {
+        return 0;
+    }
+    uint32_t dt = s->ts_ms - c->ts;
+    uint64_t token = zigzag32((int32_t)(dt - c->dt));
+    if (mixed) {
+        token = token << TOKEN_SHIFT | (s->flags ? TOKEN_FLAGS : 0) | ch;
+    }
+    uint16_t dv = zigzag16((int16_t)(s->value - c->value[ch]));
+    uint16_t len = varint_len(token) + varint_len(dv) + (mixed && s->flags ? 1 : 0);
+    if (len > avail) {
+        return 0;
+    }
+    uint8_t *p = varint_put(dst, token);
+    if (mixed && s->flags) {
+        *p++ = s->flags;
+    }
+    varint_put(p, dv);
+    c->ts = s->ts_ms;
+    c->dt = dt;
+    c->value[ch] = s->value;
+    return len;
+}
+
+uint16_t codec_get(codec_t *c, sample_t *s, bool mixed, uint8_t channel, const uint8_t *src, uint16_t avail) {
+    const uint8_t *end = src + avail;
+    uint64_t token, dv;
+    const uint8_t *p = varint_get(src, end, 5, &token);
+    if (p == NULL) {
+        return 0;
+    }
+    uint8_t ch = 0;
+    uint8_t flags = 0;
+    if (mixed) {
+        ch = token & TOKEN_CHANNEL_MASK;
+        if (token & TOKEN_FLAGS) {
+            if (p == end) {
+                return 0;
+            }
+            flags = *p++;
+        }
+        token >>= TOKEN_SHIFT;
+    }
+    p = varint_get(p, end, 3, &dv);
+    if (p == NULL || token > UINT32_MAX || dv > UINT16_MAX) {
+        return 0;
+    }
+    c->dt += (uint32_t)unzigzag32(token);
+    c->ts += c->dt;
+    c->value[ch] += unzigzag16(dv);
+    s->ts_ms = c->ts;
+    s->acq_us = SAMPLE_NO_ACQUIRE;
+    s->value = c->value[ch];
+    s->channel = mixed ? ch : channel;
+    s->flags = flags;
+    return p - src;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sample_ring.h"
+
+/*
+Lossless delta coding of sample runs, shared by notification frames
+(batch.h) and flash log records (sample_log.h).
+
+Each sample is coded against the previous one as two zigzag varints (LEB128,
+7 bits per byte, low bits first):
+    timestamp   delta of delta: (ts - prev_ts) - (prev_ts - prev_prev_ts)
+    value       delta from the previous value on the same channel
+
+A steady sample rate makes the timestamp term 0 and slowly changing signals
+keep the value term within +-63, so a typical sample takes 2 bytes instead of
+4 (frames) or 8 (log). Arithmetic wraps (32-bit timestamps, 16-bit values), so
+any input round-trips exactly; the worst case is CODEC_MAX_SAMPLE_LEN bytes.
+
+A mixed run carries several channels: the timestamp varint then holds
+(zigzag(dod) << 3) | has_flags << 2 | channel, followed by the flags byte if
+they are not 0, and value deltas are kept per channel. A single-channel run
+takes the channel from the caller and drops flags, which frames do not carry.
+
+The decoder needs the same starting state as the encoder: codec_init() with
+the run's base timestamp, which the container stores.
+*/
+
+#define CODEC_CHANNELS 4        // channel ids a mixed run can carry
+#define CODEC_MIN_SAMPLE_LEN 2
+#define CODEC_MAX_SAMPLE_LEN 9  // 5-byte timestamp token, 3-byte value delta, flags
+
+typedef struct {
+    uint32_t ts;                     // previous timestamp
+    uint32_t dt;                     // previous timestamp delta
+    uint16_t value[CODEC_CHANNELS];  // previous value per channel
+} codec_t;
+
+void codec_init(codec_t *c, uint32_t base_ts);
+
+// Appends one sample to dst. Returns the bytes written, 0 if it does not fit in
+// avail (the state is then unchanged) or, in a mixed run, its channel is out
+// of range.
+uint16_t codec_put(codec_t *c, const sample_t *s, bool mixed, uint8_t *dst, uint16_t avail);
+
+// Decodes one sample from src; channel is used for single-channel runs.
+// Returns the bytes consumed, 0 if src is truncated or malformed.
+uint16_t codec_get(codec_t *c, sample_t *s, bool mixed, uint8_t channel, const uint8_t *src, uint16_t avail);
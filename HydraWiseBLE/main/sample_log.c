@@ -0,0 +1,317 @@
+#include <string.h>
+#include "sample_log.h"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+} sector_hdr_t;
+
+static uint16_t crc16(uint16_t crc, const uint8_t *p, uint32_t len) {
+    while (len--) {
+        crc ^= (uint16_t)*p++ << 8;
+        for (int i = 0; i < 8; i++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static uint16_t record_crc(uint16_t len, const uint8_t *payload) {
+    uint8_t l[2] = { len & 0xff, len >> 8 };
+    return crc16(crc16(0xffff, l, 2), payload, len);
+}
+
+static inline uint16_t record_size(uint16_t len) {
+    return (SLOG_REC_HDR + len + 3) & ~3u;
+}
+
+static inline uint32_t sector_addr(const slog_t *log, uint16_t sector) {
+    return (uint32_t)sector * SLOG_SECTOR_SIZE;
+}
+
+static inline uint16_t next_sector(const slog_t *log, uint16_t sector) {
+    return (sector + 1) % log->flash.sectors;
+}
+
+static bool read_hdr(slog_t *log, uint16_t sector, sector_hdr_t *hdr) {
+    if (log->flash.read(log->flash.ctx, sector_addr(log, sector), hdr, sizeof(*hdr)) != 0) {
+        log->io_errors++;
+        return false;
+    }
+    return hdr->magic == SLOG_MAGIC && hdr->seq != UINT32_MAX;
+}
+
+// True if sector is one of the used sectors, tail to head
+static inline bool sector_live(const slog_t *log, uint16_t sector) {
+    return (uint16_t)((sector + log->flash.sectors - log->tail) % log->flash.sectors) < log->used;
+}
+
+// Reads and checks the record at (sector, off). Returns the payload length,
+// 0 for erased flash, -1 for a torn or unreadable record.
+static int read_record(slog_t *log, uint16_t sector, uint16_t off, uint8_t *payload) {
+    uint8_t hdr[SLOG_REC_HDR];
+    if (off + SLOG_REC_HDR > SLOG_SECTOR_SIZE) {
+        return 0;
+    }
+    if (log->flash.read(log->flash.ctx, sector_addr(log, sector) + off, hdr, sizeof(hdr)) != 0) {
+        log->io_errors++;
+        return -1;
+    }
+    uint16_t len = hdr[0] | hdr[1] << 8;
+    uint16_t crc = hdr[2] | hdr[3] << 8;
+    if (len == 0xffff && crc == 0xffff) {
+        return 0;
+    }
+    if (len <= SLOG_BASE_LEN || len > SLOG_MAX_PAYLOAD ||
+        off + record_size(len) > SLOG_SECTOR_SIZE) {
+        return -1;
+    }
+    if (log->flash.read(log->flash.ctx, sector_addr(log, sector) + off + SLOG_REC_HDR, payload, len) != 0) {
+        log->io_errors++;
+        return -1;
+    }
+    return record_crc(len, payload) == crc ? len : -1;
+}
+
+int slog_open(slog_t *log, const slog_flash_t *flash) {
+    memset(log, 0, sizeof(*log));
+    log->flash = *flash;
+
+    // newest sector by sequence number
+    sector_hdr_t hdr;
+    bool found = false;
+    uint32_t retired_seq = 0;
+    for (uint16_t s = 0; s < flash->sectors; s++) {
+        if (read_hdr(log, s, &hdr)) {
+            if (!found || hdr.seq > log->head_seq) {
+                found = true;
+                log->head = s;
+                log->head_seq = hdr.seq;
+            }
+        } else if (!found && hdr.magic == 0 && hdr.seq != UINT32_MAX && hdr.seq > retired_seq) {
+            retired_seq = hdr.seq;
+            log->head = s;
+        }
+    }
+    if (!found) {
+        // nothing open: the first flush opens sector 0, or the one after the
+        // last retired sector so that wear keeps going round
+        log->head_seq = retired_seq;
+        log->write_off = log->head_end = SLOG_SECTOR_SIZE;
+        log->read = (slog_pos_t){ log->head, SLOG_SECTOR_HDR };
+        return log->io_errors ? -1 : 0;
+    }
+
+    // older sectors run backwards from the head with consecutive sequence numbers
+    log->tail = log->head;
+    log->used = 1;
+    while (log->used < flash->sectors) {
+        uint16_t prev = (log->tail + flash->sectors - 1) % flash->sectors;
+        if (!read_hdr(log, prev, &hdr) || hdr.seq != log->head_seq - log->used) {
+            break;
+        }
+        log->tail = prev;
+        log->used++;
+    }
+
+    // write position: after the last good record of the head sector
+    uint8_t payload[SLOG_MAX_PAYLOAD];
+    uint16_t off = SLOG_SECTOR_HDR;
+    int len;
+    while ((len = read_record(log, log->head, off, payload)) > 0) {
+        off += record_size(len);
+    }
+    log->head_end = off;
+    log->write_off = off;
+    if (len < 0) {
+        log->torn++;
+        log->write_off = SLOG_SECTOR_SIZE; // close the sector, the rest of it may be half programmed
+    }
+    log->read = slog_oldest(log);
+    return 0;
+}
+
+// Starts the next sector, overwriting the oldest one if the log is full
+static int open_sector(slog_t *log) {
+    uint16_t next = log->head_seq == 0 ? log->head : next_sector(log, log->head);
+    if (log->used == log->flash.sectors) {
+        log->overwritten++;
+        if (log->read.sector == log->tail) {
+            log->read = (slog_pos_t){ next_sector(log, log->tail), SLOG_SECTOR_HDR };
+        }
+        log->tail = next_sector(log, log->tail);
+        log->used--;
+    }
+    int err = log->flash.erase(log->flash.ctx, sector_addr(log, next));
+    if (err != 0) {
+        log->io_errors++;
+        return err;
+    }
+    log->erases++;
+    sector_hdr_t hdr = { .magic = SLOG_MAGIC, .seq = log->head_seq + 1 };
+    err = log->flash.write(log->flash.ctx, sector_addr(log, next), &hdr, sizeof(hdr));
+    if (err != 0) {
+        log->io_errors++;
+        return err;
+    }
+    if (log->used == 0) {
+        log->tail = next;
+        log->read = (slog_pos_t){ next, SLOG_SECTOR_HDR };
+    }
+    log->head = next;
+    log->head_seq++;
+    log->used++;
+    log->write_off = log->head_end = SLOG_SECTOR_HDR;
+    return 0;
+}
+
+int slog_flush(slog_t *log) {
+    if (log->chunk_n == 0) {
+        return 0;
+    }
+    uint8_t rec[SLOG_REC_HDR + SLOG_MAX_PAYLOAD + 3];
+    uint8_t *p = rec + SLOG_REC_HDR;
+    uint32_t base = log->chunk[0].ts_ms;
+    p[0] = base & 0xff;
+    p[1] = (base >> 8) & 0xff;
+    p[2] = (base >> 16) & 0xff;
+    p[3] = base >> 24;
+    uint16_t len = SLOG_BASE_LEN;
+    codec_t c;
+    codec_init(&c, base);
+    for (int i = 0; i < log->chunk_n; i++) {
+        // channels were checked by slog_append(), so every sample fits
+        len += codec_put(&c, &log->chunk[i], true, p + len, SLOG_MAX_PAYLOAD - len);
+    }
+    uint16_t crc = record_crc(len, rec + SLOG_REC_HDR);
+    rec[0] = len & 0xff;
+    rec[1] = len >> 8;
+    rec[2] = crc & 0xff;
+    rec[3] = crc >> 8;
+    uint16_t size = record_size(len);
+    memset(rec + SLOG_REC_HDR + len, 0xff, size - SLOG_REC_HDR - len);
+    log->chunk_n = 0; // a failed write drops the chunk rather than retrying forever
+
+    if (log->used == 0 || log->write_off + size > SLOG_SECTOR_SIZE) {
+        int err = open_sector(log);
+        if (err != 0) {
+            return err;
+        }
+    }
+    int err = log->flash.write(log->flash.ctx, sector_addr(log, log->head) + log->write_off, rec, size);
+    if (err != 0) {
+        log->io_errors++;
+        log->write_off = SLOG_SECTOR_SIZE; // do not program over a failed record, readers stop at head_end
+        return err;
+    }
+    log->write_off += size;
+    log->head_end = log->write_off;
+    log->records++;
+    log->payload_bytes += len;
+    return 0;
+}
+
+int slog_append(slog_t *log, const sample_t *s) {
+    if (s->channel >= CODEC_CHANNELS) {
+        return -1;
+    }
+    log->chunk[log->chunk_n++] = *s;
+    log->appended++;
+    return log->chunk_n == SLOG_CHUNK_SAMPLES ? slog_flush(log) : 0;
+}
+
+bool slog_readable(const slog_t *log) {
+    if (log->used == 0) {
+        return false;
+    }
+    return log->read.sector != log->head || log->read.offset < log->head_end;
+}
+
+int slog_read(slog_t *log, sample_t *out, slog_pos_t *next) {
+    uint8_t payload[SLOG_MAX_PAYLOAD];
+    while (slog_readable(log)) {
+        int len = read_record(log, log->read.sector, log->read.offset, payload);
+        if (len <= 0) {
+            if (len < 0) {
+                log->torn++;
+            }
+            if (log->read.sector == log->head) {
+                log->read.offset = log->head_end; // skip what cannot be read rather than retry it forever
+                return 0;
+            }
+            // end of this sector (or the rest of it is torn): move on
+            log->read = (slog_pos_t){ next_sector(log, log->read.sector), SLOG_SECTOR_HDR };
+            continue;
+        }
+        codec_t c;
+        codec_init(&c, payload[0] | payload[1] << 8 | payload[2] << 16 | (uint32_t)payload[3] << 24);
+        int n = 0;
+        uint16_t off = SLOG_BASE_LEN;
+        while (off < len && n < SLOG_CHUNK_SAMPLES) {
+            uint16_t used = codec_get(&c, &out[n], true, 0, payload + off, len - off);
+            if (used == 0) {
+                break;
+            }
+            off += used;
+            n++;
+        }
+        if (off != len) {
+            log->torn++; // passed its CRC yet does not decode: keep what did
+        }
+        log->read.offset += record_size(len);
+        if (next) {
+            *next = log->read;
+        }
+        return n;
+    }
+    return 0;
+}
+
+void slog_seek(slog_t *log, slog_pos_t pos) {
+    // a position in a sector that was since retired or overwritten reads from the oldest
+    log->read = sector_live(log, pos.sector) ? pos : slog_oldest(log);
+}
+
+static int retire_tail(slog_t *log) {
+    // Retiring clears the magic (programming 1s to 0s needs no erase) and keeps
+    // the sequence number, so each sector is still erased only once per lap,
+    // when open_sector() reuses it.
+    static const uint32_t retired = 0;
+    int err = log->flash.write(log->flash.ctx, sector_addr(log, log->tail), &retired, sizeof(retired));
+    if (err != 0) {
+        log->io_errors++;
+        return err;
+    }
+    if (log->read.sector == log->tail) {
+        log->read = (slog_pos_t){ next_sector(log, log->tail), SLOG_SECTOR_HDR };
+    }
+    log->tail = next_sector(log, log->tail);
+    log->used--;
+    return 0;
+}
+
+int slog_release(slog_t *log, slog_pos_t pos) {
+    if (!sector_live(log, pos.sector)) {
+        return 0; // already retired
+    }
+    while (log->used > 1 && log->tail != pos.sector) {
+        int err = retire_tail(log);
+        if (err != 0) {
+            return err;
+        }
+    }
+    // Everything written was delivered: retire the head too, or the next boot
+    // would find it and send it again. Writing resumes in the next sector.
+    if (log->used == 1 && pos.sector == log->head && pos.offset >= log->head_end) {
+        int err = retire_tail(log);
+        if (err != 0) {
+            return err;
+        }
+        log->write_off = log->head_end = SLOG_SECTOR_SIZE;
+    }
+    return 0;
+}
+
+slog_pos_t slog_oldest(const slog_t *log) {
+    return (slog_pos_t){ log->tail, SLOG_SECTOR_HDR };
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sample_ring.h"
+#include "sample_codec.h"
+
+/*
+Flash ring log of samples, for store-and-forward while no peer is connected.
+
+The log is a ring of erase sectors. Each sector starts with a header
+{ uint32 magic, uint32 sequence } and is followed by records
+{ uint16 length, uint16 crc16, payload }, 4-byte aligned. A payload is one
+chunk of up to SLOG_CHUNK_SAMPLES samples: a uint32 base timestamp followed by
+the samples as a mixed delta-coded run (sample_codec.h), so a record mostly
+takes 2-3 bytes per sample. Erased flash (0xffff length) ends a sector.
+
+Writes:   appends collect in a RAM chunk and reach flash one record at a time,
+          so flash sees one program per chunk rather than per sample. Sectors
+          are used strictly in order and erased once per lap, which spreads
+          wear evenly. A full log overwrites its oldest sector.
+Reads:    a cursor walks records from the oldest sector up to the last good
+          record of the head sector; slog_release() retires the sectors behind
+          a consumed position, the head sector too once all of it was read, so
+          delivered data is not found again after a reboot.
+Recovery: slog_open() reads every sector header once and walks the records of
+          the newest sector only, so boot time is bounded by the partition
+          size, not by the amount of data. A record torn by power loss fails
+          its CRC; its sector is closed, readers stop before it and writing
+          resumes in the next sector. A failed write is handled the same way.
+          At most the unflushed RAM chunk is lost.
+
+Flash access goes through slog_flash_t, so the same code runs against a RAM
+image on the host.
+*/
+
+#define SLOG_SECTOR_SIZE 4096
+#define SLOG_MAGIC 0x324c5748      // "HWL2", delta-coded records; older sectors are reused
+#define SLOG_SECTOR_HDR 8
+#define SLOG_REC_HDR 4
+#define SLOG_CHUNK_SAMPLES 32
+#define SLOG_SAMPLE_LEN 8          // a decoded sample_t: uint32 ts_ms, uint16 value, uint8 channel, uint8 flags
+#define SLOG_BASE_LEN 4
+#define SLOG_MAX_PAYLOAD (SLOG_BASE_LEN + SLOG_CHUNK_SAMPLES * CODEC_MAX_SAMPLE_LEN)
+
+typedef struct {
+    int (*read)(void *ctx, uint32_t addr, void *dst, uint32_t len);
+    int (*write)(void *ctx, uint32_t addr, const void *src, uint32_t len);
+    int (*erase)(void *ctx, uint32_t addr); // one SLOG_SECTOR_SIZE sector
+    void *ctx;
+    uint32_t sectors;
+} slog_flash_t;
+
+// Position of a record: sector index and byte offset within the sector
+typedef struct {
+    uint16_t sector;
+    uint16_t offset;
+} slog_pos_t;
+
+typedef struct {
+    slog_flash_t flash;
+    uint32_t head_seq;    // sequence number of the head sector
+    uint16_t head;        // sector being written
+    uint16_t tail;        // oldest sector holding data
+    uint16_t used;        // sectors holding data, 0 = empty log
+    uint16_t write_off;   // next record offset in the head sector, SLOG_SECTOR_SIZE once closed
+    uint16_t head_end;    // end of the good records in the head sector, where reading stops
+    slog_pos_t read;      // next record to read
+    sample_t chunk[SLOG_CHUNK_SAMPLES]; // appended, not yet on flash
+    uint8_t chunk_n;
+
+    uint32_t appended;    // samples accepted
+    uint32_t records;     // records written
+    uint32_t payload_bytes; // record payload written, against SLOG_SAMPLE_LEN per sample raw
+    uint32_t erases;
+    uint32_t overwritten; // sectors lost to wraparound before they were read
+    uint32_t torn;        // records that failed their CRC
+    uint32_t io_errors;
+} slog_t;
+
+// Scans the flash and positions the writer after the newest valid record and
+// the reader at the oldest one. Returns 0, or the flash error.
+int slog_open(slog_t *log, const slog_flash_t *flash);
+
+// Queues a sample; writes a record when the RAM chunk is full. Channels must be
+// below CODEC_CHANNELS, others are refused with -1.
+int slog_append(slog_t *log, const sample_t *s);
+
+// Writes the RAM chunk now, e.g. on a timer to bound what power loss can take.
+int slog_flush(slog_t *log);
+
+// True if records exist between the read cursor and the write position.
+bool slog_readable(const slog_t *log);
+
+// Decodes the record at the read cursor into out (SLOG_CHUNK_SAMPLES entries)
+// and advances the cursor. Returns the sample count, 0 when nothing is left.
+// *next receives the cursor after the record, for slog_release().
+int slog_read(slog_t *log, sample_t *out, slog_pos_t *next);
+
+// Moves the read cursor back, e.g. to the last position the peer acknowledged.
+// A position whose sector was retired or overwritten since reads from the oldest.
+void slog_seek(slog_t *log, slog_pos_t pos);
+
+// Everything before pos was delivered: retires the sectors wholly behind it,
+// and the head sector when pos is at its end.
+int slog_release(slog_t *log, slog_pos_t pos);
+
+// Start of the oldest record
+slog_pos_t slog_oldest(const slog_t *log);
@@ -0,0 +1,67 @@
+#include <assert.h>
+#include <string.h>
+#include "sample_ring.h"
+
+void ring_init(sample_ring_t *r, sample_t *buf, uint32_t capacity) {
+    memset(r, 0, sizeof(*r));
+    assert(RING_IS_POW2(capacity)); // the indices wrap with the mask
+    r->buf = buf;
+    r->mask = capacity - 1;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+}
+
+// Consumer only
+static inline void ring_note_depth(sample_ring_t *r, uint32_t depth) {
+    if (depth > r->high_water) {
+        r->high_water = depth;
+    }
+}
+
+bool ring_push(sample_ring_t *r, const sample_t *s) {
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint32_t used = head - r->tail_cache;
+    if (used > r->mask) {
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+        used = head - r->tail_cache;
+        if (used > r->mask) {
+            r->overflow++;
+            return false;
+        }
+    }
+    r->buf[head & r->mask] = *s;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool ring_pop(sample_ring_t *r, sample_t *s) {
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    // ring_consume() after a peek can move tail past the cached head
+    if ((int32_t)(r->head_cache - tail) <= 0) {
+        r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+        if (tail == r->head_cache) {
+            return false;
+        }
+        ring_note_depth(r, r->head_cache - tail);
+    }
+    *s = r->buf[tail & r->mask];
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+const sample_t *ring_peek(const sample_ring_t *r, uint32_t i) {
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    return &r->buf[(tail + i) & r->mask];
+}
+
+void ring_consume(sample_ring_t *r, uint32_t n) {
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    ring_note_depth(r, atomic_load_explicit(&r->head, memory_order_acquire) - tail);
+    atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+}
+
+uint32_t ring_count(const sample_ring_t *r) {
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    return head - tail;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Lock-free single-producer / single-consumer sample ring.
+
+One context (an ISR or a sampling task) pushes, one task pops. Head is only
+written by the producer and tail only by the consumer, each on its own cache
+line, and each side keeps a private copy of the other index so the shared
+line is only re-read when the ring looks full or empty. Capacity must be a
+power of two. A push into a full ring is refused and counted, never blocks.
+The high water mark is kept by the consumer, which sees the live head each
+time it takes samples, so the producer never reads the consumer's line.
+*/
+
+#ifndef RING_CACHE_LINE
+#define RING_CACHE_LINE 32 // ESP32 cache line
+#endif
+
+#define RING_IS_POW2(n) ((n) != 0 && ((n) & ((n) - 1)) == 0)
+
+#define SAMPLE_NO_ACQUIRE UINT32_MAX // acq_us of a sample read back from the log
+
+typedef struct {
+    uint32_t ts_ms;
+    uint32_t acq_us; // esp_timer, low 32 bits, when it was taken; not logged
+    uint16_t value;
+    uint8_t channel;
+    uint8_t flags;
+} sample_t;
+
+typedef struct {
+    // producer side
+    _Alignas(RING_CACHE_LINE) _Atomic uint32_t head;
+    uint32_t tail_cache;
+    uint32_t overflow;   // pushes refused because the ring was full
+
+    // consumer side
+    _Alignas(RING_CACHE_LINE) _Atomic uint32_t tail;
+    uint32_t head_cache;
+    uint32_t high_water; // most samples seen queued when taking some
+
+    // read-only after init
+    _Alignas(RING_CACHE_LINE) sample_t *buf;
+    uint32_t mask;
+} sample_ring_t;
+
+// `capacity` must be a power of two (RING_IS_POW2); `buf` must hold `capacity` samples.
+void ring_init(sample_ring_t *r, sample_t *buf, uint32_t capacity);
+
+// Producer only. Returns false and counts an overflow if the ring is full.
+bool ring_push(sample_ring_t *r, const sample_t *s);
+
+// Consumer only. Returns false if the ring is empty.
+bool ring_pop(sample_ring_t *r, sample_t *s);
+
+// Consumer only. The i-th queued sample, valid until it is consumed; the
+// caller must check ring_count() first.
+const sample_t *ring_peek(const sample_ring_t *r, uint32_t i);
+
+// Consumer only. Drops `n` samples from the front after a peek.
+void ring_consume(sample_ring_t *r, uint32_t n);
+
+// Samples currently queued. Exact from either side, approximate elsewhere.
+uint32_t ring_count(const sample_ring_t *r);
+
+static inline uint32_t ring_capacity(const sample_ring_t *r) {
+    return r->mask + 1;
+}
@@ -0,0 +1,251 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+#include "sample_store.h"
+#include "sample_log.h"
+
+static const char *TAG = "sample_store";
+
+static const esp_partition_t *partition = NULL;
+static slog_t slog;                        // behind log_mutex: flash I/O cannot run in a critical section
+static SemaphoreHandle_t log_mutex = NULL;
+static QueueHandle_t append_queue = NULL;
+static TaskHandle_t store_task_handle = NULL;
+static uint32_t queue_drops = 0;
+
+// Requests for the store task
+static volatile bool flush_requested = false;
+static portMUX_TYPE release_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool release_valid = false;
+static slog_pos_t release_pos;
+
+// Backfill state, owned by the scheduler task
+typedef struct {
+    slog_pos_t next;    // read position after the record
+    uint16_t unsent;    // its samples still queued in the backfill stream
+} inflight_t;
+static inflight_t inflight[STORE_INFLIGHT_RECORDS];
+static uint8_t inflight_head, inflight_count;
+static slog_pos_t acked;           // everything before this was sent
+static uint32_t since_ms;
+static uint32_t backfilled;
+
+static int flash_read(void *ctx, uint32_t addr, void *dst, uint32_t len) {
+    return esp_partition_read(partition, addr, dst, len) == ESP_OK ? 0 : -1;
+}
+
+static int flash_write(void *ctx, uint32_t addr, const void *src, uint32_t len) {
+    return esp_partition_write(partition, addr, src, len) == ESP_OK ? 0 : -1;
+}
+
+static int flash_erase(void *ctx, uint32_t addr) {
+    return esp_partition_erase_range(partition, addr, SLOG_SECTOR_SIZE) == ESP_OK ? 0 : -1;
+}
+
+// Woken per queued sample and per request; all flash I/O happens here
+static void store_task(void *param) {
+    sample_t s;
+    TickType_t chunk_since = 0;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STORE_FLUSH_MS));
+        xSemaphoreTake(log_mutex, portMAX_DELAY);
+        while (xQueueReceive(append_queue, &s, 0) == pdTRUE) {
+            if (slog.chunk_n == 0) {
+                chunk_since = xTaskGetTickCount();
+            }
+            slog_append(&slog, &s);
+        }
+        // a partial chunk reaches flash after STORE_FLUSH_MS at the latest
+        if (flush_requested || (slog.chunk_n > 0 && xTaskGetTickCount() - chunk_since >= pdMS_TO_TICKS(STORE_FLUSH_MS))) {
+            flush_requested = false;
+            slog_flush(&slog);
+        }
+        taskENTER_CRITICAL(&release_lock);
+        bool release = release_valid;
+        slog_pos_t pos = release_pos;
+        release_valid = false;
+        taskEXIT_CRITICAL(&release_lock);
+        if (release) {
+            slog_release(&slog, pos);
+        }
+        xSemaphoreGive(log_mutex);
+    }
+}
+
+esp_err_t store_init(void) {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, STORE_PARTITION_SUBTYPE, STORE_PARTITION_LABEL);
+    if (partition == NULL) {
+        ESP_LOGE(TAG, "No \"%s\" partition, samples taken offline are dropped", STORE_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    slog_flash_t flash = {
+        .read = flash_read,
+        .write = flash_write,
+        .erase = flash_erase,
+        .sectors = partition->size / SLOG_SECTOR_SIZE,
+    };
+    int64_t t0 = esp_timer_get_time();
+    if (slog_open(&slog, &flash) != 0) {
+        ESP_LOGW(TAG, "Sample log recovery hit %lu flash errors", (unsigned long)slog.io_errors);
+    }
+    ESP_LOGI(TAG, "Sample log: %u/%lu sectors in use, %lu torn records, recovered in %lld us",
+        slog.used, (unsigned long)flash.sectors, (unsigned long)slog.torn, (long long)(esp_timer_get_time() - t0));
+    acked = slog.read;
+
+    log_mutex = xSemaphoreCreateMutex();
+    append_queue = xQueueCreate(STORE_QUEUE_LEN, sizeof(sample_t));
+    if (log_mutex == NULL || append_queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    // below the scheduler task: erases (tens of ms) only run when nothing else is due
+    xTaskCreate(store_task, "store_task", 3072, NULL, 2, &store_task_handle);
+    return ESP_OK;
+}
+
+static void store_wake(void) {
+    if (store_task_handle != NULL) {
+        xTaskNotifyGive(store_task_handle);
+    }
+}
+
+void store_append(const sample_t *s) {
+    if (append_queue == NULL || xQueueSend(append_queue, s, 0) != pdTRUE) {
+        queue_drops++;
+        return;
+    }
+    store_wake();
+}
+
+void store_flush(void) {
+    flush_requested = true;
+    store_wake();
+}
+
+bool store_pending(void) {
+    if (log_mutex == NULL) {
+        return false;
+    }
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    bool pending = slog_readable(&slog) || slog.chunk_n > 0;
+    xSemaphoreGive(log_mutex);
+    return pending || uxQueueMessagesWaiting(append_queue) > 0;
+}
+
+void store_backfill_start(uint32_t since) {
+    if (log_mutex == NULL) {
+        return;
+    }
+    since_ms = since;
+    backfilled = 0;
+    inflight_head = inflight_count = 0;
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    slog_seek(&slog, acked);
+    xSemaphoreGive(log_mutex);
+}
+
+// Records before the oldest unsent one can go
+static void release_acked(void) {
+    taskENTER_CRITICAL(&release_lock);
+    release_pos = acked;
+    release_valid = true;
+    taskEXIT_CRITICAL(&release_lock);
+    store_wake();
+}
+
+uint32_t store_backfill_fill(sample_ring_t *ring) {
+    sample_t buf[SLOG_CHUNK_SAMPLES];
+    uint32_t added = 0;
+    if (log_mutex == NULL) {
+        return 0;
+    }
+    while (inflight_count < STORE_INFLIGHT_RECORDS &&
+           ring_capacity(ring) - ring_count(ring) >= SLOG_CHUNK_SAMPLES) {
+        // the store task may be erasing: try again on the next tick instead of waiting
+        if (xSemaphoreTake(log_mutex, 0) != pdTRUE) {
+            break;
+        }
+        slog_pos_t next;
+        int n = slog_read(&slog, buf, &next);
+        xSemaphoreGive(log_mutex);
+        if (n <= 0) {
+            break;
+        }
+        uint16_t pushed = 0;
+        for (int i = 0; i < n; i++) {
+            if ((int32_t)(buf[i].ts_ms - since_ms) >= 0 && ring_push(ring, &buf[i])) {
+                pushed++;
+            }
+        }
+        inflight[(inflight_head + inflight_count) % STORE_INFLIGHT_RECORDS] = (inflight_t){ next, pushed };
+        inflight_count++;
+        added += pushed;
+    }
+    store_backfill_ack(0); // records that were entirely filtered out
+    return added;
+}
+
+void store_backfill_ack(uint32_t samples) {
+    bool moved = false;
+    while (inflight_count > 0) {
+        inflight_t *r = &inflight[inflight_head];
+        if (r->unsent > samples) {
+            r->unsent -= samples;
+            break;
+        }
+        samples -= r->unsent;
+        backfilled += r->unsent;
+        acked = r->next;
+        moved = true;
+        inflight_head = (inflight_head + 1) % STORE_INFLIGHT_RECORDS;
+        inflight_count--;
+    }
+    if (moved) {
+        release_acked();
+    }
+}
+
+bool store_backfill_done(void) {
+    if (log_mutex == NULL) {
+        return true;
+    }
+    if (inflight_count > 0 || xSemaphoreTake(log_mutex, 0) != pdTRUE) {
+        return false;
+    }
+    // samples still on their way to flash are part of this backfill too
+    bool done = !slog_readable(&slog) && slog.chunk_n == 0 && uxQueueMessagesWaiting(append_queue) == 0;
+    xSemaphoreGive(log_mutex);
+    return done;
+}
+
+void store_backfill_abort(void) {
+    inflight_head = inflight_count = 0;
+    if (log_mutex == NULL) {
+        return;
+    }
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    slog_seek(&slog, acked);
+    xSemaphoreGive(log_mutex);
+}
+
+void store_log_stats(void) {
+    if (log_mutex == NULL) {
+        return;
+    }
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    ESP_LOGI(TAG, "Sample log: %lu appended, %lu records, %lu erases, %lu sectors overwritten, %lu torn, %lu io errors, %lu queue drops, %lu backfilled",
+        (unsigned long)slog.appended, (unsigned long)slog.records, (unsigned long)slog.erases,
+        (unsigned long)slog.overwritten, (unsigned long)slog.torn, (unsigned long)slog.io_errors,
+        (unsigned long)queue_drops, (unsigned long)backfilled);
+    uint32_t written = slog.appended - slog.chunk_n;
+    if (written > 0) {
+        uint32_t tenths = (uint32_t)((uint64_t)slog.payload_bytes * 10 / written);
+        ESP_LOGI(TAG, "Sample log payload: %lu bytes, %lu.%lu bytes/sample (raw %d)",
+            (unsigned long)slog.payload_bytes, (unsigned long)(tenths / 10), (unsigned long)(tenths % 10), SLOG_SAMPLE_LEN);
+    }
+    xSemaphoreGive(log_mutex);
+}
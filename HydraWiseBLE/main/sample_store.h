@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sample_ring.h"
+
+/*
+Store-and-forward of samples taken while no peer is connected.
+
+Samples are queued by the scheduler task and written to the sample log
+(sample_log.h) on the "samplelog" data partition by a low-priority store task,
+so flash programs and erases never stall sampling. After a reconnect the
+scheduler task pulls records back out into the backfill stream. A record's
+flash space is only given back once every sample in it was sent; an
+interrupted backfill starts again from the first unsent record, so a peer may
+see a few samples twice but never misses one.
+*/
+
+#define STORE_PARTITION_LABEL "samplelog"
+#define STORE_PARTITION_SUBTYPE 0x40 // custom data subtype, see partitions.csv
+#define STORE_QUEUE_LEN 64           // samples waiting for the store task
+#define STORE_FLUSH_MS 5000          // longest a sample stays in RAM, bounds power-loss loss
+#define STORE_INFLIGHT_RECORDS 16    // records read into the backfill stream and not yet sent
+
+esp_err_t store_init(void);
+
+// Queues a sample for the log; never blocks, a full queue counts a drop.
+void store_append(const sample_t *s);
+
+// Writes whatever the store task still holds in RAM.
+void store_flush(void);
+
+// True if the log holds samples that were not sent yet.
+bool store_pending(void);
+
+// Backfill, from the scheduler task only
+void store_backfill_start(uint32_t since_ms);
+// Moves whole records into ring while it has room. Returns the samples added.
+uint32_t store_backfill_fill(sample_ring_t *ring);
+// `samples` more of the filled samples were sent
+void store_backfill_ack(uint32_t samples);
+// True once every record was read and acknowledged
+bool store_backfill_done(void);
+// Forgets unacknowledged reads; the next backfill resends them
+void store_backfill_abort(void);
+
+void store_log_stats(void);
@@ -0,0 +1,108 @@
+#include <string.h>
+#include "scheduler.h"
+
+// Tick counters wrap, so compare deadlines by signed distance.
+static inline int32_t tick_diff(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b);
+}
+
+void sched_init(sched_t *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+int sched_add(sched_t *s, const char *name, uint32_t period, sched_fn_t fn, void *arg) {
+    if (s->count >= SCHED_MAX_CHANNELS || period == 0 || fn == NULL) {
+        return -1;
+    }
+    sched_channel_t *c = &s->ch[s->count];
+    c->name = name;
+    c->period = period;
+    c->next_due = 0;
+    c->armed = false;
+    c->fn = fn;
+    c->arg = arg;
+    return s->count++;
+}
+
+void sched_arm(sched_t *s, int id, uint32_t now) {
+    if (id < 0 || id >= s->count || s->ch[id].armed) {
+        return;
+    }
+    s->ch[id].next_due = now + s->ch[id].period;
+    s->ch[id].armed = true;
+}
+
+void sched_disarm(sched_t *s, int id) {
+    if (id < 0 || id >= s->count) {
+        return;
+    }
+    s->ch[id].armed = false;
+}
+
+void sched_set_period(sched_t *s, int id, uint32_t period) {
+    if (id < 0 || id >= s->count || period == 0) {
+        return;
+    }
+    sched_channel_t *c = &s->ch[id];
+    if (c->armed) {
+        // pull the pending deadline in if the new period is shorter
+        uint32_t last = c->next_due - c->period;
+        if (tick_diff(last + period, c->next_due) < 0) {
+            c->next_due = last + period;
+        }
+    }
+    c->period = period;
+}
+
+bool sched_next_deadline(const sched_t *s, uint32_t *due) {
+    bool found = false;
+    uint32_t best = 0;
+    for (int i = 0; i < s->count; i++) {
+        const sched_channel_t *c = &s->ch[i];
+        if (!c->armed) {
+            continue;
+        }
+        if (!found || tick_diff(c->next_due, best) < 0) {
+            best = c->next_due;
+            found = true;
+        }
+    }
+    if (found && due) {
+        *due = best;
+    }
+    return found;
+}
+
+uint32_t sched_wait_ticks(const sched_t *s, uint32_t now) {
+    uint32_t due;
+    if (!sched_next_deadline(s, &due)) {
+        return 0;
+    }
+    int32_t d = tick_diff(due, now);
+    return d > 0 ? (uint32_t)d : 0;
+}
+
+int sched_run_due(sched_t *s, uint32_t now) {
+    int ran = 0;
+    for (int i = 0; i < s->count; i++) {
+        sched_channel_t *c = &s->ch[i];
+        if (!c->armed || tick_diff(c->next_due, now) > 0) {
+            continue;
+        }
+        c->fn(c->arg);
+        ran++;
+        s->runs++;
+        // the callback may have disarmed the channel
+        if (!c->armed) {
+            continue;
+        }
+        c->next_due += c->period;
+        if (tick_diff(c->next_due, now) <= 0) {
+            // more than a full period late: drop the missed runs, keep phase
+            uint32_t behind = (uint32_t)tick_diff(now, c->next_due) / c->period + 1;
+            c->next_due += behind * c->period;
+            s->overrun += behind;
+        }
+    }
+    return ran;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+Deadline scheduler for the periodic notify channels.
+
+Every channel has a period in ticks and an absolute next deadline. The owner
+task asks for the earliest armed deadline, sleeps until then, and runs whatever
+is due. When no channel is armed there is no deadline at all, so the owner can
+block forever instead of polling. This file has no FreeRTOS dependency so the
+same logic builds on the host.
+*/
+
+#define SCHED_MAX_CHANNELS 8
+
+typedef void (*sched_fn_t)(void *arg);
+
+typedef struct {
+    const char *name;
+    uint32_t period;   // ticks between runs
+    uint32_t next_due; // absolute tick of the next run
+    bool armed;
+    sched_fn_t fn;
+    void *arg;
+} sched_channel_t;
+
+typedef struct {
+    sched_channel_t ch[SCHED_MAX_CHANNELS];
+    uint8_t count;
+    uint32_t runs;    // channel callbacks executed
+    uint32_t overrun; // periods skipped because we fell more than one period behind
+} sched_t;
+
+void sched_init(sched_t *s);
+
+// Returns the channel id, or -1 if the table is full or period is zero.
+int sched_add(sched_t *s, const char *name, uint32_t period, sched_fn_t fn, void *arg);
+
+// Arms a channel so its first run is one period after `now`. Re-arming an
+// armed channel keeps its phase.
+void sched_arm(sched_t *s, int id, uint32_t now);
+void sched_disarm(sched_t *s, int id);
+void sched_set_period(sched_t *s, int id, uint32_t period);
+
+// Earliest armed deadline. Returns false if nothing is armed, in which case
+// the caller should block without a timeout.
+bool sched_next_deadline(const sched_t *s, uint32_t *due);
+
+// Ticks to wait from `now` until the earliest deadline (0 if already due).
+// Only meaningful when sched_next_deadline() returned true.
+uint32_t sched_wait_ticks(const sched_t *s, uint32_t now);
+
+// Runs every channel whose deadline is <= now and advances it by whole
+// periods, so a late wakeup does not accumulate drift. Returns the number of
+// callbacks run.
+int sched_run_due(sched_t *s, uint32_t now);
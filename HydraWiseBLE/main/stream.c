@@ -0,0 +1,401 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "host/ble_hs.h"
+#include "stream.h"
+#include "notify_pool.h"
+#include "dlog.h"
+#include "diag.h"
+
+static const char *TAG = "stream";
+
+_Static_assert(SAMPLE_NO_ACQUIRE == DIAG_NO_ACQUIRE, "logged samples carry no acquisition time to measure from");
+
+static conn_table_t peers;
+static portMUX_TYPE peers_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t now_ms(void) {
+    return pdTICKS_TO_MS(xTaskGetTickCount());
+}
+
+void peers_init(uint8_t window_min, uint8_t window_max, uint8_t window_init) {
+    conn_table_init(&peers, window_min, window_max, window_init);
+}
+
+bool peers_add(uint16_t conn_handle) {
+    taskENTER_CRITICAL(&peers_lock);
+    peer_t *p = conn_add(&peers, conn_handle);
+    taskEXIT_CRITICAL(&peers_lock);
+    return p != NULL;
+}
+
+void peers_remove(uint16_t conn_handle) {
+    taskENTER_CRITICAL(&peers_lock);
+    peer_t *p = conn_find(&peers, conn_handle);
+    flow_ctl_t flow = { 0 };
+    if (p != NULL) {
+        flow = p->flow;
+    }
+    conn_remove(&peers, conn_handle);
+    taskEXIT_CRITICAL(&peers_lock);
+    diag_conn_closed(conn_handle);
+    if (p != NULL) {
+        ESP_LOGI(TAG, "Peer %u flow: window %u, sent %lu, completed %lu, failed %lu, window full %lu",
+            conn_handle, flow.window, (unsigned long)flow.sent, (unsigned long)flow.completed,
+            (unsigned long)flow.failed, (unsigned long)flow.window_full);
+    }
+}
+
+void peers_subscribe(uint16_t conn_handle, uint8_t chr, bool on) {
+    taskENTER_CRITICAL(&peers_lock);
+    peer_t *p = conn_find(&peers, conn_handle);
+    if (p != NULL) {
+        conn_set_subscribed(p, chr, on);
+    }
+    taskEXIT_CRITICAL(&peers_lock);
+}
+
+void peers_set_mtu(uint16_t conn_handle, uint16_t mtu) {
+    taskENTER_CRITICAL(&peers_lock);
+    peer_t *p = conn_find(&peers, conn_handle);
+    if (p != NULL) {
+        p->mtu = mtu;
+    }
+    taskEXIT_CRITICAL(&peers_lock);
+}
+
+void peers_set_data_len(uint16_t conn_handle, uint16_t tx_octets) {
+    taskENTER_CRITICAL(&peers_lock);
+    peer_t *p = conn_find(&peers, conn_handle);
+    if (p != NULL) {
+        p->ll_tx_octets = tx_octets;
+    }
+    taskEXIT_CRITICAL(&peers_lock);
+}
+
+uint8_t peers_count(void) {
+    taskENTER_CRITICAL(&peers_lock);
+    uint8_t n = peers.count;
+    taskEXIT_CRITICAL(&peers_lock);
+    return n;
+}
+
+// Halve the window of every listed peer that still has notifications queued,
+// after a failed notify or an empty pool
+static void peers_congested(const uint16_t *handles, uint8_t n) {
+    taskENTER_CRITICAL(&peers_lock);
+    for (int i = 0; i < n; i++) {
+        peer_t *p = conn_find(&peers, handles[i]);
+        if (p != NULL && p->flow.in_flight > 0) {
+            flow_on_congestion(&p->flow);
+        }
+    }
+    taskEXIT_CRITICAL(&peers_lock);
+}
+
+bool peers_on_released(uint16_t conn_handle) {
+    bool resume = false;
+    taskENTER_CRITICAL(&peers_lock);
+    peer_t *p = conn_find(&peers, conn_handle);
+    if (p != NULL) {
+        resume = flow_on_released(&p->flow);
+    }
+    taskEXIT_CRITICAL(&peers_lock);
+    diag_tx_released(conn_handle);
+    return resume;
+}
+
+void peers_on_notify_tx(uint16_t conn_handle, int status) {
+    if (status != 0) {
+        peers_congested(&conn_handle, 1);
+        diag_fail(DIAG_FAIL_TX);
+    }
+}
+
+// Count a notification as in flight on every listed peer. acquire_us is when
+// its first sample was taken, DIAG_NO_ACQUIRE if it carries none.
+static void peers_mark_sent(const uint16_t *handles, uint8_t n, uint32_t acquire_us) {
+    taskENTER_CRITICAL(&peers_lock);
+    for (int i = 0; i < n; i++) {
+        peer_t *p = conn_find(&peers, handles[i]);
+        if (p != NULL) {
+            flow_on_sent(&p->flow); // completed when its mbuf comes back, whatever rc is
+        }
+    }
+    taskEXIT_CRITICAL(&peers_lock);
+    for (int i = 0; i < n; i++) {
+        diag_tx_start(handles[i], acquire_us);
+    }
+}
+
+// Notify call timed into the CALL stage, its failure counted
+static int notify_timed(uint16_t conn_handle, uint16_t attr_handle, struct os_mbuf *om) {
+    uint32_t start = diag_cycles();
+    notify_pool_set_owner(om, conn_handle);
+    int rc = ble_gattc_notify_custom(conn_handle, attr_handle, om);
+    diag_stage_cycles(DIAG_STAGE_CALL, start);
+    diag_tx_called(conn_handle, rc);
+    if (rc != 0) {
+        diag_fail(rc == BLE_HS_ENOMEM ? DIAG_FAIL_NOTIFY_ENOMEM : DIAG_FAIL_NOTIFY_ERROR);
+    }
+    return rc;
+}
+
+void stream_init(stream_t *st, const char *name, uint8_t chr, const uint16_t *attr_handle,
+    uint8_t channel, uint32_t latency_cap_ms) {
+    memset(st, 0, sizeof(*st));
+    st->name = name;
+    st->chr = chr;
+    st->attr_handle = attr_handle;
+    batch_init(&st->batch, channel, BLE_ATT_MTU_DFLT - 3, latency_cap_ms);
+    ring_init(&st->ring, st->ring_buf, STREAM_RING_LEN);
+}
+
+// Sends the owed frame to the peers that refused it and are still subscribed.
+// Returns true once nobody is owed it.
+static bool stream_send_owed(stream_t *st) {
+    uint8_t left = 0;
+    for (int i = 0; i < st->owed_n; i++) {
+        uint16_t handle = st->owed[i];
+        taskENTER_CRITICAL(&peers_lock);
+        peer_t *p = conn_find(&peers, handle);
+        bool listening = p != NULL && (p->subscribed & (1u << st->chr));
+        taskEXIT_CRITICAL(&peers_lock);
+        if (!listening) {
+            continue; // gone or unsubscribed since
+        }
+        int rc = BLE_HS_ENOMEM; // after one refusal the rest wait for the next drain
+        if (left == 0) {
+            struct os_mbuf *om = notify_pool_from_flat(st->owed_frame, st->owed_len);
+            if (om != NULL) {
+                peers_mark_sent(&handle, 1, st->owed_acquire_us);
+                rc = notify_timed(handle, *st->attr_handle, om);
+            } else {
+                diag_fail(DIAG_FAIL_POOL_EMPTY);
+            }
+        }
+        if (rc == 0) {
+            st->resent++;
+        } else if (rc == BLE_HS_ENOMEM) {
+            st->owed[left++] = handle;
+        } else {
+            DLOG(DLOG_FRAME_FAILED, st->chr, handle, rc);
+            st->peer_drops++;
+        }
+    }
+    st->owed_n = left;
+    return left == 0;
+}
+
+void stream_drain(stream_t *st, bool force) {
+    uint16_t handles[CONN_TABLE_MAX];
+    struct os_mbuf *oms[CONN_TABLE_MAX];
+
+    if (st->owed_n > 0 && !stream_send_owed(st)) {
+        st->backpressure++;
+        return; // the host is still short of buffers; later frames wait behind it
+    }
+    while (batch_due(&st->batch, &st->ring, now_ms()) || (force && ring_count(&st->ring) > 0)) {
+        bool blocked;
+        taskENTER_CRITICAL(&peers_lock);
+        uint8_t n = conn_subscribers(&peers, st->chr, handles, &blocked);
+        // encoded once, so sized for the most constrained subscriber
+        uint16_t payload = conn_subscribers_payload(&peers, st->chr, NOTIFY_POOL_MAX_PAYLOAD);
+        taskEXIT_CRITICAL(&peers_lock);
+        if (blocked) {
+            st->backpressure++;
+            diag_fail(DIAG_FAIL_WINDOW_FULL);
+            return; // a window is full: samples keep coalescing until a release reopens it
+        }
+        batch_set_max_payload(&st->batch, payload);
+        uint8_t count = batch_frame_samples(&st->batch, &st->ring);
+        if (n == 0) {
+            // nobody listens to this characteristic
+            batch_commit(&st->batch, &st->ring, count);
+            st->discarded += count;
+            continue;
+        }
+
+        // one mbuf per peer up front, so a short pool never splits a frame
+        int64_t t0 = esp_timer_get_time();
+        uint32_t encode_start = diag_cycles();
+        uint32_t acquire_us = ring_peek(&st->ring, 0)->acq_us;
+        int got = 0;
+        while (got < n && (oms[got] = notify_pool_get()) != NULL) {
+            got++;
+        }
+        uint16_t bound = batch_frame_bound(&st->batch, count);
+        uint8_t *dst = got == n ? os_mbuf_extend(oms[0], bound) : NULL;
+        if (dst == NULL) {
+            for (int i = 0; i < got; i++) {
+                os_mbuf_free_chain(oms[i]);
+            }
+            st->backpressure++;
+            diag_fail(DIAG_FAIL_POOL_EMPTY);
+            peers_congested(handles, n);
+            return; // every notify mbuf is in flight, retry on the next tick
+        }
+        uint16_t len = batch_encode(&st->batch, &st->ring, &count, dst); // Encode once, in place
+        if (len < bound) {
+            os_mbuf_adj(oms[0], (int)len - bound); // a delta frame came out shorter, trim the tail
+        }
+        uint8_t ready = 1;
+        for (int i = 1; i < n; i++) {
+            if (os_mbuf_append(oms[i], dst, len) != 0) {
+                // cannot happen with pool-sized buffers; the other peers still get the frame
+                os_mbuf_free_chain(oms[i]);
+                continue;
+            }
+            handles[ready] = handles[i];
+            oms[ready++] = oms[i];
+        }
+
+        diag_stage_cycles(DIAG_STAGE_ENCODE, encode_start);
+        if (acquire_us != DIAG_NO_ACQUIRE) {
+            diag_stage_us(DIAG_STAGE_QUEUE, (uint32_t)esp_timer_get_time() - acquire_us);
+        }
+
+        if (ready > 1) {
+            // kept in case the host takes it for some peers only: oms[0] goes with the first
+            memcpy(st->owed_frame, dst, len);
+        }
+        peers_mark_sent(handles, ready, acquire_us);
+        int accepted = 0;
+        uint8_t enomem = 0;
+        for (int i = 0; i < ready; i++) {
+            int rc = notify_timed(handles[i], *st->attr_handle, oms[i]);
+            if (rc == 0) {
+                accepted++;
+            } else if (rc == BLE_HS_ENOMEM) {
+                st->owed[enomem++] = handles[i];
+            } else {
+                DLOG(DLOG_FRAME_FAILED, st->chr, handles[i], rc);
+            }
+        }
+        if (accepted == 0 && enomem > 0) {
+            st->backpressure++;
+            return; // samples stay queued
+        }
+        st->peer_drops += n - accepted - enomem;
+        if (enomem > 0) {
+            // the others have it: owe it to these rather than send its samples twice
+            st->owed_len = len;
+            st->owed_acquire_us = acquire_us;
+            st->owed_n = enomem;
+        }
+        DLOG(DLOG_FRAME_SENT, st->chr, st->batch.seq, count, accepted);
+        stream_frame_sent(st, count, len);
+        uint32_t us = esp_timer_get_time() - t0;
+        st->send_us += us;
+        if (us > st->send_us_max) {
+            st->send_us_max = us;
+        }
+        if (enomem > 0) {
+            st->backpressure++;
+            return; // the owed frame goes first on the next drain
+        }
+    }
+}
+
+void stream_frame_sent(stream_t *st, uint8_t count, uint16_t len) {
+    batch_commit(&st->batch, &st->ring, count);
+    st->frames_sent++;
+    st->frame_bytes += len;
+    st->raw_bytes += batch_frame_len(count);
+}
+
+void stream_discard(stream_t *st) {
+    uint32_t queued = ring_count(&st->ring);
+    ring_consume(&st->ring, queued);
+    st->discarded += queued;
+    st->owed_n = 0;
+}
+
+void stream_log_stats(const stream_t *st) {
+    dlog_flush(); // deferred lines first
+    if (st->frames_sent > 0) {
+        ESP_LOGI(TAG, "%s send path: %lu us per frame on average, %lu us max", st->name,
+            (unsigned long)(st->send_us / st->frames_sent), (unsigned long)st->send_us_max);
+    }
+    if (st->raw_bytes > 0) {
+        ESP_LOGI(TAG, "%s stream: %lu frame bytes, %lu%% of raw frames", st->name,
+            (unsigned long)st->frame_bytes, (unsigned long)((uint64_t)st->frame_bytes * 100 / st->raw_bytes));
+    }
+    ESP_LOGI(TAG, "%s stream: %lu frames, ring high water %lu/%lu, overflow %lu, backpressure %lu, discarded %lu, peer drops %lu, resent %lu",
+        st->name, (unsigned long)st->frames_sent,
+        (unsigned long)st->ring.high_water, (unsigned long)ring_capacity(&st->ring),
+        (unsigned long)st->ring.overflow, (unsigned long)st->backpressure,
+        (unsigned long)st->discarded, (unsigned long)st->peer_drops, (unsigned long)st->resent);
+}
+
+// Sends one flat value to one peer. Returns 0 or the notify error.
+static int notify_one(uint16_t conn_handle, uint16_t attr_handle, const void *data, uint16_t len) {
+    struct os_mbuf *om = notify_pool_from_flat(data, len);
+    int rc = BLE_HS_ENOMEM;
+    if (om != NULL) {
+        peers_mark_sent(&conn_handle, 1, DIAG_NO_ACQUIRE);
+        rc = notify_timed(conn_handle, attr_handle, om);
+    } else {
+        diag_fail(DIAG_FAIL_POOL_EMPTY);
+        peers_congested(&conn_handle, 1);
+    }
+    if (rc != 0) {
+        DLOG(DLOG_VALUE_FAILED, conn_handle, rc);
+    }
+    return rc;
+}
+
+// Sends one flat value to every subscriber of chr. Gated sends give up when a
+// subscriber's window is full; ungated ones go out regardless.
+static bool notify_flat(uint8_t chr, uint16_t attr_handle, const void *data, uint16_t len, bool gated) {
+    uint16_t handles[CONN_TABLE_MAX];
+    bool blocked = false;
+    taskENTER_CRITICAL(&peers_lock);
+    uint8_t n = conn_subscribers(&peers, chr, handles, gated ? &blocked : NULL);
+    taskEXIT_CRITICAL(&peers_lock);
+    if (blocked) {
+        diag_fail(DIAG_FAIL_WINDOW_FULL);
+        return false;
+    }
+    int accepted = 0;
+    for (int i = 0; i < n; i++) {
+        accepted += notify_one(handles[i], attr_handle, data, len) == 0;
+    }
+    return n == 0 || accepted > 0;
+}
+
+void stream_notify_value(uint8_t chr, uint16_t attr_handle, const void *data, uint16_t len) {
+    notify_flat(chr, attr_handle, data, len, false); // state changes go out even on a full window
+}
+
+void stream_notify_peer(uint16_t conn_handle, uint16_t attr_handle, const void *data, uint16_t len) {
+    notify_one(conn_handle, attr_handle, data, len);
+}
+
+bool stream_notify_frame(uint8_t chr, uint16_t attr_handle, const void *data, uint16_t len) {
+    return notify_flat(chr, attr_handle, data, len, true);
+}
+
+uint16_t peers_payload(uint8_t chr) {
+    taskENTER_CRITICAL(&peers_lock);
+    uint16_t payload = conn_subscribers_payload(&peers, chr, NOTIFY_POOL_MAX_PAYLOAD);
+    uint16_t handles[CONN_TABLE_MAX];
+    uint8_t n = conn_subscribers(&peers, chr, handles, NULL);
+    taskEXIT_CRITICAL(&peers_lock);
+    return n > 0 ? payload : 0;
+}
+
+bool peers_in_flight(uint8_t chr) {
+    bool queued = false;
+    uint16_t handles[CONN_TABLE_MAX];
+    taskENTER_CRITICAL(&peers_lock);
+    uint8_t n = conn_subscribers(&peers, chr, handles, NULL);
+    for (int i = 0; i < n && !queued; i++) {
+        peer_t *p = conn_find(&peers, handles[i]);
+        queued = p != NULL && p->flow.in_flight > 0;
+    }
+    taskEXIT_CRITICAL(&peers_lock);
+    return queued;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "batch.h"
+#include "sample_ring.h"
+#include "conn_table.h"
+#include "notify_pool.h"
+
+/*
+Notify streams and their fan-out to connected peers.
+
+One stream per notifying characteristic: samples wait in the stream's ring
+until a frame carrying them has been accepted by the stack. Each frame is
+encoded once into a notify-pool mbuf and copied into one mbuf per subscribed
+peer, so extra peers cost a memcpy rather than a re-encode. The slowest
+subscribed peer's flow window gates the stream, so no peer misses a frame
+because another one drains faster. A frame some peers took while the host had
+no buffer for the others is kept and owed to those, and goes to them before
+the stream encodes another.
+
+The peer table is updated from the NimBLE host task (GAP events) and read
+from the scheduler task (sends), so it lives here behind a lock.
+*/
+
+#define STREAM_RING_LEN 256
+_Static_assert(RING_IS_POW2(STREAM_RING_LEN), "the sample ring needs a power of two");
+
+// Characteristics tracked per peer for subscriptions
+enum {
+    CHR_HR,
+    CHR_CONDUCTIVITY,
+    CHR_BUTTON,
+    CHR_LOG,
+    CHR_COUNT,
+};
+
+typedef struct {
+    const char *name;
+    uint8_t chr;                 // CHR_xxx index, selects subscribers
+    const uint16_t *attr_handle; // characteristic value handle, resolved at registration
+    batch_t batch;
+    sample_ring_t ring;
+    sample_t ring_buf[STREAM_RING_LEN];
+    uint32_t frames_sent;
+    uint32_t frame_bytes;  // frame payload sent, once per frame
+    uint32_t raw_bytes;    // what those frames would take uncompressed
+    uint32_t send_us;      // time from encode to the last notify call, summed over frames
+    uint32_t send_us_max;
+    uint32_t backpressure; // send attempts deferred for lack of an mbuf or window
+    uint32_t discarded;    // samples dropped because the link went away or nobody subscribed
+    uint32_t peer_drops;   // frames a single peer missed after the others accepted them
+    uint32_t resent;       // owed frames sent again after an ENOMEM
+
+    // last frame, owed to the peers that refused it with ENOMEM
+    uint8_t owed_n;
+    uint16_t owed[CONN_TABLE_MAX];
+    uint16_t owed_len;
+    uint32_t owed_acquire_us;
+    uint8_t owed_frame[NOTIFY_POOL_MAX_PAYLOAD];
+} stream_t;
+
+void stream_init(stream_t *st, const char *name, uint8_t chr, const uint16_t *attr_handle,
+    uint8_t channel, uint32_t latency_cap_ms);
+
+// Send every frame that is due. `force` also sends a partial frame (used on STOP).
+void stream_drain(stream_t *st, bool force);
+
+// Account for a frame of count samples and len bytes the stack accepted and
+// consume its samples
+void stream_frame_sent(stream_t *st, uint8_t count, uint16_t len);
+
+// Drop whatever the stream still holds, owed frame included, e.g. after the last peer left
+void stream_discard(stream_t *st);
+
+void stream_log_stats(const stream_t *st);
+
+// Fan a small value (e.g. the button state) out to every peer subscribed to `chr`
+void stream_notify_value(uint8_t chr, uint16_t attr_handle, const void *data, uint16_t len);
+
+// The same to one peer, e.g. the current value when it subscribes
+void stream_notify_peer(uint16_t conn_handle, uint16_t attr_handle, const void *data, uint16_t len);
+
+// Same, but gated by the slowest subscriber's flow window like stream_drain.
+// Returns false if nothing was sent and the caller should retry once the window reopens.
+bool stream_notify_frame(uint8_t chr, uint16_t attr_handle, const void *data, uint16_t len);
+
+// Peer table, called from GAP events
+void peers_init(uint8_t window_min, uint8_t window_max, uint8_t window_init);
+bool peers_add(uint16_t conn_handle);
+void peers_remove(uint16_t conn_handle);
+void peers_subscribe(uint16_t conn_handle, uint8_t chr, bool on);
+uint8_t peers_count(void);
+
+// Largest notification every subscriber of chr can take, 0 if nobody subscribed
+uint16_t peers_payload(uint8_t chr);
+
+// True while a subscriber of chr still has notifications in the host
+bool peers_in_flight(uint8_t chr);
+
+// Link sizes from BLE_GAP_EVENT_MTU and the LL data length change
+void peers_set_mtu(uint16_t conn_handle, uint16_t mtu);
+void peers_set_data_len(uint16_t conn_handle, uint16_t tx_octets);
+
+// Completes one in-flight notification for a peer, from the notify pool's
+// release callback. Returns true if that peer's window had stalled a sender
+// and now has room again.
+bool peers_on_released(uint16_t conn_handle);
+
+// NOTIFY_TX: a failure halves the peer's window
+void peers_on_notify_tx(uint16_t conn_handle, int status);
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// Cycles at CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ of the virtual clock: code takes no time here
+uint32_t esp_cpu_get_cycle_count(void);
@@ -0,0 +1,113 @@
+#pragma once
+
+/*
+The NimBLE host API the firmware uses, implemented by sim_ble.c on top of the
+link model of sim_link.c and the scripted centrals of sim_central.c.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "os/os_mbuf.h"
+#include "host/ble_hs_addr.h"
+#include "host/ble_uuid.h"
+#include "host/ble_gatt.h"
+#include "host/ble_gap.h"
+#include "host/ble_store.h"
+
+#define BLE_HS_EAGAIN 1
+#define BLE_HS_EALREADY 2
+#define BLE_HS_EINVAL 3
+#define BLE_HS_EMSGSIZE 4
+#define BLE_HS_ENOENT 5
+#define BLE_HS_ENOMEM 6
+#define BLE_HS_ENOTCONN 7
+#define BLE_HS_ENOTSUP 8
+#define BLE_HS_EAPP 9
+#define BLE_HS_EBADDATA 10
+#define BLE_HS_EOS 11
+#define BLE_HS_ECONTROLLER 12
+#define BLE_HS_ETIMEOUT 13
+#define BLE_HS_EDONE 14
+#define BLE_HS_EBUSY 15
+#define BLE_HS_EREJECT 16
+#define BLE_HS_EUNKNOWN 17
+#define BLE_HS_EROLE 18
+#define BLE_HS_ETIMEOUT_HCI 19
+#define BLE_HS_ENOMEM_EVT 20
+#define BLE_HS_ENOADDR 21
+#define BLE_HS_ENOTSYNCED 22
+#define BLE_HS_EAUTHEN 23
+#define BLE_HS_EAUTHOR 24
+#define BLE_HS_EENCRYPT 25
+#define BLE_HS_EENCRYPT_KEY_SZ 26
+#define BLE_HS_ESTORE_CAP 27
+#define BLE_HS_ESTORE_FAIL 28
+#define BLE_HS_EPREEMPTED 29
+#define BLE_HS_EDISABLED 30
+#define BLE_HS_ESTALLED 31
+
+#define BLE_HS_ERR_ATT_BASE 0x100
+#define BLE_HS_ERR_HCI_BASE 0x200
+#define BLE_HS_FOREVER INT32_MAX
+#define BLE_HS_CONN_HANDLE_NONE 0xffff
+
+#define BLE_ERR_CONN_SPVN_TMO 0x08
+#define BLE_ERR_REM_USER_CONN_TERM 0x13
+#define BLE_ERR_CONN_TERM_LOCAL 0x16
+#define BLE_ERR_UNSUPP_REM_FEATURE 0x1a
+#define BLE_ERR_INV_LMP_LL_PARM 0x1e
+#define BLE_ERR_UNSPECIFIED 0x1f
+
+#define BLE_ATT_MTU_DFLT 23
+#define BLE_ATT_ERR_INVALID_HANDLE 0x01
+#define BLE_ATT_ERR_READ_NOT_PERMITTED 0x02
+#define BLE_ATT_ERR_WRITE_NOT_PERMITTED 0x03
+#define BLE_ATT_ERR_REQ_NOT_SUPPORTED 0x06
+#define BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN 0x0d
+#define BLE_ATT_ERR_UNLIKELY 0x0e
+#define BLE_ATT_ERR_INSUFFICIENT_RES 0x11
+
+#define BLE_HCI_ADV_FILT_NONE 0
+#define BLE_HCI_ADV_FILT_SCAN 1
+#define BLE_HCI_ADV_FILT_CONN 2
+#define BLE_HCI_ADV_FILT_BOTH 3
+
+#define BLE_SM_IO_CAP_DISP_ONLY 0
+#define BLE_SM_IO_CAP_DISP_YES_NO 1
+#define BLE_SM_IO_CAP_KEYBOARD_ONLY 2
+#define BLE_SM_IO_CAP_NO_IO 3
+#define BLE_SM_IO_CAP_KEYBOARD_DISP 4
+#define BLE_SM_PAIR_KEY_DIST_ENC 0x01
+#define BLE_SM_PAIR_KEY_DIST_ID 0x02
+#define BLE_SM_PAIR_KEY_DIST_SIGN 0x04
+
+typedef void ble_hs_sync_fn(void);
+typedef void ble_hs_reset_fn(int reason);
+typedef int ble_store_status_fn(struct ble_store_status_event *event, void *arg);
+
+struct ble_hs_cfg {
+    ble_hs_reset_fn *reset_cb;
+    ble_hs_sync_fn *sync_cb;
+    void *store_read_cb;
+    void *store_write_cb;
+    void *store_delete_cb;
+    ble_store_status_fn *store_status_cb;
+    void *store_status_arg;
+    uint8_t sm_io_cap;
+    unsigned sm_oob_data_flag : 1;
+    unsigned sm_bonding : 1;
+    unsigned sm_mitm : 1;
+    unsigned sm_sc : 1;
+    unsigned sm_keypress : 1;
+    uint8_t sm_our_key_dist;
+    uint8_t sm_their_key_dist;
+};
+
+extern struct ble_hs_cfg ble_hs_cfg;
+
+int ble_hs_id_infer_auto(int privacy, uint8_t *out_addr_type);
+struct os_mbuf *ble_hs_mbuf_from_flat(const void *buf, uint16_t len);
+int ble_hs_mbuf_to_flat(const struct os_mbuf *om, void *flat, uint16_t max_len, uint16_t *out_copy_len);
+uint16_t ble_att_mtu(uint16_t conn_handle);
+int ble_att_set_preferred_mtu(uint16_t mtu);
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+
+#define BLE_ADDR_PUBLIC 0x00
+#define BLE_ADDR_RANDOM 0x01
+#define BLE_ADDR_PUBLIC_ID 0x02
+#define BLE_ADDR_RANDOM_ID 0x03
+
+typedef struct {
+    uint8_t type;
+    uint8_t val[6];
+} ble_addr_t;
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+
+struct os_mbuf;
+struct ble_l2cap_chan;
+
+#define BLE_L2CAP_EVENT_COC_CONNECTED 0
+#define BLE_L2CAP_EVENT_COC_DISCONNECTED 1
+#define BLE_L2CAP_EVENT_COC_ACCEPT 2
+#define BLE_L2CAP_EVENT_COC_DATA_RECEIVED 3
+#define BLE_L2CAP_EVENT_COC_TX_UNSTALLED 4
+#define BLE_L2CAP_EVENT_COC_RECONFIG_COMPLETED 5
+#define BLE_L2CAP_EVENT_COC_PEER_RECONFIGURED 6
+
+struct ble_l2cap_event {
+    int type;
+    union {
+        struct {
+            int status;
+            uint16_t conn_handle;
+            struct ble_l2cap_chan *chan;
+        } connect;
+        struct {
+            uint16_t conn_handle;
+            struct ble_l2cap_chan *chan;
+        } disconnect;
+        struct {
+            uint16_t conn_handle;
+            uint16_t peer_sdu_size;
+            struct ble_l2cap_chan *chan;
+        } accept;
+        struct {
+            uint16_t conn_handle;
+            struct ble_l2cap_chan *chan;
+            struct os_mbuf *sdu_rx;
+        } receive;
+        struct {
+            uint16_t conn_handle;
+            struct ble_l2cap_chan *chan;
+            int status;
+        } tx_unstalled;
+    };
+};
+
+struct ble_l2cap_chan_info {
+    uint16_t scid;
+    uint16_t dcid;
+    uint16_t our_l2cap_mtu;
+    uint16_t peer_l2cap_mtu;
+    uint16_t psm;
+    uint16_t our_coc_mtu;
+    uint16_t peer_coc_mtu;
+};
+
+typedef int ble_l2cap_event_fn(struct ble_l2cap_event *event, void *arg);
+
+int ble_l2cap_create_server(uint16_t psm, uint16_t mtu, ble_l2cap_event_fn *cb, void *cb_arg);
+int ble_l2cap_send(struct ble_l2cap_chan *chan, struct os_mbuf *sdu_tx);
+int ble_l2cap_recv_ready(struct ble_l2cap_chan *chan, struct os_mbuf *sdu_rx);
+int ble_l2cap_get_chan_info(struct ble_l2cap_chan *chan, struct ble_l2cap_chan_info *chan_info);
+int ble_l2cap_disconnect(struct ble_l2cap_chan *chan);
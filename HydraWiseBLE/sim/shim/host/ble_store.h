@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+#include "host/ble_hs_addr.h"
+
+#define BLE_STORE_ADDR_TYPE_NONE 0xff
+
+struct ble_store_key_sec {
+    ble_addr_t peer_addr;
+    uint8_t idx;
+};
+
+struct ble_store_value_sec {
+    ble_addr_t peer_addr;
+    uint8_t key_size;
+    unsigned ltk_present : 1;
+    unsigned irk_present : 1;
+    unsigned authenticated : 1;
+    unsigned sc : 1;
+};
+
+struct ble_store_status_event;
+
+int ble_store_read_peer_sec(const struct ble_store_key_sec *key, struct ble_store_value_sec *value);
+int ble_store_util_bonded_peers(ble_addr_t *out_peer_id_addrs, int *out_num_peers, int max_peers);
+int ble_store_util_delete_peer(const ble_addr_t *peer_id_addr);
+int ble_store_util_status_rr(struct ble_store_status_event *event, void *arg);
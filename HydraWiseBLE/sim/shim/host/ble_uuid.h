@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+    uint8_t type;
+} ble_uuid_t;
+
+typedef struct {
+    ble_uuid_t u;
+    uint16_t value;
+} ble_uuid16_t;
+
+typedef struct {
+    ble_uuid_t u;
+    uint8_t value[16];
+} ble_uuid128_t;
+
+typedef union {
+    ble_uuid_t u;
+    ble_uuid16_t u16;
+    ble_uuid128_t u128;
+} ble_uuid_any_t;
+
+#define BLE_UUID_TYPE_16 16
+#define BLE_UUID_TYPE_128 128
+
+#define BLE_UUID16_INIT(uuid16) { .u = { .type = BLE_UUID_TYPE_16 }, .value = (uuid16) }
+#define BLE_UUID128_INIT(uuid128...) { .u = { .type = BLE_UUID_TYPE_128 }, .value = { uuid128 } }
+#define BLE_UUID16_DECLARE(uuid16) ((const ble_uuid_t *)(&(ble_uuid16_t)BLE_UUID16_INIT(uuid16)))
+#define BLE_UUID128_DECLARE(uuid128...) ((const ble_uuid_t *)(&(ble_uuid128_t)BLE_UUID128_INIT(uuid128)))
+
+int ble_uuid_cmp(const ble_uuid_t *a, const ble_uuid_t *b);
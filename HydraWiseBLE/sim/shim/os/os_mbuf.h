@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/queue.h>
+#include "os/os_mempool.h"
+
+/*
+NimBLE mbufs, see sim_mbuf.c: chains of pool blocks with a packet header in
+the first one, as in porting/nimble/include/os/os_mbuf.h.
+*/
+
+struct os_mbuf_pool {
+    uint16_t omp_databuf_len;
+    struct os_mempool *omp_pool;
+};
+
+struct os_mbuf_pkthdr {
+    uint16_t omp_len;
+    uint16_t omp_flags;
+};
+
+struct os_mbuf {
+    uint8_t *om_data;
+    uint8_t om_flags;
+    uint8_t om_pkthdr_len;
+    uint16_t om_len;
+    struct os_mbuf_pool *om_omp;
+    SLIST_ENTRY(os_mbuf) om_next;
+    uint8_t om_databuf[];
+};
+
+#define OS_MBUF_IS_PKTHDR(om) ((om)->om_pkthdr_len >= sizeof(struct os_mbuf_pkthdr))
+#define OS_MBUF_PKTHDR(om) ((struct os_mbuf_pkthdr *)(void *)(om)->om_databuf)
+#define OS_MBUF_PKTLEN(om) (OS_MBUF_PKTHDR(om)->omp_len)
+#define OS_MBUF_DATA(om, type) ((type)(om)->om_data)
+#define OS_MBUF_LEADINGSPACE(om) \
+    ((uint16_t)((om)->om_data - &(om)->om_databuf[0] - (om)->om_pkthdr_len))
+#define OS_MBUF_TRAILINGSPACE(om) \
+    ((uint16_t)(&(om)->om_databuf[0] + (om)->om_omp->omp_databuf_len - (om)->om_data - (om)->om_len))
+
+int os_mbuf_pool_init(struct os_mbuf_pool *omp, struct os_mempool *mp, uint16_t buf_len, uint16_t nbufs);
+struct os_mbuf *os_mbuf_get(struct os_mbuf_pool *omp, uint16_t leadingspace);
+struct os_mbuf *os_mbuf_get_pkthdr(struct os_mbuf_pool *omp, uint8_t user_pkthdr_len);
+int os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len);
+void *os_mbuf_extend(struct os_mbuf *om, uint16_t len);
+void os_mbuf_adj(struct os_mbuf *om, int req_len);
+int os_mbuf_copydata(const struct os_mbuf *om, int off, int len, void *dst);
+uint16_t os_mbuf_len(const struct os_mbuf *om);
+int os_mbuf_free(struct os_mbuf *om);
+int os_mbuf_free_chain(struct os_mbuf *om);
+
+// Shared pools of the host (CONFIG_BT_NIMBLE_MSYS_*)
+struct os_mbuf *os_msys_get(uint16_t dsize, uint16_t leadingspace);
+struct os_mbuf *os_msys_get_pkthdr(uint16_t dsize, uint16_t user_hdr_len);
+int os_msys_num_free(void);
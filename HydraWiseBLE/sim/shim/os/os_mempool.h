@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+NimBLE memory pools, see sim_mbuf.c. Blocks are aligned for the host's
+pointers instead of the ESP32's 4 bytes; everything else behaves as in
+porting/nimble/include/os/os_mempool.h, extended pools and their put
+callback included.
+*/
+
+#define OS_ALIGNMENT 8
+#define OS_ALIGN(n, a) (((n) + ((a) - 1)) / (a) * (a))
+
+typedef uint64_t os_membuf_t;
+
+#define OS_MEMPOOL_SIZE(n, blksize) ((((blksize) + (OS_ALIGNMENT - 1)) / OS_ALIGNMENT) * (n))
+#define OS_MEMPOOL_BYTES(n, blksize) (sizeof(os_membuf_t) * OS_MEMPOOL_SIZE((n), (blksize)))
+
+#define OS_MEMPOOL_F_EXT 0x01
+
+struct os_memblock {
+    struct os_memblock *mb_next;
+};
+
+struct os_mempool {
+    uint32_t mp_block_size;
+    uint16_t mp_num_blocks;
+    uint16_t mp_num_free;
+    uint16_t mp_min_free;
+    uint8_t mp_flags;
+    uintptr_t mp_membuf_addr;
+    struct os_memblock *mp_head;
+    const char *name;
+};
+
+struct os_mempool_ext;
+typedef int os_mempool_put_fn(struct os_mempool_ext *ome, void *data, void *arg);
+
+struct os_mempool_ext {
+    struct os_mempool mpe_mp;
+    os_mempool_put_fn *mpe_put_cb;
+    void *mpe_put_arg;
+};
+
+int os_mempool_init(struct os_mempool *mp, uint16_t blocks, uint32_t block_size, void *membuf, const char *name);
+int os_mempool_ext_init(struct os_mempool_ext *mpe, uint16_t blocks, uint32_t block_size, void *membuf,
+    const char *name);
+void *os_memblock_get(struct os_mempool *mp);
+int os_memblock_put(struct os_mempool *mp, void *block);
+int os_memblock_put_from_cb(struct os_mempool *mp, void *block);
@@ -0,0 +1,23 @@
+#pragma once
+
+/*
+Configuration the firmware reads from sdkconfig.h, fixed to the values in the
+firmware's sdkconfig so the simulation sizes its tables the same way.
+*/
+
+#define CONFIG_BT_NIMBLE_MAX_CONNECTIONS 3
+#define CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM 1
+#define CONFIG_BT_NIMBLE_WHITELIST_SIZE 12
+#define CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU 256
+#define CONFIG_BT_NIMBLE_NVS_PERSIST 1
+#define CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT 12
+#define CONFIG_BT_NIMBLE_MSYS_1_BLOCK_SIZE 256
+#define CONFIG_BT_NIMBLE_MSYS_2_BLOCK_COUNT 24
+#define CONFIG_BT_NIMBLE_MSYS_2_BLOCK_SIZE 320
+#define CONFIG_BT_NIMBLE_ACL_BUF_COUNT 24
+#define CONFIG_BT_NIMBLE_ACL_BUF_SIZE 255
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ 160
+#define CONFIG_XTAL_FREQ 40
+#define CONFIG_PM_ENABLE 1
+#define CONFIG_PM_LIGHT_SLEEP_CALLBACKS 1
@@ -0,0 +1,3 @@
+#pragma once
+
+void ble_store_config_init(void);
@@ -0,0 +1,187 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_adc/adc_continuous.h"
+#include "esp_pm.h"
+#include "adc_acq.h"
+#include "sim_adc.h"
+#include "sim_clock.h"
+#include "sim_rand.h"
+
+#define SIM_ADC_PATTERN_MAX 8
+
+struct sim_adc {
+    uint32_t frame_bytes;
+    uint32_t pool_frames;
+    uint8_t *pool;
+    uint32_t head;           // oldest full frame
+    uint32_t full;           // full frames waiting to be read
+    uint8_t *fill;           // frame being converted into
+    uint32_t fill_bytes;
+    uint8_t pattern[SIM_ADC_PATTERN_MAX];
+    uint32_t pattern_num;
+    uint32_t next;           // pattern entry of the next conversion
+    uint32_t freq_hz;
+    double due;              // conversions owed to the clock
+    adc_continuous_evt_cbs_t cbs;
+    void *user;
+    esp_pm_lock_handle_t pm_lock; // the driver keeps APB up while converting
+    bool started;
+};
+
+static struct sim_adc adc;
+static sim_rand_t rnd;
+static double bpm_cfg;
+static double electrode = 1800;
+static double pulse_phase;
+static double true_bpm;
+static uint32_t frames;
+static uint32_t frames_lost;
+
+void sim_adc_init(double bpm, uint32_t seed) {
+    bpm_cfg = bpm;
+    true_bpm = bpm;
+    sim_rand_seed(&rnd, seed);
+}
+
+double sim_adc_true_bpm(void) {
+    return true_bpm;
+}
+
+uint32_t sim_adc_frames(void) {
+    return frames;
+}
+
+uint32_t sim_adc_frames_lost(void) {
+    return frames_lost;
+}
+
+// --- inputs ---
+
+static uint16_t convert(uint8_t channel, double t) {
+    if (channel == ADC_ACQ_CHANNEL) {
+        return (uint16_t)(electrode + sim_rand_range(&rnd, -8, 8));
+    }
+    if (channel == ADC_ACQ_PPG_CHANNEL) {
+        // photodiode: falls on each pulse
+        pulse_phase += true_bpm / 60 / ADC_ACQ_INPUT_HZ;
+        double f = pulse_phase - floor(pulse_phase);
+        double pulse = exp(-pow((f - 0.2) / 0.06, 2)) + 0.4 * exp(-pow((f - 0.5) / 0.08, 2));
+        return (uint16_t)(2000 + 50 * sin(t * 0.2 * 2 * M_PI) - 100 * pulse + sim_rand_range(&rnd, -20, 20));
+    }
+    return 0;
+}
+
+static void frame_done(void) {
+    frames++;
+    if (adc.full == adc.pool_frames) {
+        // the driver drops the frame and says so
+        frames_lost++;
+        if (adc.cbs.on_pool_ovf != NULL) {
+            adc.cbs.on_pool_ovf(&adc, &(adc_continuous_evt_data_t){ 0 }, adc.user);
+        }
+    } else {
+        uint8_t *dst = adc.pool + ((adc.head + adc.full) % adc.pool_frames) * adc.frame_bytes;
+        memcpy(dst, adc.fill, adc.frame_bytes);
+        adc.full++;
+        if (adc.cbs.on_conv_done != NULL) {
+            adc_continuous_evt_data_t ev = { .conv_frame_buffer = dst, .size = adc.frame_bytes };
+            adc.cbs.on_conv_done(&adc, &ev, adc.user);
+        }
+    }
+    adc.fill_bytes = 0;
+}
+
+void sim_adc_step(uint64_t step_us) {
+    double t = sim_now_us() / 1e6;
+    electrode += sim_rand_range(&rnd, -100, 100) / 1000.0;
+    electrode = electrode < 200 ? 200 : electrode > 3800 ? 3800 : electrode;
+    true_bpm = bpm_cfg * (1 + 0.05 * sin(t * 0.3));
+    if (!adc.started) {
+        return;
+    }
+    adc.due += (double)adc.freq_hz * step_us / 1e6;
+    while (adc.due >= 1) {
+        adc.due -= 1;
+        uint8_t ch = adc.pattern[adc.next];
+        adc.next = (adc.next + 1) % adc.pattern_num;
+        adc_digi_output_data_t out = { .type1 = { .data = convert(ch, t), .channel = ch } };
+        memcpy(adc.fill + adc.fill_bytes, &out, SOC_ADC_DIGI_RESULT_BYTES);
+        adc.fill_bytes += SOC_ADC_DIGI_RESULT_BYTES;
+        if (adc.fill_bytes == adc.frame_bytes) {
+            frame_done();
+        }
+    }
+}
+
+// --- driver ---
+
+esp_err_t adc_continuous_new_handle(const adc_continuous_handle_cfg_t *cfg, adc_continuous_handle_t *out) {
+    if (cfg->conv_frame_size == 0 || cfg->conv_frame_size % SOC_ADC_DIGI_RESULT_BYTES != 0 ||
+        cfg->max_store_buf_size < cfg->conv_frame_size)
+        return ESP_ERR_INVALID_ARG;
+    adc.frame_bytes = cfg->conv_frame_size;
+    adc.pool_frames = cfg->max_store_buf_size / cfg->conv_frame_size;
+    adc.pool = malloc(adc.pool_frames * adc.frame_bytes);
+    adc.fill = malloc(adc.frame_bytes);
+    esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "adc_dma", &adc.pm_lock);
+    *out = &adc;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_config(adc_continuous_handle_t h, const adc_continuous_config_t *cfg) {
+    if (cfg->pattern_num == 0 || cfg->pattern_num > SIM_ADC_PATTERN_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (uint32_t i = 0; i < cfg->pattern_num; i++) {
+        h->pattern[i] = cfg->adc_pattern[i].channel;
+    }
+    h->pattern_num = cfg->pattern_num;
+    h->freq_hz = cfg->sample_freq_hz;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_register_event_callbacks(adc_continuous_handle_t h, const adc_continuous_evt_cbs_t *cbs,
+    void *user_data) {
+    h->cbs = *cbs;
+    h->user = user_data;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_start(adc_continuous_handle_t h) {
+    if (h->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    h->started = true;
+    esp_pm_lock_acquire(h->pm_lock);
+    h->next = 0;
+    h->due = 0;
+    h->fill_bytes = 0;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_stop(adc_continuous_handle_t h) {
+    if (!h->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    h->started = false;
+    esp_pm_lock_release(h->pm_lock);
+    h->head = 0;
+    h->full = 0;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_read(adc_continuous_handle_t h, uint8_t *buf, uint32_t len, uint32_t *out_len,
+    uint32_t timeout_ms) {
+    // a frame at a time; the firmware only polls with timeout 0
+    if (h->full == 0) {
+        *out_len = 0;
+        return ESP_ERR_TIMEOUT;
+    }
+    uint32_t n = len < h->frame_bytes ? len : h->frame_bytes;
+    memcpy(buf, h->pool + h->head * h->frame_bytes, n);
+    h->head = (h->head + 1) % h->pool_frames;
+    h->full--;
+    *out_len = n;
+    return ESP_OK;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+The continuous ADC driver with its two inputs, see shim/esp_adc. The
+electrode input is a slow random walk with a little conversion noise; the
+PPG input is a pulse with a dicrotic notch, breathing wander and noise,
+at a heart rate that drifts ±5% around the configured one.
+*/
+
+void sim_adc_init(double bpm, uint32_t seed);
+
+// Converts the samples due in the next step_us; full frames raise on_conv_done
+void sim_adc_step(uint64_t step_us);
+
+// Heart rate the PPG input beats at now
+double sim_adc_true_bpm(void);
+
+uint32_t sim_adc_frames(void);
+uint32_t sim_adc_frames_lost(void); // found the pool full
@@ -0,0 +1,1463 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host/ble_hs.h"
+#include "host/ble_l2cap.h"
+#include "nimble/nimble_port.h"
+#include "nimble/nimble_port_freertos.h"
+#include "services/gap/ble_svc_gap.h"
+#include "services/gatt/ble_svc_gatt.h"
+#include "store/config/ble_store_config.h"
+#include "sdkconfig.h"
+#include "sim_clock.h"
+#include "sim_ble.h"
+
+#define HOST_TASK_PRIO 21       // ESP-IDF NIMBLE_HS_TASK priority
+#define HANDLE_FIRST 0x0010     // after the GAP and GATT services
+#define L2CAP_HDR_LEN 4
+#define ATT_NOTIFY_HDR_LEN 3
+#define COC_SDU_LEN_LEN 2       // in the first K-frame of an SDU
+#define PROC_EVENTS 6           // connection events until an LL procedure takes effect
+#define DLE_EVENTS 2
+#define SUPERVISION_TIMEOUT 500 // 5 s, what the centrals connect with
+#define ADV_HD_ITVL_US 3750     // high duty cycle directed advertising
+#define ADV_HD_MAX_MS 1280
+#define ADV_DELAY_MAX_US 10000  // advDelay added to every advertising event
+#define PEERS_MAX 8
+#define CONNS_MAX CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#define CHANS_MAX (CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM > 0 ? CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM : 1)
+
+struct ble_hs_cfg ble_hs_cfg;
+
+// --- state ---
+
+// An SDU being sent, shared by its K-frames until the last one was acked or dropped
+typedef struct {
+    uint16_t refs;
+    uint16_t len;
+    uint16_t frames;
+    uint8_t data[];
+} sdu_tx_t;
+
+typedef enum {
+    PDU_NOTIFY,
+    PDU_KFRAME,
+} pdu_kind_t;
+
+// An L2CAP PDU on its way out: queued in the host until its last fragment went to the
+// controller, then in flight until every fragment was acked or dropped
+typedef struct pdu {
+    struct pdu *next;       // host queue of the connection
+    pdu_kind_t kind;
+    uint16_t len;           // L2CAP PDU, header included
+    uint16_t handed;        // bytes handed to the controller
+    uint8_t frags_out;      // fragments in the controller
+    bool in_host;
+    bool delivered_ok;      // every fragment acked so far
+    uint16_t attr_handle;
+    struct os_mbuf *om;     // the sender's mbuf, freed once the last fragment is handed over
+    sdu_tx_t *sdu;
+    bool sdu_last;
+    uint16_t value_len;
+    uint8_t value[];
+} pdu_t;
+
+typedef struct {
+    bool used;
+    bool terminating;
+    uint32_t id;            // tells a reused handle apart in queued jobs
+    uint16_t handle;
+    sim_ble_peer_t *peer;
+    ble_gap_event_fn *cb;
+    void *cb_arg;
+    uint16_t mtu;
+    uint16_t ll_octets;
+    uint16_t itvl;
+    uint16_t latency;
+    uint16_t timeout;
+    struct ble_gap_sec_state sec;
+    uint32_t cccd;          // notifications enabled, a bit per registered characteristic
+    uint8_t upd_events;     // 0 = no parameter update pending
+    struct ble_gap_upd_params upd;
+    uint8_t dle_events;
+    uint16_t dle_octets;
+    pdu_t *txq_head;
+    pdu_t *txq_tail;
+    uint32_t txq_len;
+} conn_t;
+
+struct ble_l2cap_chan {
+    bool used;
+    uint32_t conn_id;
+    uint16_t conn_handle;
+    uint16_t psm;
+    uint16_t our_mtu;
+    uint16_t peer_mtu;
+    uint16_t peer_mps;
+    uint16_t credits;       // K-frames the peer takes
+    bool stalled;
+    struct os_mbuf *tx_sdu;
+    sdu_tx_t *tx_copy;
+    uint16_t tx_off;
+    struct os_mbuf *rx_buf;
+    ble_l2cap_event_fn *cb;
+    void *cb_arg;
+};
+
+typedef struct {
+    uint16_t psm;
+    uint16_t mtu;
+    ble_l2cap_event_fn *cb;
+    void *cb_arg;
+} coc_server_t;
+
+typedef struct {
+    const ble_uuid_t *svc_uuid;
+    const struct ble_gatt_chr_def *chr;
+    uint16_t def_handle;
+    uint16_t val_handle;
+    bool cccd;
+} gatt_chr_t;
+
+typedef struct {
+    bool used;
+    ble_addr_t addr;
+    uint32_t cccd;
+    uint32_t seq;           // age, for evicting the oldest
+} bond_t;
+
+typedef enum {
+    JOB_SYNC,
+    JOB_CONNECT,
+    JOB_DISCONNECT,
+    JOB_NOCP,
+    JOB_ADV_TIMEOUT,
+    JOB_MTU,
+    JOB_ENCRYPT,
+    JOB_SUBSCRIBE,
+    JOB_WRITE,
+    JOB_READ,
+    JOB_UPDATE_DONE,
+    JOB_DLE_DONE,
+    JOB_COC_CONNECT,
+    JOB_COC_CREDITS,
+    JOB_COC_SDU,
+} job_type_t;
+
+// Work for the host task, from the controller or a central
+typedef struct job {
+    struct job *next;
+    job_type_t type;
+    uint32_t conn_id;
+    int a;
+    int b;
+    int c;
+    int d;
+    uint16_t len;
+    uint8_t data[];
+} job_t;
+
+static sim_rand_t *rnd;
+static TaskHandle_t host_task;
+static bool sync_posted;
+static job_t *jobs_head, *jobs_tail;
+static bool nocp_posted;
+static uint32_t conn_ids;
+
+static conn_t conns[CONNS_MAX];
+static sim_ble_peer_t *peers[PEERS_MAX];
+static int peer_count;
+static struct ble_l2cap_chan chans[CHANS_MAX];
+static coc_server_t servers[CHANS_MAX];
+static int server_count;
+
+static gatt_chr_t chrs[SIM_BLE_CHRS_MAX];
+static int chr_count;
+static uint16_t next_handle = HANDLE_FIRST;
+static uint16_t preferred_mtu = CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU;
+static char device_name[32] = "nimble";
+
+static bond_t bonds[SIM_BLE_BONDS_MAX];
+static uint32_t bond_seq;
+static bool store_ready;
+
+static struct {
+    bool active;
+    bool connectable;
+    bool directed;
+    bool accept_list;
+    ble_addr_t direct;
+    uint32_t itvl_us;
+    bool delay;             // advDelay, not for high duty cycle
+    uint64_t next_us;
+    uint64_t end_us;
+    ble_gap_event_fn *cb;
+    void *cb_arg;
+} adv;
+static ble_addr_t accept_list[CONFIG_BT_NIMBLE_WHITELIST_SIZE];
+static uint8_t accept_count;
+
+static sim_ble_stats_t stats;
+static uint32_t host_queue_max; // 0 = no limit
+
+static void link_event(uint16_t conn_handle, bool lost);
+static void link_acked(uint16_t conn_handle, void *ctx);
+
+void sim_ble_init(const sim_link_cfg_t *link, sim_rand_t *rand) {
+    rnd = rand;
+    static const sim_link_cbs_t link_cbs = { .event = link_event, .acked = link_acked };
+    sim_link_init(link, &link_cbs, rand);
+}
+
+void sim_ble_set_host_queue(uint32_t pdus) {
+    host_queue_max = pdus;
+}
+
+static bool addr_eq(const ble_addr_t *a, const ble_addr_t *b) {
+    return a->type == b->type && memcmp(a->val, b->val, sizeof(a->val)) == 0;
+}
+
+static conn_t *conn_find(uint16_t conn_handle) {
+    for (int i = 0; i < CONNS_MAX; i++) {
+        if (conns[i].used && conns[i].handle == conn_handle) {
+            return &conns[i];
+        }
+    }
+    return NULL;
+}
+
+static conn_t *conn_by_id(uint32_t id) {
+    for (int i = 0; i < CONNS_MAX; i++) {
+        if (conns[i].used && conns[i].id == id) {
+            return &conns[i];
+        }
+    }
+    return NULL;
+}
+
+static conn_t *peer_conn(const sim_ble_peer_t *p) {
+    return p->conn_handle != BLE_HS_CONN_HANDLE_NONE ? conn_find(p->conn_handle) : NULL;
+}
+
+static int gap_event(conn_t *c, struct ble_gap_event *event) {
+    return c->cb != NULL ? c->cb(event, c->cb_arg) : 0;
+}
+
+static int chr_by_val(uint16_t val_handle) {
+    for (int i = 0; i < chr_count; i++) {
+        if (chrs[i].val_handle == val_handle) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// --- host task and jobs ---
+
+static job_t *job_new(job_type_t type, const conn_t *c, const void *data, uint16_t len) {
+    job_t *j = calloc(1, sizeof(*j) + len);
+    j->type = type;
+    j->conn_id = c != NULL ? c->id : 0;
+    j->len = len;
+    if (len > 0) {
+        memcpy(j->data, data, len);
+    }
+    return j;
+}
+
+static void job_post(job_t *j) {
+    if (jobs_tail != NULL) {
+        jobs_tail->next = j;
+    } else {
+        jobs_head = j;
+    }
+    jobs_tail = j;
+    if (host_task != NULL) {
+        xTaskNotifyGive(host_task);
+    }
+}
+
+static void job_run(job_t *j);
+
+esp_err_t nimble_port_init(void) {
+    return ESP_OK;
+}
+
+void nimble_port_freertos_init(TaskFunction_t host_task_fn) {
+    xTaskCreatePinnedToCore(host_task_fn, "nimble_host", 4096, NULL, HOST_TASK_PRIO, &host_task, 0);
+}
+
+void nimble_port_run(void) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (jobs_head != NULL) {
+            job_t *j = jobs_head;
+            jobs_head = j->next;
+            if (jobs_head == NULL) {
+                jobs_tail = NULL;
+            }
+            job_run(j);
+            free(j);
+        }
+    }
+}
+
+// --- transmit path ---
+
+static void pdu_release(pdu_t *p) {
+    if (p->in_host || p->frags_out > 0) {
+        return;
+    }
+    if (p->sdu != NULL && --p->sdu->refs == 0) {
+        free(p->sdu);
+    }
+    free(p);
+}
+
+static void txq_push(conn_t *c, pdu_t *p) {
+    p->in_host = true;
+    p->delivered_ok = true;
+    if (c->txq_tail != NULL) {
+        c->txq_tail->next = p;
+    } else {
+        c->txq_head = p;
+    }
+    c->txq_tail = p;
+    if (++c->txq_len > stats.pdus_queued_max) {
+        stats.pdus_queued_max = c->txq_len;
+    }
+}
+
+static pdu_t *txq_pop(conn_t *c) {
+    pdu_t *p = c->txq_head;
+    c->txq_head = p->next;
+    if (c->txq_head == NULL) {
+        c->txq_tail = NULL;
+    }
+    c->txq_len--;
+    p->next = NULL;
+    p->in_host = false;
+    return p;
+}
+
+// Moves queued fragments into free controller buffers, connection by connection like
+// ble_hs_wakeup_tx(): the first connection drains before the next gets a buffer
+static void host_tx_pump(void) {
+    for (int i = 0; i < CONNS_MAX; i++) {
+        conn_t *c = &conns[i];
+        while (c->used && c->txq_head != NULL && sim_link_acl_free() > 0) {
+            pdu_t *p = c->txq_head;
+            uint16_t frag = p->len - p->handed;
+            if (frag > SIM_LINK_ACL_SIZE) {
+                frag = SIM_LINK_ACL_SIZE;
+            }
+            sim_link_acl_tx(c->handle, frag, p);
+            p->handed += frag;
+            p->frags_out++;
+            if (p->handed == p->len) {
+                txq_pop(c);
+                if (p->om != NULL) {
+                    os_mbuf_free_chain(p->om); // back to its pool, e.g. the notify pool
+                    p->om = NULL;
+                }
+            }
+        }
+    }
+}
+
+// Number Of Completed Packets: one fragment was acked by the peer
+static void link_acked(uint16_t conn_handle, void *ctx) {
+    pdu_t *p = ctx;
+    conn_t *c = conn_find(conn_handle);
+    p->frags_out--;
+    if (!p->in_host && p->frags_out == 0 && c != NULL) {
+        sim_ble_peer_t *peer = c->peer;
+        if (p->kind == PDU_NOTIFY && peer->cbs->notified != NULL) {
+            peer->cbs->notified(peer->arg, p->attr_handle, p->value, p->value_len);
+        } else if (p->kind == PDU_KFRAME && p->sdu_last && peer->cbs->sdu != NULL) {
+            peer->cbs->sdu(peer->arg, p->sdu->data, p->sdu->len, p->sdu->frames);
+        }
+    }
+    pdu_release(p);
+    if (!nocp_posted) {
+        nocp_posted = true;
+        job_post(job_new(JOB_NOCP, NULL, NULL, 0));
+    }
+}
+
+static void link_dropped(void *ctx) {
+    pdu_t *p = ctx;
+    p->frags_out--;
+    if (p->kind == PDU_NOTIFY && !p->in_host && p->frags_out == 0) {
+        stats.notify_dropped++;
+    }
+    pdu_release(p);
+}
+
+int ble_gattc_notify_custom(uint16_t conn_handle, uint16_t att_handle, struct os_mbuf *om) {
+    int rc = 0;
+    conn_t *c = conn_find(conn_handle);
+    stats.notifies++;
+    if (c == NULL) {
+        rc = BLE_HS_ENOTCONN;
+    } else if (om == NULL) {
+        rc = BLE_HS_EINVAL; // the firmware always builds the value itself
+    } else if (host_queue_max > 0 && c->txq_len >= host_queue_max) {
+        rc = BLE_HS_ENOMEM; // no mbuf for the ATT header; the value is freed below
+    } else {
+        uint16_t len = OS_MBUF_PKTLEN(om);
+        if (len > c->mtu - ATT_NOTIFY_HDR_LEN) {
+            stats.notify_truncated++; // a peer drops it
+        }
+        pdu_t *p = calloc(1, sizeof(*p) + len);
+        p->kind = PDU_NOTIFY;
+        p->len = L2CAP_HDR_LEN + ATT_NOTIFY_HDR_LEN + len;
+        p->attr_handle = att_handle;
+        p->value_len = len;
+        os_mbuf_copydata(om, 0, len, p->value);
+        p->om = om;
+        om = NULL;
+        txq_push(c, p);
+        host_tx_pump();
+    }
+    if (rc != 0) {
+        stats.notify_errors++;
+    }
+    if (c != NULL) {
+        // the transmission was attempted, as ble_gattc_notify_custom() reports it
+        struct ble_gap_event event = { .type = BLE_GAP_EVENT_NOTIFY_TX };
+        event.notify_tx.status = rc;
+        event.notify_tx.conn_handle = conn_handle;
+        event.notify_tx.attr_handle = att_handle;
+        gap_event(c, &event);
+    }
+    os_mbuf_free_chain(om);
+    return rc;
+}
+
+// --- connection events ---
+
+static void link_event(uint16_t conn_handle, bool lost) {
+    conn_t *c = conn_find(conn_handle);
+    if (c == NULL || c->terminating) {
+        return;
+    }
+    if (c->dle_events > 0 && --c->dle_events == 0) {
+        uint16_t octets = c->dle_octets < c->peer->ll_octets ? c->dle_octets : c->peer->ll_octets;
+        if (octets != c->ll_octets) {
+            job_t *j = job_new(JOB_DLE_DONE, c, NULL, 0);
+            j->a = octets;
+            job_post(j);
+        }
+    }
+    if (c->upd_events > 0 && --c->upd_events == 0) {
+        job_t *j = job_new(JOB_UPDATE_DONE, c, NULL, 0);
+        if (c->upd.itvl_max < c->peer->itvl_floor) {
+            j->a = BLE_HS_ERR_HCI_BASE + 0x3b; // Unacceptable Connection Parameters
+        } else {
+            j->b = c->upd.itvl_min > c->peer->itvl_floor ? c->upd.itvl_min : c->peer->itvl_floor;
+            j->c = c->upd.latency;
+            j->d = c->upd.supervision_timeout;
+            c->itvl = (uint16_t)j->b; // the instant passed: events follow the new interval
+            sim_link_set_itvl(c->handle, c->itvl * 1250u);
+        }
+        job_post(j);
+    }
+    if (!lost && c->peer->cbs->event != NULL) {
+        c->peer->cbs->event(c->peer->arg);
+    }
+}
+
+// --- advertising ---
+
+static bool on_accept_list(const ble_addr_t *addr) {
+    for (int i = 0; i < accept_count; i++) {
+        if (addr_eq(&accept_list[i], addr)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void connect_peer(sim_ble_peer_t *p, uint64_t now_us) {
+    conn_t *c = NULL;
+    for (int i = 0; i < CONNS_MAX && c == NULL; i++) {
+        if (!conns[i].used) {
+            c = &conns[i];
+            *c = (conn_t){
+                .used = true,
+                .id = ++conn_ids,
+                .handle = (uint16_t)(i + 1),
+                .peer = p,
+                .cb = adv.cb,
+                .cb_arg = adv.cb_arg,
+                .mtu = BLE_ATT_MTU_DFLT,
+                .ll_octets = 27,
+                .itvl = p->itvl,
+                .timeout = SUPERVISION_TIMEOUT,
+            };
+        }
+    }
+    if (c == NULL) {
+        return; // the controller has no room for another connection
+    }
+    adv.active = false; // a connection ends advertising, without ADV_COMPLETE
+    p->scanning = false;
+    p->sec_requested = false;
+    p->conn_handle = c->handle;
+    sim_link_open(c->handle, c->itvl * 1250u, c->ll_octets, now_us);
+    stats.connects++;
+    job_post(job_new(JOB_CONNECT, c, NULL, 0));
+    if (p->cbs->connected != NULL) {
+        p->cbs->connected(p->arg, c->handle);
+    }
+}
+
+static void adv_event(uint64_t now_us) {
+    stats.adv_events++;
+    if (!adv.connectable) {
+        return;
+    }
+    for (int i = 0; i < peer_count; i++) {
+        sim_ble_peer_t *p = peers[i];
+        if (!p->scanning || p->conn_handle != BLE_HS_CONN_HANDLE_NONE) {
+            continue;
+        }
+        if ((adv.directed && !addr_eq(&p->addr, &adv.direct)) || (adv.accept_list && !on_accept_list(&p->addr))) {
+            continue;
+        }
+        if (sim_rand_below(rnd, 100) < p->scan_pct) {
+            connect_peer(p, now_us);
+            return;
+        }
+    }
+}
+
+void sim_ble_step(uint64_t now_us) {
+    if (!sync_posted && host_task != NULL && now_us >= SIM_BLE_SYNC_US) {
+        sync_posted = true;
+        job_post(job_new(JOB_SYNC, NULL, NULL, 0));
+    }
+    if (adv.active && now_us >= adv.end_us) {
+        adv.active = false;
+        job_post(job_new(JOB_ADV_TIMEOUT, NULL, NULL, 0));
+    }
+    while (adv.active && now_us >= adv.next_us) {
+        adv.next_us += adv.itvl_us + (adv.delay ? sim_rand_below(rnd, ADV_DELAY_MAX_US) : 0);
+        adv_event(now_us);
+    }
+    sim_link_run(now_us);
+}
+
+int ble_gap_adv_start(uint8_t own_addr_type, const ble_addr_t *direct_addr, int32_t duration_ms,
+    const struct ble_gap_adv_params *params, ble_gap_event_fn *cb, void *cb_arg) {
+    if (adv.active) {
+        return BLE_HS_EALREADY;
+    }
+    bool directed = params->conn_mode == BLE_GAP_CONN_MODE_DIR;
+    if (directed && direct_addr == NULL) {
+        return BLE_HS_EINVAL;
+    }
+    uint64_t now = sim_now_us();
+    adv.connectable = params->conn_mode != BLE_GAP_CONN_MODE_NON;
+    adv.directed = directed;
+    adv.accept_list = params->filter_policy == BLE_HCI_ADV_FILT_CONN || params->filter_policy == BLE_HCI_ADV_FILT_BOTH;
+    if (directed) {
+        adv.direct = *direct_addr;
+    }
+    if (directed && params->high_duty_cycle) {
+        // the controller ends it after 1.28 s with a directed advertising timeout
+        adv.itvl_us = ADV_HD_ITVL_US;
+        adv.delay = false;
+        if (duration_ms == BLE_HS_FOREVER || duration_ms > ADV_HD_MAX_MS) {
+            duration_ms = ADV_HD_MAX_MS;
+        }
+    } else {
+        adv.itvl_us = params->itvl_min * 625u;
+        adv.delay = true;
+    }
+    adv.end_us = duration_ms == BLE_HS_FOREVER ? UINT64_MAX : now + (uint64_t)duration_ms * 1000;
+    adv.next_us = now;
+    adv.cb = cb;
+    adv.cb_arg = cb_arg;
+    adv.active = true;
+    return 0;
+}
+
+int ble_gap_adv_stop(void) {
+    if (!adv.active) {
+        return BLE_HS_EALREADY;
+    }
+    adv.active = false;
+    return 0;
+}
+
+int ble_gap_adv_active(void) {
+    return adv.active;
+}
+
+int ble_gap_adv_set_data(const uint8_t *data, int len) {
+    return len > 31 ? BLE_HS_EMSGSIZE : 0;
+}
+
+int ble_gap_adv_rsp_set_data(const uint8_t *data, int len) {
+    return len > 31 ? BLE_HS_EMSGSIZE : 0;
+}
+
+int ble_gap_wl_set(const ble_addr_t *addrs, uint8_t white_list_count) {
+    if (white_list_count > CONFIG_BT_NIMBLE_WHITELIST_SIZE) {
+        return BLE_HS_EINVAL;
+    }
+    if (adv.active && adv.accept_list) {
+        return BLE_HS_EBUSY; // the controller does not change a list in use
+    }
+    memcpy(accept_list, addrs, white_list_count * sizeof(addrs[0]));
+    accept_count = white_list_count;
+    return 0;
+}
+
+bool sim_ble_advertising(void) {
+    return adv.active;
+}
+
+// --- connections ---
+
+int ble_gap_conn_find(uint16_t conn_handle, struct ble_gap_conn_desc *out_desc) {
+    conn_t *c = conn_find(conn_handle);
+    if (c == NULL) {
+        return BLE_HS_ENOTCONN;
+    }
+    if (out_desc != NULL) {
+        memset(out_desc, 0, sizeof(*out_desc));
+        out_desc->sec_state = c->sec;
+        out_desc->peer_id_addr = c->peer->addr;
+        out_desc->peer_ota_addr = c->peer->addr;
+        out_desc->conn_handle = c->handle;
+        out_desc->conn_itvl = c->itvl;
+        out_desc->conn_latency = c->latency;
+        out_desc->supervision_timeout = c->timeout;
+        out_desc->role = BLE_GAP_ROLE_SLAVE;
+    }
+    return 0;
+}
+
+int ble_gap_terminate(uint16_t conn_handle, uint8_t hci_reason) {
+    conn_t *c = conn_find(conn_handle);
+    if (c == NULL) {
+        return BLE_HS_ENOTCONN;
+    }
+    if (c->terminating) {
+        return BLE_HS_EALREADY;
+    }
+    c->terminating = true;
+    job_t *j = job_new(JOB_DISCONNECT, c, NULL, 0);
+    j->a = BLE_HS_ERR_HCI_BASE + BLE_ERR_CONN_TERM_LOCAL;
+    job_post(j);
+    return 0;
+}
+
+int ble_gap_update_params(uint16_t conn_handle, const struct ble_gap_upd_params *params) {
+    conn_t *c = conn_find(conn_handle);
+    if (c == NULL) {
+        return BLE_HS_ENOTCONN;
+    }
+    if (c->upd_events > 0) {
+        return BLE_HS_EALREADY;
+    }
+    if (params->itvl_min < 6 || params->itvl_min > params->itvl_max) {
+        return BLE_HS_EINVAL;
+    }
+    c->upd = *params;
+    c->upd_events = PROC_EVENTS;
+    return 0;
+}
+
+int ble_gap_set_data_len(uint16_t conn_handle, uint16_t tx_octets, uint16_t tx_time) {
+    conn_t *c = conn_find(conn_handle);
+    if (c == NULL) {
+        return BLE_HS_ENOTCONN;
+    }
+    if (tx_octets < 27 || tx_octets > 251) {
+        return BLE_HS_EINVAL;
+    }
+    c->dle_octets = tx_octets;
+    c->dle_events = DLE_EVENTS;
+    return 0;
+}
+
+int ble_gap_security_initiate(uint16_t conn_handle) {
+    conn_t *c = conn_find(conn_handle);
+    if (c == NULL) {
+        return BLE_HS_ENOTCONN;
+    }
+    if (c->sec.encrypted) {
+        return BLE_HS_EALREADY;
+    }
+    c->peer->sec_requested = true;
+    return 0;
+}
+
+uint16_t ble_att_mtu(uint16_t conn_handle) {
+    conn_t *c = conn_find(conn_handle);
+    return c != NULL ? c->mtu : 0;
+}
+
+int ble_att_set_preferred_mtu(uint16_t mtu) {
+    if (mtu < BLE_ATT_MTU_DFLT || mtu > 527) {
+        return BLE_HS_EINVAL;
+    }
+    preferred_mtu = mtu;
+    return 0;
+}
+
+int ble_hs_id_infer_auto(int privacy, uint8_t *out_addr_type) {
+    *out_addr_type = BLE_ADDR_PUBLIC;
+    return 0;
+}
+
+// --- bond store ---
+
+static bond_t *bond_find(const ble_addr_t *addr) {
+    for (int i = 0; i < SIM_BLE_BONDS_MAX; i++) {
+        if (bonds[i].used && addr_eq(&bonds[i].addr, addr)) {
+            return &bonds[i];
+        }
+    }
+    return NULL;
+}
+
+static int bond_count(void) {
+    int n = 0;
+    for (int i = 0; i < SIM_BLE_BONDS_MAX; i++) {
+        n += bonds[i].used;
+    }
+    return n;
+}
+
+// The n-th bond, oldest first
+static bond_t *bond_nth(int n) {
+    bond_t *order[SIM_BLE_BONDS_MAX];
+    int count = 0;
+    for (int i = 0; i < SIM_BLE_BONDS_MAX; i++) {
+        if (bonds[i].used) {
+            int j = count++;
+            while (j > 0 && order[j - 1]->seq > bonds[i].seq) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = &bonds[i];
+        }
+    }
+    return n < count ? order[n] : NULL;
+}
+
+static bool bond_save(const ble_addr_t *addr, uint32_t cccd) {
+    if (bond_count() == SIM_BLE_BONDS_MAX && ble_hs_cfg.store_status_cb != NULL) {
+        ble_hs_cfg.store_status_cb(NULL, ble_hs_cfg.store_status_arg); // BLE_STORE_EVENT_FULL
+    }
+    for (int i = 0; i < SIM_BLE_BONDS_MAX; i++) {
+        if (!bonds[i].used) {
+            bonds[i] = (bond_t){ .used = true, .addr = *addr, .cccd = cccd, .seq = ++bond_seq };
+            stats.bonds++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ble_store_config_init(void) {
+    store_ready = true;
+}
+
+int ble_store_read_peer_sec(const struct ble_store_key_sec *key, struct ble_store_value_sec *value) {
+    bond_t *b = key->peer_addr.type == BLE_STORE_ADDR_TYPE_NONE ? bond_nth(key->idx) :
+        key->idx == 0 ? bond_find(&key->peer_addr) : NULL;
+    if (b == NULL) {
+        return BLE_HS_ENOENT;
+    }
+    memset(value, 0, sizeof(*value));
+    value->peer_addr = b->addr;
+    value->key_size = 16;
+    value->ltk_present = 1;
+    value->irk_present = 1;
+    value->sc = 1;
+    return 0;
+}
+
+int ble_store_util_bonded_peers(ble_addr_t *out_peer_id_addrs, int *out_num_peers, int max_peers) {
+    *out_num_peers = 0;
+    bond_t *b;
+    for (int n = 0; (b = bond_nth(n)) != NULL; n++) {
+        if (n == max_peers) {
+            return BLE_HS_ENOMEM;
+        }
+        out_peer_id_addrs[(*out_num_peers)++] = b->addr;
+    }
+    return 0;
+}
+
+int ble_store_util_delete_peer(const ble_addr_t *peer_id_addr) {
+    bond_t *b = bond_find(peer_id_addr);
+    if (b != NULL) {
+        b->used = false;
+    }
+    return 0;
+}
+
+int ble_store_util_status_rr(struct ble_store_status_event *event, void *arg) {
+    bond_t *oldest = bond_nth(0);
+    if (oldest == NULL) {
+        return BLE_HS_ESTORE_CAP;
+    }
+    oldest->used = false;
+    return 0;
+}
+
+// --- GATT server ---
+
+void ble_svc_gap_init(void) {
+}
+
+void ble_svc_gatt_init(void) {
+}
+
+const char *ble_svc_gap_device_name(void) {
+    return device_name;
+}
+
+int ble_svc_gap_device_name_set(const char *name) {
+    if (strlen(name) >= sizeof(device_name)) {
+        return BLE_HS_EINVAL;
+    }
+    strcpy(device_name, name);
+    return 0;
+}
+
+int ble_uuid_cmp(const ble_uuid_t *a, const ble_uuid_t *b) {
+    if (a->type != b->type) {
+        return a->type - b->type;
+    }
+    if (a->type == BLE_UUID_TYPE_16) {
+        return ((const ble_uuid16_t *)a)->value - ((const ble_uuid16_t *)b)->value;
+    }
+    return memcmp(((const ble_uuid128_t *)a)->value, ((const ble_uuid128_t *)b)->value, 16);
+}
+
+int ble_gatts_count_cfg(const struct ble_gatt_svc_def *defs) {
+    return 0;
+}
+
+int ble_gatts_add_svcs(const struct ble_gatt_svc_def *svcs) {
+    for (const struct ble_gatt_svc_def *s = svcs; s->type != BLE_GATT_SVC_TYPE_END; s++) {
+        next_handle++; // service declaration
+        for (const struct ble_gatt_chr_def *d = s->characteristics; d != NULL && d->uuid != NULL; d++) {
+            if (chr_count == SIM_BLE_CHRS_MAX) {
+                return BLE_HS_ENOMEM;
+            }
+            gatt_chr_t *g = &chrs[chr_count++];
+            g->svc_uuid = s->uuid;
+            g->chr = d;
+            g->def_handle = next_handle++;
+            g->val_handle = next_handle++;
+            g->cccd = (d->flags & (BLE_GATT_CHR_F_NOTIFY | BLE_GATT_CHR_F_INDICATE)) != 0;
+            if (g->cccd) {
+                next_handle++;
+            }
+            if (d->val_handle != NULL) {
+                *d->val_handle = g->val_handle;
+            }
+        }
+    }
+    return 0;
+}
+
+int ble_gatts_find_chr(const ble_uuid_t *svc_uuid, const ble_uuid_t *chr_uuid, uint16_t *out_def_handle,
+    uint16_t *out_val_handle) {
+    for (int i = 0; i < chr_count; i++) {
+        if (ble_uuid_cmp(chrs[i].svc_uuid, svc_uuid) == 0 && ble_uuid_cmp(chrs[i].chr->uuid, chr_uuid) == 0) {
+            if (out_def_handle != NULL) {
+                *out_def_handle = chrs[i].def_handle;
+            }
+            if (out_val_handle != NULL) {
+                *out_val_handle = chrs[i].val_handle;
+            }
+            return 0;
+        }
+    }
+    return BLE_HS_ENOENT;
+}
+
+uint16_t sim_ble_find_chr(const ble_uuid_t *uuid) {
+    for (int i = 0; i < chr_count; i++) {
+        if (ble_uuid_cmp(chrs[i].chr->uuid, uuid) == 0) {
+            return chrs[i].val_handle;
+        }
+    }
+    return 0;
+}
+
+// --- L2CAP connection-oriented channels ---
+
+int ble_l2cap_create_server(uint16_t psm, uint16_t mtu, ble_l2cap_event_fn *cb, void *cb_arg) {
+    if (server_count == CHANS_MAX) {
+        return BLE_HS_ENOMEM;
+    }
+    servers[server_count++] = (coc_server_t){ .psm = psm, .mtu = mtu, .cb = cb, .cb_arg = cb_arg };
+    return 0;
+}
+
+// Queues K-frames while the peer has credits; ESTALLED while part of the SDU waits for more
+static int coc_continue_tx(struct ble_l2cap_chan *ch) {
+    conn_t *c = conn_by_id(ch->conn_id);
+    while (ch->tx_sdu != NULL && ch->credits > 0 && c != NULL) {
+        uint16_t sdu_len = ch->tx_copy->len;
+        uint16_t hdr = ch->tx_off == 0 ? COC_SDU_LEN_LEN : 0;
+        uint16_t seg = sdu_len - ch->tx_off;
+        if (seg > ch->peer_mps - hdr) {
+            seg = ch->peer_mps - hdr;
+        }
+        pdu_t *p = calloc(1, sizeof(*p));
+        p->kind = PDU_KFRAME;
+        p->len = L2CAP_HDR_LEN + hdr + seg;
+        p->sdu = ch->tx_copy;
+        p->sdu->refs++;
+        ch->tx_off += seg;
+        p->sdu_last = ch->tx_off == sdu_len;
+        ch->credits--;
+        txq_push(c, p);
+        if (p->sdu_last) {
+            os_mbuf_free_chain(ch->tx_sdu);
+            ch->tx_sdu = NULL;
+            if (--ch->tx_copy->refs == 0) {
+                free(ch->tx_copy);
+            }
+            ch->tx_copy = NULL;
+        }
+    }
+    host_tx_pump();
+    if (ch->tx_sdu != NULL) {
+        if (!ch->stalled) {
+            stats.stalls++;
+        }
+        ch->stalled = true;
+        return BLE_HS_ESTALLED;
+    }
+    if (ch->stalled) {
+        ch->stalled = false;
+        struct ble_l2cap_event event = { .type = BLE_L2CAP_EVENT_COC_TX_UNSTALLED };
+        event.tx_unstalled.conn_handle = ch->conn_handle;
+        event.tx_unstalled.chan = ch;
+        ch->cb(&event, ch->cb_arg);
+    }
+    return 0;
+}
+
+int ble_l2cap_send(struct ble_l2cap_chan *chan, struct os_mbuf *sdu_tx) {
+    if (!chan->used) {
+        return BLE_HS_ENOTCONN;
+    }
+    uint16_t len = OS_MBUF_PKTLEN(sdu_tx);
+    if (len > chan->peer_mtu) {
+        return BLE_HS_EBADDATA;
+    }
+    if (chan->tx_sdu != NULL) {
+        return BLE_HS_EBUSY;
+    }
+    sdu_tx_t *copy = malloc(sizeof(*copy) + len);
+    copy->refs = 1;
+    copy->len = len;
+    uint16_t first = chan->peer_mps - COC_SDU_LEN_LEN;
+    copy->frames = 1 + (len > first ? (len - first + chan->peer_mps - 1) / chan->peer_mps : 0);
+    os_mbuf_copydata(sdu_tx, 0, len, copy->data);
+    chan->tx_sdu = sdu_tx;
+    chan->tx_copy = copy;
+    chan->tx_off = 0;
+    stats.sdus++;
+    return coc_continue_tx(chan);
+}
+
+int ble_l2cap_recv_ready(struct ble_l2cap_chan *chan, struct os_mbuf *sdu_rx) {
+    if (chan->rx_buf != NULL) {
+        os_mbuf_free_chain(chan->rx_buf);
+    }
+    chan->rx_buf = sdu_rx;
+    return 0;
+}
+
+int ble_l2cap_get_chan_info(struct ble_l2cap_chan *chan, struct ble_l2cap_chan_info *chan_info) {
+    memset(chan_info, 0, sizeof(*chan_info));
+    chan_info->psm = chan->psm;
+    chan_info->our_coc_mtu = chan->our_mtu;
+    chan_info->peer_coc_mtu = chan->peer_mtu;
+    chan_info->our_l2cap_mtu = chan->our_mtu;
+    chan_info->peer_l2cap_mtu = chan->peer_mps;
+    return 0;
+}
+
+static void chan_free(struct ble_l2cap_chan *ch) {
+    os_mbuf_free_chain(ch->tx_sdu);
+    if (ch->tx_copy != NULL && --ch->tx_copy->refs == 0) {
+        free(ch->tx_copy);
+    }
+    os_mbuf_free_chain(ch->rx_buf);
+    struct ble_l2cap_event event = { .type = BLE_L2CAP_EVENT_COC_DISCONNECTED };
+    event.disconnect.conn_handle = ch->conn_handle;
+    event.disconnect.chan = ch;
+    ble_l2cap_event_fn *cb = ch->cb;
+    void *arg = ch->cb_arg;
+    memset(ch, 0, sizeof(*ch));
+    cb(&event, arg);
+}
+
+int ble_l2cap_disconnect(struct ble_l2cap_chan *chan) {
+    if (!chan->used) {
+        return BLE_HS_ENOTCONN;
+    }
+    chan_free(chan);
+    return 0;
+}
+
+// --- jobs ---
+
+// Link gone: as ble_gap_conn_broken(), subscriptions end first, then the connection and
+// whatever it still queued are freed, then the application hears of the disconnect
+static void conn_broken(conn_t *c, int reason) {
+    struct ble_gap_event event;
+    if (c->upd_events > 0) {
+        c->upd_events = 0;
+        event = (struct ble_gap_event){ .type = BLE_GAP_EVENT_CONN_UPDATE };
+        event.conn_update.status = reason;
+        event.conn_update.conn_handle = c->handle;
+        gap_event(c, &event);
+    }
+    for (int i = 0; i < chr_count; i++) {
+        if (c->cccd & (1u << i)) {
+            c->cccd &= ~(1u << i);
+            event = (struct ble_gap_event){ .type = BLE_GAP_EVENT_SUBSCRIBE };
+            event.subscribe.conn_handle = c->handle;
+            event.subscribe.attr_handle = chrs[i].val_handle;
+            event.subscribe.reason = BLE_GAP_SUBSCRIBE_REASON_TERM;
+            event.subscribe.prev_notify = 1;
+            gap_event(c, &event);
+        }
+    }
+    event = (struct ble_gap_event){ .type = BLE_GAP_EVENT_DISCONNECT };
+    event.disconnect.reason = reason;
+    ble_gap_conn_find(c->handle, &event.disconnect.conn);
+
+    sim_link_close(c->handle, link_dropped);
+    while (c->txq_head != NULL) {
+        pdu_t *p = txq_pop(c);
+        if (p->kind == PDU_NOTIFY) {
+            stats.notify_dropped++;
+        }
+        os_mbuf_free_chain(p->om);
+        pdu_release(p);
+    }
+    for (int i = 0; i < CHANS_MAX; i++) {
+        if (chans[i].used && chans[i].conn_id == c->id) {
+            chan_free(&chans[i]);
+        }
+    }
+    sim_ble_peer_t *peer = c->peer;
+    ble_gap_event_fn *cb = c->cb;
+    void *cb_arg = c->cb_arg;
+    c->used = false;
+    peer->conn_handle = BLE_HS_CONN_HANDLE_NONE;
+    peer->sec_requested = false;
+    stats.disconnects++;
+    cb(&event, cb_arg);
+    if (peer->cbs->disconnected != NULL) {
+        peer->cbs->disconnected(peer->arg, reason);
+    }
+}
+
+static void enc_change(conn_t *c, int status) {
+    struct ble_gap_event event = { .type = BLE_GAP_EVENT_ENC_CHANGE };
+    event.enc_change.status = status;
+    event.enc_change.conn_handle = c->handle;
+    gap_event(c, &event);
+}
+
+static void subscribe_event(conn_t *c, int chr, uint8_t reason, bool prev, bool cur) {
+    struct ble_gap_event event = { .type = BLE_GAP_EVENT_SUBSCRIBE };
+    event.subscribe.conn_handle = c->handle;
+    event.subscribe.attr_handle = chrs[chr].val_handle;
+    event.subscribe.reason = reason;
+    event.subscribe.prev_notify = prev;
+    event.subscribe.cur_notify = cur;
+    gap_event(c, &event);
+}
+
+static void encrypt(conn_t *c) {
+    sim_ble_peer_t *p = c->peer;
+    if (c->sec.encrypted) {
+        return;
+    }
+    bond_t *b = bond_find(&p->addr);
+    if (p->keys) {
+        if (b == NULL) {
+            // we lost the bond: the LTK request gets a negative reply and the central drops its keys
+            p->keys = false;
+            enc_change(c, BLE_HS_ERR_HCI_BASE + 0x06); // PIN or Key Missing
+            if (p->cbs->encrypted != NULL) {
+                p->cbs->encrypted(p->arg, BLE_HS_ERR_HCI_BASE + 0x06, false, false);
+            }
+            return;
+        }
+        c->sec = (struct ble_gap_sec_state){ .encrypted = 1, .bonded = 1, .key_size = 16 };
+        enc_change(c, 0);
+        // ble_gatts_bonding_restored(): the stored CCCDs come back after ENC_CHANGE
+        stats.restores++;
+        for (int i = 0; i < chr_count; i++) {
+            if ((b->cccd & (1u << i)) && !(c->cccd & (1u << i))) {
+                c->cccd |= 1u << i;
+                subscribe_event(c, i, BLE_GAP_SUBSCRIBE_REASON_RESTORE, false, true);
+            }
+        }
+        if (p->cbs->encrypted != NULL) {
+            p->cbs->encrypted(p->arg, 0, true, true);
+        }
+        return;
+    }
+    if (b != NULL) {
+        // the central lost its keys but we kept ours
+        struct ble_gap_event event = { .type = BLE_GAP_EVENT_REPEAT_PAIRING };
+        event.repeat_pairing.conn_handle = c->handle;
+        if (gap_event(c, &event) != BLE_GAP_REPEAT_PAIRING_RETRY) {
+            enc_change(c, BLE_HS_EAUTHEN);
+            return;
+        }
+        ble_store_util_delete_peer(&p->addr);
+    }
+    bool bonded = p->bond && ble_hs_cfg.sm_bonding && store_ready && bond_save(&p->addr, c->cccd);
+    c->sec = (struct ble_gap_sec_state){ .encrypted = 1, .bonded = bonded, .key_size = 16 };
+    p->keys = bonded;
+    enc_change(c, 0);
+    if (p->cbs->encrypted != NULL) {
+        p->cbs->encrypted(p->arg, 0, bonded, false);
+    }
+}
+
+static void respond(conn_t *c, uint16_t attr_handle, int status, const uint8_t *data, uint16_t len) {
+    if (c->peer->cbs->response != NULL) {
+        c->peer->cbs->response(c->peer->arg, attr_handle, status, data, len);
+    }
+}
+
+static void subscribe(conn_t *c, uint16_t val_handle, bool on) {
+    int i = chr_by_val(val_handle);
+    if (i < 0 || !chrs[i].cccd) {
+        respond(c, val_handle, BLE_HS_ERR_ATT_BASE + BLE_ATT_ERR_INVALID_HANDLE, NULL, 0);
+        return;
+    }
+    bool prev = (c->cccd & (1u << i)) != 0;
+    c->cccd = on ? c->cccd | (1u << i) : c->cccd & ~(1u << i);
+    if (c->sec.bonded) {
+        bond_t *b = bond_find(&c->peer->addr);
+        if (b != NULL) {
+            b->cccd = c->cccd; // ble_store_write_cccd()
+        }
+    }
+    if (prev != on) {
+        subscribe_event(c, i, BLE_GAP_SUBSCRIBE_REASON_WRITE, prev, on);
+    }
+    respond(c, val_handle, 0, NULL, 0);
+}
+
+static void chr_access(conn_t *c, uint16_t attr_handle, bool write, const uint8_t *data, uint16_t len) {
+    int i = chr_by_val(attr_handle);
+    if (i < 0) {
+        respond(c, attr_handle, BLE_HS_ERR_ATT_BASE + BLE_ATT_ERR_INVALID_HANDLE, NULL, 0);
+        return;
+    }
+    const struct ble_gatt_chr_def *d = chrs[i].chr;
+    uint16_t needed = write ? BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP : BLE_GATT_CHR_F_READ;
+    if (!(d->flags & needed)) {
+        respond(c, attr_handle, BLE_HS_ERR_ATT_BASE +
+            (write ? BLE_ATT_ERR_WRITE_NOT_PERMITTED : BLE_ATT_ERR_READ_NOT_PERMITTED), NULL, 0);
+        return;
+    }
+    struct ble_gatt_access_ctxt ctxt = { .op = write ? BLE_GATT_ACCESS_OP_WRITE_CHR : BLE_GATT_ACCESS_OP_READ_CHR };
+    ctxt.chr = d;
+    ctxt.om = write ? ble_hs_mbuf_from_flat(data, len) : os_msys_get_pkthdr(0, 0);
+    if (ctxt.om == NULL) {
+        respond(c, attr_handle, BLE_HS_ERR_ATT_BASE + BLE_ATT_ERR_INSUFFICIENT_RES, NULL, 0);
+        return;
+    }
+    int rc = d->access_cb(c->handle, attr_handle, &ctxt, d->arg);
+    uint8_t value[512];
+    uint16_t value_len = 0;
+    if (rc == 0 && !write) {
+        ble_hs_mbuf_to_flat(ctxt.om, value, sizeof(value), &value_len); // a long read takes it all
+    }
+    os_mbuf_free_chain(ctxt.om);
+    respond(c, attr_handle, rc != 0 ? BLE_HS_ERR_ATT_BASE + rc : 0, value, value_len);
+}
+
+static void coc_connect(conn_t *c, uint16_t psm, uint16_t mtu, uint16_t mps, uint16_t credits) {
+    sim_ble_peer_t *p = c->peer;
+    coc_server_t *srv = NULL;
+    for (int i = 0; i < server_count; i++) {
+        if (servers[i].psm == psm) {
+            srv = &servers[i];
+        }
+    }
+    struct ble_l2cap_chan *ch = NULL;
+    for (int i = 0; i < CHANS_MAX && ch == NULL; i++) {
+        if (!chans[i].used) {
+            ch = &chans[i];
+        }
+    }
+    if (srv == NULL || ch == NULL) {
+        if (p->cbs->coc_connected != NULL) {
+            p->cbs->coc_connected(p->arg, srv == NULL ? BLE_HS_ENOTSUP : BLE_HS_ENOMEM);
+        }
+        return;
+    }
+    *ch = (struct ble_l2cap_chan){
+        .used = true,
+        .conn_id = c->id,
+        .conn_handle = c->handle,
+        .psm = psm,
+        .our_mtu = srv->mtu,
+        .peer_mtu = mtu,
+        .peer_mps = mps,
+        .credits = credits,
+        .cb = srv->cb,
+        .cb_arg = srv->cb_arg,
+    };
+    struct ble_l2cap_event event = { .type = BLE_L2CAP_EVENT_COC_ACCEPT };
+    event.accept.conn_handle = c->handle;
+    event.accept.peer_sdu_size = mtu;
+    event.accept.chan = ch;
+    int rc = srv->cb(&event, srv->cb_arg);
+    if (rc != 0) {
+        os_mbuf_free_chain(ch->rx_buf);
+        memset(ch, 0, sizeof(*ch));
+        if (p->cbs->coc_connected != NULL) {
+            p->cbs->coc_connected(p->arg, rc);
+        }
+        return;
+    }
+    event = (struct ble_l2cap_event){ .type = BLE_L2CAP_EVENT_COC_CONNECTED };
+    event.connect.conn_handle = c->handle;
+    event.connect.chan = ch;
+    srv->cb(&event, srv->cb_arg);
+    if (p->cbs->coc_connected != NULL) {
+        p->cbs->coc_connected(p->arg, 0);
+    }
+}
+
+static struct ble_l2cap_chan *chan_of(const conn_t *c) {
+    for (int i = 0; i < CHANS_MAX; i++) {
+        if (chans[i].used && chans[i].conn_id == c->id) {
+            return &chans[i];
+        }
+    }
+    return NULL;
+}
+
+static void coc_received(conn_t *c, const uint8_t *data, uint16_t len) {
+    struct ble_l2cap_chan *ch = chan_of(c);
+    if (ch == NULL || ch->rx_buf == NULL) {
+        return; // without a receive buffer the central had no credits for it
+    }
+    struct os_mbuf *sdu = ch->rx_buf;
+    ch->rx_buf = NULL;
+    os_mbuf_append(sdu, data, len);
+    struct ble_l2cap_event event = { .type = BLE_L2CAP_EVENT_COC_DATA_RECEIVED };
+    event.receive.conn_handle = c->handle;
+    event.receive.chan = ch;
+    event.receive.sdu_rx = sdu;
+    ch->cb(&event, ch->cb_arg);
+}
+
+static void job_run(job_t *j) {
+    if (j->type == JOB_SYNC) {
+        if (ble_hs_cfg.sync_cb != NULL) {
+            ble_hs_cfg.sync_cb();
+        }
+        return;
+    }
+    if (j->type == JOB_NOCP) {
+        nocp_posted = false;
+        host_tx_pump();
+        return;
+    }
+    if (j->type == JOB_ADV_TIMEOUT) {
+        struct ble_gap_event event = { .type = BLE_GAP_EVENT_ADV_COMPLETE };
+        event.adv_complete.reason = BLE_HS_ETIMEOUT;
+        if (adv.cb != NULL) {
+            adv.cb(&event, adv.cb_arg);
+        }
+        return;
+    }
+    conn_t *c = conn_by_id(j->conn_id);
+    if (c == NULL) {
+        return; // the connection went away since
+    }
+    struct ble_gap_event event;
+    switch (j->type) {
+        case JOB_CONNECT:
+            event = (struct ble_gap_event){ .type = BLE_GAP_EVENT_CONNECT };
+            event.connect.conn_handle = c->handle;
+            gap_event(c, &event);
+            break;
+        case JOB_DISCONNECT:
+            conn_broken(c, j->a);
+            break;
+        case JOB_MTU:
+            c->mtu = c->peer->mtu < preferred_mtu ? c->peer->mtu : preferred_mtu;
+            event = (struct ble_gap_event){ .type = BLE_GAP_EVENT_MTU };
+            event.mtu.conn_handle = c->handle;
+            event.mtu.channel_id = 4; // ATT
+            event.mtu.value = c->mtu;
+            gap_event(c, &event);
+            respond(c, 0, 0, NULL, 0);
+            break;
+        case JOB_ENCRYPT:
+            encrypt(c);
+            break;
+        case JOB_SUBSCRIBE:
+            subscribe(c, (uint16_t)j->a, j->b != 0);
+            break;
+        case JOB_WRITE:
+            chr_access(c, (uint16_t)j->a, true, j->data, j->len);
+            break;
+        case JOB_READ:
+            chr_access(c, (uint16_t)j->a, false, NULL, 0);
+            break;
+        case JOB_UPDATE_DONE:
+            if (j->a == 0) {
+                c->latency = (uint16_t)j->c;
+                c->timeout = (uint16_t)j->d;
+            }
+            event = (struct ble_gap_event){ .type = BLE_GAP_EVENT_CONN_UPDATE };
+            event.conn_update.status = j->a;
+            event.conn_update.conn_handle = c->handle;
+            gap_event(c, &event);
+            break;
+        case JOB_DLE_DONE:
+            c->ll_octets = (uint16_t)j->a;
+            sim_link_set_ll_octets(c->handle, c->ll_octets);
+            event = (struct ble_gap_event){ .type = BLE_GAP_EVENT_DATA_LEN_CHG };
+            event.data_len_chg.conn_handle = c->handle;
+            event.data_len_chg.max_tx_octets = c->ll_octets;
+            event.data_len_chg.max_tx_time = (c->ll_octets + 14) * 8;
+            event.data_len_chg.max_rx_octets = c->ll_octets;
+            event.data_len_chg.max_rx_time = (c->ll_octets + 14) * 8;
+            gap_event(c, &event);
+            break;
+        case JOB_COC_CONNECT:
+            coc_connect(c, (uint16_t)j->a, (uint16_t)j->b, (uint16_t)j->c, (uint16_t)j->d);
+            break;
+        case JOB_COC_CREDITS: {
+            struct ble_l2cap_chan *ch = chan_of(c);
+            if (ch != NULL) {
+                ch->credits += (uint16_t)j->a;
+                if (ch->tx_sdu != NULL) {
+                    coc_continue_tx(ch);
+                }
+            }
+            break;
+        }
+        case JOB_COC_SDU:
+            coc_received(c, j->data, j->len);
+            break;
+        default:
+            break;
+    }
+}
+
+// --- central side ---
+
+void sim_ble_peer_init(sim_ble_peer_t *p) {
+    p->conn_handle = BLE_HS_CONN_HANDLE_NONE;
+    p->scanning = false;
+    p->keys = false;
+    p->sec_requested = false;
+    if (peer_count < PEERS_MAX) {
+        peers[peer_count++] = p;
+    }
+}
+
+void sim_ble_scan(sim_ble_peer_t *p, bool on) {
+    p->scanning = on;
+}
+
+static void peer_post(sim_ble_peer_t *p, job_type_t type, int a, int b, const void *data, uint16_t len) {
+    conn_t *c = peer_conn(p);
+    if (c == NULL || c->terminating) {
+        return;
+    }
+    job_t *j = job_new(type, c, data, len);
+    j->a = a;
+    j->b = b;
+    job_post(j);
+}
+
+void sim_ble_terminate(sim_ble_peer_t *p, uint8_t hci_reason) {
+    conn_t *c = peer_conn(p);
+    if (c == NULL || c->terminating) {
+        return;
+    }
+    peer_post(p, JOB_DISCONNECT, BLE_HS_ERR_HCI_BASE + hci_reason, 0, NULL, 0);
+    c->terminating = true;
+}
+
+void sim_ble_forget(sim_ble_peer_t *p) {
+    p->keys = false;
+}
+
+void sim_ble_mtu_exchange(sim_ble_peer_t *p) {
+    peer_post(p, JOB_MTU, 0, 0, NULL, 0);
+}
+
+void sim_ble_encrypt(sim_ble_peer_t *p) {
+    peer_post(p, JOB_ENCRYPT, 0, 0, NULL, 0);
+}
+
+void sim_ble_subscribe(sim_ble_peer_t *p, uint16_t val_handle, bool on) {
+    peer_post(p, JOB_SUBSCRIBE, val_handle, on, NULL, 0);
+}
+
+void sim_ble_write(sim_ble_peer_t *p, uint16_t attr_handle, const void *data, uint16_t len) {
+    peer_post(p, JOB_WRITE, attr_handle, 0, data, len);
+}
+
+void sim_ble_read(sim_ble_peer_t *p, uint16_t attr_handle) {
+    peer_post(p, JOB_READ, attr_handle, 0, NULL, 0);
+}
+
+void sim_ble_coc_connect(sim_ble_peer_t *p, uint16_t psm, uint16_t mtu, uint16_t mps, uint16_t credits) {
+    conn_t *c = peer_conn(p);
+    if (c == NULL || c->terminating) {
+        return;
+    }
+    job_t *j = job_new(JOB_COC_CONNECT, c, NULL, 0);
+    j->a = psm;
+    j->b = mtu;
+    j->c = mps;
+    j->d = credits;
+    job_post(j);
+}
+
+void sim_ble_coc_credits(sim_ble_peer_t *p, uint16_t credits) {
+    peer_post(p, JOB_COC_CREDITS, credits, 0, NULL, 0);
+}
+
+void sim_ble_coc_send(sim_ble_peer_t *p, const void *data, uint16_t len) {
+    peer_post(p, JOB_COC_SDU, 0, 0, data, len);
+}
+
+uint16_t sim_ble_conn_itvl(const sim_ble_peer_t *p) {
+    conn_t *c = peer_conn(p);
+    return c != NULL ? c->itvl : 0;
+}
+
+const sim_ble_stats_t *sim_ble_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "host/ble_hs.h"
+#include "sim_link.h"
+#include "sim_rand.h"
+
+/*
+NimBLE host of the simulation: the host API the firmware calls (shim/host,
+shim/services, shim/nimble), on top of the controller in sim_link.c, and the
+air side the centrals of sim_central.c act through.
+
+What the firmware sees behaves as on the device:
+
+    host task     nimble_port_run() runs GAP, GATT and L2CAP events in the
+                  task nimble_port_freertos_init() created, at the priority
+                  of the ESP-IDF host task; sync_cb comes once the controller
+                  is up
+    notify        ble_gattc_notify_custom() queues the PDU on its connection
+                  and hands ACL fragments to the controller while it has
+                  buffers, in the caller's task; the mbuf is freed once its
+                  last fragment was handed over and NOTIFY_TX fires before
+                  the call returns. With a host queue limit a notify to a
+                  connection that has that many PDUs queued fails with
+                  BLE_HS_ENOMEM, as when msys runs out on the device. Buffers come back as the peer acks
+                  packets (Number Of Completed Packets), and the host task
+                  moves the next fragments.
+    advertising   legacy advertising events on the interval, high duty
+                  directed advertising for at most 1.28 s, the accept list;
+                  a connect stops advertising without ADV_COMPLETE
+    security      a central with keys encrypts and its CCCDs are restored
+                  (ENC_CHANGE, then SUBSCRIBE with reason RESTORE); one
+                  without pairs and bonds if both sides want to. Bonds live
+                  in RAM for one run, at most SIM_BLE_BONDS_MAX of them.
+    procedures    MTU exchange, data length update and connection parameter
+                  updates complete a few connection events after the request
+    L2CAP CoC     credit based channels on a server PSM: K-frames of the
+                  peer's MPS, ESTALLED and TX_UNSTALLED, credits returned by
+                  the central as it consumes SDUs
+
+A central (sim_ble_peer_t) scans and connects with its own parameters and
+acts from its event callback, once per connection event, through the
+sim_ble_* calls below. Those run in the main loop, outside of any task, and
+post their work to the host task like the controller would.
+*/
+
+#define SIM_BLE_BONDS_MAX 3     // CONFIG_BT_NIMBLE_MAX_BONDS
+#define SIM_BLE_CHRS_MAX 32
+#define SIM_BLE_SYNC_US 20000   // controller reset and host startup before sync_cb
+
+typedef struct {
+    // the connection is up; the central starts its procedures from the next event
+    void (*connected)(void *arg, uint16_t conn_handle);
+    void (*disconnected)(void *arg, int reason);
+    // a connection event: the central may act
+    void (*event)(void *arg);
+    // a notification arrived over the air
+    void (*notified)(void *arg, uint16_t attr_handle, const uint8_t *data, uint16_t len);
+    // answer to sim_ble_read/sim_ble_write/sim_ble_subscribe/sim_ble_mtu_exchange (attr 0)
+    void (*response)(void *arg, uint16_t attr_handle, int status, const uint8_t *data, uint16_t len);
+    // encryption is on, with a new bond if bonded and not restored
+    void (*encrypted)(void *arg, int status, bool bonded, bool restored);
+    void (*coc_connected)(void *arg, int status);
+    // an SDU arrived over the channel in `frames` K-frames
+    void (*sdu)(void *arg, const uint8_t *data, uint16_t len, uint16_t frames);
+} sim_ble_peer_cbs_t;
+
+// A central as the peripheral sees it over the air
+typedef struct {
+    ble_addr_t addr;        // identity address, no resolvable private address
+    uint16_t mtu;           // ATT MTU it offers
+    uint16_t ll_octets;     // longest LL packet it takes
+    uint16_t itvl;          // connection interval it connects with, 1.25 ms units
+    uint16_t itvl_floor;    // shortest interval it grants on an update request
+    uint8_t scan_pct;       // chance to pick up one advertising event while scanning
+    bool bond;              // bonds when pairing
+    const sim_ble_peer_cbs_t *cbs;
+    void *arg;
+
+    // owned by sim_ble.c
+    bool scanning;
+    bool keys;              // holds keys from an earlier bond with the device
+    bool sec_requested;     // the peripheral sent a Security Request on this connection
+    uint16_t conn_handle;   // BLE_HS_CONN_HANDLE_NONE while not connected
+} sim_ble_peer_t;
+
+typedef struct {
+    uint32_t connects;
+    uint32_t disconnects;
+    uint32_t adv_events;
+    uint32_t notifies;        // ble_gattc_notify_custom() calls
+    uint32_t notify_errors;   // calls that failed
+    uint32_t notify_dropped;  // queued notifications lost with their connection
+    uint32_t notify_truncated;// values longer than MTU - 3
+    uint32_t pdus_queued_max; // longest host queue of a connection, in PDUs
+    uint32_t sdus;
+    uint32_t stalls;
+    uint32_t bonds;
+    uint32_t restores;
+} sim_ble_stats_t;
+
+void sim_ble_init(const sim_link_cfg_t *link, sim_rand_t *rand);
+
+// PDUs a connection's host queue holds before notifies fail with BLE_HS_ENOMEM, 0 = no limit
+void sim_ble_set_host_queue(uint32_t pdus);
+
+// Advertising events and connection events due by now, called from the main loop
+void sim_ble_step(uint64_t now_us);
+
+// --- central side ---
+
+void sim_ble_peer_init(sim_ble_peer_t *p);
+void sim_ble_scan(sim_ble_peer_t *p, bool on);
+// The central disconnects (BLE_ERR_REM_USER_CONN_TERM) or the link is lost (BLE_ERR_CONN_SPVN_TMO)
+void sim_ble_terminate(sim_ble_peer_t *p, uint8_t hci_reason);
+// The central drops its keys, e.g. the user removed the device
+void sim_ble_forget(sim_ble_peer_t *p);
+void sim_ble_mtu_exchange(sim_ble_peer_t *p);
+// Encrypts with the central's keys, or pairs without
+void sim_ble_encrypt(sim_ble_peer_t *p);
+void sim_ble_subscribe(sim_ble_peer_t *p, uint16_t val_handle, bool on);
+void sim_ble_write(sim_ble_peer_t *p, uint16_t attr_handle, const void *data, uint16_t len);
+void sim_ble_read(sim_ble_peer_t *p, uint16_t attr_handle);
+void sim_ble_coc_connect(sim_ble_peer_t *p, uint16_t psm, uint16_t mtu, uint16_t mps, uint16_t credits);
+void sim_ble_coc_credits(sim_ble_peer_t *p, uint16_t credits);
+void sim_ble_coc_send(sim_ble_peer_t *p, const void *data, uint16_t len);
+
+// Value handle of a characteristic, as discovery would find it; 0 if there is none
+uint16_t sim_ble_find_chr(const ble_uuid_t *uuid);
+// The peer's view of the connection interval, 1.25 ms units
+uint16_t sim_ble_conn_itvl(const sim_ble_peer_t *p);
+bool sim_ble_advertising(void);
+
+const sim_ble_stats_t *sim_ble_stats(void);
@@ -0,0 +1,451 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host/ble_hs.h"
+#include "batch.h"
+#include "sample_codec.h"
+#include "ctrl_proto.h"
+#include "hrm.h"
+#include "l2cap_bulk.h"
+#include "sim_clock.h"
+#include "sim_central.h"
+
+#define CHANNEL_HR 0                // BATCH_CHANNEL_*
+#define CHANNEL_CONDUCTIVITY 1
+#define COND_PERIOD_MS 100          // 1000 / ADC_ACQ_OUTPUT_HZ
+#define COC_MPS 247                 // K-frame payload that fills one 251-byte LL packet
+#define COC_CREDITS 10
+#define SECURITY_WAIT_US 1000000    // a central without keys waits this long for a Security Request
+
+enum {
+    STEP_MTU,
+    STEP_SECURITY,
+    STEP_DISCOVER,
+    STEP_SUBSCRIBE,
+    STEP_COMMAND,
+    STEP_COC,
+    STEP_BENCH,
+    STEP_READY,
+};
+
+// What the app knows of the device's GATT database
+static const ble_uuid16_t hr_uuid = BLE_UUID16_INIT(0x2A37);
+static const ble_uuid16_t cmd_uuid = BLE_UUID16_INIT(0x2A00);
+static const ble_uuid128_t cond_uuid = BLE_UUID128_INIT(0xaa, 0x5b, 0x97, 0x50, 0xc9, 0x82, 0x4c, 0xe6,
+    0x90, 0xc7, 0x54, 0xc0, 0xc8, 0xc6, 0xae, 0x84);
+static const ble_uuid128_t button_uuid = BLE_UUID128_INIT(0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff, 0x00, 0x11,
+    0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99);
+static const ble_uuid128_t log_uuid = BLE_UUID128_INIT(0xaa, 0x5b, 0x97, 0x50, 0xc9, 0x82, 0x4c, 0xe6,
+    0x90, 0xc7, 0x54, 0xc0, 0x01, 0x10, 0xae, 0x84);
+static const ble_uuid128_t diag_uuid = BLE_UUID128_INIT(0xaa, 0x5b, 0x97, 0x50, 0xc9, 0x82, 0x4c, 0xe6,
+    0x90, 0xc7, 0x54, 0xc0, 0x01, 0x20, 0xae, 0x84);
+
+static inline uint16_t get_le16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get_le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void span_add(sim_central_span_t *s, uint32_t ms) {
+    s->count++;
+    s->sum_ms += ms;
+    if (ms > s->max_ms) {
+        s->max_ms = ms;
+    }
+}
+
+// --- receiving ---
+
+static void cond_seen(sim_central_t *c, uint32_t ts_ms) {
+    if (!c->seen_phase_valid) {
+        c->seen_phase_valid = true;
+        c->seen_phase = ts_ms % COND_PERIOD_MS;
+    }
+    // blocks are stamped on arrival, so timestamps jitter around the sample period
+    uint32_t i = (ts_ms - c->seen_phase + COND_PERIOD_MS / 2) / COND_PERIOD_MS;
+    if (i >= c->seen_len) {
+        return;
+    }
+    if (c->seen[i / 8] & (1u << (i % 8))) {
+        c->cond_dups++;
+        return;
+    }
+    c->seen[i / 8] |= 1u << (i % 8);
+    if (c->cond_samples++ == 0 || i < c->seen_first) {
+        c->seen_first = i;
+    }
+    if (i > c->seen_last) {
+        c->seen_last = i;
+    }
+}
+
+static void on_sample(sim_central_t *c, const sample_t *s, bool live) {
+    if (s->channel != CHANNEL_CONDUCTIVITY) {
+        c->log_samples += !live;
+        return;
+    }
+    if (live) {
+        uint32_t ms = sim_now_ms() - s->ts_ms;
+        hist_add(&c->cond_latency, ms * 1000);
+        if (ms > c->cond_latency_max_ms) {
+            c->cond_latency_max_ms = ms;
+        }
+    } else {
+        c->log_samples++;
+    }
+    cond_seen(c, s->ts_ms);
+}
+
+// A batch frame (batch.h): header, then raw or delta-coded samples. Returns false if malformed.
+static bool decode_frame(sim_central_t *c, const uint8_t *d, uint16_t len, bool live) {
+    if (len < BATCH_HDR_LEN) {
+        return false;
+    }
+    uint16_t seq = get_le16(d);
+    uint8_t count = d[2];
+    uint8_t channel = d[3] & ~BATCH_FLAG_DELTA;
+    uint32_t base = get_le32(d + 4);
+    if (live) {
+        if (c->cond_seq_valid && seq != (uint16_t)(c->cond_seq + 1)) {
+            c->seq_gaps += (uint16_t)(seq - c->cond_seq - 1);
+        }
+        c->cond_seq_valid = true;
+        c->cond_seq = seq;
+    }
+    if (d[3] & BATCH_FLAG_DELTA) {
+        codec_t k;
+        codec_init(&k, base);
+        uint16_t off = BATCH_HDR_LEN;
+        for (uint8_t i = 0; i < count; i++) {
+            sample_t s;
+            uint16_t n = codec_get(&k, &s, false, channel, d + off, len - off);
+            if (n == 0) {
+                return false;
+            }
+            off += n;
+            on_sample(c, &s, live);
+        }
+        return off == len;
+    }
+    if (len != batch_frame_len(count)) {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        const uint8_t *p = d + BATCH_HDR_LEN + i * BATCH_SAMPLE_LEN;
+        sample_t s = { .ts_ms = base + get_le16(p), .value = get_le16(p + 2), .channel = channel };
+        on_sample(c, &s, live);
+    }
+    return true;
+}
+
+static void bench_frame(sim_central_t *c, uint16_t len) {
+    uint64_t now = sim_now_us();
+    if (c->bench_frames++ == 0) {
+        c->bench_first_us = now;
+    }
+    c->bench_last_us = now;
+    c->bench_bytes += len;
+}
+
+static void cb_notified(void *arg, uint16_t attr, const uint8_t *data, uint16_t len) {
+    sim_central_t *c = arg;
+    if (!c->got_notify) {
+        c->got_notify = true;
+        span_add(&c->first_notify[c->restored], (uint32_t)((sim_now_us() - c->connected_us) / 1000));
+    }
+    if (attr == c->h_hr) {
+        c->hr_frames++;
+        if (len >= HRM_MIN_LEN) {
+            c->hr_bpm = data[0] & HRM_FLAG_HR_UINT16 && len >= 3 ? get_le16(data + 1) : data[1];
+        }
+    } else if (attr == c->h_cond) {
+        c->cond_frames++;
+        c->bad_frames += !decode_frame(c, data, len, true);
+    } else if (attr == c->h_log) {
+        if (c->bench_active) {
+            bench_frame(c, len);
+            return;
+        }
+        c->log_frames++;
+        c->bad_frames += !decode_frame(c, data, len, false);
+    }
+}
+
+static void cb_sdu(void *arg, const uint8_t *data, uint16_t len, uint16_t frames) {
+    sim_central_t *c = arg;
+    c->sdus++;
+    if (c->bench_active) {
+        bench_frame(c, len);
+    } else {
+        c->log_frames++;
+        c->bad_frames += !decode_frame(c, data, len, false);
+    }
+    // the app consumed the SDU: the K-frames it took come back as credits
+    sim_ble_coc_credits(&c->peer, frames);
+}
+
+// --- script ---
+
+static void cb_connected(void *arg, uint16_t conn_handle) {
+    sim_central_t *c = arg;
+    uint64_t now = sim_now_us();
+    if (c->connects++ > 0) {
+        span_add(&c->reconnect_gap, (uint32_t)((now - c->disconnected_us) / 1000));
+    }
+    c->connected_us = now;
+    c->step = STEP_MTU;
+    c->waiting = false;
+    c->subscribed = 0;
+    c->restored = false;
+    c->got_notify = false;
+    c->bench_active = false;
+    c->cond_seq_valid = false; // frames queued at the disconnect are gone, not a gap
+}
+
+static void cb_disconnected(void *arg, int reason) {
+    sim_central_t *c = arg;
+    c->disconnected_us = sim_now_us();
+    c->rescan_at_us = c->disconnected_us + (uint64_t)c->cfg.offline_ms * 1000;
+}
+
+static void cb_response(void *arg, uint16_t attr, int status, const uint8_t *data, uint16_t len) {
+    sim_central_t *c = arg;
+    c->waiting = false;
+    if (attr != 0 && attr == c->h_diag && status == 0) {
+        c->diag_len = len < sizeof(c->diag) ? len : sizeof(c->diag);
+        memcpy(c->diag, data, c->diag_len);
+        return;
+    }
+    switch (c->step) {
+        case STEP_MTU:
+            c->step = STEP_SECURITY;
+            break;
+        case STEP_SUBSCRIBE:
+            // next CCCD on the next event
+            break;
+        default:
+            c->step++;
+            break;
+    }
+}
+
+static void cb_encrypted(void *arg, int status, bool bonded, bool restored) {
+    sim_central_t *c = arg;
+    c->waiting = false;
+    if (status != 0) {
+        return; // keys dropped, pairs on the next event
+    }
+    c->restored = restored;
+    // a restored bond has its subscriptions, and the app its attribute cache
+    c->step = restored ? STEP_COMMAND : STEP_DISCOVER;
+    c->step_at_us = sim_now_us() + (restored ? 0 : (uint64_t)c->cfg.discovery_ms * 1000);
+}
+
+static void cb_coc_connected(void *arg, int status) {
+    sim_central_t *c = arg;
+    c->waiting = false;
+    c->step = STEP_BENCH;
+}
+
+static uint16_t sub_handle(const sim_central_t *c, uint8_t bit) {
+    switch (bit) {
+        case SIM_CENTRAL_SUB_HR: return c->h_hr;
+        case SIM_CENTRAL_SUB_COND: return c->h_cond;
+        case SIM_CENTRAL_SUB_LOG: return c->h_log;
+        case SIM_CENTRAL_SUB_BUTTON: return c->h_button;
+        default: return 0;
+    }
+}
+
+static void command(sim_central_t *c) {
+    uint8_t buf[8];
+    uint8_t n = 0;
+    buf[n++] = CTRL_OP_START;
+    buf[n++] = 0; // every channel
+    if (c->cfg.codec != SIM_CENTRAL_NO_CODEC) {
+        buf[n++] = CTRL_OP_SET_CODEC;
+        buf[n++] = 2;
+        buf[n++] = CTRL_ALL_CHANNELS;
+        buf[n++] = c->cfg.codec;
+    }
+    sim_ble_write(&c->peer, c->h_cmd, buf, n);
+}
+
+static void bench(sim_central_t *c) {
+    uint8_t buf[5] = { CTRL_OP_BENCH, 3, c->cfg.bench_transport, c->cfg.bench_s & 0xff, c->cfg.bench_s >> 8 };
+    c->bench_active = true;
+    sim_ble_write(&c->peer, c->h_cmd, buf, sizeof(buf));
+}
+
+static void cb_event(void *arg) {
+    sim_central_t *c = arg;
+    uint64_t now = sim_now_us();
+    if (c->waiting) {
+        return;
+    }
+    switch (c->step) {
+        case STEP_MTU:
+            c->waiting = true;
+            sim_ble_mtu_exchange(&c->peer);
+            break;
+        case STEP_SECURITY:
+            if (c->peer.keys || c->peer.sec_requested) {
+                c->waiting = true;
+                sim_ble_encrypt(&c->peer);
+            } else if (now - c->connected_us >= SECURITY_WAIT_US) {
+                c->step = STEP_DISCOVER;
+                c->step_at_us = now + (uint64_t)c->cfg.discovery_ms * 1000;
+            }
+            break;
+        case STEP_DISCOVER:
+            if (now >= c->step_at_us) {
+                c->step = STEP_SUBSCRIBE;
+            }
+            break;
+        case STEP_SUBSCRIBE: {
+            uint8_t todo = c->cfg.subscribe & ~c->subscribed;
+            if (todo == 0) {
+                c->step = STEP_COMMAND;
+                break;
+            }
+            uint8_t bit = todo & -todo;
+            c->subscribed |= bit;
+            c->waiting = true;
+            sim_ble_subscribe(&c->peer, sub_handle(c, bit), true);
+            break;
+        }
+        case STEP_COMMAND:
+            if (!c->cfg.start || c->started) {
+                c->step = STEP_COC;
+                break;
+            }
+            c->started = true;
+            c->waiting = true;
+            command(c);
+            break;
+        case STEP_COC:
+            if (!c->cfg.coc) {
+                c->step = STEP_BENCH;
+                break;
+            }
+            c->waiting = true;
+            sim_ble_coc_connect(&c->peer, L2CAP_BULK_PSM, L2CAP_BULK_MTU, COC_MPS, COC_CREDITS);
+            break;
+        case STEP_BENCH:
+            if (c->cfg.bench_s == 0 || c->bench_sent) {
+                c->step = STEP_READY;
+                break;
+            }
+            c->bench_sent = true;
+            c->waiting = true;
+            bench(c);
+            break;
+        default:
+            if (c->bench_active && c->bench_frames > 0 &&
+                now - c->bench_last_us > (uint64_t)c->cfg.bench_s * 1000000) {
+                c->bench_active = false; // the run is long over, what comes now is backfill
+            }
+            break;
+    }
+}
+
+static const sim_ble_peer_cbs_t central_cbs = {
+    .connected = cb_connected,
+    .disconnected = cb_disconnected,
+    .event = cb_event,
+    .notified = cb_notified,
+    .response = cb_response,
+    .encrypted = cb_encrypted,
+    .coc_connected = cb_coc_connected,
+    .sdu = cb_sdu,
+};
+
+void sim_central_init(sim_central_t *c, const sim_central_cfg_t *cfg, uint32_t run_ms) {
+    memset(c, 0, sizeof(*c));
+    c->cfg = *cfg;
+    c->peer.addr = (ble_addr_t){ .type = BLE_ADDR_PUBLIC, .val = { cfg->addr, 0x11, 0x22, 0x33, 0x44, 0xc0 } };
+    c->peer.mtu = cfg->mtu;
+    c->peer.ll_octets = cfg->ll_octets;
+    c->peer.itvl = cfg->itvl;
+    c->peer.itvl_floor = cfg->itvl_floor;
+    c->peer.scan_pct = cfg->scan_pct;
+    c->peer.bond = cfg->bond;
+    c->peer.cbs = &central_cbs;
+    c->peer.arg = c;
+    sim_ble_peer_init(&c->peer);
+    c->rescan_at_us = (uint64_t)cfg->connect_at_ms * 1000;
+    c->seen_len = run_ms / COND_PERIOD_MS + 2;
+    c->seen = calloc((c->seen_len + 7) / 8, 1);
+}
+
+void sim_central_step(sim_central_t *c, uint64_t now_us) {
+    if (c->h_cmd == 0) {
+        // the attribute cache of an app that has seen the device before
+        c->h_hr = sim_ble_find_chr(&hr_uuid.u);
+        c->h_cond = sim_ble_find_chr(&cond_uuid.u);
+        c->h_button = sim_ble_find_chr(&button_uuid.u);
+        c->h_log = sim_ble_find_chr(&log_uuid.u);
+        c->h_diag = sim_ble_find_chr(&diag_uuid.u);
+        c->h_cmd = sim_ble_find_chr(&cmd_uuid.u);
+    }
+    bool connected = c->peer.conn_handle != BLE_HS_CONN_HANDLE_NONE;
+    if (!connected) {
+        if (!c->peer.scanning && now_us >= c->rescan_at_us) {
+            sim_ble_scan(&c->peer, true);
+        }
+        return;
+    }
+    if (c->cfg.online_ms > 0 && now_us - c->connected_us >= (uint64_t)c->cfg.online_ms * 1000) {
+        sim_ble_terminate(&c->peer, c->cfg.link_loss ? BLE_ERR_CONN_SPVN_TMO : BLE_ERR_REM_USER_CONN_TERM);
+    }
+}
+
+void sim_central_read_diag(sim_central_t *c) {
+    c->diag_len = 0;
+    sim_ble_read(&c->peer, c->h_diag);
+}
+
+uint32_t sim_central_cond_missing(const sim_central_t *c, uint32_t tail_ms) {
+    if (c->cond_samples == 0) {
+        return 0;
+    }
+    uint32_t tail = tail_ms / COND_PERIOD_MS;
+    uint32_t last = c->seen_last > c->seen_first + tail ? c->seen_last - tail : c->seen_first;
+    uint32_t missing = 0;
+    for (uint32_t i = c->seen_first; i <= last; i++) {
+        missing += !(c->seen[i / 8] & (1u << (i % 8)));
+    }
+    return missing;
+}
+
+static void print_span(const char *name, const sim_central_span_t *s) {
+    if (s->count == 0) {
+        return;
+    }
+    printf("    %-22s n %-5lu mean %6lu ms  max %6lu ms\n", name, (unsigned long)s->count,
+        (unsigned long)(s->sum_ms / s->count), (unsigned long)s->max_ms);
+}
+
+void sim_central_report(const sim_central_t *c) {
+    printf("  %s: %lu connects, %lu heart rate frames (%u bpm), %lu conductivity frames, %lu log frames, %lu SDUs, %lu malformed\n",
+        c->cfg.name, (unsigned long)c->connects, (unsigned long)c->hr_frames, c->hr_bpm,
+        (unsigned long)c->cond_frames, (unsigned long)c->log_frames, (unsigned long)c->sdus,
+        (unsigned long)c->bad_frames);
+    printf("    conductivity: %lu samples, %lu duplicates, %lu missing, %lu frames skipped, %lu backfilled samples\n",
+        (unsigned long)c->cond_samples, (unsigned long)c->cond_dups,
+        (unsigned long)sim_central_cond_missing(c, 5000), (unsigned long)c->seq_gaps,
+        (unsigned long)c->log_samples);
+    const latency_hist_t *h = &c->cond_latency;
+    printf("    %-22s n %-9lu p50 <%7lu us  p99 <%7lu us  max %lu us\n", "live latency", (unsigned long)h->count,
+        (unsigned long)hist_percentile(h, 50), (unsigned long)hist_percentile(h, 99), (unsigned long)h->max_us);
+    print_span("reconnect gap", &c->reconnect_gap);
+    print_span("first notify", &c->first_notify[0]);
+    print_span("first notify, restored", &c->first_notify[1]);
+    if (c->bench_frames > 1) {
+        double s = (c->bench_last_us - c->bench_first_us) / 1e6;
+        printf("    bench: %lu frames, %llu bytes received in %.2f s, %.1f kbit/s\n", (unsigned long)c->bench_frames,
+            (unsigned long long)c->bench_bytes, s, c->bench_bytes * 8 / s / 1000);
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "latency_hist.h"
+#include "sim_ble.h"
+
+/*
+Scripted centrals: what a phone app does with the device, over sim_ble.h.
+
+After connecting, a central takes one step per connection event, each
+waiting for the answer to the previous one:
+
+    MTU         exchange its ATT MTU
+    security    encrypt with its keys, or pair if the device asked to;
+                after a key-missing failure it pairs again
+    discovery   services and characteristics take discovery_ms, skipped
+                when the bond restored the subscriptions
+    subscribe   write the CCCDs of the characteristics in its mask
+    command     START (all channels) with SET_CODEC, on its first connection
+    bulk        open the L2CAP channel, if configured
+    bench       send BENCH once, if configured
+
+Everything received is measured at the receiver, on the virtual clock:
+conductivity latency from the sample timestamp to its arrival, the time
+from connecting to the first notification, the gap from a disconnect to
+the next connection, and benchmark throughput from the frames that arrived.
+Conductivity samples are tracked one by one, so samples the device never
+delivered, live or backfilled, and duplicates show up.
+
+A central with online_ms leaves after that long connected (link loss or a
+user disconnect) and scans again after offline_ms.
+*/
+
+#define SIM_CENTRAL_SUB_HR (1u << 0)
+#define SIM_CENTRAL_SUB_COND (1u << 1)
+#define SIM_CENTRAL_SUB_LOG (1u << 2)
+#define SIM_CENTRAL_SUB_BUTTON (1u << 3)
+#define SIM_CENTRAL_NO_CODEC 0xff
+
+typedef struct {
+    const char *name;
+    uint8_t addr;           // last byte of its public address
+    uint16_t mtu;
+    uint16_t ll_octets;
+    uint16_t itvl;          // 1.25 ms units
+    uint16_t itvl_floor;
+    uint8_t scan_pct;
+    bool bond;
+    uint8_t subscribe;      // SIM_CENTRAL_SUB_* bits
+    bool start;             // sends START on its first connection
+    uint8_t codec;          // SET_CODEC for every channel with START, or SIM_CENTRAL_NO_CODEC
+    bool coc;               // opens the bulk channel
+    uint8_t bench_transport;
+    uint16_t bench_s;       // 0 = no benchmark
+    uint32_t connect_at_ms; // starts scanning
+    uint32_t discovery_ms;
+    uint32_t online_ms;     // 0 = stays connected
+    uint32_t offline_ms;
+    bool link_loss;         // leaves by supervision timeout rather than a user disconnect
+} sim_central_cfg_t;
+
+typedef struct {
+    uint32_t count;
+    uint64_t sum_ms;
+    uint32_t max_ms;
+} sim_central_span_t;
+
+typedef struct {
+    sim_central_cfg_t cfg;
+    sim_ble_peer_t peer;
+
+    // script of the current connection
+    uint8_t step;
+    bool waiting;
+    uint8_t subscribed;     // CCCDs written on this connection
+    bool restored;
+    bool started;
+    bool bench_sent;
+    bool got_notify;
+    uint64_t connected_us;
+    uint64_t disconnected_us;
+    uint64_t step_at_us;
+    uint64_t rescan_at_us;
+    uint16_t h_hr, h_cond, h_log, h_button, h_cmd, h_diag;
+
+    // receiver side
+    uint32_t connects;
+    uint32_t hr_frames;
+    uint16_t hr_bpm;
+    uint32_t cond_frames;
+    uint32_t log_frames;
+    uint32_t log_samples;
+    uint32_t sdus;
+    uint32_t bad_frames;
+    uint32_t seq_gaps;      // conductivity frames missed, from the frame sequence numbers
+    bool cond_seq_valid;
+    uint16_t cond_seq;
+    latency_hist_t cond_latency;
+    uint32_t cond_latency_max_ms;
+    sim_central_span_t first_notify[2]; // written CCCDs / restored
+    sim_central_span_t reconnect_gap;
+    uint64_t bench_bytes;
+    uint32_t bench_frames;
+    uint64_t bench_first_us;
+    uint64_t bench_last_us;
+    bool bench_active;
+
+    // conductivity samples seen, by index at the 100 ms sample period
+    uint8_t *seen;
+    uint32_t seen_len;
+    bool seen_phase_valid;
+    uint32_t seen_phase;
+    uint32_t seen_first, seen_last;
+    uint32_t cond_samples;
+    uint32_t cond_dups;
+
+    uint8_t diag[512];
+    uint16_t diag_len;
+} sim_central_t;
+
+// Registers the central with sim_ble.c; run_ms bounds the samples it tracks
+void sim_central_init(sim_central_t *c, const sim_central_cfg_t *cfg, uint32_t run_ms);
+
+// Scanning and leaving on its schedule, called from the main loop
+void sim_central_step(sim_central_t *c, uint64_t now_us);
+
+// Reads the diagnostics characteristic, the answer lands in diag
+void sim_central_read_diag(sim_central_t *c);
+
+// Conductivity samples missing between the first and the last delivered one,
+// leaving out the last tail_ms (still on their way at the end of a run)
+uint32_t sim_central_cond_missing(const sim_central_t *c, uint32_t tail_ms);
+
+void sim_central_report(const sim_central_t *c);
@@ -0,0 +1,25 @@
+#include "sdkconfig.h"
+#include "sim_clock.h"
+
+static uint64_t now_us;
+
+void sim_clock_reset(void) {
+    now_us = 0;
+}
+
+void sim_clock_advance(uint64_t us) {
+    now_us += us;
+}
+
+uint64_t sim_now_us(void) {
+    return now_us;
+}
+
+uint32_t sim_now_ms(void) {
+    // the tick-based millisecond clock the firmware stamps samples with
+    return (uint32_t)(now_us / SIM_TICK_US * (SIM_TICK_US / 1000));
+}
+
+uint32_t sim_now_ticks(void) {
+    return (uint32_t)(now_us / SIM_TICK_US);
+}
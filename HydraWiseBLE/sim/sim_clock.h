@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+Virtual clock of the simulation. Nothing in the simulation reads a real
+clock: time only moves when the main loop advances it, so a run is
+deterministic for a given configuration and seed, and hours of device time
+take seconds.
+*/
+
+#define SIM_TICK_US (1000000 / CONFIG_FREERTOS_HZ) // FreeRTOS tick, as on the device
+
+void sim_clock_reset(void);
+void sim_clock_advance(uint64_t us);
+
+uint64_t sim_now_us(void);
+uint32_t sim_now_ms(void);      // the sample timestamp clock
+uint32_t sim_now_ticks(void);   // scheduler ticks
@@ -0,0 +1,189 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_random.h"
+#include "esp_nimble_hci.h"
+#include "nvs_flash.h"
+#include "sdkconfig.h"
+#include "sim_clock.h"
+#include "sim_esp.h"
+#include "sim_rand.h"
+
+static esp_log_level_t log_level = ESP_LOG_WARN;
+static sim_rand_t rng;
+
+void sim_esp_init(uint32_t seed, esp_log_level_t level) {
+    log_level = level;
+    sim_rand_seed(&rng, seed ^ 0x5eed);
+}
+
+// --- logging and errors ---
+
+void sim_log(esp_log_level_t level, const char *tag, const char *fmt, ...) {
+    static const char letters[] = "NEWIDV";
+    if (level > log_level) {
+        return;
+    }
+    printf("%c (%lu) %s: ", letters[level], (unsigned long)sim_now_ms(), tag);
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    putchar('\n');
+}
+
+const char *esp_err_to_name(esp_err_t err) {
+    switch (err) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        default: return "ERROR";
+    }
+}
+
+// --- system ---
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    return ESP_OK;
+}
+
+esp_err_t esp_nimble_hci_and_controller_init(void) {
+    return ESP_OK;
+}
+
+uint32_t esp_random(void) {
+    return sim_rand(&rng);
+}
+
+uint32_t esp_cpu_get_cycle_count(void) {
+    return (uint32_t)(sim_now_us() * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+}
+
+uint32_t esp_rom_get_cpu_ticks_per_us(void) {
+    return CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+}
+
+// --- power management ---
+
+struct sim_pm_lock {
+    esp_pm_lock_type_t type;
+    const char *name;
+    int count;
+    uint32_t acquires;
+};
+
+#define SIM_PM_LOCKS_MAX 16
+
+static struct sim_pm_lock pm_locks[SIM_PM_LOCKS_MAX];
+static int pm_lock_count;
+static bool light_sleep_enabled;
+static esp_pm_sleep_cbs_register_config_t sleep_cbs;
+static uint64_t idle_us;
+static uint64_t slept_us;
+static uint32_t sleeps;
+static uint32_t dumps;
+
+esp_err_t esp_pm_configure(const void *config) {
+    light_sleep_enabled = ((const esp_pm_config_t *)config)->light_sleep_enable;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int arg, const char *name, esp_pm_lock_handle_t *out) {
+    if (pm_lock_count == SIM_PM_LOCKS_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    struct sim_pm_lock *l = &pm_locks[pm_lock_count++];
+    *l = (struct sim_pm_lock){ .type = type, .name = name };
+    *out = l;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t lock) {
+    if (lock->count++ == 0) {
+        lock->acquires++;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t lock) {
+    if (lock->count == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    lock->count--;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_dump_locks(FILE *stream) {
+    dumps++;
+    for (int i = 0; i < pm_lock_count; i++) {
+        fprintf(stream, "  %-12s type %d held %d, %lu acquires\n", pm_locks[i].name, pm_locks[i].type,
+            pm_locks[i].count, (unsigned long)pm_locks[i].acquires);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_light_sleep_register_cbs(esp_pm_sleep_cbs_register_config_t *cbs) {
+    sleep_cbs = *cbs;
+    return ESP_OK;
+}
+
+int sim_pm_held(int type) {
+    int n = 0;
+    for (int i = 0; i < pm_lock_count; i++) {
+        if ((int)pm_locks[i].type == type) {
+            n += pm_locks[i].count;
+        }
+    }
+    return n;
+}
+
+static void sleep_end(void) {
+    // the idle task only enters light sleep after idling a few ticks; the rest it sleeps
+    uint64_t wait_us = (uint64_t)SIM_SLEEP_IDLE_TICKS * SIM_TICK_US;
+    if (idle_us > wait_us) {
+        uint64_t us = idle_us - wait_us;
+        slept_us += us;
+        sleeps++;
+        if (sleep_cbs.exit_cb != NULL) {
+            sleep_cbs.exit_cb((int64_t)us, sleep_cbs.exit_cb_user_arg);
+        }
+    }
+    idle_us = 0;
+}
+
+void sim_pm_step(bool busy, uint64_t step_us) {
+    bool can_sleep = light_sleep_enabled && !busy && sim_pm_held(ESP_PM_NO_LIGHT_SLEEP) == 0
+        && sim_pm_held(ESP_PM_CPU_FREQ_MAX) == 0 && sim_pm_held(ESP_PM_APB_FREQ_MAX) == 0;
+    if (can_sleep) {
+        idle_us += step_us;
+    } else {
+        sleep_end();
+    }
+}
+
+uint64_t sim_pm_slept_us(void) {
+    return slept_us;
+}
+
+uint32_t sim_pm_sleeps(void) {
+    return sleeps;
+}
+
+uint32_t sim_pm_dumps(void) {
+    return dumps;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_log.h"
+
+/*
+The ESP-IDF services the firmware calls that are not the RTOS, flash, ADC or
+BLE: logging, errors, NVS init, random numbers, cycle counters and the power
+management driver.
+*/
+
+void sim_esp_init(uint32_t seed, esp_log_level_t log_level);
+
+// Light sleep model, called once per main loop step of step_us with whether
+// any task ran in it. The idle task sleeps once the CPU has idled for
+// SIM_SLEEP_IDLE_TICKS with no lock held that forbids light sleep.
+#define SIM_SLEEP_IDLE_TICKS 3 // CONFIG_FREERTOS_IDLE_TIME_BEFORE_SLEEP
+void sim_pm_step(bool busy, uint64_t step_us);
+
+// Light sleep reported so far
+uint64_t sim_pm_slept_us(void);
+uint32_t sim_pm_sleeps(void);
+
+// Held counts of the driver's locks, by esp_pm_lock_type_t
+int sim_pm_held(int type);
+
+// Times esp_pm_dump_locks() ran
+uint32_t sim_pm_dumps(void);
@@ -0,0 +1,99 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_partition.h"
+#include "sim_flash.h"
+
+static esp_partition_t log_part = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = 0x40,
+    .address = 0x110000,
+    .size = SIM_FLASH_LOG_SIZE,
+    .erase_size = 4096,
+    .label = "samplelog",
+};
+
+static enum { FAULT_NONE, FAULT_FAIL, FAULT_CUT } fault;
+static uint32_t fault_keep;
+static uint32_t writes;
+static uint32_t erases;
+
+void sim_flash_init(void) {
+    if (log_part.image == NULL) {
+        log_part.image = malloc(log_part.size);
+        memset(log_part.image, 0xff, log_part.size);
+    }
+}
+
+void sim_flash_fail_next_write(void) {
+    fault = FAULT_FAIL;
+}
+
+void sim_flash_cut_next_write(uint32_t keep) {
+    fault = FAULT_CUT;
+    fault_keep = keep;
+}
+
+uint32_t sim_flash_writes(void) {
+    return writes;
+}
+
+uint32_t sim_flash_erases(void) {
+    return erases;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+    const char *label) {
+    if (type != log_part.type || subtype != log_part.subtype) {
+        return NULL;
+    }
+    if (label != NULL && strcmp(label, log_part.label) != 0) {
+        return NULL;
+    }
+    sim_flash_init();
+    return &log_part;
+}
+
+static bool in_range(const esp_partition_t *p, size_t offset, size_t size) {
+    return offset <= p->size && size <= p->size - offset;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *p, size_t offset, void *dst, size_t size) {
+    if (!in_range(p, offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, p->image + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *p, size_t offset, const void *src, size_t size) {
+    if (!in_range(p, offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    writes++;
+    size_t n = size;
+    esp_err_t err = ESP_OK;
+    if (fault == FAULT_FAIL) {
+        n = 0;
+        err = ESP_FAIL;
+    } else if (fault == FAULT_CUT) {
+        n = fault_keep < size ? fault_keep : size;
+        err = ESP_FAIL;
+    }
+    fault = FAULT_NONE;
+    // NOR flash: programming only clears bits
+    const uint8_t *s = src;
+    for (size_t i = 0; i < n; i++) {
+        p->image[offset + i] &= s[i];
+    }
+    return err;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *p, size_t offset, size_t size) {
+    if (!in_range(p, offset, size) || offset % p->erase_size != 0 || size % p->erase_size != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    erases++;
+    memset(p->image + offset, 0xff, size);
+    return ESP_OK;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+The "samplelog" data partition of partitions.csv on a RAM image that outlives
+a simulated reboot. Faults are armed for the next write: it fails outright,
+or power is cut after `keep` bytes are programmed.
+*/
+
+#define SIM_FLASH_LOG_SIZE 0xF0000
+
+void sim_flash_init(void);
+void sim_flash_fail_next_write(void);
+void sim_flash_cut_next_write(uint32_t keep);
+
+uint32_t sim_flash_writes(void);
+uint32_t sim_flash_erases(void);
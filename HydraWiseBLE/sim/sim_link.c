@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include "sim_link.h"
+
+typedef struct {
+    void *ctx;
+    uint16_t bytes_left;
+} acl_pkt_t;
+
+typedef struct {
+    bool open;
+    uint16_t conn_handle;
+    uint32_t itvl_us;
+    uint16_t ll_octets;
+    uint64_t next_event_us;
+    acl_pkt_t queue[SIM_LINK_QUEUE_MAX];
+    uint8_t head;
+    uint8_t count;
+} link_conn_t;
+
+static sim_link_cfg_t cfg;
+static sim_link_cbs_t cbs;
+static sim_rand_t *rnd;
+static link_conn_t conns[SIM_LINK_CONN_MAX];
+static uint8_t acl_used;
+static sim_link_stats_t stats;
+
+void sim_link_init(const sim_link_cfg_t *c, const sim_link_cbs_t *callbacks, sim_rand_t *rand) {
+    cfg = *c;
+    cbs = *callbacks;
+    rnd = rand;
+}
+
+static link_conn_t *find(uint16_t conn_handle) {
+    for (int i = 0; i < SIM_LINK_CONN_MAX; i++) {
+        if (conns[i].open && conns[i].conn_handle == conn_handle) {
+            return &conns[i];
+        }
+    }
+    return NULL;
+}
+
+void sim_link_open(uint16_t conn_handle, uint32_t itvl_us, uint16_t ll_octets, uint64_t now_us) {
+    for (int i = 0; i < SIM_LINK_CONN_MAX; i++) {
+        link_conn_t *l = &conns[i];
+        if (!l->open) {
+            *l = (link_conn_t){
+                .open = true,
+                .conn_handle = conn_handle,
+                .itvl_us = itvl_us,
+                .ll_octets = ll_octets,
+                .next_event_us = now_us + itvl_us,
+            };
+            return;
+        }
+    }
+}
+
+uint8_t sim_link_close(uint16_t conn_handle, void (*drop)(void *ctx)) {
+    link_conn_t *l = find(conn_handle);
+    if (l == NULL) {
+        return 0;
+    }
+    uint8_t dropped = l->count;
+    acl_used -= dropped;
+    l->open = false;
+    for (uint8_t i = 0; i < dropped; i++) {
+        drop(l->queue[(l->head + i) % SIM_LINK_QUEUE_MAX].ctx);
+    }
+    return dropped;
+}
+
+void sim_link_set_itvl(uint16_t conn_handle, uint32_t itvl_us) {
+    link_conn_t *l = find(conn_handle);
+    if (l != NULL) {
+        l->itvl_us = itvl_us; // from the next event on: the instant has passed
+    }
+}
+
+void sim_link_set_ll_octets(uint16_t conn_handle, uint16_t ll_octets) {
+    link_conn_t *l = find(conn_handle);
+    if (l != NULL) {
+        l->ll_octets = ll_octets;
+    }
+}
+
+uint8_t sim_link_acl_free(void) {
+    return cfg.acl_bufs - acl_used;
+}
+
+void sim_link_acl_tx(uint16_t conn_handle, uint16_t len, void *ctx) {
+    link_conn_t *l = find(conn_handle);
+    if (l == NULL || acl_used == cfg.acl_bufs || l->count == SIM_LINK_QUEUE_MAX) {
+        abort(); // the host checks for a buffer first
+    }
+    acl_used++;
+    l->queue[(l->head + l->count++) % SIM_LINK_QUEUE_MAX] = (acl_pkt_t){ .ctx = ctx, .bytes_left = len };
+    stats.acl_packets++;
+    stats.acl_bytes += len;
+}
+
+static void run_event(link_conn_t *l) {
+    stats.events++;
+    bool lost = cfg.loss_pct > 0 && sim_rand_below(rnd, 100) < cfg.loss_pct;
+    if (lost) {
+        stats.events_lost++;
+    } else {
+        for (uint8_t n = 0; n < cfg.pkts_per_event && l->count > 0; n++) {
+            acl_pkt_t *p = &l->queue[l->head];
+            uint16_t sent = p->bytes_left < l->ll_octets ? p->bytes_left : l->ll_octets;
+            p->bytes_left -= sent;
+            stats.ll_packets++;
+            if (p->bytes_left == 0) {
+                void *ctx = p->ctx;
+                l->head = (l->head + 1) % SIM_LINK_QUEUE_MAX;
+                l->count--;
+                acl_used--;
+                cbs.acked(l->conn_handle, ctx);
+                if (!l->open) {
+                    return; // the ack closed the connection
+                }
+            }
+        }
+    }
+    cbs.event(l->conn_handle, lost);
+}
+
+void sim_link_run(uint64_t now_us) {
+    for (int i = 0; i < SIM_LINK_CONN_MAX; i++) {
+        link_conn_t *l = &conns[i];
+        while (l->open && l->next_event_us <= now_us) {
+            l->next_event_us += l->itvl_us;
+            run_event(l);
+        }
+    }
+}
+
+const sim_link_stats_t *sim_link_stats(void) {
+    return &stats;
+}
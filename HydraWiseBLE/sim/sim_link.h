@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sim_rand.h"
+
+/*
+Link layer of the controller: connection events and the LE ACL buffers the
+host hands data to.
+
+The host fragments each L2CAP PDU into HCI ACL packets of at most
+SIM_LINK_ACL_SIZE bytes, and each packet occupies one of the controller's
+acl_bufs buffers until the peer acknowledged it over the air, when the
+controller reports it in Number Of Completed Packets and the host may send
+the next one. Buffers are shared by all connections, as on the ESP32.
+
+Every connection interval a connection has one event moving up to
+pkts_per_event LL packets of its LL data length; an ACL packet takes
+ceil(bytes / ll_octets) of them. With loss_pct an event carries nothing at
+all, the way a missed event or a run of CRC errors looks to the sender.
+*/
+
+#define SIM_LINK_ACL_SIZE 251   // LE ACL data packet length the controller reports
+#define SIM_LINK_CONN_MAX 8
+#define SIM_LINK_QUEUE_MAX 64   // ACL packets queued per connection, >= acl_bufs
+
+typedef struct {
+    uint8_t acl_bufs;       // controller ACL buffers
+    uint8_t pkts_per_event; // LL packets the controller fits into one event
+    uint8_t loss_pct;       // events that carry nothing
+} sim_link_cfg_t;
+
+typedef struct {
+    // An event took place on conn (also a lost one: the central still runs its procedures)
+    void (*event)(uint16_t conn_handle, bool lost);
+    // The peer acknowledged an ACL packet and its buffer is free again
+    void (*acked)(uint16_t conn_handle, void *ctx);
+} sim_link_cbs_t;
+
+typedef struct {
+    uint32_t events;
+    uint32_t events_lost;
+    uint32_t ll_packets;
+    uint32_t acl_packets;
+    uint64_t acl_bytes;
+} sim_link_stats_t;
+
+void sim_link_init(const sim_link_cfg_t *cfg, const sim_link_cbs_t *cbs, sim_rand_t *rand);
+
+// Connection up at now_us with its interval and LL data length; the first event is one interval later
+void sim_link_open(uint16_t conn_handle, uint32_t itvl_us, uint16_t ll_octets, uint64_t now_us);
+
+// Connection gone: queued packets are dropped and their buffers freed without an ack,
+// each handed to drop(). Returns the number of packets dropped.
+uint8_t sim_link_close(uint16_t conn_handle, void (*drop)(void *ctx));
+
+void sim_link_set_itvl(uint16_t conn_handle, uint32_t itvl_us);
+void sim_link_set_ll_octets(uint16_t conn_handle, uint16_t ll_octets);
+
+// Free controller buffers
+uint8_t sim_link_acl_free(void);
+
+// Hands one ACL packet of len bytes to the controller; ctx comes back in acked().
+// The caller checked sim_link_acl_free().
+void sim_link_acl_tx(uint16_t conn_handle, uint16_t len, void *ctx);
+
+// Runs every connection event due by now_us
+void sim_link_run(uint64_t now_us);
+
+const sim_link_stats_t *sim_link_stats(void);
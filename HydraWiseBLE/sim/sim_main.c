@@ -0,0 +1,424 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "latency_hist.h"
+#include "diag.h"
+#include "sim_clock.h"
+#include "sim_rand.h"
+#include "sim_rtos.h"
+#include "sim_esp.h"
+#include "sim_adc.h"
+#include "sim_flash.h"
+#include "sim_ble.h"
+#include "sim_central.h"
+
+/*
+Host simulation of the firmware.
+
+Boots the firmware itself, app_main() and every module of main/, on host
+shims of FreeRTOS, esp_timer, the ADC, flash, power management and the
+NimBLE host (shim/ and the sim_*.c next to them), against a virtual clock,
+so hours of device time take seconds and changes to batching, codecs, flow
+control, backfill, advertising or bonding can be measured without hardware.
+The world around it:
+
+    acquisition  the continuous ADC driver converting both inputs at 10 kHz,
+                 a random-walk electrode and a pulse waveform, sim_adc.c
+    controller   connection events, shared ACL buffers, lost events,
+                 sim_link.c
+    host         GAP, GATT, ATT, SM, the bond store and L2CAP CoC as the
+                 firmware sees them from NimBLE, sim_ble.c
+    centrals     phone apps that connect, subscribe, start streaming, come
+                 and go, and measure what they receive, sim_central.c
+
+Everything is measured where it is observable: latency and completeness at
+the receiving central, throughput by the frames that arrived, and the
+firmware's own view by reading its diagnostics characteristic at the end.
+The --check-* options turn the run into a test that exits nonzero.
+*/
+
+#define SIM_STEP_US 1000
+#define SIM_CENTRALS_MAX 3      // CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#define SIM_TAIL_MS 5000        // samples still on their way when the run ends
+
+typedef struct {
+    double hours;
+    uint32_t itvl_ms;
+    uint32_t itvl_floor_ms;
+    uint16_t mtu;
+    uint16_t ll_octets;
+    uint8_t pkts_per_event;
+    uint8_t acl_bufs;
+    uint32_t host_queue;
+    uint8_t loss_pct;
+    uint8_t codec;
+    double bpm;
+    uint32_t online_s;   // 0 = never disconnects
+    uint32_t offline_s;
+    bool link_loss;
+    uint8_t peers;
+    bool bond;
+    bool bulk;
+    bool idle;
+    uint8_t bench_transport;
+    uint16_t bench_s;
+    uint8_t scan_pct;
+    uint32_t discovery_ms;
+    uint32_t seed;
+    bool verbose;
+    // checks, 0 = off
+    uint32_t check_latency_ms;
+    bool check_complete;
+    int32_t check_dups;  // -1 = off
+    uint32_t check_restored;
+    uint32_t check_bonded_reconnects;
+    uint32_t check_bench_kbps;
+    uint32_t check_sleep_pct;
+} sim_cfg_t;
+
+static sim_cfg_t cfg = {
+    .hours = 1,
+    .itvl_ms = 30,
+    .itvl_floor_ms = 15,
+    .mtu = 256,
+    .ll_octets = 251,
+    .pkts_per_event = 4,
+    .acl_bufs = 12,
+    .codec = SIM_CENTRAL_NO_CODEC,
+    .bpm = 72,
+    .peers = 1,
+    .scan_pct = 30,
+    .discovery_ms = 600,
+    .seed = 1,
+    .check_dups = -1,
+};
+
+static sim_rand_t rnd;
+static sim_central_t centrals[SIM_CENTRALS_MAX];
+static int failures;
+static uint32_t reconnects[DIAG_RECONNECT_COUNT]; // by advertising mode, from the diagnostics
+
+extern void app_main(void);
+
+// --- report --------------------------------------------------------------
+
+static void print_hist(const char *name, const latency_hist_t *h) {
+    printf("  %-6s n %-9lu p50 <%7lu us  p99 <%7lu us  max %lu us\n", name, (unsigned long)h->count,
+        (unsigned long)hist_percentile(h, 50), (unsigned long)hist_percentile(h, 99), (unsigned long)h->max_us);
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// The firmware's own view, from the diagnostics characteristic (layout in diag.h)
+static void print_diag(const uint8_t *d, uint16_t len) {
+    static const char *stages[] = { "queue", "encode", "call", "tx", "air" };
+    static const char *fails[] = { "notify ENOMEM", "notify error", "tx failed", "window full", "pool empty" };
+    static const char *modes[] = { "directed", "accept list", "open" };
+    if (len < 8 || d[0] != DIAG_VERSION || d[1] != DIAG_STAGE_COUNT || d[2] != HIST_BUCKETS || len != DIAG_VALUE_LEN) {
+        printf("Diagnostics: %u bytes, layout %u not understood\n", len, len > 0 ? d[0] : 0);
+        return;
+    }
+    const uint8_t *p = d + 8;
+    printf("Device diagnostics (uptime %lu s):\n ", (unsigned long)get_le32(d + 4));
+    for (int i = 0; i < DIAG_FAIL_COUNT; i++, p += 4) {
+        printf(" %s %lu%s", fails[i], (unsigned long)get_le32(p), i + 1 < DIAG_FAIL_COUNT ? "," : "\n");
+    }
+    for (int i = 0; i < DIAG_STAGE_COUNT; i++) {
+        latency_hist_t h = { .count = get_le32(p), .max_us = get_le32(p + 4) };
+        p += 8;
+        for (int b = 0; b < HIST_BUCKETS; b++, p += 4) {
+            h.buckets[b] = get_le32(p);
+        }
+        print_hist(stages[i], &h);
+    }
+    for (int i = 0; i < DIAG_RECONNECT_COUNT; i++, p += 12) {
+        reconnects[i] = get_le32(p);
+        if (reconnects[i] > 0) {
+            printf("  reconnect %-11s n %-5lu mean %6lu ms  max %6lu ms\n", modes[i], (unsigned long)reconnects[i],
+                (unsigned long)(get_le32(p + 4) / reconnects[i]), (unsigned long)get_le32(p + 8));
+        }
+    }
+}
+
+static void report(double seconds) {
+    const sim_ble_stats_t *b = sim_ble_stats();
+    const sim_link_stats_t *l = sim_link_stats();
+    printf("Simulated %.2f h: interval %lu ms, MTU %u, LL %u, %u packets per event, %u ACL buffers, %u%% events lost\n",
+        seconds / 3600, (unsigned long)cfg.itvl_ms, cfg.mtu, cfg.ll_octets, cfg.pkts_per_event, cfg.acl_bufs, cfg.loss_pct);
+    printf("Link: %lu connects, %lu disconnects, %lu events (%lu lost), %lu LL packets, %lu ACL packets, %.1f B/s\n",
+        (unsigned long)b->connects, (unsigned long)b->disconnects, (unsigned long)l->events,
+        (unsigned long)l->events_lost, (unsigned long)l->ll_packets, (unsigned long)l->acl_packets,
+        l->acl_bytes / seconds);
+    printf("Host: %lu notifies (%lu failed, %lu dropped at disconnect, %lu over MTU), queue high water %lu, %lu SDUs, %lu stalls, %lu bonds, %lu restores, %lu advertising events\n",
+        (unsigned long)b->notifies, (unsigned long)b->notify_errors, (unsigned long)b->notify_dropped,
+        (unsigned long)b->notify_truncated, (unsigned long)b->pdus_queued_max, (unsigned long)b->sdus,
+        (unsigned long)b->stalls, (unsigned long)b->bonds, (unsigned long)b->restores, (unsigned long)b->adv_events);
+    printf("Power: light sleep %.1f%% of the time in %lu sleeps, %lu task switches\n",
+        sim_pm_slept_us() * 100.0 / sim_now_us(), (unsigned long)sim_pm_sleeps(), (unsigned long)sim_rtos_switches());
+    printf("Acquisition: %lu ADC frames, %lu lost; heart rate %.0f bpm; flash %lu writes, %lu erases\n",
+        (unsigned long)sim_adc_frames(), (unsigned long)sim_adc_frames_lost(), sim_adc_true_bpm(),
+        (unsigned long)sim_flash_writes(), (unsigned long)sim_flash_erases());
+    printf("Centrals:\n");
+    for (int i = 0; i < cfg.peers; i++) {
+        sim_central_report(&centrals[i]);
+    }
+    if (centrals[0].diag_len > 0) {
+        print_diag(centrals[0].diag, centrals[0].diag_len);
+    }
+}
+
+static void check(bool ok, const char *what, unsigned long got, unsigned long want) {
+    if (!ok) {
+        printf("FAIL: %s: %lu, expected %lu\n", what, got, want);
+        failures++;
+    }
+}
+
+static void run_checks(void) {
+    uint32_t restored = 0;
+    for (int i = 0; i < cfg.peers; i++) {
+        const sim_central_t *c = &centrals[i];
+        restored += c->first_notify[1].count;
+        check(c->bad_frames == 0, "malformed frames", c->bad_frames, 0);
+        if (cfg.check_latency_ms > 0) {
+            check(c->cond_latency_max_ms <= cfg.check_latency_ms, "conductivity latency ms",
+                c->cond_latency_max_ms, cfg.check_latency_ms);
+        }
+        if (cfg.check_complete && (c->cfg.subscribe & SIM_CENTRAL_SUB_COND)) {
+            check(c->cond_samples > 0, "conductivity samples", c->cond_samples, 1);
+            uint32_t missing = sim_central_cond_missing(c, SIM_TAIL_MS);
+            check(missing == 0, "conductivity samples missing", missing, 0);
+        }
+        if (cfg.check_dups >= 0) {
+            check(c->cond_dups <= (uint32_t)cfg.check_dups, "duplicate samples", c->cond_dups, cfg.check_dups);
+        }
+    }
+    if (cfg.check_restored > 0) {
+        check(restored >= cfg.check_restored, "connections with restored subscriptions", restored, cfg.check_restored);
+    }
+    if (cfg.check_bonded_reconnects > 0) {
+        uint32_t n = reconnects[DIAG_RECONNECT_DIRECTED] + reconnects[DIAG_RECONNECT_ACCEPT_LIST];
+        check(n >= cfg.check_bonded_reconnects, "reconnects in the directed and accept list tiers", n,
+            cfg.check_bonded_reconnects);
+    }
+    if (cfg.check_bench_kbps > 0) {
+        const sim_central_t *c = &centrals[0];
+        double s = (c->bench_last_us - c->bench_first_us) / 1e6;
+        uint32_t kbps = c->bench_frames > 1 ? (uint32_t)(c->bench_bytes * 8 / s / 1000) : 0;
+        check(kbps >= cfg.check_bench_kbps, "benchmark kbit/s at the receiver", kbps, cfg.check_bench_kbps);
+    }
+    if (cfg.check_sleep_pct > 0) {
+        uint32_t pct = (uint32_t)(sim_pm_slept_us() * 100 / sim_now_us());
+        check(pct >= cfg.check_sleep_pct, "light sleep %", pct, cfg.check_sleep_pct);
+    }
+}
+
+// --- main ----------------------------------------------------------------
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  --hours H          simulated time (1)\n"
+        "  --itvl-ms MS       connection interval the centrals connect with (30)\n"
+        "  --itvl-floor-ms MS shortest interval they grant (15)\n"
+        "  --mtu N            ATT MTU the centrals offer (256)\n"
+        "  --ll N             LL octets the centrals take (251)\n"
+        "  --pkts N           LL packets per connection event (4)\n"
+        "  --bufs N           controller ACL buffers (12)\n"
+        "  --host-queue N     PDUs queued per connection before a notify fails with ENOMEM, 0 = no limit (0)\n"
+        "  --loss-pct P       connection events lost (0)\n"
+        "  --codec raw|delta  SET_CODEC the first central sends with START (none)\n"
+        "  --bpm N            simulated heart rate (72)\n"
+        "  --peers N          centrals, 1-3 (1)\n"
+        "  --bond             centrals bond\n"
+        "  --bulk             the first central opens the L2CAP channel\n"
+        "  --bench gatt|l2cap:S  the first central runs a benchmark of S seconds\n"
+        "  --online-s S       the first central leaves after S s connected, 0 = never (0)\n"
+        "  --offline-s S      and comes back after S s (0)\n"
+        "  --link-loss        it leaves by supervision timeout\n"
+        "  --idle             it never sends START: no samples, nothing notified periodically\n"
+        "  --scan-pct P       advertising events a scanning central picks up (30)\n"
+        "  --discovery-ms MS  service discovery after connecting (600)\n"
+        "  --seed N           random seed (1)\n"
+        "  -v                 firmware log at INFO\n"
+        "  --check-latency-ms MS  live conductivity latency at most MS\n"
+        "  --check-complete   no conductivity sample missing at any subscriber\n"
+        "  --check-dups N     at most N duplicate samples\n"
+        "  --check-restored N at least N connections with restored subscriptions\n"
+        "  --check-bonded-reconnects N  at least N reconnects in the directed or accept list tier\n"
+        "  --check-bench-kbps N  benchmark throughput at the receiver\n"
+        "  --check-sleep-pct P   light sleep at least P%% of the time\n",
+        prog);
+    exit(2);
+}
+
+static void parse_args(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (strcmp(a, "--bond") == 0) {
+            cfg.bond = true;
+            continue;
+        } else if (strcmp(a, "--bulk") == 0) {
+            cfg.bulk = true;
+            continue;
+        } else if (strcmp(a, "--link-loss") == 0) {
+            cfg.link_loss = true;
+            continue;
+        } else if (strcmp(a, "--idle") == 0) {
+            cfg.idle = true;
+            continue;
+        } else if (strcmp(a, "--check-complete") == 0) {
+            cfg.check_complete = true;
+            continue;
+        } else if (strcmp(a, "-v") == 0) {
+            cfg.verbose = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+        const char *v = argv[++i];
+        if (strcmp(a, "--hours") == 0) {
+            cfg.hours = atof(v);
+        } else if (strcmp(a, "--itvl-ms") == 0) {
+            cfg.itvl_ms = (uint32_t)atoi(v);
+        } else if (strcmp(a, "--itvl-floor-ms") == 0) {
+            cfg.itvl_floor_ms = (uint32_t)atoi(v);
+        } else if (strcmp(a, "--mtu") == 0) {
+            cfg.mtu = (uint16_t)atoi(v);
+        } else if (strcmp(a, "--ll") == 0) {
+            cfg.ll_octets = (uint16_t)atoi(v);
+        } else if (strcmp(a, "--pkts") == 0) {
+            cfg.pkts_per_event = (uint8_t)atoi(v);
+        } else if (strcmp(a, "--bufs") == 0) {
+            cfg.acl_bufs = (uint8_t)atoi(v);
+        } else if (strcmp(a, "--host-queue") == 0) {
+            cfg.host_queue = (uint32_t)atoi(v);
+        } else if (strcmp(a, "--loss-pct") == 0) {
+            cfg.loss_pct = (uint8_t)atoi(v);
+        } else if (strcmp(a, "--codec") == 0) {
+            cfg.codec = strcmp(v, "delta") == 0 ? 1 : 0;
+        } else if (strcmp(a, "--bpm") == 0) {
+            cfg.bpm = atof(v);
+        } else if (strcmp(a, "--peers") == 0) {
+            cfg.peers = (uint8_t)atoi(v);
+        } else if (strcmp(a, "--bench") == 0) {
+            cfg.bench_transport = strncmp(v, "l2cap", 5) == 0;
+            const char *s = strchr(v, ':');
+            cfg.bench_s = s != NULL ? (uint16_t)atoi(s + 1) : 10;
+        } else if (strcmp(a, "--online-s") == 0) {
+            cfg.online_s = (uint32_t)atoi(v);
+        } else if (strcmp(a, "--offline-s") == 0) {
+            cfg.offline_s = (uint32_t)atoi(v);
+        } else if (strcmp(a, "--scan-pct") == 0) {
+            cfg.scan_pct = (uint8_t)atoi(v);
+        } else if (strcmp(a, "--discovery-ms") == 0) {
+            cfg.discovery_ms = (uint32_t)atoi(v);
+        } else if (strcmp(a, "--seed") == 0) {
+            cfg.seed = (uint32_t)strtoul(v, NULL, 0);
+        } else if (strcmp(a, "--check-latency-ms") == 0) {
+            cfg.check_latency_ms = (uint32_t)atoi(v);
+        } else if (strcmp(a, "--check-dups") == 0) {
+            cfg.check_dups = atoi(v);
+        } else if (strcmp(a, "--check-restored") == 0) {
+            cfg.check_restored = (uint32_t)atoi(v);
+        } else if (strcmp(a, "--check-bonded-reconnects") == 0) {
+            cfg.check_bonded_reconnects = (uint32_t)atoi(v);
+        } else if (strcmp(a, "--check-bench-kbps") == 0) {
+            cfg.check_bench_kbps = (uint32_t)atoi(v);
+        } else if (strcmp(a, "--check-sleep-pct") == 0) {
+            cfg.check_sleep_pct = (uint32_t)atoi(v);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (cfg.hours <= 0 || cfg.itvl_ms < 8 || cfg.itvl_floor_ms < 8 || cfg.mtu < 23 || cfg.mtu > 527 ||
+        cfg.ll_octets < 27 || cfg.ll_octets > 251 || cfg.pkts_per_event == 0 || cfg.acl_bufs == 0 ||
+        cfg.acl_bufs > SIM_LINK_QUEUE_MAX || cfg.loss_pct >= 100 || cfg.peers == 0 ||
+        cfg.peers > SIM_CENTRALS_MAX || cfg.scan_pct == 0 || cfg.scan_pct > 100) {
+        usage(argv[0]);
+    }
+}
+
+static void centrals_init(uint32_t run_ms) {
+    for (int i = 0; i < cfg.peers; i++) {
+        static const char *names[] = { "central 0", "central 1", "central 2" };
+        bool first = i == 0;
+        sim_central_cfg_t cc = {
+            .name = names[i],
+            .addr = (uint8_t)(0x10 + i),
+            .mtu = cfg.mtu,
+            .ll_octets = cfg.ll_octets,
+            .itvl = (uint16_t)(cfg.itvl_ms * 4 / 5),
+            .itvl_floor = (uint16_t)(cfg.itvl_floor_ms * 4 / 5),
+            .scan_pct = cfg.scan_pct,
+            .bond = cfg.bond,
+            // the first central is the app that runs the session, the others only watch
+            .subscribe = first ? SIM_CENTRAL_SUB_HR | SIM_CENTRAL_SUB_COND | SIM_CENTRAL_SUB_LOG | SIM_CENTRAL_SUB_BUTTON
+                               : SIM_CENTRAL_SUB_HR | SIM_CENTRAL_SUB_COND,
+            .start = first && !cfg.idle,
+            .codec = first ? cfg.codec : SIM_CENTRAL_NO_CODEC,
+            .coc = first && cfg.bulk,
+            .bench_transport = cfg.bench_transport,
+            .bench_s = first ? cfg.bench_s : 0,
+            .connect_at_ms = 100 + 500 * i,
+            .discovery_ms = cfg.discovery_ms,
+            .online_ms = first ? cfg.online_s * 1000 : 0,
+            .offline_ms = cfg.offline_s * 1000,
+            .link_loss = cfg.link_loss,
+        };
+        sim_central_init(&centrals[i], &cc, run_ms);
+    }
+}
+
+static void step(void) {
+    sim_clock_advance(SIM_STEP_US);
+    sim_adc_step(SIM_STEP_US);
+    for (int i = 0; i < cfg.peers; i++) {
+        sim_central_step(&centrals[i], sim_now_us());
+    }
+    sim_ble_step(sim_now_us());
+    uint32_t resumes = sim_rtos_run();
+    sim_pm_step(resumes > 0, SIM_STEP_US);
+}
+
+int main(int argc, char **argv) {
+    parse_args(argc, argv);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    sim_rand_seed(&rnd, cfg.seed);
+    sim_clock_reset();
+    sim_esp_init(cfg.seed, cfg.verbose ? ESP_LOG_INFO : ESP_LOG_WARN);
+    sim_adc_init(cfg.bpm, cfg.seed);
+    sim_flash_init();
+    sim_link_cfg_t link = {
+        .acl_bufs = cfg.acl_bufs,
+        .pkts_per_event = cfg.pkts_per_event,
+        .loss_pct = cfg.loss_pct,
+    };
+    sim_ble_init(&link, &rnd);
+    sim_ble_set_host_queue(cfg.host_queue);
+    uint64_t end_us = (uint64_t)(cfg.hours * 3600e6);
+    centrals_init((uint32_t)(end_us / 1000));
+
+    sim_rtos_init(app_main);
+    sim_rtos_run();
+    while (sim_now_us() < end_us) {
+        step();
+    }
+    // the firmware's own numbers, read over the air like an app would
+    if (centrals[0].peer.conn_handle != BLE_HS_CONN_HANDLE_NONE) {
+        sim_central_read_diag(&centrals[0]);
+        for (int i = 0; i < 1000 && centrals[0].diag_len == 0; i++) {
+            step();
+        }
+    }
+    report(sim_now_us() / 1e6);
+    run_checks();
+    return failures > 0 ? 1 : 0;
+}
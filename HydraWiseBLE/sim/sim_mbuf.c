@@ -0,0 +1,339 @@
+#include <string.h>
+#include "os/os_mempool.h"
+#include "os/os_mbuf.h"
+#include "host/ble_hs.h"
+#include "sdkconfig.h"
+
+#define OS_OK 0
+#define OS_ENOMEM 1
+#define OS_EINVAL 2
+
+// --- mempools ---
+
+int os_mempool_init(struct os_mempool *mp, uint16_t blocks, uint32_t block_size, void *membuf, const char *name) {
+    if (mp == NULL || block_size == 0 || (blocks > 0 && membuf == NULL)) {
+        return OS_EINVAL;
+    }
+    uint32_t size = OS_ALIGN(block_size, OS_ALIGNMENT);
+    *mp = (struct os_mempool){
+        .mp_block_size = size,
+        .mp_num_blocks = blocks,
+        .mp_num_free = blocks,
+        .mp_min_free = blocks,
+        .mp_membuf_addr = (uintptr_t)membuf,
+        .name = name,
+    };
+    struct os_memblock *prev = NULL;
+    for (uint16_t i = 0; i < blocks; i++) {
+        struct os_memblock *b = (struct os_memblock *)((uint8_t *)membuf + (size_t)i * size);
+        b->mb_next = NULL;
+        if (prev == NULL) {
+            mp->mp_head = b;
+        } else {
+            prev->mb_next = b;
+        }
+        prev = b;
+    }
+    return OS_OK;
+}
+
+int os_mempool_ext_init(struct os_mempool_ext *mpe, uint16_t blocks, uint32_t block_size, void *membuf,
+    const char *name) {
+    int rc = os_mempool_init(&mpe->mpe_mp, blocks, block_size, membuf, name);
+    if (rc != OS_OK) {
+        return rc;
+    }
+    mpe->mpe_mp.mp_flags = OS_MEMPOOL_F_EXT;
+    mpe->mpe_put_cb = NULL;
+    mpe->mpe_put_arg = NULL;
+    return OS_OK;
+}
+
+void *os_memblock_get(struct os_mempool *mp) {
+    struct os_memblock *b = mp->mp_head;
+    if (b == NULL) {
+        return NULL;
+    }
+    mp->mp_head = b->mb_next;
+    mp->mp_num_free--;
+    if (mp->mp_num_free < mp->mp_min_free) {
+        mp->mp_min_free = mp->mp_num_free;
+    }
+    return b;
+}
+
+int os_memblock_put_from_cb(struct os_mempool *mp, void *block) {
+    struct os_memblock *b = block;
+    b->mb_next = mp->mp_head;
+    mp->mp_head = b;
+    mp->mp_num_free++;
+    return OS_OK;
+}
+
+int os_memblock_put(struct os_mempool *mp, void *block) {
+    if (mp->mp_flags & OS_MEMPOOL_F_EXT) {
+        struct os_mempool_ext *mpe = (struct os_mempool_ext *)mp;
+        if (mpe->mpe_put_cb != NULL) {
+            return mpe->mpe_put_cb(mpe, block, mpe->mpe_put_arg);
+        }
+    }
+    return os_memblock_put_from_cb(mp, block);
+}
+
+// --- mbufs ---
+
+int os_mbuf_pool_init(struct os_mbuf_pool *omp, struct os_mempool *mp, uint16_t buf_len, uint16_t nbufs) {
+    omp->omp_databuf_len = buf_len - sizeof(struct os_mbuf);
+    omp->omp_pool = mp;
+    return OS_OK;
+}
+
+struct os_mbuf *os_mbuf_get(struct os_mbuf_pool *omp, uint16_t leadingspace) {
+    if (leadingspace > omp->omp_databuf_len) {
+        return NULL;
+    }
+    struct os_mbuf *om = os_memblock_get(omp->omp_pool);
+    if (om == NULL) {
+        return NULL;
+    }
+    SLIST_NEXT(om, om_next) = NULL;
+    om->om_flags = 0;
+    om->om_pkthdr_len = 0;
+    om->om_len = 0;
+    om->om_data = &om->om_databuf[0] + leadingspace;
+    om->om_omp = omp;
+    return om;
+}
+
+struct os_mbuf *os_mbuf_get_pkthdr(struct os_mbuf_pool *omp, uint8_t user_pkthdr_len) {
+    uint16_t pkthdr_len = sizeof(struct os_mbuf_pkthdr) + user_pkthdr_len;
+    if (pkthdr_len > omp->omp_databuf_len) {
+        return NULL;
+    }
+    struct os_mbuf *om = os_mbuf_get(omp, 0);
+    if (om == NULL) {
+        return NULL;
+    }
+    om->om_pkthdr_len = pkthdr_len;
+    om->om_data += pkthdr_len;
+    OS_MBUF_PKTHDR(om)->omp_len = 0;
+    OS_MBUF_PKTHDR(om)->omp_flags = 0;
+    return om;
+}
+
+static struct os_mbuf *last_buf(struct os_mbuf *om) {
+    while (SLIST_NEXT(om, om_next) != NULL) {
+        om = SLIST_NEXT(om, om_next);
+    }
+    return om;
+}
+
+int os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len) {
+    if (om == NULL) {
+        return OS_EINVAL;
+    }
+    const uint8_t *src = data;
+    struct os_mbuf *last = last_buf(om);
+    uint16_t remainder = len;
+    uint16_t space = OS_MBUF_TRAILINGSPACE(last);
+    if (space > 0) {
+        uint16_t n = space < remainder ? space : remainder;
+        memcpy(last->om_data + last->om_len, src, n);
+        last->om_len += n;
+        src += n;
+        remainder -= n;
+    }
+    while (remainder > 0) {
+        struct os_mbuf *next = os_mbuf_get(om->om_omp, 0);
+        if (next == NULL) {
+            break;
+        }
+        uint16_t n = next->om_omp->omp_databuf_len < remainder ? next->om_omp->omp_databuf_len : remainder;
+        memcpy(next->om_data, src, n);
+        next->om_len = n;
+        SLIST_NEXT(last, om_next) = next;
+        last = next;
+        src += n;
+        remainder -= n;
+    }
+    if (OS_MBUF_IS_PKTHDR(om)) {
+        OS_MBUF_PKTHDR(om)->omp_len += len - remainder;
+    }
+    return remainder != 0 ? OS_ENOMEM : OS_OK;
+}
+
+void *os_mbuf_extend(struct os_mbuf *om, uint16_t len) {
+    struct os_mbuf *last = last_buf(om);
+    if (OS_MBUF_TRAILINGSPACE(last) < len) {
+        if (len > om->om_omp->omp_databuf_len) {
+            return NULL;
+        }
+        struct os_mbuf *next = os_mbuf_get(om->om_omp, 0);
+        if (next == NULL) {
+            return NULL;
+        }
+        SLIST_NEXT(last, om_next) = next;
+        last = next;
+    }
+    void *p = last->om_data + last->om_len;
+    last->om_len += len;
+    if (OS_MBUF_IS_PKTHDR(om)) {
+        OS_MBUF_PKTHDR(om)->omp_len += len;
+    }
+    return p;
+}
+
+void os_mbuf_adj(struct os_mbuf *om, int req_len) {
+    if (om == NULL) {
+        return;
+    }
+    int len = req_len;
+    if (len >= 0) {
+        // trim from the head
+        struct os_mbuf *m = om;
+        while (m != NULL && len > 0) {
+            if (m->om_len <= len) {
+                len -= m->om_len;
+                m->om_len = 0;
+                m = SLIST_NEXT(m, om_next);
+            } else {
+                m->om_len -= len;
+                m->om_data += len;
+                len = 0;
+            }
+        }
+        if (OS_MBUF_IS_PKTHDR(om)) {
+            OS_MBUF_PKTHDR(om)->omp_len -= req_len - len;
+        }
+        return;
+    }
+    // trim from the tail
+    len = -len;
+    int total = os_mbuf_len(om);
+    int keep = total > len ? total - len : 0;
+    if (OS_MBUF_IS_PKTHDR(om)) {
+        OS_MBUF_PKTHDR(om)->omp_len = keep;
+    }
+    for (struct os_mbuf *m = om; m != NULL; m = SLIST_NEXT(m, om_next)) {
+        if (m->om_len >= keep) {
+            m->om_len = keep;
+            keep = 0;
+        } else {
+            keep -= m->om_len;
+        }
+    }
+}
+
+int os_mbuf_copydata(const struct os_mbuf *om, int off, int len, void *dst) {
+    uint8_t *d = dst;
+    while (om != NULL && off >= om->om_len) {
+        off -= om->om_len;
+        om = SLIST_NEXT(om, om_next);
+    }
+    while (len > 0 && om != NULL) {
+        int n = om->om_len - off < len ? om->om_len - off : len;
+        memcpy(d, om->om_data + off, n);
+        d += n;
+        len -= n;
+        off = 0;
+        om = SLIST_NEXT(om, om_next);
+    }
+    return len > 0 ? -1 : 0;
+}
+
+uint16_t os_mbuf_len(const struct os_mbuf *om) {
+    uint16_t len = 0;
+    for (; om != NULL; om = SLIST_NEXT(om, om_next)) {
+        len += om->om_len;
+    }
+    return len;
+}
+
+int os_mbuf_free(struct os_mbuf *om) {
+    return os_memblock_put(om->om_omp->omp_pool, om);
+}
+
+int os_mbuf_free_chain(struct os_mbuf *om) {
+    while (om != NULL) {
+        struct os_mbuf *next = SLIST_NEXT(om, om_next);
+        int rc = os_mbuf_free(om);
+        if (rc != 0) {
+            return rc;
+        }
+        om = next;
+    }
+    return OS_OK;
+}
+
+// --- msys ---
+
+#define MSYS_1_SIZE OS_ALIGN(CONFIG_BT_NIMBLE_MSYS_1_BLOCK_SIZE, 4)
+#define MSYS_2_SIZE OS_ALIGN(CONFIG_BT_NIMBLE_MSYS_2_BLOCK_SIZE, 4)
+
+static os_membuf_t msys_1_mem[OS_MEMPOOL_SIZE(CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT, MSYS_1_SIZE)];
+static os_membuf_t msys_2_mem[OS_MEMPOOL_SIZE(CONFIG_BT_NIMBLE_MSYS_2_BLOCK_COUNT, MSYS_2_SIZE)];
+static struct os_mempool msys_1_mempool;
+static struct os_mempool msys_2_mempool;
+static struct os_mbuf_pool msys_pools[2]; // smallest first
+static bool msys_ready;
+
+static void msys_init(void) {
+    os_mempool_init(&msys_1_mempool, CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT, MSYS_1_SIZE, msys_1_mem, "msys_1");
+    os_mempool_init(&msys_2_mempool, CONFIG_BT_NIMBLE_MSYS_2_BLOCK_COUNT, MSYS_2_SIZE, msys_2_mem, "msys_2");
+    os_mbuf_pool_init(&msys_pools[0], &msys_1_mempool, MSYS_1_SIZE, CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT);
+    os_mbuf_pool_init(&msys_pools[1], &msys_2_mempool, MSYS_2_SIZE, CONFIG_BT_NIMBLE_MSYS_2_BLOCK_COUNT);
+    msys_ready = true;
+}
+
+// The first pool whose blocks hold dsize, else the largest; no fallback when it is empty
+static struct os_mbuf_pool *msys_find_pool(uint16_t dsize) {
+    if (!msys_ready) {
+        msys_init();
+    }
+    for (size_t i = 0; i < sizeof(msys_pools) / sizeof(msys_pools[0]); i++) {
+        if (dsize <= msys_pools[i].omp_databuf_len) {
+            return &msys_pools[i];
+        }
+    }
+    return &msys_pools[sizeof(msys_pools) / sizeof(msys_pools[0]) - 1];
+}
+
+struct os_mbuf *os_msys_get(uint16_t dsize, uint16_t leadingspace) {
+    return os_mbuf_get(msys_find_pool(dsize), leadingspace);
+}
+
+struct os_mbuf *os_msys_get_pkthdr(uint16_t dsize, uint16_t user_hdr_len) {
+    return os_mbuf_get_pkthdr(msys_find_pool(dsize + sizeof(struct os_mbuf_pkthdr) + user_hdr_len),
+        (uint8_t)user_hdr_len);
+}
+
+int os_msys_num_free(void) {
+    if (!msys_ready) {
+        msys_init();
+    }
+    return msys_1_mempool.mp_num_free + msys_2_mempool.mp_num_free;
+}
+
+// --- host helpers ---
+
+struct os_mbuf *ble_hs_mbuf_from_flat(const void *buf, uint16_t len) {
+    struct os_mbuf *om = os_msys_get_pkthdr(len, 0);
+    if (om == NULL) {
+        return NULL;
+    }
+    if (os_mbuf_append(om, buf, len) != 0) {
+        os_mbuf_free_chain(om);
+        return NULL;
+    }
+    return om;
+}
+
+int ble_hs_mbuf_to_flat(const struct os_mbuf *om, void *flat, uint16_t max_len, uint16_t *out_copy_len) {
+    uint16_t len = os_mbuf_len(om);
+    uint16_t n = len < max_len ? len : max_len;
+    os_mbuf_copydata(om, 0, n, flat);
+    if (out_copy_len != NULL) {
+        *out_copy_len = n;
+    }
+    return n < len ? BLE_HS_EMSGSIZE : 0;
+}
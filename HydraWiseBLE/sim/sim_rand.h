@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+xorshift32, so a run depends on the seed alone and not on the host libc.
+*/
+
+typedef struct {
+    uint32_t s;
+} sim_rand_t;
+
+static inline void sim_rand_seed(sim_rand_t *r, uint32_t seed) {
+    r->s = seed != 0 ? seed : 0x2545f491;
+}
+
+static inline uint32_t sim_rand(sim_rand_t *r) {
+    uint32_t x = r->s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return r->s = x;
+}
+
+// Uniform in [0, n)
+static inline uint32_t sim_rand_below(sim_rand_t *r, uint32_t n) {
+    return (uint32_t)(((uint64_t)sim_rand(r) * n) >> 32);
+}
+
+// Uniform in [lo, hi]
+static inline int32_t sim_rand_range(sim_rand_t *r, int32_t lo, int32_t hi) {
+    return lo + (int32_t)sim_rand_below(r, (uint32_t)(hi - lo + 1));
+}
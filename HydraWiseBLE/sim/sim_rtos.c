@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "sim_clock.h"
+#include "sim_rtos.h"
+
+typedef enum {
+    TASK_READY,
+    TASK_BLOCKED,
+    TASK_DONE,
+} task_state_t;
+
+struct sim_task {
+    const char *name;
+    TaskFunction_t fn;
+    void *arg;
+    UBaseType_t prio;
+    BaseType_t core;
+    ucontext_t ctx;
+    void *stack;
+    task_state_t state;
+    uint32_t notify;
+    bool (*wait_ready)(struct sim_task *t); // NULL: a plain delay
+    void *wait_obj;
+    uint64_t wake_at_us;                    // UINT64_MAX: no timeout
+    bool timed_out;
+};
+
+struct sim_queue {
+    uint8_t *buf;
+    UBaseType_t len;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+struct sim_mutex {
+    struct sim_task *holder;
+};
+
+#define SIM_TIMERS_MAX 32
+
+struct sim_timer {
+    esp_timer_cb_t cb;
+    void *arg;
+    const char *name;
+    bool used;
+    bool armed;
+    uint64_t expiry_us;
+    uint64_t period_us; // 0: one shot
+};
+
+static struct sim_task *tasks[SIM_TASKS_MAX];
+static int task_count;
+static struct sim_task *current; // NULL in the kernel
+static ucontext_t kernel_ctx;
+static uint32_t switches;
+
+static struct sim_timer timers[SIM_TIMERS_MAX];
+static TaskHandle_t timer_task;
+static void (*main_fn)(void);
+
+// --- scheduling ---
+
+static bool runnable(struct sim_task *t) {
+    if (t->state == TASK_READY) {
+        return true;
+    }
+    if (t->state != TASK_BLOCKED) {
+        return false;
+    }
+    if (t->wait_ready != NULL && t->wait_ready(t)) {
+        return true;
+    }
+    if (sim_now_us() >= t->wake_at_us) {
+        t->timed_out = true;
+        return true;
+    }
+    return false;
+}
+
+static struct sim_task *pick(void) {
+    struct sim_task *best = NULL;
+    for (int i = 0; i < task_count; i++) {
+        struct sim_task *t = tasks[i];
+        if ((best == NULL || t->prio > best->prio) && runnable(t)) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+static void switch_to_kernel(void) {
+    struct sim_task *t = current;
+    swapcontext(&t->ctx, &kernel_ctx);
+}
+
+// Blocks the running task until ready() holds or `wait` ticks pass. Returns false on timeout.
+static bool block_on(bool (*ready)(struct sim_task *), void *obj, TickType_t wait) {
+    struct sim_task *t = current;
+    if (t == NULL) {
+        fprintf(stderr, "sim_rtos: blocking call outside a task\n");
+        abort();
+    }
+    t->wait_obj = obj;
+    bool ok = ready != NULL && ready(t);
+    if (ok || wait == 0) {
+        t->wait_obj = NULL;
+        return ok;
+    }
+    t->wait_ready = ready;
+    // FreeRTOS timeouts end on a tick boundary
+    t->wake_at_us = wait == portMAX_DELAY ? UINT64_MAX
+                                          : ((uint64_t)sim_now_ticks() + wait) * SIM_TICK_US;
+    t->timed_out = false;
+    t->state = TASK_BLOCKED;
+    switch_to_kernel();
+    t->wait_ready = NULL;
+    t->wait_obj = NULL;
+    return !t->timed_out;
+}
+
+// A task that just made a higher-priority task runnable gives it the CPU, as it would be preempted
+static void preempt_check(void) {
+    if (current == NULL) {
+        return;
+    }
+    for (int i = 0; i < task_count; i++) {
+        struct sim_task *t = tasks[i];
+        if (t != current && t->prio > current->prio && runnable(t)) {
+            switch_to_kernel();
+            return;
+        }
+    }
+}
+
+static void task_entry(void) {
+    struct sim_task *t = current;
+    t->fn(t->arg);
+    // FreeRTOS tasks must not return; a test harness task may
+    t->state = TASK_DONE;
+    switch_to_kernel();
+}
+
+static void timers_kick(void);
+
+uint32_t sim_rtos_run(void) {
+    uint32_t resumes = 0;
+    timers_kick();
+    for (;;) {
+        struct sim_task *t = pick();
+        if (t == NULL) {
+            break;
+        }
+        t->state = TASK_READY;
+        current = t;
+        switches++;
+        resumes++;
+        swapcontext(&kernel_ctx, &t->ctx);
+        current = NULL;
+        timers_kick();
+    }
+    return resumes;
+}
+
+const char *sim_rtos_current_name(void) {
+    return current != NULL ? current->name : "kernel";
+}
+
+uint32_t sim_rtos_switches(void) {
+    return switches;
+}
+
+BaseType_t xPortGetCoreID(void) {
+    return current != NULL && current->core >= 0 ? current->core : 0;
+}
+
+// --- tasks ---
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+    UBaseType_t prio, TaskHandle_t *handle, BaseType_t core) {
+    if (task_count == SIM_TASKS_MAX) {
+        return pdFAIL;
+    }
+    struct sim_task *t = calloc(1, sizeof(*t));
+    t->name = name;
+    t->fn = fn;
+    t->arg = arg;
+    t->prio = prio;
+    t->core = core;
+    t->stack = malloc(SIM_TASK_STACK);
+    t->state = TASK_READY;
+    t->wake_at_us = UINT64_MAX;
+    getcontext(&t->ctx);
+    t->ctx.uc_stack.ss_sp = t->stack;
+    t->ctx.uc_stack.ss_size = SIM_TASK_STACK;
+    t->ctx.uc_link = NULL;
+    makecontext(&t->ctx, task_entry, 0);
+    tasks[task_count++] = t;
+    if (handle != NULL) {
+        *handle = t;
+    }
+    preempt_check();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+    UBaseType_t prio, TaskHandle_t *handle) {
+    return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, handle, -1);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return current;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (ticks == 0) {
+        // a yield: the kernel picks again, this task stays ready
+        switch_to_kernel();
+        return;
+    }
+    block_on(NULL, NULL, ticks);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return sim_now_ticks();
+}
+
+TickType_t xTaskGetTickCountFromISR(void) {
+    return sim_now_ticks();
+}
+
+static bool notify_ready(struct sim_task *t) {
+    return t->notify > 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) {
+    struct sim_task *t = current;
+    if (!block_on(notify_ready, NULL, wait)) {
+        return 0;
+    }
+    uint32_t v = t->notify;
+    t->notify = clear ? 0 : v - 1;
+    return v;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    task->notify++;
+    preempt_check();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+    task->notify++;
+    if (woken != NULL && current != NULL && task->prio > current->prio) {
+        *woken = pdTRUE;
+    }
+}
+
+// --- queues ---
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size) {
+    struct sim_queue *q = calloc(1, sizeof(*q));
+    q->buf = calloc(len, item_size);
+    q->len = len;
+    q->item_size = item_size;
+    return q;
+}
+
+static bool queue_has_item(struct sim_task *t) {
+    return ((struct sim_queue *)t->wait_obj)->count > 0;
+}
+
+static bool queue_has_space(struct sim_task *t) {
+    struct sim_queue *q = t->wait_obj;
+    return q->count < q->len;
+}
+
+static bool queue_put(QueueHandle_t q, const void *item) {
+    if (q->count == q->len) {
+        return false;
+    }
+    memcpy(q->buf + ((q->head + q->count) % q->len) * q->item_size, item, q->item_size);
+    q->count++;
+    return true;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait) {
+    if (q->count == q->len) {
+        if (current == NULL || !block_on(queue_has_space, q, wait)) {
+            return errQUEUE_FULL;
+        }
+    }
+    queue_put(q, item);
+    preempt_check();
+    return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void *item, BaseType_t *woken) {
+    return queue_put(q, item) ? pdPASS : errQUEUE_FULL;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait) {
+    if (q->count == 0) {
+        if (current == NULL || !block_on(queue_has_item, q, wait)) {
+            return pdFALSE;
+        }
+    }
+    memcpy(item, q->buf + q->head * q->item_size, q->item_size);
+    q->head = (q->head + 1) % q->len;
+    q->count--;
+    preempt_check();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t q) {
+    q->head = 0;
+    q->count = 0;
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+    return q->count;
+}
+
+// --- mutexes ---
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return calloc(1, sizeof(struct sim_mutex));
+}
+
+static bool mutex_free(struct sim_task *t) {
+    return ((struct sim_mutex *)t->wait_obj)->holder == NULL;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t m, TickType_t wait) {
+    if (m->holder != NULL && !block_on(mutex_free, m, wait)) {
+        return pdFALSE;
+    }
+    m->holder = current;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t m) {
+    if (m->holder != current) {
+        return pdFALSE;
+    }
+    m->holder = NULL;
+    preempt_check();
+    return pdTRUE;
+}
+
+// --- esp_timer ---
+
+int64_t esp_timer_get_time(void) {
+    return (int64_t)sim_now_us();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out) {
+    for (int i = 0; i < SIM_TIMERS_MAX; i++) {
+        struct sim_timer *t = &timers[i];
+        if (!t->used) {
+            *t = (struct sim_timer){
+                .cb = args->callback, .arg = args->arg, .name = args->name, .used = true,
+            };
+            *out = t;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t t, uint64_t timeout_us) {
+    if (t->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    t->armed = true;
+    t->expiry_us = sim_now_us() + timeout_us;
+    t->period_us = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t t, uint64_t period_us) {
+    if (t->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    t->armed = true;
+    t->expiry_us = sim_now_us() + period_us;
+    t->period_us = period_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t t) {
+    if (!t->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    t->armed = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t t) {
+    if (t->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    t->used = false;
+    return ESP_OK;
+}
+
+static bool timer_due(const struct sim_timer *t) {
+    return t->used && t->armed && t->expiry_us <= sim_now_us();
+}
+
+static void timers_kick(void) {
+    if (timer_task == NULL || timer_task->notify > 0) {
+        return;
+    }
+    for (int i = 0; i < SIM_TIMERS_MAX; i++) {
+        if (timer_due(&timers[i])) {
+            timer_task->notify++;
+            return;
+        }
+    }
+}
+
+static void esp_timer_task(void *arg) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        for (int i = 0; i < SIM_TIMERS_MAX; i++) {
+            struct sim_timer *t = &timers[i];
+            if (!timer_due(t)) {
+                continue;
+            }
+            if (t->period_us != 0) {
+                // missed periods are skipped, not run back to back
+                while (t->expiry_us <= sim_now_us()) {
+                    t->expiry_us += t->period_us;
+                }
+            } else {
+                t->armed = false;
+            }
+            t->cb(t->arg);
+        }
+    }
+}
+
+static void main_task(void *arg) {
+    // like the IDF main task, deleted once app_main returns
+    main_fn();
+}
+
+void sim_rtos_init(void (*app_main_fn)(void)) {
+    main_fn = app_main_fn;
+    xTaskCreate(esp_timer_task, "esp_timer", 4096, NULL, 22, &timer_task);
+    if (app_main_fn != NULL) {
+        xTaskCreate(main_task, "main", 4096, NULL, 1, NULL);
+    }
+}
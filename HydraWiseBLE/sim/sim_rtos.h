@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/*
+Cooperative FreeRTOS kernel of the simulation, behind the shim headers in
+shim/freertos and esp_timer.h.
+
+Each task runs on its own stack (ucontext) and keeps the CPU until it blocks
+on a notification, queue, mutex or delay, or wakes a task of higher priority,
+which then runs first as it would preempt on the device. Blocked tasks wake
+on their condition or at the tick their timeout ends. Both cores are one:
+nothing in the firmware relies on two tasks running at the same instant.
+
+The main loop advances the virtual clock, lets the world (ADC, link, central)
+raise its events, then calls sim_rtos_run(), which runs tasks until every one
+of them is blocked. esp_timer callbacks run in an "esp_timer" task, as with
+ESP_TIMER_TASK dispatch.
+*/
+
+#define SIM_TASKS_MAX 16
+#define SIM_TASK_STACK (256 * 1024) // host stacks: firmware stack sizes are for the ESP32
+
+// Creates the esp_timer task and a main task that will run app_main()
+void sim_rtos_init(void (*app_main_fn)(void));
+
+// Runs tasks until all are blocked. Returns how many times a task was resumed.
+uint32_t sim_rtos_run(void);
+
+// Name of the running task, "kernel" outside of one
+const char *sim_rtos_current_name(void);
+
+// Task switches so far, for the report
+uint32_t sim_rtos_switches(void);
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdio.h>
+
+/*
+Assertions for the host unit tests. A failed check prints where it is and
+the test goes on; CHECK_DONE() in main() turns the failures into the exit
+status ctest reads.
+*/
+
+static int check_failures;
+
+#define CHECK(cond)                                                                 \
+    do {                                                                            \
+        if (!(cond)) {                                                              \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            check_failures++;                                                       \
+        }                                                                           \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                              \
+    do {                                                                            \
+        long long check_a_ = (long long)(a), check_b_ = (long long)(b);             \
+        if (check_a_ != check_b_) {                                                 \
+            fprintf(stderr, "%s:%d: %s == %s failed: %lld != %lld\n", __FILE__,     \
+                __LINE__, #a, #b, check_a_, check_b_);                              \
+            check_failures++;                                                       \
+        }                                                                           \
+    } while (0)
+
+#define CHECK_DONE()                                                                \
+    (check_failures > 0 ? (fprintf(stderr, "%d checks failed\n", check_failures), 1) : 0)
@@ -0,0 +1,137 @@
+#include <stdint.h>
+#include <string.h>
+#include "adv_bcast.h"
+#include "adv_payload.h"
+#include "check.h"
+
+#define NAME "HydraWise-BLE-Server" // the firmware's DEVICE_NAME
+
+static const uint16_t primary[] = { 0x180D, 0x181C };
+static const uint16_t all[] = { 0x180D, 0x181C, 0x180F, 0x180A, 0x180C, 0x180E };
+
+// Finds AD structure `type` in a buffer, as a scanner parses it; checks the
+// structures tile the buffer exactly
+static const uint8_t *find(const adv_buf_t *b, uint8_t type, uint8_t *len) {
+    const uint8_t *found = NULL;
+    uint8_t off = 0;
+    while (off < b->len) {
+        uint8_t n = b->data[off];
+        CHECK(n >= 1 && off + 1 + n <= b->len);
+        if (n < 1 || off + 1 + n > b->len) {
+            return NULL;
+        }
+        if (b->data[off + 1] == type && found == NULL) {
+            found = &b->data[off + 2];
+            *len = n - 1;
+        }
+        off += 1 + n;
+    }
+    CHECK_EQ(off, b->len);
+    return found;
+}
+
+static void test_structure_layout(void) {
+    adv_payload_t p;
+    adv_payload_init(&p);
+    const uint8_t flags = ADV_FLAG_LE_GENERAL | ADV_FLAG_BREDR_UNSUPPORTED;
+    CHECK_EQ(adv_payload_add(&p, ADV_TYPE_FLAGS, &flags, 1, true), ADV_PLACED_ADV);
+    CHECK_EQ(adv_payload_add_uuid16(&p, primary, 2, false, true), ADV_PLACED_ADV);
+    const uint8_t want[] = { 2, ADV_TYPE_FLAGS, 0x06, 5, ADV_TYPE_UUID16_INCOMPLETE, 0x0d, 0x18, 0x1c, 0x18 };
+    CHECK_EQ(p.adv.len, sizeof(want));
+    CHECK(memcmp(p.adv.data, want, sizeof(want)) == 0);
+    CHECK_EQ(p.rsp.len, 0);
+    CHECK_EQ(adv_buf_room(&p.adv), ADV_MAX_LEN - sizeof(want) - 2);
+}
+
+// A field goes to the scan response once the advertising data is full, is
+// refused with adv_only, and fills a buffer to the last byte
+static void test_overflow_to_scan_response(void) {
+    adv_payload_t p;
+    adv_payload_init(&p);
+    uint8_t big[ADV_MAX_LEN - 2];
+    memset(big, 0xa5, sizeof(big));
+    CHECK_EQ(adv_payload_add(&p, ADV_TYPE_MANUFACTURER, big, sizeof(big) - 4, true), ADV_PLACED_ADV);
+    CHECK_EQ(adv_buf_room(&p.adv), 2);
+    const uint8_t tx = 0;
+    CHECK_EQ(adv_payload_add(&p, ADV_TYPE_MANUFACTURER, big, 2, false), ADV_PLACED_ADV);
+    CHECK_EQ(adv_buf_room(&p.adv), 0);
+    CHECK_EQ(adv_payload_add(&p, ADV_TYPE_TX_POWER, &tx, 1, true), ADV_PLACED_NONE);
+    CHECK_EQ(adv_payload_add(&p, ADV_TYPE_MANUFACTURER, big, sizeof(big), false), ADV_PLACED_RSP);
+    CHECK_EQ(p.rsp.len, ADV_MAX_LEN);
+    CHECK_EQ(adv_payload_add(&p, ADV_TYPE_TX_POWER, &tx, 0, false), ADV_PLACED_NONE);
+    CHECK_EQ(p.adv.len, ADV_MAX_LEN);
+    // never truncated: a field longer than a whole buffer fits nowhere
+    adv_payload_init(&p);
+    uint16_t many[15] = { 0 };
+    CHECK_EQ(adv_payload_add_uuid16(&p, many, 15, true, false), ADV_PLACED_NONE);
+    CHECK_EQ(p.adv.len + p.rsp.len, 0);
+}
+
+// The complete name in the advertising data, else the scan response, else
+// shortened in what the advertising data has left
+static void test_name_placement(void) {
+    adv_payload_t p;
+    adv_payload_init(&p);
+    CHECK_EQ(adv_payload_add_name(&p, "Hydra", 4), ADV_PLACED_ADV);
+    uint8_t len = 0;
+    const uint8_t *name = find(&p.adv, ADV_TYPE_NAME_COMPLETE, &len);
+    CHECK(name != NULL && len == 5 && memcmp(name, "Hydra", 5) == 0);
+
+    uint8_t fill[20] = { 0 };
+    adv_payload_init(&p);
+    adv_payload_add(&p, ADV_TYPE_MANUFACTURER, fill, sizeof(fill), true);
+    CHECK_EQ(adv_payload_add_name(&p, NAME, 4), ADV_PLACED_RSP);
+    CHECK(find(&p.rsp, ADV_TYPE_NAME_COMPLETE, &len) != NULL && len == strlen(NAME));
+
+    adv_payload_init(&p);
+    adv_payload_add(&p, ADV_TYPE_MANUFACTURER, fill, sizeof(fill), true);
+    CHECK_EQ(adv_payload_add(&p, ADV_TYPE_MANUFACTURER, fill, sizeof(fill), false), ADV_PLACED_RSP);
+    CHECK_EQ(adv_payload_add_name(&p, NAME, 4), ADV_PLACED_ADV);
+    name = find(&p.adv, ADV_TYPE_NAME_SHORT, &len);
+    CHECK(name != NULL && len == 7 && memcmp(name, NAME, 7) == 0);
+    CHECK_EQ(p.adv.len, ADV_MAX_LEN);
+
+    // less room than min_len: refused rather than cut shorter
+    adv_payload_init(&p);
+    adv_payload_add(&p, ADV_TYPE_MANUFACTURER, fill, sizeof(fill), true);
+    adv_payload_add(&p, ADV_TYPE_MANUFACTURER, fill, sizeof(fill), false);
+    CHECK_EQ(adv_payload_add_name(&p, NAME, 8), ADV_PLACED_NONE);
+    CHECK_EQ(p.adv.len, 22);
+    // longer than any buffer: shortened straight away
+    adv_payload_init(&p);
+    CHECK_EQ(adv_payload_add_name(&p, "A name of more than twenty-nine bytes", 8), ADV_PLACED_ADV);
+    CHECK(find(&p.adv, ADV_TYPE_NAME_SHORT, &len) != NULL && len == ADV_MAX_LEN - 2);
+}
+
+// The firmware's layouts (HydraWiseBLE.c adv_build), connectable and broadcasting
+static void test_firmware_layouts(void) {
+    const uint8_t flags = ADV_FLAG_LE_GENERAL | ADV_FLAG_BREDR_UNSUPPORTED;
+    adv_payload_t p;
+    adv_payload_init(&p);
+    CHECK_EQ(adv_payload_add(&p, ADV_TYPE_FLAGS, &flags, 1, true), ADV_PLACED_ADV);
+    CHECK_EQ(adv_payload_add_uuid16(&p, primary, 2, false, true), ADV_PLACED_ADV);
+    CHECK_EQ(adv_payload_add_name(&p, NAME, 8), ADV_PLACED_ADV);
+    CHECK_EQ(adv_payload_add_uuid16(&p, all, 6, true, false), ADV_PLACED_RSP);
+    CHECK_EQ(p.adv.len, ADV_MAX_LEN);
+    uint8_t len = 0;
+    const uint8_t *uuids = find(&p.rsp, ADV_TYPE_UUID16_COMPLETE, &len);
+    CHECK(uuids != NULL && len == 12 && uuids[10] == 0x0e && uuids[11] == 0x18);
+
+    const uint8_t values[BCAST_LEN] = { 0 };
+    adv_payload_init(&p);
+    adv_payload_add(&p, ADV_TYPE_FLAGS, &flags, 1, true);
+    CHECK_EQ(adv_payload_add(&p, ADV_TYPE_MANUFACTURER, values, sizeof(values), true), ADV_PLACED_ADV);
+    CHECK_EQ(adv_payload_add_uuid16(&p, primary, 2, false, true), ADV_PLACED_ADV);
+    CHECK_EQ(adv_payload_add_name(&p, NAME, 8), ADV_PLACED_RSP);
+    // the complete list gives way to the name
+    CHECK_EQ(adv_payload_add_uuid16(&p, all, 6, true, false), ADV_PLACED_NONE);
+    CHECK(find(&p.adv, ADV_TYPE_MANUFACTURER, &len) != NULL && len == sizeof(values));
+}
+
+int main(void) {
+    test_structure_layout();
+    test_overflow_to_scan_response();
+    test_name_placement();
+    test_firmware_layouts();
+    return CHECK_DONE();
+}
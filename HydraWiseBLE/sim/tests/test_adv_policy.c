@@ -0,0 +1,122 @@
+#include <stdint.h>
+#include "adv_policy.h"
+#include "check.h"
+
+static void test_backs_off_to_slow(void) {
+    adv_policy_t p;
+    adv_policy_init(&p, 0);
+    CHECK(!p.running);
+    CHECK_EQ(adv_policy_params(&p).duration_ms, 0);
+    CHECK_EQ(adv_policy_params(&p).itvl_min, ADV_ITVL_MS(1022.5));
+
+    adv_policy_wake(&p, ADV_WAKE_BOOT, 1000, false);
+    adv_tier_params_t t = adv_policy_params(&p);
+    CHECK_EQ(p.tier, ADV_TIER_FAST);
+    CHECK_EQ(t.itvl_min, 32); // 20 ms
+    CHECK_EQ(t.itvl_max, 48); // 30 ms
+    CHECK_EQ(t.duration_ms, ADV_FAST_WINDOW_MS);
+    CHECK_EQ(adv_policy_on_timeout(&p, 1000 + ADV_FAST_WINDOW_MS), ADV_TIER_MEDIUM);
+    CHECK_EQ(adv_policy_params(&p).duration_ms, ADV_MEDIUM_WINDOW_MS);
+    uint32_t slow_at = 1000 + ADV_FAST_WINDOW_MS + ADV_MEDIUM_WINDOW_MS;
+    CHECK_EQ(adv_policy_on_timeout(&p, slow_at), ADV_TIER_SLOW);
+    CHECK_EQ(adv_policy_params(&p).duration_ms, 0);
+    CHECK_EQ(adv_policy_on_timeout(&p, slow_at + 1), ADV_TIER_SLOW); // no tier past the last
+    CHECK_EQ(p.tier_ms[ADV_TIER_FAST], ADV_FAST_WINDOW_MS);
+    CHECK_EQ(p.tier_ms[ADV_TIER_MEDIUM], ADV_MEDIUM_WINDOW_MS);
+
+    uint32_t ttc = 0;
+    CHECK(adv_policy_on_connect(&p, slow_at + 5000, &ttc));
+    CHECK_EQ(ttc, ADV_FAST_WINDOW_MS + ADV_MEDIUM_WINDOW_MS + 5000);
+    CHECK_EQ(p.tier_ms[ADV_TIER_SLOW], 5000);
+    CHECK_EQ(p.connects_in_tier[ADV_TIER_SLOW], 1);
+    CHECK(!p.running);
+}
+
+static void test_custom_fast_window(void) {
+    adv_policy_t p;
+    adv_policy_init(&p, 5000);
+    adv_policy_wake(&p, ADV_WAKE_BOOT, 0, false);
+    CHECK_EQ(adv_policy_params(&p).duration_ms, 5000);
+}
+
+// A bonded peer that left: directed, then the accept list, then open as usual
+static void test_reconnect_tiers(void) {
+    adv_policy_t p;
+    adv_policy_init(&p, 0);
+    adv_policy_wake(&p, ADV_WAKE_DISCONNECT, 0, true);
+    CHECK_EQ(p.tier, ADV_TIER_DIRECTED);
+    CHECK_EQ(adv_policy_params(&p).duration_ms, ADV_DIRECTED_MS);
+    CHECK_EQ(adv_policy_on_timeout(&p, ADV_DIRECTED_MS), ADV_TIER_ACCEPT_LIST);
+    CHECK_EQ(adv_policy_params(&p).duration_ms, ADV_ACCEPT_LIST_WINDOW_MS);
+    CHECK_EQ(adv_policy_on_timeout(&p, ADV_DIRECTED_MS + ADV_ACCEPT_LIST_WINDOW_MS), ADV_TIER_FAST);
+    uint32_t ttc = 0;
+    CHECK(adv_policy_on_connect(&p, ADV_DIRECTED_MS + ADV_ACCEPT_LIST_WINDOW_MS + 200, &ttc));
+    CHECK_EQ(ttc, ADV_DIRECTED_MS + ADV_ACCEPT_LIST_WINDOW_MS + 200);
+    CHECK_EQ(p.connects_in_tier[ADV_TIER_FAST], 1);
+    CHECK_EQ(p.tier_ms[ADV_TIER_DIRECTED], ADV_DIRECTED_MS);
+    CHECK_EQ(p.by_reason[ADV_WAKE_DISCONNECT].connects, 1);
+    CHECK_EQ(p.by_reason[ADV_WAKE_BOOT].connects, 0);
+}
+
+// A connect in the millisecond of the wake is a run with a 0 ms time to
+// connect; a connect with no run in progress is not a run at all
+static void test_connect_outside_a_run(void) {
+    adv_policy_t p;
+    adv_policy_init(&p, 0);
+    uint32_t ttc = 12345;
+    CHECK(!adv_policy_on_connect(&p, 100, &ttc));
+    CHECK_EQ(ttc, 12345);
+    adv_policy_wake(&p, ADV_WAKE_DISCONNECT, 500, true);
+    CHECK(adv_policy_on_connect(&p, 500, &ttc));
+    CHECK_EQ(ttc, 0);
+    CHECK_EQ(p.by_reason[ADV_WAKE_DISCONNECT].connects, 1);
+    CHECK_EQ(p.connects_in_tier[ADV_TIER_DIRECTED], 1);
+    // the slot kept open while connected: a second central
+    CHECK(!adv_policy_on_connect(&p, 900, &ttc));
+    CHECK_EQ(p.by_reason[ADV_WAKE_DISCONNECT].connects, 1);
+}
+
+// A wake during a run closes the tier it was in and times from the new wake
+static void test_wake_restarts_the_run(void) {
+    adv_policy_t p;
+    adv_policy_init(&p, 0);
+    adv_policy_wake(&p, ADV_WAKE_BOOT, 0, false);
+    adv_policy_on_timeout(&p, ADV_FAST_WINDOW_MS);
+    adv_policy_wake(&p, ADV_WAKE_DISCONNECT, ADV_FAST_WINDOW_MS + 4000, false);
+    CHECK_EQ(p.tier, ADV_TIER_FAST);
+    CHECK_EQ(p.tier_ms[ADV_TIER_MEDIUM], 4000);
+    uint32_t ttc = 0;
+    CHECK(adv_policy_on_connect(&p, ADV_FAST_WINDOW_MS + 4300, &ttc));
+    CHECK_EQ(ttc, 300);
+    CHECK_EQ(p.by_reason[ADV_WAKE_DISCONNECT].ttc_max_ms, 300);
+    CHECK_EQ(p.by_reason[ADV_WAKE_BOOT].connects, 0);
+}
+
+static void test_time_to_connect_stats(void) {
+    adv_policy_t p;
+    adv_policy_init(&p, 0);
+    const uint32_t ttcs[] = { 800, 2400, 100 };
+    uint32_t now = 0, ttc;
+    for (int i = 0; i < 3; i++) {
+        adv_policy_wake(&p, ADV_WAKE_DISCONNECT, now, false);
+        now += ttcs[i];
+        CHECK(adv_policy_on_connect(&p, now, &ttc));
+        CHECK_EQ(ttc, ttcs[i]);
+        now += 60000;
+    }
+    const adv_ttc_t *t = &p.by_reason[ADV_WAKE_DISCONNECT];
+    CHECK_EQ(t->connects, 3);
+    CHECK_EQ(t->ttc_sum_ms, 3300);
+    CHECK_EQ(t->ttc_max_ms, 2400);
+    CHECK_EQ(p.tier_ms[ADV_TIER_FAST], 3300); // connected time is not advertising time
+}
+
+int main(void) {
+    test_backs_off_to_slow();
+    test_custom_fast_window();
+    test_reconnect_tiers();
+    test_connect_outside_a_run();
+    test_wake_restarts_the_run();
+    test_time_to_connect_stats();
+    return CHECK_DONE();
+}
@@ -0,0 +1,98 @@
+#include <stdint.h>
+#include "conn_policy.h"
+#include "check.h"
+
+static void test_faster_interval_satisfies(void) {
+    conn_policy_t p;
+    conn_policy_init(&p, 6, 0, 300); // 7.5 ms, faster than the streaming range
+    conn_policy_want(&p, CONN_PROFILE_STREAMING);
+    CHECK(conn_policy_satisfied(&p));
+    conn_params_t req;
+    CHECK(!conn_policy_next(&p, 0, &req));
+}
+
+// A link left fast by backfill is slowed down once idle
+static void test_idle_slows_a_fast_link(void) {
+    conn_policy_t p;
+    conn_params_t req;
+    conn_policy_init(&p, 40, 0, 300);
+    conn_policy_want(&p, CONN_PROFILE_BACKFILL);
+    CHECK(conn_policy_next(&p, 0, &req));
+    conn_policy_on_update(&p, 0, 100, 6, 0, 300); // 7.5 ms granted
+    CHECK(conn_policy_satisfied(&p));
+    conn_policy_want(&p, CONN_PROFILE_IDLE);
+    CHECK(!conn_policy_satisfied(&p));
+    CHECK(conn_policy_next(&p, 200, &req));
+    CHECK_EQ(req.itvl_min, conn_profile_params(CONN_PROFILE_IDLE)->itvl_min);
+    CHECK_EQ(req.latency, conn_profile_params(CONN_PROFILE_IDLE)->latency);
+    conn_policy_on_update(&p, 0, 300, 120, 4, 600); // 150 ms
+    CHECK(conn_policy_satisfied(&p));
+    CHECK_EQ(p.granted, 2);
+}
+
+static void test_slow_interval_latency_or_timeout_request(void) {
+    conn_policy_t p;
+    conn_params_t req;
+    conn_policy_init(&p, 40, 0, 300); // 50 ms
+    conn_policy_want(&p, CONN_PROFILE_STREAMING);
+    CHECK(!conn_policy_satisfied(&p));
+    CHECK(conn_policy_next(&p, 0, &req));
+    CHECK_EQ(req.itvl_min, conn_profile_params(CONN_PROFILE_STREAMING)->itvl_min);
+    CHECK_EQ(req.itvl_max, conn_profile_params(CONN_PROFILE_STREAMING)->itvl_max);
+    CHECK(!conn_policy_next(&p, 0, &req)); // pending
+
+    conn_policy_init(&p, 12, 4, 300); // fast, but skips events
+    conn_policy_want(&p, CONN_PROFILE_STREAMING);
+    CHECK(!conn_policy_satisfied(&p));
+
+    conn_policy_init(&p, 12, 0, 2000); // fast, but a lost link takes 20 s to notice
+    conn_policy_want(&p, CONN_PROFILE_STREAMING);
+    CHECK(!conn_policy_satisfied(&p));
+}
+
+static void test_grant_and_rejection_backoff(void) {
+    conn_policy_t p;
+    conn_params_t req;
+    conn_policy_init(&p, 200, 0, 300); // 250 ms, outside even the widest range
+    conn_policy_want(&p, CONN_PROFILE_STREAMING);
+    CHECK(conn_policy_next(&p, 0, &req));
+    conn_policy_on_update(&p, 0x3b, 10, 0, 0, 0); // rejected
+    CHECK_EQ(p.rejected, 1);
+    CHECK(!conn_policy_next(&p, 500, &req));      // backing off
+    uint32_t at;
+    CHECK(conn_policy_retry_time(&p, &at));
+    CHECK_EQ(at, (10 + CONN_POLICY_BACKOFF_MS * 2) | 1);
+    CHECK(conn_policy_next(&p, at, &req));
+    CHECK_EQ(req.itvl_max, 2 * conn_profile_params(CONN_PROFILE_STREAMING)->itvl_max); // widened
+    conn_policy_on_update(&p, 0, at + 100, 9, 0, 300); // the central went faster still
+    CHECK(conn_policy_satisfied(&p));
+    CHECK_EQ(p.granted, 1);
+    CHECK_EQ(p.rejects, 0);
+    CHECK(!conn_policy_retry_time(&p, &at));
+}
+
+static void test_central_moves_on_its_own(void) {
+    conn_policy_t p;
+    conn_params_t req;
+    conn_policy_init(&p, 12, 0, 300);
+    conn_policy_want(&p, CONN_PROFILE_STREAMING);
+    CHECK(conn_policy_satisfied(&p));
+    conn_policy_on_update(&p, 0, 1000, 6, 0, 300); // faster: fine
+    CHECK(!conn_policy_next(&p, 1000, &req));
+    conn_policy_on_update(&p, 0, 2000, 80, 0, 300); // slower: wait before asking back
+    CHECK_EQ(p.rejected, 0);
+    CHECK(!conn_policy_next(&p, 2000, &req));
+    uint32_t at;
+    CHECK(conn_policy_retry_time(&p, &at));
+    CHECK_EQ(at, (2000 + CONN_POLICY_BACKOFF_MS) | 1);
+    CHECK(conn_policy_next(&p, at, &req));
+}
+
+int main(void) {
+    test_faster_interval_satisfies();
+    test_idle_slows_a_fast_link();
+    test_slow_interval_latency_or_timeout_request();
+    test_grant_and_rejection_backoff();
+    test_central_moves_on_its_own();
+    return CHECK_DONE();
+}
@@ -0,0 +1,128 @@
+#include <stdint.h>
+#include <string.h>
+#include "ctrl_proto.h"
+#include "check.h"
+
+// A write split into segments of seg_len bytes, like an mbuf chain; counts
+// the segments handed out, which with 1-byte segments are the bytes read
+typedef struct {
+    const uint8_t *data;
+    uint16_t len;
+    uint16_t seg_len;
+    uint16_t off;
+    uint32_t reads;
+} split_src_t;
+
+static bool split_next(void *ctx, const uint8_t **data, uint16_t *len) {
+    split_src_t *s = ctx;
+    if (s->off >= s->len) {
+        return false;
+    }
+    *data = s->data + s->off;
+    *len = s->len - s->off < s->seg_len ? s->len - s->off : s->seg_len;
+    s->off += *len;
+    s->reads += *len;
+    return true;
+}
+
+static void split_rewind(void *ctx) {
+    ((split_src_t *)ctx)->off = 0;
+}
+
+typedef struct {
+    ctrl_cmd_t cmds[8];
+    int n;
+} got_t;
+
+static void collect(const ctrl_cmd_t *cmd, void *arg) {
+    got_t *g = arg;
+    if (g->n < 8) {
+        g->cmds[g->n++] = *cmd;
+    }
+}
+
+static ctrl_status_t parse(const void *data, uint16_t len, uint16_t seg_len, got_t *g,
+    ctrl_result_t *res, uint32_t *reads) {
+    split_src_t s = { .data = data, .len = len, .seg_len = seg_len };
+    ctrl_src_t src = { .next = split_next, .rewind = split_rewind, .ctx = &s };
+    memset(g, 0, sizeof(*g));
+    ctrl_status_t st = ctrl_parse(&src, collect, g, res);
+    if (reads != NULL) {
+        *reads = s.reads;
+    }
+    return st;
+}
+
+static void test_records_across_segments(void) {
+    const uint8_t w[] = {
+        CTRL_OP_SET_RATE, 3, 1, 0xe8, 0x03,    // channel 1 every 1000 ms
+        0x7f, 2, 0xaa, 0xbb,                   // unknown, skipped
+        CTRL_OP_BACKFILL, 4, 0x10, 0x27, 0, 0, // since 10000 ms
+        CTRL_OP_START, 0,
+    };
+    for (uint16_t seg = 1; seg <= sizeof(w); seg++) {
+        got_t g;
+        ctrl_result_t res;
+        CHECK_EQ(parse(w, sizeof(w), seg, &g, &res, NULL), CTRL_OK);
+        CHECK_EQ(res.commands, 3);
+        CHECK_EQ(res.unknown, 1);
+        CHECK_EQ(g.cmds[0].op, CTRL_OP_SET_RATE);
+        CHECK_EQ(g.cmds[0].channel, 1);
+        CHECK_EQ(g.cmds[0].period_ms, 1000);
+        CHECK_EQ(g.cmds[1].since_ms, 10000);
+        CHECK_EQ(g.cmds[2].channels, CTRL_ALL_CHANNELS);
+    }
+}
+
+static void test_rejects_before_applying(void) {
+    got_t g;
+    const uint8_t bad_len[] = { CTRL_OP_START, 0, CTRL_OP_SET_BATCH, 3, 1, 2, 3 };
+    CHECK_EQ(parse(bad_len, sizeof(bad_len), 2, &g, NULL, NULL), CTRL_ERR_BAD_VALUE);
+    CHECK_EQ(g.n, 0);
+    const uint8_t truncated[] = { CTRL_OP_STOP, 0, CTRL_OP_BENCH, 3, 0, 10 };
+    CHECK_EQ(parse(truncated, sizeof(truncated), 1, &g, NULL, NULL), CTRL_ERR_TRUNCATED);
+    CHECK_EQ(g.n, 0);
+    CHECK_EQ(parse(truncated, 0, 1, &g, NULL, NULL), CTRL_ERR_EMPTY);
+}
+
+static void test_legacy_ascii(void) {
+    got_t g;
+    CHECK_EQ(parse("START", 5, 2, &g, NULL, NULL), CTRL_OK);
+    CHECK_EQ(g.n, 1);
+    CHECK_EQ(g.cmds[0].op, CTRL_OP_START);
+    CHECK_EQ(parse("STOP", 4, 1, &g, NULL, NULL), CTRL_OK);
+    CHECK_EQ(g.cmds[0].op, CTRL_OP_STOP);
+    CHECK_EQ(g.cmds[0].channels, CTRL_ALL_CHANNELS);
+    // not a keyword: parsed as records, 'S' an unknown opcode with 'T' bytes
+    CHECK_EQ(parse("STARTX", 6, 1, &g, NULL, NULL), CTRL_ERR_TRUNCATED);
+    CHECK_EQ(parse("STO", 3, 1, &g, NULL, NULL), CTRL_ERR_TRUNCATED);
+    CHECK_EQ(g.n, 0);
+}
+
+// The header's claim: a binary write costs one read of its first byte for the
+// keyword check, then two per byte (validate, apply)
+static void test_reads_per_byte(void) {
+    uint8_t w[60];
+    const uint8_t rec[] = { CTRL_OP_SET_BATCH, 2, 1, 8 }; // 8 samples per frame on channel 1
+    uint16_t len = 0;
+    while (len + sizeof(rec) <= sizeof(w)) {
+        memcpy(w + len, rec, sizeof(rec));
+        len += sizeof(rec);
+    }
+    got_t g;
+    uint32_t reads;
+    CHECK_EQ(parse(w, len, 1, &g, NULL, &reads), CTRL_OK);
+    CHECK_EQ(reads, 1 + 2 * len);
+    // a keyword lookalike reads as far as it matches, still never more than three times
+    const uint8_t s[] = { 'S', 2, 'T', 'A' };
+    CHECK_EQ(parse(s, sizeof(s), 1, &g, NULL, &reads), CTRL_OK);
+    CHECK(reads <= 3 * sizeof(s));
+}
+
+int main(void) {
+    test_records_across_segments();
+    test_rejects_before_applying();
+    test_legacy_ascii();
+    test_reads_per_byte();
+    return CHECK_DONE();
+}
@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "adc_acq.h"
+#include "decimator.h"
+#include "check.h"
+
+typedef struct {
+    uint32_t blocks;
+    uint16_t last[DECIM_BLOCK_MAX];
+    uint16_t last_n;
+    uint64_t sum;
+} sink_t;
+
+static void sink_block(const uint16_t *samples, uint16_t n, void *arg) {
+    sink_t *s = arg;
+    s->blocks++;
+    memcpy(s->last, samples, n * sizeof(samples[0]));
+    s->last_n = n;
+    for (uint16_t i = 0; i < n; i++) {
+        s->sum += samples[i];
+    }
+}
+
+static void test_mean_rounds_to_nearest(void) {
+    decim_t d;
+    sink_t s = { 0 };
+    decim_init(&d, 4, 2, sink_block, &s);
+    const uint16_t raw[] = { 1, 2, 3, 4, 0, 0, 0, 1 };
+    decim_feed(&d, raw, 8);
+    CHECK_EQ(s.blocks, 1);
+    CHECK_EQ(s.last_n, 2);
+    CHECK_EQ(s.last[0], 3); // 10 / 4 = 2.5 rounds up
+    CHECK_EQ(s.last[1], 0); // 1 / 4 rounds down
+    CHECK_EQ(d.outputs, 2);
+}
+
+static void test_groups_span_feeds(void) {
+    decim_t d;
+    sink_t s = { 0 };
+    decim_init(&d, 1000, 5, sink_block, &s);
+    uint16_t raw[37];
+    for (int i = 0; i < 37; i++) {
+        raw[i] = 2000;
+    }
+    // odd DMA frame sizes: groups and blocks straddle the feeds
+    uint32_t fed = 0;
+    while (fed + 37 <= 20000) {
+        decim_feed(&d, raw, 37);
+        fed += 37;
+    }
+    CHECK_EQ(d.outputs, fed / 1000);
+    CHECK_EQ(s.blocks, fed / 5000);
+    CHECK_EQ(d.acc_n, fed % 1000);
+    CHECK_EQ(s.sum, (uint64_t)s.blocks * 5 * 2000);
+}
+
+static void test_reset_drops_partial(void) {
+    decim_t d;
+    sink_t s = { 0 };
+    decim_init(&d, 2, 2, sink_block, &s);
+    const uint16_t high[] = { 100, 100, 100 };
+    decim_feed(&d, high, 3); // one output and half a group
+    decim_reset(&d);
+    const uint16_t low[] = { 10, 10, 10, 10 };
+    decim_feed(&d, low, 4);
+    CHECK_EQ(s.blocks, 1);
+    CHECK_EQ(s.last[0], 10);
+    CHECK_EQ(s.last[1], 10);
+}
+
+static void test_block_len_limits(void) {
+    decim_t d;
+    decim_init(&d, 0, 0, NULL, NULL);
+    CHECK_EQ(d.factor, 1);
+    CHECK_EQ(d.block_len, DECIM_BLOCK_MAX);
+    decim_init(&d, 1, DECIM_BLOCK_MAX + 1, NULL, NULL);
+    CHECK_EQ(d.block_len, DECIM_BLOCK_MAX);
+    const uint16_t raw[DECIM_BLOCK_MAX] = { 0 };
+    decim_feed(&d, raw, DECIM_BLOCK_MAX); // no callback: blocks are still counted
+    CHECK_EQ(d.blocks, 1);
+}
+
+// Synthetic electrode feed at the firmware's rates: a slow ramp with
+// conversion noise of ±4 counts; the means follow the ramp.
+static uint16_t synth_reading(uint32_t i, uint32_t *rng) {
+    *rng = *rng * 1664525u + 1013904223u;
+    return (uint16_t)(1000 + i / ADC_ACQ_INPUT_HZ + (int)(*rng >> 29) - 4);
+}
+
+static void test_synthetic_feed(void) {
+    decim_t d;
+    sink_t s = { 0 };
+    decim_init(&d, ADC_ACQ_INPUT_HZ / ADC_ACQ_OUTPUT_HZ, ADC_ACQ_BLOCK_LEN, sink_block, &s);
+    uint32_t rng = 1;
+    uint16_t frame[ADC_ACQ_FRAME_BYTES / 4]; // one input's share of a DMA frame
+    uint32_t n = 0;
+    for (int f = 0; f < 10 * ADC_ACQ_INPUT_HZ / 256; f++) {
+        for (int i = 0; i < 256; i++) {
+            frame[i] = synth_reading(n++, &rng);
+        }
+        decim_feed(&d, frame, 256);
+    }
+    CHECK_EQ(d.outputs, n / (ADC_ACQ_INPUT_HZ / ADC_ACQ_OUTPUT_HZ));
+    CHECK_EQ(s.blocks, d.outputs / ADC_ACQ_BLOCK_LEN);
+    // the last block covers the 10th second of the ramp
+    for (uint16_t i = 0; i < s.last_n; i++) {
+        CHECK(s.last[i] >= 1008 && s.last[i] <= 1010);
+    }
+}
+
+// Host cost of decimating one minute of the electrode input, per output sample.
+// Not checked: it is the number to compare before flashing.
+static void bench_decimate(void) {
+    static uint16_t raw[ADC_ACQ_INPUT_HZ];
+    uint32_t rng = 1;
+    for (uint32_t i = 0; i < ADC_ACQ_INPUT_HZ; i++) {
+        raw[i] = synth_reading(i, &rng);
+    }
+    decim_t d;
+    sink_t s = { 0 };
+    decim_init(&d, ADC_ACQ_INPUT_HZ / ADC_ACQ_OUTPUT_HZ, ADC_ACQ_BLOCK_LEN, sink_block, &s);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int sec = 0; sec < 60; sec++) {
+        for (uint32_t i = 0; i < ADC_ACQ_INPUT_HZ; i += 256) {
+            decim_feed(&d, raw + i, ADC_ACQ_INPUT_HZ - i < 256 ? ADC_ACQ_INPUT_HZ - i : 256);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    printf("decimator: %lu outputs in %lu blocks, %.0f ns per output sample, %.2f ns per reading on this host\n",
+        (unsigned long)d.outputs, (unsigned long)s.blocks, ns / d.outputs, ns / (60.0 * ADC_ACQ_INPUT_HZ));
+    CHECK_EQ(d.outputs, 60 * ADC_ACQ_OUTPUT_HZ);
+}
+
+int main(void) {
+    test_mean_rounds_to_nearest();
+    test_groups_span_feeds();
+    test_reset_drops_partial();
+    test_block_len_limits();
+    test_synthetic_feed();
+    bench_decimate();
+    return CHECK_DONE();
+}
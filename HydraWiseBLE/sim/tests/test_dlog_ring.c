@@ -0,0 +1,88 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "dlog_ring.h"
+#include "check.h"
+
+#define CAP 8
+
+static dlog_slot_t slots[CAP];
+
+static dlog_rec_t rec(uint32_t i) {
+    return (dlog_rec_t){ .ts_us = i, .id = (uint16_t)(i % 7), .nargs = 2, .args = { i, ~i } };
+}
+
+static void test_fifo_across_wrap(void) {
+    dlog_ring_t r;
+    dlog_ring_init(&r, slots, CAP);
+    uint32_t in = 0, out = 0;
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < 5; i++) {
+            dlog_rec_t x = rec(in++);
+            CHECK(dlog_ring_put(&r, &x));
+        }
+        dlog_rec_t y;
+        while (dlog_ring_take(&r, &y)) {
+            CHECK_EQ(y.ts_us, out);
+            CHECK_EQ(y.args[1], ~out);
+            out++;
+        }
+    }
+    CHECK_EQ(out, in);
+    CHECK_EQ(r.dropped, 0);
+}
+
+static void test_full_ring_drops_and_counts(void) {
+    dlog_ring_t r;
+    dlog_ring_init(&r, slots, CAP);
+    for (uint32_t i = 0; i < CAP + 3; i++) {
+        dlog_rec_t x = rec(i);
+        CHECK_EQ(dlog_ring_put(&r, &x), i < CAP);
+    }
+    CHECK_EQ(r.dropped, 3);
+    dlog_rec_t y;
+    CHECK(dlog_ring_take(&r, &y));
+    CHECK_EQ(y.ts_us, 0);
+    dlog_rec_t x = rec(100);
+    CHECK(dlog_ring_put(&r, &x)); // room again
+}
+
+static double now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+// What DLOG() costs the caller against formatting the line there, as
+// DLOG_DIRECT 1 does before the UART write. Not checked: it is the number to
+// compare before flashing.
+static void bench_put_against_format(void) {
+    const int n = 1000000;
+    dlog_ring_t r;
+    dlog_ring_init(&r, slots, CAP);
+    dlog_rec_t x = rec(1), y;
+    double t0 = now_ns();
+    for (int i = 0; i < n; i++) {
+        x.args[0] = i;
+        dlog_ring_put(&r, &x);
+        dlog_ring_take(&r, &y); // the drain task's share, off the caller's path on the device
+    }
+    double t1 = now_ns();
+    static volatile int sink;
+    char line[128];
+    for (int i = 0; i < n; i++) {
+        sink += snprintf(line, sizeof(line), "I (%lu) dlog: (%lu us, core %u) Characteristic %u notification sent: seq %u, %u samples, %u peers",
+            (unsigned long)i, (unsigned long)i * 1000, 0u, 1u, (unsigned)i, 8u, 2u);
+    }
+    double t2 = now_ns();
+    printf("dlog: %.1f ns per record put and taken, %.1f ns per line formatted on this host; "
+        "a %d byte line then takes %.1f ms at 115200 baud\n",
+        (t1 - t0) / n, (t2 - t1) / n, (int)sink / n, sink / n * 10 / 115.2);
+}
+
+int main(void) {
+    test_fifo_across_wrap();
+    test_full_ring_drops_and_counts();
+    bench_put_against_format();
+    return CHECK_DONE();
+}
@@ -0,0 +1,78 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "flow_ctl.h"
+#include "check.h"
+
+static void send_n(flow_ctl_t *f, int n) {
+    for (int i = 0; i < n; i++) {
+        CHECK(flow_can_send(f));
+        flow_on_sent(f);
+    }
+}
+
+static void test_window_closes_until_release(void) {
+    flow_ctl_t f;
+    flow_init(&f, 1, 8, 2);
+    send_n(&f, 2);
+    CHECK(!flow_can_send(&f));
+    CHECK_EQ(f.window_full, 1);
+    CHECK(flow_on_released(&f)); // the refused sender is woken
+    CHECK(flow_can_send(&f));
+    CHECK(!flow_on_released(&f)); // nobody waiting
+    CHECK_EQ(f.in_flight, 0);
+}
+
+static void test_grows_per_window_of_releases(void) {
+    flow_ctl_t f;
+    flow_init(&f, 1, 4, 2);
+    for (int round = 0; round < 10; round++) {
+        send_n(&f, f.window);
+        uint8_t w = f.window;
+        for (int i = 0; i < w; i++) {
+            flow_on_released(&f);
+        }
+    }
+    CHECK_EQ(f.window, 4);
+    CHECK_EQ(f.completed, f.sent);
+}
+
+static void test_congestion_halves_to_min(void) {
+    flow_ctl_t f;
+    flow_init(&f, 2, 8, 8);
+    send_n(&f, 8);
+    flow_on_congestion(&f);
+    CHECK_EQ(f.window, 4);
+    flow_on_congestion(&f);
+    flow_on_congestion(&f);
+    CHECK_EQ(f.window, 2);
+    CHECK_EQ(f.failed, 3);
+    CHECK(!flow_can_send(&f)); // 8 still queued
+    // the queued ones still complete and the window grows back from 2
+    bool woken = false;
+    for (int i = 0; i < 8; i++) {
+        woken |= flow_on_released(&f);
+    }
+    CHECK(woken);
+    CHECK_EQ(f.in_flight, 0);
+    CHECK(f.window > 2 && f.window < 8);
+}
+
+static void test_reset_keeps_counters(void) {
+    flow_ctl_t f;
+    flow_init(&f, 1, 8, 3);
+    send_n(&f, 3);
+    flow_on_congestion(&f);
+    flow_reset(&f);
+    CHECK_EQ(f.window, 3);
+    CHECK_EQ(f.in_flight, 0);
+    CHECK_EQ(f.sent, 3);
+    CHECK_EQ(f.failed, 1);
+}
+
+int main(void) {
+    test_window_closes_until_release();
+    test_grows_per_window_of_releases();
+    test_congestion_halves_to_min();
+    test_reset_keeps_counters();
+    return CHECK_DONE();
+}
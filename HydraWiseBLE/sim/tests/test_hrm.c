@@ -0,0 +1,84 @@
+#include <stdint.h>
+#include <string.h>
+#include "hrm.h"
+#include "check.h"
+
+static uint16_t le16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static void test_uint8_rate(void) {
+    hrm_meas_t m = { .bpm = 72, .contact_supported = true, .contact = true };
+    uint8_t f[8];
+    uint8_t used = 99;
+    CHECK_EQ(hrm_encode(&m, f, sizeof(f), &used), HRM_MIN_LEN);
+    CHECK_EQ(f[0], HRM_FLAG_CONTACT_SUPPORTED | HRM_FLAG_CONTACT_DETECTED);
+    CHECK_EQ(f[1], 72);
+    CHECK_EQ(used, 0);
+    m.contact = false;
+    hrm_encode(&m, f, sizeof(f), NULL);
+    CHECK_EQ(f[0], HRM_FLAG_CONTACT_SUPPORTED);
+}
+
+// Above 255 bpm the rate takes two bytes and flags bit 0
+static void test_uint16_rate(void) {
+    hrm_meas_t m = { .bpm = 300 };
+    uint8_t f[8];
+    CHECK_EQ(hrm_encode(&m, f, sizeof(f), NULL), 3);
+    CHECK_EQ(f[0], HRM_FLAG_HR_UINT16);
+    CHECK_EQ(le16(&f[1]), 300);
+    m.bpm = 255;
+    CHECK_EQ(hrm_encode(&m, f, sizeof(f), NULL), 2);
+    CHECK_EQ(f[0], 0);
+}
+
+// Energy follows the rate and goes in ahead of any RR interval
+static void test_energy(void) {
+    const uint16_t rr[] = { 1000 };
+    hrm_meas_t m = { .bpm = 300, .has_energy = true, .energy_kj = 1234, .rr_ms = rr, .rr_count = 1 };
+    uint8_t f[8];
+    uint8_t used = 0;
+    CHECK_EQ(hrm_encode(&m, f, sizeof(f), &used), 7);
+    CHECK_EQ(f[0], HRM_FLAG_HR_UINT16 | HRM_FLAG_ENERGY | HRM_FLAG_RR);
+    CHECK_EQ(le16(&f[3]), 1234);
+    CHECK_EQ(le16(&f[5]), 1024);
+    CHECK_EQ(used, 1);
+    // room for the energy only
+    CHECK_EQ(hrm_encode(&m, f, 5, &used), 5);
+    CHECK_EQ(f[0], HRM_FLAG_HR_UINT16 | HRM_FLAG_ENERGY);
+    CHECK_EQ(used, 0);
+    // nor for that: left out with its flag
+    m.bpm = 72;
+    CHECK_EQ(hrm_encode(&m, f, 3, &used), 2);
+    CHECK_EQ(f[0], 0);
+}
+
+// RR intervals in 1/1024 s, oldest first, as many as max_len holds
+static void test_rr_truncated(void) {
+    const uint16_t rr[] = { 1000, 800, 600, 500, 65000 };
+    hrm_meas_t m = { .bpm = 72, .rr_ms = rr, .rr_count = 5 };
+    uint8_t f[16];
+    uint8_t used = 0;
+    CHECK_EQ(hrm_encode(&m, f, 8, &used), 8);
+    CHECK_EQ(used, 3);
+    CHECK_EQ(f[0], HRM_FLAG_RR);
+    CHECK_EQ(le16(&f[2]), 1024);
+    CHECK_EQ(le16(&f[4]), 819);
+    CHECK_EQ(le16(&f[6]), 614);
+    CHECK_EQ(hrm_encode(&m, f, 7, &used), 6); // an odd byte left over stays unused
+    CHECK_EQ(used, 2);
+    CHECK_EQ(hrm_encode(&m, f, 3, &used), 2);
+    CHECK_EQ(used, 0);
+    CHECK_EQ(f[0], 0); // no interval, no flag
+    CHECK_EQ(hrm_encode(&m, f, sizeof(f), &used), 12);
+    CHECK_EQ(used, 5);
+    CHECK_EQ(le16(&f[10]), UINT16_MAX); // saturates
+}
+
+int main(void) {
+    test_uint8_rate();
+    test_uint16_rate();
+    test_energy();
+    test_rr_truncated();
+    return CHECK_DONE();
+}
@@ -0,0 +1,124 @@
+#include <stdint.h>
+#include "pm_acct.h"
+#include "check.h"
+
+static pm_acct_t a;
+static int adc, radio, dsp;
+
+static void fresh(uint64_t now) {
+    pm_acct_init(&a, now);
+    adc = pm_acct_add(&a, "adc", PM_ACCT_APB);
+    radio = pm_acct_add(&a, "radio", PM_ACCT_MAX);
+    dsp = pm_acct_add(&a, "dsp", PM_ACCT_MAX);
+}
+
+// Time goes to the highest level held, each lock to its own holds
+static void test_levels_and_holds(void) {
+    fresh(1000);
+    pm_acct_acquire(&a, adc, 2000);     // APB from 2000
+    pm_acct_acquire(&a, radio, 3000);   // MAX from 3000
+    pm_acct_release(&a, radio, 3500);   // back to APB
+    pm_acct_release(&a, adc, 6000);     // MIN from 6000
+    pm_acct_report_t r;
+    pm_acct_report(&a, 10000, &r);
+    CHECK_EQ(r.total_us, 9000);
+    CHECK_EQ(r.level_us[PM_ACCT_MAX], 500);
+    CHECK_EQ(r.level_us[PM_ACCT_APB], 3500);
+    CHECK_EQ(r.level_us[PM_ACCT_MIN], 5000);
+    CHECK_EQ(pm_acct_held_us(&a, adc, 10000), 4000);
+    CHECK_EQ(pm_acct_held_us(&a, radio, 10000), 500);
+    CHECK_EQ(a.locks[adc].acquires, 1);
+}
+
+// Two locks at one level: the level holds until the last goes
+static void test_overlapping_locks(void) {
+    fresh(0);
+    pm_acct_acquire(&a, radio, 100);
+    pm_acct_acquire(&a, dsp, 200);
+    pm_acct_release(&a, radio, 300);
+    CHECK_EQ(a.level, PM_ACCT_MAX);
+    pm_acct_release(&a, dsp, 700);
+    CHECK_EQ(a.level, PM_ACCT_MIN);
+    pm_acct_report_t r;
+    pm_acct_report(&a, 1000, &r);
+    CHECK_EQ(r.level_us[PM_ACCT_MAX], 600);
+    CHECK_EQ(r.level_us[PM_ACCT_MIN], 400);
+}
+
+// Counted like esp_pm locks: one hold until the last release, and a release
+// too many is counted, not charged
+static void test_recursive_and_unbalanced(void) {
+    fresh(0);
+    pm_acct_acquire(&a, radio, 100);
+    pm_acct_acquire(&a, radio, 200);
+    pm_acct_release(&a, radio, 300);
+    CHECK_EQ(a.level, PM_ACCT_MAX);
+    pm_acct_release(&a, radio, 400);
+    CHECK_EQ(a.level, PM_ACCT_MIN);
+    CHECK_EQ(a.locks[radio].acquires, 1);
+    CHECK_EQ(pm_acct_held_us(&a, radio, 1000), 300);
+    pm_acct_release(&a, radio, 500);
+    CHECK_EQ(a.unbalanced, 1);
+    CHECK_EQ(a.held[PM_ACCT_MAX], 0);
+    CHECK_EQ(pm_acct_held_us(&a, radio, 1000), 300);
+}
+
+// Light sleep comes out of the MIN time, never more than there is of it
+static void test_sleep_out_of_min(void) {
+    fresh(0);
+    pm_acct_acquire(&a, adc, 0);
+    pm_acct_release(&a, adc, 2000);
+    pm_acct_slept(&a, 5000, 3);
+    pm_acct_report_t r;
+    pm_acct_report(&a, 10000, &r);
+    CHECK_EQ(r.slept_us, 5000);
+    CHECK_EQ(r.sleeps, 3);
+    CHECK_EQ(r.level_us[PM_ACCT_MIN], 3000);
+    CHECK_EQ(r.level_us[PM_ACCT_APB], 2000);
+    // reported ahead of the MIN time that covers it
+    pm_acct_slept(&a, 5000, 1);
+    pm_acct_report(&a, 10000, &r);
+    CHECK_EQ(r.slept_us, 8000);
+    CHECK_EQ(r.level_us[PM_ACCT_MIN], 0);
+}
+
+// A lock held across a restart is charged to the new period from the restart
+static void test_restart_with_open_hold(void) {
+    fresh(0);
+    pm_acct_acquire(&a, adc, 1000);
+    pm_acct_release(&a, radio, 1500);
+    pm_acct_slept(&a, 500, 1);
+    pm_acct_restart(&a, 4000);
+    CHECK_EQ(a.unbalanced, 0);
+    CHECK_EQ(a.locks[adc].acquires, 1);
+    CHECK_EQ(a.locks[radio].acquires, 0);
+    pm_acct_report_t r;
+    pm_acct_report(&a, 5000, &r);
+    CHECK_EQ(r.total_us, 1000);
+    CHECK_EQ(r.level_us[PM_ACCT_APB], 1000);
+    CHECK_EQ(r.level_us[PM_ACCT_MIN], 0);
+    CHECK_EQ(r.slept_us, 0);
+    CHECK_EQ(pm_acct_held_us(&a, adc, 5000), 1000);
+    pm_acct_release(&a, adc, 6000);
+    CHECK_EQ(pm_acct_held_us(&a, adc, 9000), 2000);
+}
+
+static void test_table_full(void) {
+    fresh(0);
+    while (a.count < PM_ACCT_MAX_LOCKS) {
+        CHECK(pm_acct_add(&a, "extra", PM_ACCT_MIN) >= 0);
+    }
+    CHECK_EQ(pm_acct_add(&a, "one too many", PM_ACCT_MAX), -1);
+    fresh(0);
+    CHECK_EQ(pm_acct_add(&a, "bad level", PM_ACCT_LEVELS), -1);
+}
+
+int main(void) {
+    test_levels_and_holds();
+    test_overlapping_locks();
+    test_recursive_and_unbalanced();
+    test_sleep_out_of_min();
+    test_restart_with_open_hold();
+    test_table_full();
+    return CHECK_DONE();
+}
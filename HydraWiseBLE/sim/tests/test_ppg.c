@@ -0,0 +1,201 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ppg.h"
+#include "check.h"
+
+/*
+Accuracy against annotated synthetic recordings: beats with heart rate
+variability, a pulse with its dicrotic notch, breathing wander and
+conversion noise, as the photodiode sees it (falling on each pulse). The
+annotation of each beat is the time of its systolic peak.
+*/
+
+#define REC_S 120
+#define BEATS_MAX 400
+#define MATCH_MS 150 // a detection this close to an annotated peak is that beat
+
+typedef struct {
+    uint16_t fs;
+    uint32_t n;
+    uint16_t *raw;
+    uint32_t peaks_ms[BEATS_MAX];
+    uint32_t beats;
+    double mean_bpm;
+} recording_t;
+
+static uint32_t rng = 12345;
+
+static double noise(void) {
+    rng = rng * 1664525u + 1013904223u;
+    return (double)(rng >> 8) / (1u << 24) - 0.5;
+}
+
+// bpm: mean rate, hrv: relative swing of the RR intervals, noise_counts: peak to peak
+static void record(recording_t *r, uint16_t fs, double bpm, double hrv, double noise_counts) {
+    r->fs = fs;
+    r->n = (uint32_t)fs * REC_S;
+    r->raw = malloc(r->n * sizeof(r->raw[0]));
+    r->beats = 0;
+    double start = 0, rr = 60.0 / bpm;
+    uint32_t k = 0;
+    r->peaks_ms[r->beats++] = (uint32_t)(0.2 * rr * 1000 + 0.5);
+    for (uint32_t i = 0; i < r->n; i++) {
+        double t = (double)i / fs;
+        while (t >= start + rr) {
+            start += rr;
+            k++;
+            rr = 60.0 / bpm * (1 + hrv * sin(k * 0.45) + hrv / 3 * noise());
+            if (r->beats < BEATS_MAX && start + 0.2 * rr < REC_S) {
+                r->peaks_ms[r->beats++] = (uint32_t)((start + 0.2 * rr) * 1000 + 0.5);
+            }
+        }
+        double f = (t - start) / rr;
+        double pulse = exp(-pow((f - 0.2) / 0.06, 2)) + 0.4 * exp(-pow((f - 0.5) / 0.08, 2));
+        r->raw[i] = (uint16_t)(2000 + 50 * sin(t * 0.2 * 2 * M_PI) - 100 * pulse + noise_counts * noise());
+    }
+    r->mean_bpm = 60000.0 * (r->beats - 1) / (r->peaks_ms[r->beats - 1] - r->peaks_ms[0]);
+}
+
+typedef struct {
+    uint32_t detected;
+    uint32_t true_pos;
+    uint32_t annotated; // after the pipeline settled
+    double rr_err_sum;
+    uint32_t rr_n;
+    uint16_t bpm;
+} score_t;
+
+static bool match(const recording_t *r, uint32_t ms, uint32_t *beat) {
+    for (uint32_t b = 0; b < r->beats; b++) {
+        if (abs((int32_t)(r->peaks_ms[b] - ms)) <= MATCH_MS) {
+            *beat = b;
+            return true;
+        }
+    }
+    return false;
+}
+
+static score_t run(const recording_t *r) {
+    score_t s = { 0 };
+    ppg_t p;
+    ppg_init(&p, r->fs, true);
+    uint32_t first_ms = 0;
+    uint32_t prev_beat = 0;
+    bool prev_valid = false;
+    for (uint32_t i = 0; i < r->n; i++) {
+        if (!ppg_feed(&p, r->raw[i])) {
+            continue;
+        }
+        uint16_t rr = 0, taken;
+        while (ppg_take_rr(&p, &taken, 1) == 1) {
+            rr = taken;
+        }
+        // the beat completes a little after its peak (moving average, local maximum)
+        uint32_t ms = (uint32_t)((uint64_t)i * 1000 / r->fs);
+        uint32_t beat;
+        s.detected++;
+        bool hit = false;
+        for (uint32_t lag = 0; lag <= 100 && !hit; lag += 10) {
+            hit = match(r, ms - lag, &beat);
+        }
+        if (!hit) {
+            prev_valid = false;
+            continue;
+        }
+        if (s.true_pos == 0) {
+            first_ms = r->peaks_ms[beat];
+        }
+        s.true_pos++;
+        if (prev_valid && beat == prev_beat + 1 && rr != 0) {
+            double ref = r->peaks_ms[beat] - r->peaks_ms[prev_beat];
+            s.rr_err_sum += fabs((double)rr - ref);
+            s.rr_n++;
+        }
+        prev_beat = beat;
+        prev_valid = true;
+    }
+    for (uint32_t b = 0; b < r->beats; b++) {
+        s.annotated += r->peaks_ms[b] >= first_ms;
+    }
+    s.bpm = ppg_bpm(&p);
+    return s;
+}
+
+static void check_accuracy(uint16_t fs, double bpm, double hrv, double noise_counts) {
+    recording_t r;
+    record(&r, fs, bpm, hrv, noise_counts);
+    score_t s = run(&r);
+    double sens = 100.0 * s.true_pos / s.annotated;
+    double ppv = 100.0 * s.true_pos / s.detected;
+    double rr_err = s.rr_n ? s.rr_err_sum / s.rr_n : 1e9;
+    printf("ppg %3u Hz %3.0f bpm hrv %2.0f%% noise %2.0f: %lu beats, sensitivity %.1f%%, "
+        "predictivity %.1f%%, RR error %.1f ms, bpm %u (true %.1f)\n",
+        fs, bpm, hrv * 100, noise_counts, (unsigned long)r.beats, sens, ppv, rr_err, s.bpm, r.mean_bpm);
+    CHECK(sens >= 95);
+    CHECK(ppv >= 95);
+    CHECK(rr_err <= 2 * 1000.0 / fs + 8);
+    CHECK(fabs(s.bpm - r.mean_bpm) <= 0.1 * r.mean_bpm); // the last 8 beats against the whole run
+    free(r.raw);
+}
+
+static void test_flat_input_has_no_beats(void) {
+    ppg_t p;
+    ppg_init(&p, 200, true);
+    bool beat = false;
+    for (int i = 0; i < 200 * 20; i++) {
+        beat |= ppg_feed(&p, (uint16_t)(2000 + (i & 1)));
+    }
+    CHECK(!beat);
+    CHECK_EQ(ppg_bpm(&p), 0);
+}
+
+static void test_reset_forgets_the_rhythm(void) {
+    recording_t r;
+    record(&r, 200, 72, 0.03, 10);
+    ppg_t p;
+    ppg_init(&p, r.fs, true);
+    for (uint32_t i = 0; i < r.n / 4; i++) {
+        ppg_feed(&p, r.raw[i]);
+    }
+    CHECK(ppg_bpm(&p) != 0);
+    ppg_reset(&p);
+    uint16_t rr;
+    CHECK_EQ(ppg_bpm(&p), 0);
+    CHECK_EQ(ppg_take_rr(&p, &rr, 1), 0);
+    free(r.raw);
+}
+
+// Host cost per raw sample at the firmware's PPG rate. Not checked: it is the
+// number to compare before flashing.
+static void bench_ppg(void) {
+    recording_t r;
+    record(&r, 200, 72, 0.05, 20);
+    ppg_t p;
+    ppg_init(&p, r.fs, true);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int pass = 0; pass < 10; pass++) {
+        for (uint32_t i = 0; i < r.n; i++) {
+            ppg_feed(&p, r.raw[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    printf("ppg: %.1f ns per sample on this host, %lu beats\n", ns / (10.0 * r.n), (unsigned long)p.beats);
+    free(r.raw);
+}
+
+int main(void) {
+    test_flat_input_has_no_beats();
+    test_reset_forgets_the_rhythm();
+    check_accuracy(200, 72, 0.05, 20);
+    check_accuracy(100, 55, 0.08, 20);
+    check_accuracy(400, 120, 0.03, 20);
+    check_accuracy(200, 160, 0.02, 10);
+    check_accuracy(200, 72, 0.05, 60);
+    bench_ppg();
+    return CHECK_DONE();
+}
@@ -0,0 +1,179 @@
+#include <stdint.h>
+#include <string.h>
+#include "sample_log.h"
+#include "check.h"
+
+#define SECTORS 4
+
+// RAM flash: programming only clears bits, like NOR flash
+typedef struct {
+    uint8_t mem[SECTORS * SLOG_SECTOR_SIZE];
+    bool fail_writes;
+} ram_flash_t;
+
+static ram_flash_t ram;
+
+static int ram_read(void *ctx, uint32_t addr, void *dst, uint32_t len) {
+    memcpy(dst, ((ram_flash_t *)ctx)->mem + addr, len);
+    return 0;
+}
+
+static int ram_write(void *ctx, uint32_t addr, const void *src, uint32_t len) {
+    ram_flash_t *f = ctx;
+    if (f->fail_writes) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        f->mem[addr + i] &= ((const uint8_t *)src)[i];
+    }
+    return 0;
+}
+
+static int ram_erase(void *ctx, uint32_t addr) {
+    memset(((ram_flash_t *)ctx)->mem + addr, 0xff, SLOG_SECTOR_SIZE);
+    return 0;
+}
+
+static const slog_flash_t flash = {
+    .read = ram_read, .write = ram_write, .erase = ram_erase, .ctx = &ram, .sectors = SECTORS,
+};
+
+static void fresh(slog_t *log) {
+    memset(ram.mem, 0xff, sizeof(ram.mem));
+    ram.fail_writes = false;
+    CHECK_EQ(slog_open(log, &flash), 0);
+}
+
+// n samples from ts, 100 ms apart
+static void append_n(slog_t *log, uint32_t ts, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        sample_t s = { .ts_ms = ts + i * 100, .value = (uint16_t)(1000 + i % 50), .channel = 1 };
+        slog_append(log, &s);
+    }
+}
+
+// Reads everything readable; returns the samples, stops if the reader stops moving
+static uint32_t drain(slog_t *log, slog_pos_t *end, uint32_t *first_ts) {
+    sample_t out[SLOG_CHUNK_SAMPLES];
+    uint32_t total = 0;
+    int reads = 0;
+    while (slog_readable(log) && reads++ < 1000) {
+        int n = slog_read(log, out, end);
+        if (n > 0 && total == 0 && first_ts != NULL) {
+            *first_ts = out[0].ts_ms;
+        }
+        total += n;
+    }
+    CHECK(!slog_readable(log));
+    return total;
+}
+
+static void test_reopen_reads_everything(void) {
+    slog_t log;
+    fresh(&log);
+    append_n(&log, 0, 10 * SLOG_CHUNK_SAMPLES + 5);
+    slog_flush(&log);
+    CHECK_EQ(slog_open(&log, &flash), 0);
+    slog_pos_t end;
+    uint32_t first = 1;
+    CHECK_EQ(drain(&log, &end, &first), 10 * SLOG_CHUNK_SAMPLES + 5);
+    CHECK_EQ(first, 0);
+}
+
+// A record cut short by power loss: the reader stops before it, the writer
+// moves on to the next sector, and a backfill can finish
+static void test_torn_head_record(void) {
+    slog_t log;
+    fresh(&log);
+    append_n(&log, 0, 3 * SLOG_CHUNK_SAMPLES);
+    uint16_t torn_at = log.write_off;
+    append_n(&log, 10000, SLOG_CHUNK_SAMPLES);
+    ram.mem[log.head * SLOG_SECTOR_SIZE + torn_at + SLOG_REC_HDR + 6] ^= 0x5a;
+
+    CHECK_EQ(slog_open(&log, &flash), 0);
+    CHECK_EQ(log.torn, 1);
+    CHECK_EQ(log.head_end, torn_at);
+    CHECK_EQ(log.write_off, SLOG_SECTOR_SIZE);
+    slog_pos_t end;
+    CHECK_EQ(drain(&log, &end, NULL), 3 * SLOG_CHUNK_SAMPLES);
+    CHECK_EQ(slog_release(&log, end), 0);
+    CHECK_EQ(log.used, 0);
+
+    // new data goes to the next sector and reads back
+    uint16_t old_head = log.head;
+    append_n(&log, 20000, SLOG_CHUNK_SAMPLES);
+    CHECK(log.head != old_head);
+    uint32_t first = 0;
+    CHECK_EQ(drain(&log, &end, &first), SLOG_CHUNK_SAMPLES);
+    CHECK_EQ(first, 20000);
+}
+
+static void test_failed_write(void) {
+    slog_t log;
+    fresh(&log);
+    append_n(&log, 0, 2 * SLOG_CHUNK_SAMPLES);
+    uint16_t good_end = log.write_off;
+    ram.fail_writes = true;
+    append_n(&log, 10000, SLOG_CHUNK_SAMPLES);
+    CHECK_EQ(log.io_errors, 1);
+    CHECK_EQ(log.head_end, good_end);
+    slog_pos_t end;
+    CHECK_EQ(drain(&log, &end, NULL), 2 * SLOG_CHUNK_SAMPLES);
+    ram.fail_writes = false;
+    append_n(&log, 20000, SLOG_CHUNK_SAMPLES);
+    uint32_t first = 0;
+    CHECK_EQ(drain(&log, &end, &first), SLOG_CHUNK_SAMPLES);
+    CHECK_EQ(first, 20000);
+}
+
+// Delivered data, head sector included, is not found again after a reboot
+static void test_released_is_not_resent(void) {
+    slog_t log;
+    fresh(&log);
+    append_n(&log, 0, 2 * SLOG_CHUNK_SAMPLES); // within one sector
+    slog_flush(&log);
+    slog_pos_t end;
+    drain(&log, &end, NULL);
+    CHECK_EQ(slog_release(&log, end), 0);
+    uint16_t old_head = log.head;
+
+    CHECK_EQ(slog_open(&log, &flash), 0);
+    CHECK(!slog_readable(&log));
+    append_n(&log, 50000, SLOG_CHUNK_SAMPLES);
+    CHECK_EQ(log.head, (old_head + 1) % SECTORS); // wear goes on round, not back to sector 0
+    uint32_t first = 0;
+    CHECK_EQ(drain(&log, &end, &first), SLOG_CHUNK_SAMPLES);
+    CHECK_EQ(first, 50000);
+    CHECK_EQ(log.erases, 1);
+}
+
+// A full log overwrites its oldest sector; a stale acknowledged position
+// reads from the oldest sector still there
+static void test_wraparound(void) {
+    slog_t log;
+    fresh(&log);
+    slog_pos_t start = slog_oldest(&log);
+    uint32_t ts = 0;
+    while (log.overwritten < 2) {
+        append_n(&log, ts, SLOG_CHUNK_SAMPLES);
+        ts += SLOG_CHUNK_SAMPLES * 100;
+    }
+    CHECK_EQ(log.used, SECTORS);
+    slog_seek(&log, start);
+    slog_pos_t end;
+    uint32_t n = drain(&log, &end, NULL);
+    CHECK(n > 0 && n < ts / 100);
+    CHECK_EQ(slog_release(&log, end), 0);
+    CHECK_EQ(log.used, 0);
+    CHECK_EQ(slog_open(&log, &flash), 0);
+    CHECK(!slog_readable(&log));
+}
+
+int main(void) {
+    test_reopen_reads_everything();
+    test_torn_head_record();
+    test_failed_write();
+    test_released_is_not_resent();
+    test_wraparound();
+    return CHECK_DONE();
+}
@@ -0,0 +1,240 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "sample_ring.h"
+#include "check.h"
+
+#define CAP 8
+
+static sample_t buf[CAP];
+
+static sample_t sample(uint32_t i) {
+    return (sample_t){ .ts_ms = i, .value = (uint16_t)i, .channel = 1 };
+}
+
+static void push_n(sample_ring_t *r, uint32_t from, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        CHECK(ring_push(r, &(sample_t){ .ts_ms = from + i, .value = (uint16_t)(from + i) }));
+    }
+}
+
+static void test_fifo_across_wrap(void) {
+    sample_ring_t r;
+    ring_init(&r, buf, CAP);
+    CHECK_EQ(ring_capacity(&r), CAP);
+    uint32_t in = 0, out = 0;
+    for (int round = 0; round < 5; round++) {
+        push_n(&r, in, 5);
+        in += 5;
+        sample_t s;
+        for (int i = 0; i < 5; i++) {
+            CHECK(ring_pop(&r, &s));
+            CHECK_EQ(s.ts_ms, out++);
+        }
+        CHECK(!ring_pop(&r, &s));
+    }
+    CHECK_EQ(ring_count(&r), 0);
+}
+
+static void test_full_ring_refuses_and_counts(void) {
+    sample_ring_t r;
+    ring_init(&r, buf, CAP);
+    push_n(&r, 0, CAP);
+    sample_t extra = sample(99);
+    CHECK(!ring_push(&r, &extra));
+    CHECK(!ring_push(&r, &extra));
+    CHECK_EQ(r.overflow, 2);
+    CHECK_EQ(ring_count(&r), CAP);
+    sample_t s;
+    CHECK(ring_pop(&r, &s));
+    CHECK(ring_push(&r, &extra)); // the producer re-reads tail once it looks full
+    CHECK_EQ(ring_peek(&r, CAP - 1)->ts_ms, 99);
+}
+
+// Regression: a peek/consume batch moves tail past the consumer's cached
+// head. ring_pop used to compare them for equality only, so it took the
+// stale slot behind head as a sample and left tail ahead of head.
+static void test_pop_after_consume_past_cached_head(void) {
+    sample_ring_t r;
+    ring_init(&r, buf, CAP);
+    push_n(&r, 0, 2);
+    sample_t s;
+    CHECK(ring_pop(&r, &s)); // caches head = 2
+    push_n(&r, 2, 4);        // head = 6
+    CHECK_EQ(ring_peek(&r, 0)->ts_ms, 1);
+    ring_consume(&r, 5);     // tail = 6, past the cached head
+    CHECK(!ring_pop(&r, &s));
+    CHECK_EQ(ring_count(&r), 0);
+    push_n(&r, 6, 1);
+    CHECK(ring_pop(&r, &s));
+    CHECK_EQ(s.ts_ms, 6);
+    CHECK_EQ(ring_count(&r), 0);
+}
+
+static void test_index_wrap(void) {
+    sample_ring_t r;
+    ring_init(&r, buf, CAP);
+    atomic_store(&r.head, UINT32_MAX - 2);
+    atomic_store(&r.tail, UINT32_MAX - 2);
+    r.tail_cache = r.head_cache = UINT32_MAX - 2;
+    push_n(&r, 0, 6);
+    CHECK_EQ(ring_count(&r), 6);
+    sample_t s;
+    for (uint32_t i = 0; i < 6; i++) {
+        CHECK(ring_pop(&r, &s));
+        CHECK_EQ(s.ts_ms, i);
+    }
+    CHECK(!ring_pop(&r, &s));
+}
+
+static void test_high_water_on_consumer_side(void) {
+    sample_ring_t r;
+    ring_init(&r, buf, CAP);
+    push_n(&r, 0, 6);
+    ring_consume(&r, 6);
+    CHECK_EQ(r.high_water, 6);
+    push_n(&r, 6, 3);
+    sample_t s;
+    while (ring_pop(&r, &s)) {
+    }
+    CHECK_EQ(r.high_water, 6); // a shallower batch keeps the mark
+    push_n(&r, 9, CAP);
+    CHECK(ring_pop(&r, &s));
+    CHECK_EQ(r.high_water, CAP);
+}
+
+// Two threads through one ring, as the ADC task and the stream task on two
+// cores. The producer pushes sequence numbers; `drop` refuses and moves on as
+// the ADC callback does, otherwise it retries until the sample goes in.
+#define STRESS_CAP 64
+#define STRESS_N (1u << 22)
+
+typedef struct {
+    sample_ring_t r;
+    sample_t buf[STRESS_CAP];
+    bool drop;
+    _Atomic bool done;
+    uint32_t refused;          // producer's own count of refused pushes
+    uint32_t received, dups, out_of_order;
+    uint8_t seen[STRESS_N];    // 1 refused (producer), 2 received (consumer)
+} stress_t;
+
+static void *stress_produce(void *arg) {
+    stress_t *st = arg;
+    for (uint32_t i = 0; i < STRESS_N; i++) {
+        sample_t s = { .ts_ms = i, .value = (uint16_t)i };
+        while (!ring_push(&st->r, &s)) {
+            st->refused++;
+            if (st->drop) {
+                st->seen[i] = 1;
+                break;
+            }
+            sched_yield(); // the consumer may share this core
+        }
+    }
+    atomic_store(&st->done, true);
+    return NULL;
+}
+
+static void stress_take(stress_t *st, const sample_t *s, uint32_t *next) {
+    if (s->ts_ms < *next) {
+        st->dups++;
+    } else if (!st->drop && s->ts_ms != *next) {
+        st->out_of_order++;
+    }
+    CHECK_EQ(s->value, (uint16_t)s->ts_ms);
+    if (s->ts_ms < STRESS_N) {
+        st->seen[s->ts_ms] |= 2;
+    }
+    *next = s->ts_ms + 1;
+    st->received++;
+}
+
+// Takes samples one at a time and in peek/consume batches, as stream_drain
+// does, and stands off now and then so the drop run sees the ring fill
+static void *stress_consume(void *arg) {
+    stress_t *st = arg;
+    uint32_t next = 0;
+    for (uint32_t round = 0;; round++) {
+        bool done = atomic_load(&st->done);
+        uint32_t n = ring_count(&st->r);
+        if (n == 0) {
+            if (done) {
+                break;
+            }
+            sched_yield();
+        } else if (round & 1) {
+            for (uint32_t i = 0; i < n; i++) {
+                stress_take(st, ring_peek(&st->r, i), &next);
+            }
+            ring_consume(&st->r, n);
+        } else {
+            sample_t s;
+            while (n-- > 0 && ring_pop(&st->r, &s)) {
+                stress_take(st, &s, &next);
+            }
+        }
+        if (st->drop && (round & 0xfff) == 0) {
+            nanosleep(&(struct timespec){ .tv_nsec = 50000 }, NULL);
+        }
+    }
+    return NULL;
+}
+
+static double stress_run(stress_t *st, bool drop) {
+    memset(st, 0, sizeof(*st));
+    ring_init(&st->r, st->buf, STRESS_CAP);
+    st->drop = drop;
+    atomic_init(&st->done, false);
+    pthread_t prod, cons;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    CHECK_EQ(pthread_create(&cons, NULL, stress_consume, st), 0);
+    CHECK_EQ(pthread_create(&prod, NULL, stress_produce, st), 0);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    CHECK_EQ(st->dups, 0);
+    CHECK_EQ(st->out_of_order, 0);
+    CHECK_EQ(st->r.overflow, st->refused);
+    CHECK(st->r.high_water > 0 && st->r.high_water <= STRESS_CAP);
+    CHECK_EQ(ring_count(&st->r), 0);
+    uint32_t lost = 0, both = 0;
+    for (uint32_t i = 0; i < STRESS_N; i++) {
+        lost += st->seen[i] == 0;
+        both += st->seen[i] == 3;
+    }
+    CHECK_EQ(lost, 0);
+    CHECK_EQ(both, 0);
+    CHECK_EQ(st->received + (drop ? st->refused : 0), STRESS_N);
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+// Every sample accounted for exactly once: taken in order, or refused and
+// counted as an overflow. Prints the host rate; only the accounting is checked.
+static void test_two_thread_stress(void) {
+    static stress_t st;
+    double s = stress_run(&st, false);
+    printf("sample_ring: %u samples through %u slots in %.0f ms, %.1f M push+pop/s on this host "
+        "(%lu full-ring retries, high water %lu)\n",
+        STRESS_N, STRESS_CAP, s * 1e3, STRESS_N / s / 1e6,
+        (unsigned long)st.refused, (unsigned long)st.r.high_water);
+    s = stress_run(&st, true);
+    printf("sample_ring: dropping when full, %lu taken and %lu refused in %.0f ms\n",
+        (unsigned long)st.received, (unsigned long)st.refused, s * 1e3);
+    CHECK(st.refused > 0); // the consumer stood off with the producer running
+}
+
+int main(void) {
+    test_fifo_across_wrap();
+    test_full_ring_refuses_and_counts();
+    test_pop_after_consume_past_cached_head();
+    test_index_wrap();
+    test_high_water_on_consumer_side();
+    test_two_thread_stress();
+    return CHECK_DONE();
+}
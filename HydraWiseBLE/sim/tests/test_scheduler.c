@@ -0,0 +1,225 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "scheduler.h"
+#include "sim_clock.h"
+#include "sim_rtos.h"
+#include "check.h"
+
+static int ran[SCHED_MAX_CHANNELS];
+
+static void count(void *arg) {
+    ran[(intptr_t)arg]++;
+}
+
+static sched_t *self_disarm_sched;
+static int self_disarm_id;
+
+static void disarm_self(void *arg) {
+    count(arg);
+    sched_disarm(self_disarm_sched, self_disarm_id);
+}
+
+static void test_no_deadline_until_armed(void) {
+    sched_t s;
+    sched_init(&s);
+    int a = sched_add(&s, "a", 10, count, (void *)0);
+    uint32_t due;
+    CHECK(a == 0);
+    CHECK(!sched_next_deadline(&s, &due));
+    CHECK_EQ(sched_run_due(&s, 1000), 0);
+    sched_arm(&s, a, 5);
+    CHECK(sched_next_deadline(&s, &due));
+    CHECK_EQ(due, 15);
+    CHECK_EQ(sched_wait_ticks(&s, 5), 10);
+    CHECK_EQ(sched_wait_ticks(&s, 20), 0);
+    sched_disarm(&s, a);
+    CHECK(!sched_next_deadline(&s, &due));
+}
+
+static void test_add_limits(void) {
+    sched_t s;
+    sched_init(&s);
+    CHECK_EQ(sched_add(&s, "zero", 0, count, NULL), -1);
+    CHECK_EQ(sched_add(&s, "nofn", 1, NULL, NULL), -1);
+    for (int i = 0; i < SCHED_MAX_CHANNELS; i++) {
+        CHECK_EQ(sched_add(&s, "ch", 1, count, NULL), i);
+    }
+    CHECK_EQ(sched_add(&s, "full", 1, count, NULL), -1);
+}
+
+static void test_earliest_first_and_phase(void) {
+    sched_t s;
+    sched_init(&s);
+    memset(ran, 0, sizeof(ran));
+    int slow = sched_add(&s, "slow", 100, count, (void *)0);
+    int fast = sched_add(&s, "fast", 30, count, (void *)1);
+    sched_arm(&s, slow, 0);
+    sched_arm(&s, fast, 0);
+    sched_arm(&s, fast, 20); // already armed: keeps its phase
+    uint32_t due;
+    CHECK(sched_next_deadline(&s, &due));
+    CHECK_EQ(due, 30);
+    // wake exactly on every deadline for 300 ticks
+    uint32_t now = 0;
+    while (sched_next_deadline(&s, &due) && due <= 300) {
+        now = due;
+        CHECK(sched_run_due(&s, now) > 0);
+    }
+    CHECK_EQ(ran[0], 3);
+    CHECK_EQ(ran[1], 10);
+    CHECK_EQ(s.overrun, 0);
+}
+
+static void test_late_wakeup_drops_missed_runs(void) {
+    sched_t s;
+    sched_init(&s);
+    memset(ran, 0, sizeof(ran));
+    int a = sched_add(&s, "a", 10, count, (void *)0);
+    sched_arm(&s, a, 0);
+    // 35 ticks late: one run now, three periods skipped, phase kept
+    CHECK_EQ(sched_run_due(&s, 45), 1);
+    CHECK_EQ(ran[0], 1);
+    CHECK_EQ(s.overrun, 3);
+    uint32_t due;
+    CHECK(sched_next_deadline(&s, &due));
+    CHECK_EQ(due, 50);
+}
+
+static void test_tick_wrap(void) {
+    sched_t s;
+    sched_init(&s);
+    memset(ran, 0, sizeof(ran));
+    int a = sched_add(&s, "a", 10, count, (void *)0);
+    sched_arm(&s, a, UINT32_MAX - 4);
+    uint32_t due;
+    CHECK(sched_next_deadline(&s, &due));
+    CHECK_EQ(due, 5);
+    CHECK_EQ(sched_wait_ticks(&s, UINT32_MAX - 4), 10);
+    CHECK_EQ(sched_run_due(&s, UINT32_MAX), 0); // not due before the wrap
+    CHECK_EQ(sched_run_due(&s, 5), 1);
+    CHECK_EQ(s.overrun, 0);
+}
+
+static void test_set_period_pulls_deadline_in(void) {
+    sched_t s;
+    sched_init(&s);
+    int a = sched_add(&s, "a", 100, count, (void *)0);
+    sched_arm(&s, a, 0);
+    sched_set_period(&s, a, 25);
+    uint32_t due;
+    CHECK(sched_next_deadline(&s, &due));
+    CHECK_EQ(due, 25);
+    sched_set_period(&s, a, 50); // longer: the pending deadline stays
+    CHECK(sched_next_deadline(&s, &due));
+    CHECK_EQ(due, 25);
+}
+
+static void test_callback_may_disarm(void) {
+    sched_t s;
+    sched_init(&s);
+    memset(ran, 0, sizeof(ran));
+    self_disarm_sched = &s;
+    self_disarm_id = sched_add(&s, "once", 10, disarm_self, (void *)0);
+    sched_arm(&s, self_disarm_id, 0);
+    CHECK_EQ(sched_run_due(&s, 10), 1);
+    CHECK_EQ(sched_run_due(&s, 20), 0);
+    uint32_t due;
+    CHECK(!sched_next_deadline(&s, &due));
+    CHECK_EQ(ran[0], 1);
+}
+
+// The loop of scheduler_task (HydraWiseBLE.c) on the simulated kernel, with
+// sched_kick() as a notification and sched_update_armed() as `want_armed`
+static sched_t task_sched;
+static int task_id;
+static TaskHandle_t task_handle;
+static bool want_armed;
+static uint32_t wakeups, task_runs, late_max;
+
+static void timed_run(void *arg) {
+    // next_due still holds the deadline this run is for
+    uint32_t late = xTaskGetTickCount() - task_sched.ch[task_id].next_due;
+    if (late > late_max) {
+        late_max = late;
+    }
+    task_runs++;
+}
+
+static void sched_loop(void *param) {
+    while (1) {
+        if (want_armed) {
+            sched_arm(&task_sched, task_id, xTaskGetTickCount());
+        } else {
+            sched_disarm(&task_sched, task_id);
+        }
+        uint32_t due;
+        TickType_t wait = portMAX_DELAY;
+        if (sched_next_deadline(&task_sched, &due)) {
+            wait = sched_wait_ticks(&task_sched, xTaskGetTickCount());
+        }
+        if (wait > 0 && ulTaskNotifyTake(pdTRUE, wait) > 0) {
+            wakeups++;
+            continue;
+        }
+        wakeups++;
+        sched_run_due(&task_sched, xTaskGetTickCount());
+    }
+}
+
+static void run_ms(uint32_t ms) {
+    for (uint32_t i = 0; i < ms; i++) {
+        sim_clock_advance(1000);
+        sim_rtos_run();
+    }
+}
+
+static void kick(bool armed) {
+    want_armed = armed;
+    xTaskNotifyGive(task_handle);
+    sim_rtos_run();
+}
+
+// Idle, the task wakes for nothing at all; armed, once per deadline and on
+// the tick it is due
+static void test_task_wakeups(void) {
+    sim_clock_reset();
+    sched_init(&task_sched);
+    task_id = sched_add(&task_sched, "conductivity_drain", pdMS_TO_TICKS(500), timed_run, NULL);
+    sim_rtos_init(NULL);
+    xTaskCreate(sched_loop, "sched_task", 3072, NULL, 5, &task_handle);
+    sim_rtos_run();
+    run_ms(60000);
+    CHECK_EQ(wakeups, 0);
+
+    kick(true);
+    CHECK_EQ(wakeups, 1);
+    run_ms(10000);
+    CHECK_EQ(task_runs, 20);
+    CHECK_EQ(wakeups, 1 + task_runs);
+    CHECK(late_max <= 1);
+    CHECK_EQ(task_sched.overrun, 0);
+    printf("scheduler task: %lu runs in 10 s armed, %lu wakeups, at most %lu ticks after the deadline\n",
+        (unsigned long)task_runs, (unsigned long)wakeups, (unsigned long)late_max);
+
+    kick(false);
+    uint32_t stopped = wakeups;
+    run_ms(60000);
+    CHECK_EQ(wakeups, stopped);
+    CHECK_EQ(task_runs, 20);
+    printf("scheduler task: %lu wakeups in 60 s idle\n", (unsigned long)(wakeups - stopped));
+}
+
+int main(void) {
+    test_no_deadline_until_armed();
+    test_add_limits();
+    test_earliest_first_and_phase();
+    test_late_wakeup_drops_missed_runs();
+    test_tick_wrap();
+    test_set_period_pulls_deadline_in();
+    test_callback_may_disarm();
+    test_task_wakeups();
+    return CHECK_DONE();
+}
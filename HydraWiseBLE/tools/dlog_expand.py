@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""Expand binary deferred-log records from a serial capture.
+
+Firmware built with DLOG_TEXT 0 starts its log with
+    DLOG_TABLE <hash> <count>
+and writes every deferred log record as
+    DLOG <hex>
+where hex is, little endian: uint32 timestamp (us), uint16 format id,
+uint8 argument count, uint8 core, then one uint32 per argument. The format
+ids index the table the build generated (build/esp-idf/main/dlog_table.json,
+see tools/dlog_table.py); without --table the tool parses main/dlog_fmt.h of
+this tree instead. Records are only expanded while the stream's table hash
+matches the table's, so a capture from another build is not mislabelled.
+Other lines pass through unchanged.
+
+    idf.py monitor | tools/dlog_expand.py --table build/esp-idf/main/dlog_table.json
+    tools/dlog_expand.py capture.txt
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+
+from dlog_table import load_formats as load_source, table_hash, unescape
+
+REC_RE = re.compile(r'DLOG ([0-9a-fA-F]+)')
+TABLE_RE = re.compile(r'DLOG_TABLE ([0-9a-fA-F]{8}) (\d+)')
+
+
+def load_formats(table, source):
+    """[(name, level, format)] and the table hash"""
+    if table:
+        with open(table, encoding='utf-8') as f:
+            t = json.load(f)
+        return [(e['id'], e['level'], e['format']) for e in t['formats']], int(t['hash'], 16)
+    formats = load_source(source)
+    return [(name, level, unescape(fmt)) for name, level, fmt in formats], table_hash(formats)
+
+
+def signed(v):
+    return v - (1 << 32) if v & 0x80000000 else v
+
+
+def expand(hexrec, formats):
+    raw = bytes.fromhex(hexrec)
+    ts, fid, nargs, core = struct.unpack_from('<IHBB', raw)
+    args = list(struct.unpack_from('<%dI' % nargs, raw, 8))
+    if fid >= len(formats):
+        return '? (%u us, core %u) unknown format id %u, args %s' % (ts, core, fid, args)
+    name, level, fmt = formats[fid]
+    # %d wants the sign back, every other conversion takes the raw 32 bits
+    convs = re.findall(r'%[-+ #0]*\d*([a-zA-Z%])', fmt)
+    values = []
+    for conv in (c for c in convs if c != '%'):
+        v = args[len(values)] if len(values) < len(args) else 0
+        values.append(signed(v) if conv in 'di' else v)
+    fmt = re.sub(r'%([-+ #0]*\d*)[u]', r'%\1d', fmt)
+    return '%s (%u us, core %u) %s' % (level, ts, core, fmt % tuple(values))
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('capture', nargs='?', help='serial capture, stdin if omitted')
+    ap.add_argument('--table', help='dlog_table.json generated by the firmware build')
+    ap.add_argument('--formats', default=os.path.join(here, '..', 'main', 'dlog_fmt.h'),
+                    help='format source to parse without --table')
+    opts = ap.parse_args()
+
+    formats, ours = load_formats(opts.table, opts.formats)
+    matched = True  # a capture joined after the header is taken on trust
+    src = open(opts.capture, encoding='utf-8', errors='replace') if opts.capture else sys.stdin
+    for line in src:
+        t = TABLE_RE.search(line)
+        if t:
+            matched = int(t.group(1), 16) == ours
+            if not matched:
+                sys.stderr.write('dlog_expand: the log was built with table %s, this one is %08x; '
+                                 'records are left as they are\n' % (t.group(1), ours))
+        m = REC_RE.search(line)
+        if m and matched:
+            try:
+                line = expand(m.group(1), formats) + '\n'
+            except (ValueError, struct.error):
+                pass  # a line cut short by the monitor stays as it was
+        sys.stdout.write(line)
+
+
+if __name__ == '__main__':
+    main()
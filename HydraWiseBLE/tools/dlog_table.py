@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""Generate the deferred-log format table from main/dlog_fmt.h.
+
+Run by the build (main/CMakeLists.txt, sim/CMakeLists.txt). Writes
+    dlog_table.h      DLOG_TABLE_HASH and DLOG_TABLE_COUNT for the firmware,
+                      which prints the hash at the head of a binary log
+    dlog_table.json   the table itself, for tools/dlog_expand.py --table
+The hash is FNV-1a over every entry's id, level and format as written in the
+source, so a capture can be matched to the table it was built with.
+
+    tools/dlog_table.py main/dlog_fmt.h --header build/dlog_table.h --json build/dlog_table.json
+"""
+
+import argparse
+import json
+import re
+
+FMT_RE = re.compile(r'^DLOG_FMT\(\s*(\w+)\s*,\s*([EWI])\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)', re.M)
+
+
+def load_formats(path):
+    """[(name, level, format as in the source)] in id order"""
+    with open(path, encoding='utf-8') as f:
+        return FMT_RE.findall(f.read())
+
+
+def table_hash(formats):
+    h = 0x811c9dc5
+    for entry in formats:
+        for byte in '\0'.join(entry).encode('utf-8') + b'\0':
+            h = ((h ^ byte) * 0x01000193) & 0xffffffff
+    return h
+
+
+def unescape(fmt):
+    return fmt.encode('utf-8').decode('unicode_escape').encode('latin-1').decode('utf-8')
+
+
+def write_if_changed(path, text):
+    try:
+        with open(path, encoding='utf-8') as f:
+            if f.read() == text:
+                return
+    except OSError:
+        pass
+    with open(path, 'w', encoding='utf-8') as f:
+        f.write(text)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('source', help='main/dlog_fmt.h')
+    ap.add_argument('--header', required=True)
+    ap.add_argument('--json', required=True)
+    opts = ap.parse_args()
+
+    formats = load_formats(opts.source)
+    h = table_hash(formats)
+    write_if_changed(opts.header,
+                     '// Generated by tools/dlog_table.py from dlog_fmt.h, do not edit\n'
+                     '#pragma once\n\n'
+                     '#define DLOG_TABLE_HASH 0x%08xu\n'
+                     '#define DLOG_TABLE_COUNT %d\n' % (h, len(formats)))
+    table = {
+        'hash': '%08x' % h,
+        'formats': [{'id': name, 'level': level, 'format': unescape(fmt)} for name, level, fmt in formats],
+    }
+    write_if_changed(opts.json, json.dumps(table, ensure_ascii=False, indent=1) + '\n')
+
+
+if __name__ == '__main__':
+    main()